@@ -0,0 +1,59 @@
+#include "bench.h"
+#include <inttypes.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include "esp_idf_version.h"
+#include "esp_timer.h"
+#include "sdkconfig.h"
+
+static uint32_t suite_results = 0;
+
+static int compare_u64(const void* a, const void* b) {
+    uint64_t x = *(const uint64_t*)a;
+    uint64_t y = *(const uint64_t*)b;
+    return x < y ? -1 : x > y;
+}
+
+void bench_run(const char* name, bench_body_t body, void* ctx, uint32_t ops, uint32_t samples, bench_result_t* result) {
+    uint64_t sample_ns[BENCH_MAX_SAMPLES];
+    if (samples == 0 || samples > BENCH_MAX_SAMPLES) {
+        samples = BENCH_MAX_SAMPLES;
+    }
+    if (ops == 0) {
+        ops = 1;
+    }
+
+    body(ctx, ops);
+    for (uint32_t s = 0; s < samples; s++) {
+        int64_t start = esp_timer_get_time();
+        body(ctx, ops);
+        sample_ns[s] = (esp_timer_get_time() - start) * 1000 / ops;
+    }
+    qsort(sample_ns, samples, sizeof(sample_ns[0]), compare_u64);
+
+    bench_result_t measured = {
+        .ops = ops,
+        .samples = samples,
+        .median_ns = sample_ns[samples / 2],
+        .min_ns = sample_ns[0],
+        .max_ns = sample_ns[samples - 1],
+    };
+    printf(BENCH_LINE_PREFIX "{\"name\":\"%s\",\"ns_per_op\":%" PRIu64 ",\"min_ns\":%" PRIu64 ",\"max_ns\":%" PRIu64
+                             ",\"ops\":%" PRIu32 ",\"samples\":%" PRIu32 "}\n",
+           name, measured.median_ns, measured.min_ns, measured.max_ns, ops, samples);
+    suite_results++;
+    if (result != NULL) {
+        *result = measured;
+    }
+}
+
+void bench_suite_begin(const char* suite) {
+    suite_results = 0;
+    printf(BENCH_LINE_PREFIX "{\"suite\":\"%s\",\"event\":\"begin\",\"target\":\"%s\",\"idf\":\"%s\"}\n", suite,
+           CONFIG_IDF_TARGET, esp_get_idf_version());
+}
+
+void bench_suite_end(const char* suite) {
+    printf(BENCH_LINE_PREFIX "{\"suite\":\"%s\",\"event\":\"end\",\"results\":%" PRIu32 "}\n", suite, suite_results);
+}
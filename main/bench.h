@@ -0,0 +1,30 @@
+#pragma once
+
+#include <stdint.h>
+
+// Microbenchmark harness for the hot paths. Every measurement is printed to the console as one line starting with
+// BENCH_LINE_PREFIX followed by a JSON object, which tools/bench_compare.py collects into a results file and
+// compares against the stored baseline of the target.
+#define BENCH_LINE_PREFIX "BENCH "
+#define BENCH_MAX_SAMPLES 32
+
+// Runs the measured operation ops times
+typedef void (*bench_body_t)(void* ctx, uint32_t ops);
+
+typedef struct {
+    uint32_t ops;        // Operations per sample
+    uint32_t samples;
+    uint64_t median_ns;  // Time per operation
+    uint64_t min_ns;
+    uint64_t max_ns;
+} bench_result_t;
+
+// Calls body once to warm the caches, then samples times with ops operations each, and prints the time per operation.
+// The median is what gets compared, it ignores the odd sample that an interrupt or another task stretched. ops should
+// be large enough for a sample to take a millisecond or more, esp_timer has microsecond resolution. result may be
+// NULL.
+void bench_run(const char* name, bench_body_t body, void* ctx, uint32_t ops, uint32_t samples, bench_result_t* result);
+
+// Bracket the measurements of a run, so a run that stopped halfway is not mistaken for one without regressions
+void bench_suite_begin(const char* suite);
+void bench_suite_end(const char* suite);
@@ -0,0 +1,116 @@
+#include "boot_graph.h"
+#include <inttypes.h>
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+#include "esp_err.h"
+#include "esp_log.h"
+#include "esp_timer.h"
+#include "freertos/FreeRTOS.h"
+#include "freertos/event_groups.h"
+#include "freertos/task.h"
+
+static char const TAG[] = "boot";
+
+#define BOOT_GRAPH_STACK_SIZE    6144
+#define BOOT_GRAPH_TASK_PRIORITY 1
+
+typedef struct {
+    const boot_step_t* steps;
+    boot_step_trace_t* trace;
+    EventGroupHandle_t finished;  // Bit per step that succeeded, failed or was skipped
+    int index;
+} boot_task_t;
+
+static boot_task_t tasks[BOOT_GRAPH_MAX_STEPS];
+// A step task may still be inside xEventGroupSetBits() when the wait for the last bit returns, so the group is never
+// deleted
+static StaticEventGroup_t finished_buffer;
+
+static void boot_step_task(void* arg) {
+    boot_task_t* task = arg;
+    const boot_step_t* step = &task->steps[task->index];
+    boot_step_trace_t* trace = &task->trace[task->index];
+
+    if (step->depends != 0) {
+        xEventGroupWaitBits(task->finished, step->depends, pdFALSE, pdTRUE, portMAX_DELAY);
+    }
+    bool dependencies_ok = true;
+    for (int i = 0; i < BOOT_GRAPH_MAX_STEPS; i++) {
+        if ((step->depends & BOOT_STEP(i)) && task->trace[i].result != ESP_OK) {
+            dependencies_ok = false;
+        }
+    }
+
+    if (dependencies_ok) {
+        trace->start_us = esp_timer_get_time();
+        ESP_LOGI(TAG, "+%.1f ms %s started", trace->start_us / 1000.0, step->name);
+        trace->result = step->run();
+        trace->end_us = esp_timer_get_time();
+        double took_ms = (trace->end_us - trace->start_us) / 1000.0;
+        if (trace->result == ESP_OK) {
+            ESP_LOGI(TAG, "+%.1f ms %s done in %.1f ms", trace->end_us / 1000.0, step->name, took_ms);
+        } else {
+            ESP_LOGE(TAG, "+%.1f ms %s failed after %.1f ms: %s", trace->end_us / 1000.0, step->name, took_ms,
+                     esp_err_to_name(trace->result));
+        }
+    } else {
+        trace->result = ESP_ERR_INVALID_STATE;
+        ESP_LOGW(TAG, "%s skipped, a step it depends on failed", step->name);
+    }
+
+    xEventGroupSetBits(task->finished, BOOT_STEP(task->index));
+    vTaskDelete(NULL);
+}
+
+int boot_graph_run(const boot_step_t* steps, size_t count, boot_step_trace_t* trace) {
+    EventGroupHandle_t finished = xEventGroupCreateStatic(&finished_buffer);
+
+    for (size_t i = 0; i < count; i++) {
+        trace[i] = (boot_step_trace_t){.result = ESP_ERR_INVALID_STATE};
+        tasks[i] = (boot_task_t){
+            .steps = steps,
+            .trace = trace,
+            .finished = finished,
+            .index = i,
+        };
+    }
+    // Steps that are not ready simply block on their dependencies, so they can all be started right away
+    for (size_t i = 0; i < count; i++) {
+        uint32_t stack_size = steps[i].stack_size > 0 ? steps[i].stack_size : BOOT_GRAPH_STACK_SIZE;
+        if (xTaskCreate(boot_step_task, steps[i].name, stack_size, &tasks[i], BOOT_GRAPH_TASK_PRIORITY, NULL) !=
+            pdPASS) {
+            ESP_LOGE(TAG, "Failed to start %s", steps[i].name);
+            trace[i].result = ESP_ERR_NO_MEM;
+            xEventGroupSetBits(finished, BOOT_STEP(i));
+        }
+    }
+    xEventGroupWaitBits(finished, BOOT_STEP(count) - 1, pdFALSE, pdTRUE, portMAX_DELAY);
+
+    for (size_t i = 0; i < count; i++) {
+        if (trace[i].result != ESP_OK && trace[i].result != ESP_ERR_INVALID_STATE) {
+            return i;
+        }
+    }
+    return -1;
+}
+
+void boot_graph_print(const boot_step_t* steps, size_t count, const boot_step_trace_t* trace, int64_t first_frame_us) {
+    int64_t end_us = 0;
+    for (size_t i = 0; i < count; i++) {
+        if (trace[i].end_us > end_us) {
+            end_us = trace[i].end_us;
+        }
+    }
+    ESP_LOGI(TAG, "Boot steps finished at %" PRId64 " ms, first frame at %" PRId64 " ms", end_us / 1000,
+             first_frame_us / 1000);
+    for (size_t i = 0; i < count; i++) {
+        if (trace[i].start_us == 0) {
+            ESP_LOGI(TAG, "  %-12s skipped", steps[i].name);
+            continue;
+        }
+        ESP_LOGI(TAG, "  %-12s %6" PRId64 " ms to %6" PRId64 " ms %6" PRId64 " ms%s", steps[i].name,
+                 trace[i].start_us / 1000, trace[i].end_us / 1000, (trace[i].end_us - trace[i].start_us) / 1000,
+                 trace[i].result == ESP_OK ? "" : " failed");
+    }
+}
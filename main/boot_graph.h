@@ -0,0 +1,31 @@
+#pragma once
+
+#include <stddef.h>
+#include <stdint.h>
+#include "esp_err.h"
+
+#define BOOT_GRAPH_MAX_STEPS 24
+
+#define BOOT_STEP(index) (1u << (index))
+
+typedef struct {
+    const char* name;
+    esp_err_t (*run)();
+    uint32_t depends;     // BOOT_STEP() of every step that has to succeed first
+    uint32_t stack_size;  // 0 selects the default
+    const char* error;    // Shown when the step fails
+} boot_step_t;
+
+typedef struct {
+    int64_t start_us;  // esp_timer time the step started, 0 when it was skipped
+    int64_t end_us;
+    esp_err_t result;  // ESP_ERR_INVALID_STATE when skipped because a dependency failed
+} boot_step_trace_t;
+
+// Runs every step in its own task as soon as the steps it depends on succeeded and returns once all finished. Steps
+// whose dependencies failed are skipped. Each step logs its start and end time since boot. Returns the index of the
+// first step that failed, or -1 when all succeeded.
+int boot_graph_run(const boot_step_t* steps, size_t count, boot_step_trace_t* trace);
+
+// Logs a timeline of all steps, first_frame_us is the esp_timer time of the first frame or 0 when there was none
+void boot_graph_print(const boot_step_t* steps, size_t count, const boot_step_trace_t* trace, int64_t first_frame_us);
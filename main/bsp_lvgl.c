@@ -1,8 +1,10 @@
 #include "bsp_lvgl.h"
+#include <inttypes.h>
+#include <stdbool.h>
 #include <stdint.h>
 #include <stdio.h>
-#include <sys/lock.h>
-#include <unistd.h>
+#include <string.h>
+#include "bench.h"
 #include "core/lv_group.h"
 #include "display/lv_display.h"
 #include "draw/lv_draw_buf.h"
@@ -10,308 +12,1146 @@
 #include "driver/gpio.h"
 #include "esp_err.h"
 #include "esp_heap_caps.h"
+#include "esp_idf_version.h"
 #include "esp_lcd_mipi_dsi.h"
 #include "esp_lcd_panel_ops.h"
 #include "esp_ldo_regulator.h"
 #include "esp_log.h"
 #include "esp_timer.h"
+#include "flush_batch.h"
+#include "frame_profile.h"
 #include "freertos/FreeRTOS.h"
 #include "freertos/idf_additions.h"
 #include "freertos/projdefs.h"
 #include "freertos/semphr.h"
 #include "freertos/task.h"
+#include "glyph_cache.h"
 #include "indev/lv_indev.h"
+#include "irq_timestamp.h"
+#include "key_ring.h"
+#include "keymap.h"
+#include "latency.h"
 #include "lv_demos.h"
 #include "lv_init.h"
 #include "lvgl.h"
 #include "misc/lv_types.h"
 #include "portmacro.h"
+#include "rotate_rgb565.h"
 #include "sdkconfig.h"
 #include "tanmatsu_coprocessor.h"
 
 static char const TAG[] = "bsp-lvgl";
 
-#define LVGL_TICK_PERIOD_MS          2
 #define EXAMPLE_LVGL_TASK_STACK_SIZE (64 * 1024)
 #define EXAMPLE_LVGL_TASK_PRIORITY   2
+// The LVGL task sleeps until its next timer is due and is woken early through these task notification bits. Index 0
+// belongs to LVGL's own FreeRTOS layer, so the wakeups use index 1.
+#define LVGL_WAKE_NOTIFY_INDEX 1
+#define LVGL_WAKE_INPUT        (1 << 0)  // A key event was queued
+#define LVGL_WAKE_FLUSH        (1 << 1)  // Direct mode: the panel took over a synced frame
+#define LVGL_WAKE_API          (1 << 2)  // Another task released the LVGL lock and may have changed the UI
+// Longest sleep without a wakeup, also bounds the sleep when LVGL has no timer pending
+#define LVGL_TASK_MAX_SLEEP_MS 1000
+// While a key is held the keypad is read at this interval so LVGL can generate long press and repeat events
+#define LVGL_KEY_HELD_POLL_MS  50
 
-// LVGL library is not thread-safe, this example will call LVGL APIs from different tasks, so use a mutex to protect it
-static _lock_t lvgl_api_lock;
+// LVGL's draw unit threads are not pinned, so they spread over both cores while this task waits for them
+#define EXAMPLE_LVGL_TASK_CORE       0
 
-static uint8_t* rotation_buffer = NULL;
+// Set to 1 to verify rotate_rgb565() against lv_draw_sw_rotate() and log its throughput at startup
+#define LVGL_ROTATION_BENCHMARK 0
 
-QueueHandle_t key_queue;
+// Strips are rotated into a ring of buffers. While DMA2D transfers one buffer to the panel the next strip can already
+// be rotated into another, so rendering, rotating and transferring overlap. Without DMA2D the DPI driver copies the
+// strip with the CPU before draw_bitmap returns, so the ring shrinks to a single buffer.
+#define LVGL_ROTATION_BUFFER_COUNT 2
 
+static uint8_t* rotation_buffers[LVGL_ROTATION_BUFFER_COUNT] = {NULL};
+static size_t rotation_buffer_count = LVGL_ROTATION_BUFFER_COUNT;
+static size_t rotation_buffer_next = 0;      // Next buffer to rotate into, only used by lvgl_flush_cb
+static size_t rotation_buffer_done = 0;      // Next buffer to complete its transfer, only used by the ISR
+static SemaphoreHandle_t rotation_buffers_free = NULL;
+static int64_t transfer_start_us[LVGL_ROTATION_BUFFER_COUNT];
+
+// Direct mode renders the whole screen into one buffer and rotates redrawn areas into the panel's frame buffer
+static uint8_t* panel_frame_buffer = NULL;
+static int32_t panel_frame_buffer_hres = 0;
+static flush_batch_t direct_flush_batch = {0};
+
+static lv_display_t* lvgl_display = NULL;
+static lvgl_config_t lvgl_config = {0};
+static int32_t panel_hres = 0;
+static int32_t panel_vres = 0;
+static void* draw_buffers[2] = {NULL};
+static size_t draw_buffer_size = 0;
+
+static portMUX_TYPE task_stats_lock = portMUX_INITIALIZER_UNLOCKED;
+static lvgl_task_stats_t task_stats = {0};
+
+static portMUX_TYPE flush_stats_lock = portMUX_INITIALIZER_UNLOCKED;
+static lvgl_flush_stats_t flush_stats = {0};
+
+// Key events travel from the coprocessor callback to the keypad indev through a lock-free ring. The indev drains it
+// in batches of up to KEY_BATCH_SIZE events per read.
+#define KEY_BATCH_SIZE 16
+// Dropped key events are logged at most this often
+#define KEY_DROP_REPORT_INTERVAL_US 1000000
+
+static key_ring_t key_ring;
+static key_event_t key_batch[KEY_BATCH_SIZE];
+static size_t key_batch_count = 0;
+static size_t key_batch_next = 0;
+static key_event_t key_last = {0};
+
+// Follows key events from the coprocessor interrupt to the first flush after them, only used with the LVGL lock held
+static latency_tracker_t latency_tracker;
+
+// Frame profiler, only used with the LVGL lock held. Refresh events and the flush callbacks fill in the current frame,
+// the LVGL task adds it to the profile once lv_timer_handler() returns.
+#define LVGL_PROFILE_OVERLAY_KEY       KEYMAP_KEY_F6
+#define LVGL_PROFILE_OVERLAY_PERIOD_MS 1000
+#define LVGL_PROFILE_LOG_PERIOD_MS     5000  // 0 disables the periodic serial lines
+
+typedef struct {
+    bool flushed;
+    int64_t refresh_start_us;
+    uint32_t refresh_us;
+    uint32_t flush_us;
+    uint32_t rotate_us;
+    uint32_t wait_us;
+} lvgl_profile_frame_t;
+
+static frame_profile_t frame_profile;
+static lvgl_profile_frame_t profile_frame = {0};
+static lv_obj_t* profile_overlay = NULL;
+static lv_timer_t* profile_timer = NULL;
+static uint32_t profile_log_elapsed_ms = 0;
+static uint32_t profile_logged_frames = 0;
+
+static TaskHandle_t lvgl_task = NULL;
+// esp_timer time the first frame was handed to the panel, the semaphore is given once it is set
+static int64_t first_frame_us = 0;
+static SemaphoreHandle_t first_frame_done = NULL;
+static lv_indev_t* keyboard_indev = NULL;
+// The key ring takes a single producer. The coprocessor callback decodes under this lock and everything else that
+// queues key events takes it too, so only one task pushes at a time.
+static SemaphoreHandle_t keyboard_lock = NULL;
+
+static void lvgl_wake(uint32_t reason) {
+    if (lvgl_task != NULL) {
+        xTaskNotifyIndexed(lvgl_task, LVGL_WAKE_NOTIFY_INDEX, reason, eSetBits);
+    }
+}
+
+// LVGL runs on its FreeRTOS OS layer, its global recursive mutex protects the API against concurrent use from other
+// tasks and is also taken by lv_timer_handler() itself
 void lvgl_lock() {
-    _lock_acquire(&lvgl_api_lock);
+    lv_lock();
 }
 
 void lvgl_unlock() {
-    _lock_release(&lvgl_api_lock);
+    lv_unlock();
+    if (xTaskGetCurrentTaskHandle() != lvgl_task) {
+        lvgl_wake(LVGL_WAKE_API);
+    }
 }
 
-static void lvgl_flush_cb(lv_display_t* disp, const lv_area_t* area, uint8_t* px_map) {
-    esp_lcd_panel_handle_t panel_handle = lv_display_get_user_data(disp);
+void lvgl_get_flush_stats(lvgl_flush_stats_t* stats, bool reset) {
+    portENTER_CRITICAL(&flush_stats_lock);
+    *stats = flush_stats;
+    if (reset) {
+        memset(&flush_stats, 0, sizeof(flush_stats));
+    }
+    portEXIT_CRITICAL(&flush_stats_lock);
+}
 
+// Maps an area in LVGL's rotated coordinates to the panel's native coordinates
+static void lvgl_rotate_area(lv_display_rotation_t rotation, int32_t disp_w, int32_t disp_h, const lv_area_t* area,
+                             lv_area_t* rotated_area) {
+    int32_t w = lv_area_get_width(area);
+    int32_t h = lv_area_get_height(area);
+
+    *rotated_area = *area;
+
+    if (rotation == LV_DISPLAY_ROTATION_90) {
+        rotated_area->x1 = area->y1;
+        rotated_area->y2 = disp_w - area->x1 - 1;
+        rotated_area->x2 = rotated_area->x1 + h - 1;
+        rotated_area->y1 = rotated_area->y2 - w + 1;
+    }
+
+    if (rotation == LV_DISPLAY_ROTATION_180) {
+        rotated_area->x1 = area->x1;
+        rotated_area->y2 = disp_h - area->y1 - 1;
+        rotated_area->x2 = area->x2;
+        rotated_area->y1 = rotated_area->y2 - h + 1;
+    }
+
+    if (rotation == LV_DISPLAY_ROTATION_270) {
+        rotated_area->x1 = disp_h - area->y2 - 1;
+        rotated_area->y2 = area->x2;
+        rotated_area->x2 = rotated_area->x1 + h - 1;
+        rotated_area->y1 = rotated_area->y2 - w + 1;
+    }
+}
+
+static void lvgl_latency_flush() {
+    if (latency_tracker_pending(&latency_tracker)) {
+        latency_tracker_flush(&latency_tracker, esp_timer_get_time());
+    }
+}
+
+static void flush_stats_add(bool overlapped, uint32_t pixels, uint32_t wait_us, uint32_t rotate_us) {
+    portENTER_CRITICAL(&flush_stats_lock);
+    flush_stats.flushes++;
+    flush_stats.transfers++;
+    flush_stats.overlapped += overlapped;
+    flush_stats.pixels_invalidated += pixels;
+    flush_stats.pixels += pixels;
+    flush_stats.wait_us += wait_us;
+    flush_stats.rotate_us += rotate_us;
+    if (wait_us > flush_stats.wait_max_us) {
+        flush_stats.wait_max_us = wait_us;
+    }
+    if (rotate_us > flush_stats.rotate_max_us) {
+        flush_stats.rotate_max_us = rotate_us;
+    }
+    portEXIT_CRITICAL(&flush_stats_lock);
+}
+
+// Rotates a rendered area into dst and maps it to the panel's coordinates, which is all lvgl_flush_cb does besides
+// waiting for a rotation buffer and starting the transfer
+static void lvgl_flush_prepare(lv_display_rotation_t rotation, int32_t disp_w, int32_t disp_h, lv_color_format_t cf,
+                               const lv_area_t* area, const uint8_t* px_map, uint8_t* dst, lv_area_t* rotated_area) {
     int32_t w = lv_area_get_width(area);
     int32_t h = lv_area_get_height(area);
-    lv_color_format_t cf = lv_display_get_color_format(disp);
     uint32_t w_stride = lv_draw_buf_width_to_stride(w, cf);
     uint32_t h_stride = lv_draw_buf_width_to_stride(h, cf);
 
-    lv_display_rotation_t rotation = lv_display_get_rotation(disp);
-    int32_t disp_w = lv_display_get_horizontal_resolution(disp);
-    int32_t disp_h = lv_display_get_vertical_resolution(disp);
+    uint32_t dst_stride = (rotation == LV_DISPLAY_ROTATION_90 || rotation == LV_DISPLAY_ROTATION_270) ? h_stride
+                                                                                                        : w_stride;
+    if (cf == LV_COLOR_FORMAT_RGB565) {
+        rotate_rgb565((const uint16_t*)px_map, (uint16_t*)dst, w, h, w_stride, dst_stride, rotation);
+    } else if (rotation != LV_DISPLAY_ROTATION_0) {
+        lv_draw_sw_rotate(px_map, dst, w, h, w_stride, dst_stride, rotation, cf);
+    } else {
+        memcpy(dst, px_map, w_stride * h);
+    }
+    lvgl_rotate_area(rotation, disp_w, disp_h, area, rotated_area);
+}
+
+static void lvgl_flush_cb(lv_display_t* disp, const lv_area_t* area, uint8_t* px_map) {
+    esp_lcd_panel_handle_t panel_handle = lv_display_get_user_data(disp);
+
+    // Wait until the oldest rotation buffer has been transferred to the panel
+    int64_t wait_start = esp_timer_get_time();
+    bool overlapped = uxSemaphoreGetCount(rotation_buffers_free) < rotation_buffer_count;
+    xSemaphoreTake(rotation_buffers_free, portMAX_DELAY);
+    size_t index = rotation_buffer_next;
+    rotation_buffer_next = (rotation_buffer_next + 1) % rotation_buffer_count;
+    uint8_t* rotation_buffer = rotation_buffers[index];
+    int64_t rotate_start = esp_timer_get_time();
 
     lv_area_t rotated_area;
-    if (rotation == LV_DISPLAY_ROTATION_90) {
-        lv_draw_sw_rotate(px_map, rotation_buffer, w, h, w_stride, h_stride, rotation, cf);
+    lvgl_flush_prepare(lv_display_get_rotation(disp), lv_display_get_horizontal_resolution(disp),
+                       lv_display_get_vertical_resolution(disp), lv_display_get_color_format(disp), area, px_map,
+                       rotation_buffer, &rotated_area);
+    int64_t rotate_end = esp_timer_get_time();
+
+    // The transfer may complete before draw_bitmap returns, so record its start first
+    transfer_start_us[index] = rotate_end;
+    esp_lcd_panel_draw_bitmap(panel_handle, rotated_area.x1, rotated_area.y1, rotated_area.x2 + 1,
+                              rotated_area.y2 + 1, rotation_buffer);
+
+    // The strip now lives in the rotation buffer, so LVGL can render into px_map again right away
+    lv_display_flush_ready(disp);
+    lvgl_latency_flush();
+
+    profile_frame.flushed = true;
+    profile_frame.flush_us += esp_timer_get_time() - wait_start;
+    profile_frame.rotate_us += rotate_end - rotate_start;
+    profile_frame.wait_us += rotate_start - wait_start;
+
+    flush_stats_add(overlapped, lv_area_get_size(area), rotate_start - wait_start, rotate_end - rotate_start);
+}
+
+// Rotates one area of the full-screen render buffer straight into the panel's frame buffer
+static void lvgl_direct_sync_area(lv_display_t* disp, const lv_area_t* area, const uint8_t* px_map) {
+    esp_lcd_panel_handle_t panel_handle = lv_display_get_user_data(disp);
+
+    int32_t w = lv_area_get_width(area);
+    int32_t h = lv_area_get_height(area);
+    lv_color_format_t cf = lv_display_get_color_format(disp);
+    uint32_t px_size = lv_color_format_get_size(cf);
+    uint32_t src_stride = lv_draw_buf_width_to_stride(lv_display_get_horizontal_resolution(disp), cf);
+    uint32_t dst_stride = lv_draw_buf_width_to_stride(panel_frame_buffer_hres, cf);
+
+    lv_area_t rotated_area;
+    lvgl_rotate_area(lv_display_get_rotation(disp), lv_display_get_horizontal_resolution(disp),
+                     lv_display_get_vertical_resolution(disp), area, &rotated_area);
 
-        rotated_area.x1 = area->y1;
-        rotated_area.y2 = disp_w - area->x1 - 1;
-        rotated_area.x2 = rotated_area.x1 + h - 1;
-        rotated_area.y1 = rotated_area.y2 - w + 1;
-        area = &rotated_area;
+    const uint8_t* src = px_map + area->y1 * src_stride + area->x1 * px_size;
+    uint8_t* dst = panel_frame_buffer + rotated_area.y1 * dst_stride + rotated_area.x1 * px_size;
+    rotate_rgb565((const uint16_t*)src, (uint16_t*)dst, w, h, src_stride, dst_stride, lv_display_get_rotation(disp));
+
+    // Drawing from the frame buffer itself only writes the touched rows back from the cache
+    esp_lcd_panel_draw_bitmap(panel_handle, rotated_area.x1, rotated_area.y1, rotated_area.x2 + 1,
+                              rotated_area.y2 + 1, panel_frame_buffer);
+}
+
+// Direct mode: px_map is the full-screen render buffer and area is one of the areas LVGL redrew. The areas of a
+// refresh cycle are collected, merged where that is cheaper, and only then rotated into the panel's frame buffer.
+static void lvgl_direct_flush_cb(lv_display_t* disp, const lv_area_t* area, uint8_t* px_map) {
+    flush_batch_add(&direct_flush_batch, area);
+
+    portENTER_CRITICAL(&flush_stats_lock);
+    flush_stats.flushes++;
+    flush_stats.pixels_invalidated += lv_area_get_size(area);
+    portEXIT_CRITICAL(&flush_stats_lock);
+
+    if (!lv_display_flush_is_last(disp)) {
+        lv_display_flush_ready(disp);
+        return;
     }
 
-    if (rotation == LV_DISPLAY_ROTATION_180) {
-        lv_draw_sw_rotate(px_map, rotation_buffer, w, h, w_stride, w_stride, rotation, cf);
+    int64_t sync_start = esp_timer_get_time();
+    size_t transfers = flush_batch_merge(&direct_flush_batch);
+    for (size_t i = 0; i < transfers; i++) {
+        lvgl_direct_sync_area(disp, &direct_flush_batch.areas[i], px_map);
+    }
+    uint32_t sync_us = esp_timer_get_time() - sync_start;
+    uint32_t pixels = flush_batch_pixels(&direct_flush_batch);
+    flush_batch_clear(&direct_flush_batch);
+
+    lv_display_flush_ready(disp);
+    lvgl_latency_flush();
+
+    profile_frame.flushed = true;
+    profile_frame.flush_us += esp_timer_get_time() - sync_start;
+    profile_frame.rotate_us += sync_us;
 
-        rotated_area.x1 = area->x1;
-        rotated_area.y2 = disp_h - area->y1 - 1;
-        rotated_area.x2 = area->x2;
-        rotated_area.y1 = rotated_area.y2 - h + 1;
-        area = &rotated_area;
+    portENTER_CRITICAL(&flush_stats_lock);
+    flush_stats.transfers += transfers;
+    flush_stats.pixels += pixels;
+    flush_stats.rotate_us += sync_us;
+    if (sync_us > flush_stats.rotate_max_us) {
+        flush_stats.rotate_max_us = sync_us;
     }
+    portEXIT_CRITICAL(&flush_stats_lock);
+}
 
-    if (rotation == LV_DISPLAY_ROTATION_270) {
-        lv_draw_sw_rotate(px_map, rotation_buffer, w, h, w_stride, h_stride, rotation, cf);
+// LVGL reads the time on demand instead of being ticked by a periodic timer, so an idle UI causes no wakeups
+static uint32_t lvgl_tick_get_cb(void) {
+    return (uint32_t)(esp_timer_get_time() / 1000);
+}
+
+void lvgl_get_task_stats(lvgl_task_stats_t* stats, bool reset) {
+    portENTER_CRITICAL(&task_stats_lock);
+    *stats = task_stats;
+    if (reset) {
+        memset(&task_stats, 0, sizeof(task_stats));
+    }
+    portEXIT_CRITICAL(&task_stats_lock);
+}
 
-        rotated_area.x1 = disp_h - area->y2 - 1;
-        rotated_area.y2 = area->x2;
-        rotated_area.x2 = rotated_area.x1 + h - 1;
-        rotated_area.y1 = rotated_area.y2 - w + 1;
-        area = &rotated_area;
+void lvgl_idle_report(int seconds) {
+    lvgl_task_stats_t stats;
+    lvgl_get_task_stats(&stats, true);
+    vTaskDelay(pdMS_TO_TICKS(seconds * 1000));
+    lvgl_get_task_stats(&stats, true);
+
+    ESP_LOGI(TAG,
+             "LVGL task over %d s: %.1f wakeups/s (timer %" PRIu32 ", input %" PRIu32 ", flush %" PRIu32
+             ", api %" PRIu32 "), busy %.2f%%",
+             seconds, (double)stats.wakeups / seconds, stats.timer_wakeups, stats.input_wakeups, stats.flush_wakeups,
+             stats.api_wakeups, stats.busy_us / (seconds * 10000.0));
+}
+
+static void lvgl_refresh_event_cb(lv_event_t* e) {
+    if (lv_event_get_code(e) == LV_EVENT_REFR_START) {
+        profile_frame.refresh_start_us = esp_timer_get_time();
+    } else {
+        profile_frame.refresh_us += esp_timer_get_time() - profile_frame.refresh_start_us;
+    }
+}
+
+// Refresh cycles that flushed nothing are not frames and are dropped
+static void lvgl_profile_commit(uint32_t handler_us) {
+    if (profile_frame.flushed) {
+        uint32_t render_us = profile_frame.refresh_us - profile_frame.flush_us;
+        uint32_t sample[FRAME_PROFILE_METRIC_COUNT] = {
+            [FRAME_PROFILE_HANDLER] = handler_us,
+            [FRAME_PROFILE_RENDER] = profile_frame.refresh_us > profile_frame.flush_us ? render_us : 0,
+            [FRAME_PROFILE_ROTATE] = profile_frame.rotate_us,
+            [FRAME_PROFILE_FLUSH_WAIT] = profile_frame.wait_us,
+        };
+        frame_profile_add(&frame_profile, sample);
+        if (first_frame_us == 0) {
+            first_frame_us = esp_timer_get_time();
+            xSemaphoreGive(first_frame_done);
+        }
+    }
+    memset(&profile_frame, 0, sizeof(profile_frame));
+}
+
+static void lvgl_profile_timer_cb(lv_timer_t* timer) {
+    static char text[256];
+    bool overlay_visible = !lv_obj_has_flag(profile_overlay, LV_OBJ_FLAG_HIDDEN);
+
+    if (overlay_visible) {
+        frame_profile_format(&frame_profile, text, sizeof(text), true);
+        lv_label_set_text(profile_overlay, text);
     }
 
-    int offsetx1 = area->x1;
-    int offsetx2 = area->x2;
-    int offsety1 = area->y1;
-    int offsety2 = area->y2;
+    profile_log_elapsed_ms += lv_timer_get_period(timer);
+    if (LVGL_PROFILE_LOG_PERIOD_MS > 0 && profile_log_elapsed_ms >= LVGL_PROFILE_LOG_PERIOD_MS) {
+        profile_log_elapsed_ms = 0;
+        // An idle UI stays quiet, nothing is logged until new frames were drawn
+        if (frame_profile.frames != profile_logged_frames) {
+            profile_logged_frames = frame_profile.frames;
+            frame_profile_format(&frame_profile, text, sizeof(text), false);
+            ESP_LOGI(TAG, "Frame ms min/avg/p99: %s", text);
+        }
+    }
+}
 
-    esp_lcd_panel_draw_bitmap(panel_handle, offsetx1, offsety1, offsetx2 + 1, offsety2 + 1, rotation_buffer);
+// The timer only runs as often as the overlay or the serial lines need it
+static void lvgl_profile_update_timer() {
+    if (!lv_obj_has_flag(profile_overlay, LV_OBJ_FLAG_HIDDEN)) {
+        lv_timer_set_period(profile_timer, LVGL_PROFILE_OVERLAY_PERIOD_MS);
+        lv_timer_resume(profile_timer);
+        lv_timer_ready(profile_timer);
+    } else if (LVGL_PROFILE_LOG_PERIOD_MS > 0) {
+        lv_timer_set_period(profile_timer, LVGL_PROFILE_LOG_PERIOD_MS);
+        lv_timer_resume(profile_timer);
+    } else {
+        lv_timer_pause(profile_timer);
+    }
 }
 
-static void increase_lvgl_tick(void* arg) {
-    /* Tell LVGL how many milliseconds has elapsed */
-    lv_tick_inc(LVGL_TICK_PERIOD_MS);
+static void lvgl_profile_toggle_overlay_locked() {
+    if (lv_obj_has_flag(profile_overlay, LV_OBJ_FLAG_HIDDEN)) {
+        lv_obj_remove_flag(profile_overlay, LV_OBJ_FLAG_HIDDEN);
+    } else {
+        lv_obj_add_flag(profile_overlay, LV_OBJ_FLAG_HIDDEN);
+    }
+    lvgl_profile_update_timer();
+}
+
+static void lvgl_profile_init(lv_display_t* display) {
+    frame_profile_reset(&frame_profile);
+    first_frame_done = xSemaphoreCreateBinary();
+    lv_display_add_event_cb(display, lvgl_refresh_event_cb, LV_EVENT_REFR_START, NULL);
+    lv_display_add_event_cb(display, lvgl_refresh_event_cb, LV_EVENT_REFR_READY, NULL);
+
+    profile_overlay = lv_label_create(lv_display_get_layer_top(display));
+    lv_obj_set_style_bg_color(profile_overlay, lv_color_black(), 0);
+    lv_obj_set_style_bg_opa(profile_overlay, LV_OPA_70, 0);
+    lv_obj_set_style_text_color(profile_overlay, lv_color_white(), 0);
+    lv_obj_set_style_pad_all(profile_overlay, 4, 0);
+    lv_obj_align(profile_overlay, LV_ALIGN_TOP_RIGHT, 0, 0);
+    lv_obj_add_flag(profile_overlay, LV_OBJ_FLAG_HIDDEN);
+
+    profile_timer = lv_timer_create(lvgl_profile_timer_cb, LVGL_PROFILE_OVERLAY_PERIOD_MS, NULL);
+    lvgl_profile_update_timer();
+}
+
+void lvgl_profile_toggle_overlay() {
+    lvgl_lock();
+    lvgl_profile_toggle_overlay_locked();
+    lvgl_unlock();
+}
+
+bool lvgl_wait_first_frame(uint32_t timeout_ms, int64_t* frame_us) {
+    if (first_frame_done == NULL || xSemaphoreTake(first_frame_done, pdMS_TO_TICKS(timeout_ms)) != pdTRUE) {
+        return false;
+    }
+    // Leave it given for every later caller
+    xSemaphoreGive(first_frame_done);
+    *frame_us = first_frame_us;
+    return true;
+}
+
+void lvgl_profile_print(bool reset) {
+    static char text[256];
+    lvgl_lock();
+    frame_profile_format(&frame_profile, text, sizeof(text), false);
+    if (reset) {
+        frame_profile_reset(&frame_profile);
+        profile_logged_frames = 0;
+    }
+    lvgl_unlock();
+    printf("Frame ms min/avg/p99: %s\n", text);
+}
+
+// Logs the keys dropped since the last report, at most once per KEY_DROP_REPORT_INTERVAL_US so a flood of keys does
+// not also flood the log. Only called from the LVGL task.
+static void report_dropped_keys() {
+    static uint32_t reported = 0;
+    static int64_t reported_us = 0;
+    uint32_t dropped = key_ring_dropped(&key_ring);
+    int64_t now = esp_timer_get_time();
+    if (dropped == reported || now - reported_us < KEY_DROP_REPORT_INTERVAL_US) {
+        return;
+    }
+    ESP_LOGW(TAG, "Key ring full, dropped %" PRIu32 " key events", dropped - reported);
+    reported = dropped;
+    reported_us = now;
 }
 
 static void lvgl_port_task(void* arg) {
     ESP_LOGI(TAG, "Starting LVGL task");
     uint32_t time_till_next_ms = 0;
+    uint32_t wake = 0;
+    bool key_held = false;
     while (1) {
+        int64_t busy_start = esp_timer_get_time();
         lvgl_lock();
+        // The keypad runs in event mode, it is only read when keys arrive or while one is held down
+        if ((wake & LVGL_WAKE_INPUT) || key_held) {
+            lv_indev_read(keyboard_indev);
+            key_held = lv_indev_get_state(keyboard_indev) == LV_INDEV_STATE_PRESSED;
+        }
+        int64_t handler_start = esp_timer_get_time();
         time_till_next_ms = lv_timer_handler();
+        lvgl_profile_commit(esp_timer_get_time() - handler_start);
         lvgl_unlock();
+        report_dropped_keys();
 
-        // in case of task watch dog timeout, set the minimal delay to 10ms
-        if (time_till_next_ms < 10) {
-            time_till_next_ms = 10;
+        portENTER_CRITICAL(&task_stats_lock);
+        task_stats.wakeups++;
+        task_stats.timer_wakeups += wake == 0;
+        task_stats.input_wakeups += (wake & LVGL_WAKE_INPUT) != 0;
+        task_stats.flush_wakeups += (wake & LVGL_WAKE_FLUSH) != 0;
+        task_stats.api_wakeups += (wake & LVGL_WAKE_API) != 0;
+        task_stats.busy_us += esp_timer_get_time() - busy_start;
+        portEXIT_CRITICAL(&task_stats_lock);
+
+        if (time_till_next_ms > LVGL_TASK_MAX_SLEEP_MS) {
+            time_till_next_ms = LVGL_TASK_MAX_SLEEP_MS;
+        }
+        if (key_held && time_till_next_ms > LVGL_KEY_HELD_POLL_MS) {
+            time_till_next_ms = LVGL_KEY_HELD_POLL_MS;
+        }
+
+        // Round up to whole ticks and always block for at least one, so the idle task gets to feed the watchdog
+        // even while an animation keeps LVGL busy
+        TickType_t ticks = (time_till_next_ms + portTICK_PERIOD_MS - 1) / portTICK_PERIOD_MS;
+        if (ticks == 0) {
+            ticks = 1;
         }
-        usleep(1000 * time_till_next_ms);
+        wake = 0;
+        xTaskNotifyWaitIndexed(LVGL_WAKE_NOTIFY_INDEX, 0, UINT32_MAX, &wake, ticks);
     }
 }
 
-static bool notify_lvgl_flush_ready(esp_lcd_panel_handle_t panel, esp_lcd_dpi_panel_event_data_t* edata,
-                                    void* user_ctx) {
-    lv_display_t* disp = (lv_display_t*)user_ctx;
-    lv_display_flush_ready(disp);
-    return false;
+static bool notify_transfer_done(esp_lcd_panel_handle_t panel, esp_lcd_dpi_panel_event_data_t* edata,
+                                 void* user_ctx) {
+    // Transfers complete in the order they were started, so the oldest buffer is the one that is free again
+    uint32_t transfer_us = esp_timer_get_time() - transfer_start_us[rotation_buffer_done];
+    rotation_buffer_done = (rotation_buffer_done + 1) % rotation_buffer_count;
+
+    portENTER_CRITICAL_ISR(&flush_stats_lock);
+    flush_stats.transfer_us += transfer_us;
+    if (transfer_us > flush_stats.transfer_max_us) {
+        flush_stats.transfer_max_us = transfer_us;
+    }
+    portEXIT_CRITICAL_ISR(&flush_stats_lock);
+
+    // A flush waiting for this buffer blocks on the semaphore, which also wakes the LVGL task
+    BaseType_t need_yield = pdFALSE;
+    xSemaphoreGiveFromISR(rotation_buffers_free, &need_yield);
+    return need_yield == pdTRUE;
 }
 
-typedef struct {
-    uint32_t key;
-    lv_state_t state;
-} key_event_t;
+// In direct mode no flush waits for the panel, so the LVGL task is woken explicitly
+static bool notify_direct_transfer_done(esp_lcd_panel_handle_t panel, esp_lcd_dpi_panel_event_data_t* edata,
+                                        void* user_ctx) {
+    BaseType_t need_yield = pdFALSE;
+    if (lvgl_task != NULL) {
+        xTaskNotifyIndexedFromISR(lvgl_task, LVGL_WAKE_NOTIFY_INDEX, LVGL_WAKE_FLUSH, eSetBits, &need_yield);
+    }
+    return need_yield == pdTRUE;
+}
+
+static bool key_batch_pop(key_event_t* event) {
+    if (key_batch_next == key_batch_count) {
+        key_batch_count = key_ring_pop_batch(&key_ring, key_batch, KEY_BATCH_SIZE);
+        key_batch_next = 0;
+    }
+    if (key_batch_next == key_batch_count) {
+        return false;
+    }
+    *event = key_batch[key_batch_next++];
+    return true;
+}
 
 static void read_keyboard(lv_indev_t* indev, lv_indev_data_t* data) {
+    // Without a new event the last one is repeated, so a held key stays pressed
     key_event_t event;
-
-    UBaseType_t messages_waiting = uxQueueMessagesWaiting(key_queue);
-    if (messages_waiting > 1) {
-        data->continue_reading = true;
-    }
-    if (messages_waiting >= 1) {
-        if (xQueueReceive(key_queue, &event, portMAX_DELAY) == pdTRUE) {
-            ESP_LOGI(TAG, "EVENT, %lu %u", event.key, event.state);
-            data->key = event.key;
-            data->state = event.state;
+    while (key_batch_pop(&event)) {
+        latency_tracker_read(&latency_tracker, &event.stamp, esp_timer_get_time());
+        // The overlay key is handled here and never reaches the focused widget
+        if (event.key == LVGL_PROFILE_OVERLAY_KEY) {
+            if (event.pressed) {
+                lvgl_profile_toggle_overlay_locked();
+            }
+            continue;
         }
+        key_last = event;
+        ESP_LOGI(TAG, "EVENT, %" PRIu32 " %u", key_last.key, key_last.pressed);
+        break;
     }
+
+    data->key = key_last.key;
+    data->state = key_last.pressed ? LV_INDEV_STATE_PRESSED : LV_INDEV_STATE_RELEASED;
+    data->continue_reading = key_batch_next < key_batch_count || key_ring_count(&key_ring) > 0;
 }
 
-void key_to_state(uint8_t pressed, uint32_t key) {
-    key_event_t event;
-    event.key = key;
-    event.state = pressed ? LV_INDEV_STATE_PRESSED : LV_INDEV_STATE_RELEASED;
-    xQueueSend(key_queue, &event, portMAX_DELAY);
+uint32_t lvgl_get_dropped_keys() {
+    return key_ring_dropped(&key_ring);
+}
+
+static void key_push(uint8_t pressed, uint32_t key, const latency_stamp_t* stamp) {
+    key_event_t event = {
+        .key = key,
+        .pressed = pressed,
+        .stamp = *stamp,
+    };
+    // Never block the coprocessor callback task, a full ring drops the event and counts it for report_dropped_keys()
+    key_ring_push(&key_ring, &event);
+    lvgl_wake(LVGL_WAKE_INPUT);
+}
+
+// Stamp shared by all key events decoded from one coprocessor callback, keyboard_lock guards it
+static latency_stamp_t keyboard_stamp;
+// Decoder state of the coprocessor's key bitmaps, keyboard_lock guards it
+static keymap_state_t keyboard_keymap;
+
+static void keyboard_emit(uint8_t pressed, uint32_t key) {
+    key_push(pressed, key, &keyboard_stamp);
 }
 
 void coprocessor_keyboard_callback(tanmatsu_coprocessor_handle_t handle, tanmatsu_coprocessor_keys_t* prev_keys,
                                    tanmatsu_coprocessor_keys_t* keys) {
-    if (keys->key_up != prev_keys->key_up) {
-        key_to_state(keys->key_up, LV_KEY_UP);
-    }
-    if (keys->key_down != prev_keys->key_down) {
-        key_to_state(keys->key_down, LV_KEY_DOWN);
+    // The coprocessor comes up in parallel with the UI at boot, keys pressed before the UI runs are dropped
+    if (lvgl_task == NULL) {
+        return;
     }
-    if (keys->key_left != prev_keys->key_left) {
-        key_to_state(keys->key_left, LV_KEY_LEFT);
-    }
-    if (keys->key_right != prev_keys->key_right) {
-        key_to_state(keys->key_right, LV_KEY_RIGHT);
-    }
-    if (keys->key_return != prev_keys->key_return) {
-        key_to_state(keys->key_return, LV_KEY_ENTER);
-    }
-    if (keys->key_esc != prev_keys->key_esc) {
-        key_to_state(keys->key_esc, LV_KEY_ESC);
+    int64_t now = esp_timer_get_time();
+    int64_t irq_us = now;
+    // Without a captured edge the callback time is the best estimate for the interrupt
+    irq_timestamp_take(&irq_us);
+    xSemaphoreTake(keyboard_lock, portMAX_DELAY);
+    keyboard_stamp.irq_us = irq_us;
+    keyboard_stamp.callback_us = now;
+    keymap_decode(&keyboard_keymap, prev_keys, keys, keyboard_emit);
+    xSemaphoreGive(keyboard_lock);
+}
+
+// Queues one key event the way the coprocessor callback does, for events that do not come from the coprocessor
+static void keyboard_inject(uint8_t pressed, uint32_t key, const latency_stamp_t* stamp) {
+    xSemaphoreTake(keyboard_lock, portMAX_DELAY);
+    keyboard_stamp = *stamp;
+    keyboard_emit(pressed, key);
+    xSemaphoreGive(keyboard_lock);
+}
+
+void lvgl_latency_print(bool reset) {
+    lvgl_lock();
+    latency_tracker_print(&latency_tracker);
+    if (reset) {
+        latency_tracker_reset(&latency_tracker);
     }
-    if (keys->key_tab != prev_keys->key_tab) {
-        key_to_state(keys->key_tab, LV_KEY_NEXT);
+    lvgl_unlock();
+}
+
+void lvgl_latency_synthetic(int events, uint32_t interval_ms) {
+    uint32_t seed = 0x2545F491;
+    for (int i = 0; i < events; i++) {
+        // Pretend the interrupt fired 100 us to 2 ms before the callback
+        seed = seed * 1664525u + 1013904223u;
+        uint32_t now = esp_timer_get_time();
+        latency_stamp_t stamp = {
+            .irq_us = now - (100 + (seed >> 16) % 1900),
+            .callback_us = now,
+        };
+        uint32_t key = (i & 2) ? LV_KEY_PREV : LV_KEY_NEXT;
+        keyboard_inject(!(i & 1), key, &stamp);
+        vTaskDelay(pdMS_TO_TICKS(interval_ms));
     }
-    if (keys->key_backspace != prev_keys->key_backspace) {
-        key_to_state(keys->key_backspace, LV_KEY_BACKSPACE);
+    vTaskDelay(pdMS_TO_TICKS(LATENCY_FLUSH_TIMEOUT_US / 1000));
+    ESP_LOGI(TAG, "Latency of %d synthetic key events:", events);
+    lvgl_latency_print(true);
+}
+
+// Waits until every rotation buffer has been transferred, the caller has to give all of them back
+static void lvgl_wait_transfers() {
+    for (size_t i = 0; i < rotation_buffer_count; i++) {
+        xSemaphoreTake(rotation_buffers_free, portMAX_DELAY);
     }
+}
 
-    // Keys go brrr
-    if (keys->key_a != prev_keys->key_a) {
-        key_to_state(keys->key_a, 65);
+static void lvgl_release_transfers() {
+    for (size_t i = 0; i < rotation_buffer_count; i++) {
+        xSemaphoreGive(rotation_buffers_free);
     }
-    if (keys->key_b != prev_keys->key_b) {
-        key_to_state(keys->key_b, 66);
+}
+
+static size_t lvgl_strip_size(const lvgl_config_t* config) {
+    if (config->strip_height <= 0) {
+        return panel_hres * (panel_vres / 10) * sizeof(lv_color_t);
     }
-    if (keys->key_c != prev_keys->key_c) {
-        key_to_state(keys->key_c, 67);
+    return lv_display_get_horizontal_resolution(lvgl_display) * config->strip_height * sizeof(lv_color_t);
+}
+
+// Allocates the draw and rotation buffers described by config and hands them to LVGL, the previous buffers are only
+// released once they are no longer in use. Must be called with the LVGL lock held.
+static esp_err_t lvgl_set_partial_buffers(const lvgl_config_t* config) {
+    size_t size = lvgl_strip_size(config);
+    void* draw[2] = {NULL};
+    uint8_t* rotation[LVGL_ROTATION_BUFFER_COUNT] = {NULL};
+    bool ok = true;
+
+    for (size_t i = 0; i < 2; i++) {
+        draw[i] = heap_caps_malloc(size, config->draw_buffer_caps);
+        ok &= draw[i] != NULL;
     }
-    if (keys->key_d != prev_keys->key_d) {
-        key_to_state(keys->key_d, 68);
+    for (size_t i = 0; i < rotation_buffer_count; i++) {
+        rotation[i] = heap_caps_malloc(size, config->rotation_buffer_caps);
+        ok &= rotation[i] != NULL;
     }
-    if (keys->key_e != prev_keys->key_e) {
-        key_to_state(keys->key_e, 69);
+
+    if (!ok) {
+        for (size_t i = 0; i < 2; i++) {
+            heap_caps_free(draw[i]);
+        }
+        for (size_t i = 0; i < LVGL_ROTATION_BUFFER_COUNT; i++) {
+            heap_caps_free(rotation[i]);
+        }
+        return ESP_ERR_NO_MEM;
     }
-    if (keys->key_f != prev_keys->key_f) {
-        key_to_state(keys->key_f, 70);
+
+    lvgl_wait_transfers();
+    for (size_t i = 0; i < 2; i++) {
+        heap_caps_free(draw_buffers[i]);
+        draw_buffers[i] = draw[i];
     }
-    if (keys->key_g != prev_keys->key_g) {
-        key_to_state(keys->key_g, 71);
+    for (size_t i = 0; i < LVGL_ROTATION_BUFFER_COUNT; i++) {
+        heap_caps_free(rotation_buffers[i]);
+        rotation_buffers[i] = rotation[i];
     }
-    if (keys->key_h != prev_keys->key_h) {
-        key_to_state(keys->key_h, 72);
+    draw_buffer_size = size;
+    lv_display_set_buffers(lvgl_display, draw[0], draw[1], size, LV_DISPLAY_RENDER_MODE_PARTIAL);
+    lvgl_release_transfers();
+
+    lvgl_config.strip_height = config->strip_height;
+    lvgl_config.draw_buffer_caps = config->draw_buffer_caps;
+    lvgl_config.rotation_buffer_caps = config->rotation_buffer_caps;
+    return ESP_OK;
+}
+
+#if LVGL_ROTATION_BENCHMARK
+// Rotates a width x height strip with both lv_draw_sw_rotate() and rotate_rgb565(), checks that the results match and
+// logs the throughput of each in MPix/s. Returns false on a mismatch.
+static bool lvgl_rotation_benchmark(int32_t width, int32_t height, int iterations) {
+    static const lv_display_rotation_t rotations[] = {LV_DISPLAY_ROTATION_90, LV_DISPLAY_ROTATION_180,
+                                                      LV_DISPLAY_ROTATION_270};
+    size_t size = width * height * sizeof(uint16_t);
+    uint16_t* src = heap_caps_malloc(size, MALLOC_CAP_SPIRAM);
+    uint16_t* ref = heap_caps_malloc(size, MALLOC_CAP_SPIRAM);
+    uint16_t* out = heap_caps_malloc(size, MALLOC_CAP_SPIRAM);
+    bool ok = src && ref && out;
+
+    if (ok) {
+        for (int32_t i = 0; i < width * height; i++) {
+            src[i] = (uint16_t)(i * 2654435761u >> 16);
+        }
     }
-    if (keys->key_i != prev_keys->key_i) {
-        key_to_state(keys->key_i, 73);
+
+    for (size_t r = 0; ok && r < sizeof(rotations) / sizeof(rotations[0]); r++) {
+        lv_display_rotation_t rotation = rotations[r];
+        int32_t src_stride = width * sizeof(uint16_t);
+        int32_t dst_stride = (rotation == LV_DISPLAY_ROTATION_180 ? width : height) * sizeof(uint16_t);
+
+        int64_t start = esp_timer_get_time();
+        for (int i = 0; i < iterations; i++) {
+            lv_draw_sw_rotate(src, ref, width, height, src_stride, dst_stride, rotation, LV_COLOR_FORMAT_RGB565);
+        }
+        int64_t lvgl_us = esp_timer_get_time() - start;
+
+        start = esp_timer_get_time();
+        for (int i = 0; i < iterations; i++) {
+            rotate_rgb565(src, out, width, height, src_stride, dst_stride, rotation);
+        }
+        int64_t tiled_us = esp_timer_get_time() - start;
+
+        if (memcmp(ref, out, size) != 0) {
+            ESP_LOGE(TAG, "Rotation %d: output differs from lv_draw_sw_rotate", rotation * 90);
+            ok = false;
+            break;
+        }
+
+        double mpix = (double)width * height * iterations;
+        ESP_LOGI(TAG, "%" PRId32 "x%" PRId32 " rotation %d: lv_draw_sw_rotate %.1f MPix/s, rotate_rgb565 %.1f MPix/s",
+                 width, height, rotation * 90, mpix / (lvgl_us ? lvgl_us : 1), mpix / (tiled_us ? tiled_us : 1));
     }
-    if (keys->key_j != prev_keys->key_j) {
-        key_to_state(keys->key_j, 74);
+
+    heap_caps_free(src);
+    heap_caps_free(ref);
+    heap_caps_free(out);
+    return ok;
+}
+#endif
+
+// Lets the DPI driver copy strips into its frame buffer with DMA2D, returns false when it has to use the CPU
+static bool lvgl_enable_dma2d(esp_lcd_panel_handle_t mipi_dpi_panel) {
+#if ESP_IDF_VERSION >= ESP_IDF_VERSION_VAL(5, 4, 0)
+    esp_err_t res = esp_lcd_dpi_panel_enable_dma2d(mipi_dpi_panel);
+    if (res != ESP_OK) {
+        ESP_LOGW(TAG, "DMA2D not available for the panel (%s), strips are copied by the CPU", esp_err_to_name(res));
+        return false;
     }
-    if (keys->key_k != prev_keys->key_k) {
-        key_to_state(keys->key_k, 75);
+    return true;
+#else
+    // Before IDF 5.4 DMA2D can only be selected in the configuration the panel driver creates the panel with
+    ESP_LOGW(TAG, "DMA2D needs IDF 5.4 or later, strips are copied by the CPU");
+    return false;
+#endif
+}
+
+static void lvgl_init_partial(lv_display_t* display, esp_lcd_panel_handle_t mipi_dpi_panel,
+                              const lvgl_config_t* config) {
+    rotation_buffer_count = lvgl_enable_dma2d(mipi_dpi_panel) ? LVGL_ROTATION_BUFFER_COUNT : 1;
+    rotation_buffers_free = xSemaphoreCreateCounting(rotation_buffer_count, rotation_buffer_count);
+    assert(rotation_buffers_free);
+    ESP_ERROR_CHECK(lvgl_set_partial_buffers(config));
+
+#if LVGL_ROTATION_BENCHMARK
+    lvgl_rotation_benchmark(panel_hres, panel_vres / 10, 20);
+#endif
+
+    // Set the callback which can copy the rendered image to an area of the display
+    lv_display_set_flush_cb(display, lvgl_flush_cb);
+
+    esp_lcd_dpi_panel_event_callbacks_t cbs = {
+        .on_color_trans_done = notify_transfer_done,
+    };
+
+    ESP_ERROR_CHECK(esp_lcd_dpi_panel_register_event_callbacks(mipi_dpi_panel, &cbs, display));
+}
+
+static esp_err_t lvgl_init_direct(lv_display_t* display, esp_lcd_panel_handle_t mipi_dpi_panel,
+                                  const lvgl_config_t* config) {
+    void* frame_buffer = NULL;
+    esp_err_t res = esp_lcd_dpi_panel_get_frame_buffer(mipi_dpi_panel, 1, &frame_buffer);
+    if (res != ESP_OK) {
+        return res;
     }
-    if (keys->key_l != prev_keys->key_l) {
-        key_to_state(keys->key_l, 76);
+    esp_lcd_dpi_panel_event_callbacks_t cbs = {
+        .on_color_trans_done = notify_direct_transfer_done,
+    };
+    res = esp_lcd_dpi_panel_register_event_callbacks(mipi_dpi_panel, &cbs, display);
+    if (res != ESP_OK) {
+        return res;
     }
-    if (keys->key_m != prev_keys->key_m) {
-        key_to_state(keys->key_m, 77);
+
+    // LVGL renders in rotated coordinates, so it gets its own full-screen buffer instead of the panel's
+    size_t render_buffer_sz = panel_hres * panel_vres * sizeof(lv_color_t);
+    void* render_buffer = heap_caps_malloc(render_buffer_sz, config->draw_buffer_caps);
+    if (render_buffer == NULL) {
+        return ESP_ERR_NO_MEM;
     }
-    if (keys->key_n != prev_keys->key_n) {
-        key_to_state(keys->key_n, 78);
+
+    panel_frame_buffer = frame_buffer;
+    panel_frame_buffer_hres = panel_hres;
+    draw_buffers[0] = render_buffer;
+    draw_buffer_size = render_buffer_sz;
+
+    lv_display_set_buffers(display, render_buffer, NULL, render_buffer_sz, LV_DISPLAY_RENDER_MODE_DIRECT);
+    lv_display_set_flush_cb(display, lvgl_direct_flush_cb);
+    return ESP_OK;
+}
+
+// Fully redraws screen frames times and returns the average time per frame, including the transfer of the last
+// strips. Must be called with the LVGL lock held.
+static int64_t lvgl_measure_frame_us(lv_obj_t* screen, int frames) {
+    int64_t start = esp_timer_get_time();
+    for (int f = 0; f < frames; f++) {
+        lv_obj_invalidate(screen);
+        lv_refr_now(lvgl_display);
     }
-    if (keys->key_o != prev_keys->key_o) {
-        key_to_state(keys->key_o, 79);
+    if (lvgl_config.mode == LVGL_DISPLAY_MODE_PARTIAL) {
+        lvgl_wait_transfers();
+        lvgl_release_transfers();
     }
-    if (keys->key_p != prev_keys->key_p) {
-        key_to_state(keys->key_p, 80);
+    return (esp_timer_get_time() - start) / frames;
+}
+
+static lv_obj_t* lvgl_sweep_scene_create() {
+    // Keep the scene's buttons out of the default group so focus on the real UI is left alone
+    lv_group_t* group = lv_group_get_default();
+    lv_group_set_default(NULL);
+
+    lv_obj_t* scene = lv_obj_create(NULL);
+    lv_obj_set_flex_flow(scene, LV_FLEX_FLOW_ROW_WRAP);
+    for (int i = 0; i < 24; i++) {
+        lv_obj_t* button = lv_button_create(scene);
+        lv_obj_t* label = lv_label_create(button);
+        lv_label_set_text_fmt(label, "Button %d", i);
     }
-    if (keys->key_q != prev_keys->key_q) {
-        key_to_state(keys->key_q, 81);
+
+    lv_group_set_default(group);
+    return scene;
+}
+
+void lvgl_buffer_sweep(int frames) {
+    static const struct {
+        const char* name;
+        uint32_t draw_buffer_caps;
+        uint32_t rotation_buffer_caps;
+    } placements[] = {
+        {"psram/psram", MALLOC_CAP_SPIRAM, MALLOC_CAP_SPIRAM},
+        {"internal/psram", MALLOC_CAP_INTERNAL | MALLOC_CAP_DMA, MALLOC_CAP_SPIRAM},
+        {"psram/internal", MALLOC_CAP_SPIRAM, MALLOC_CAP_INTERNAL | MALLOC_CAP_DMA},
+        {"internal/internal", MALLOC_CAP_INTERNAL | MALLOC_CAP_DMA, MALLOC_CAP_INTERNAL | MALLOC_CAP_DMA},
+    };
+    // Strip heights as a fraction of the rotated display height
+    static const int32_t strip_divisors[] = {40, 20, 10, 5, 2};
+
+    if (lvgl_config.mode != LVGL_DISPLAY_MODE_PARTIAL) {
+        ESP_LOGW(TAG, "Buffer sweep is only available in partial mode");
+        return;
     }
-    if (keys->key_r != prev_keys->key_r) {
-        key_to_state(keys->key_r, 82);
+
+    lvgl_lock();
+    lvgl_config_t original = lvgl_config;
+    lv_obj_t* previous = lv_screen_active();
+    lv_obj_t* scene = lvgl_sweep_scene_create();
+    lv_screen_load(scene);
+    int32_t disp_h = lv_display_get_vertical_resolution(lvgl_display);
+    lvgl_unlock();
+
+    ESP_LOGI(TAG, "Buffer sweep, %d frames per configuration (draw/rotation placement)", frames);
+    for (size_t p = 0; p < sizeof(placements) / sizeof(placements[0]); p++) {
+        for (size_t d = 0; d < sizeof(strip_divisors) / sizeof(strip_divisors[0]); d++) {
+            lvgl_config_t config = original;
+            config.strip_height = disp_h / strip_divisors[d];
+            config.draw_buffer_caps = placements[p].draw_buffer_caps;
+            config.rotation_buffer_caps = placements[p].rotation_buffer_caps;
+
+            lvgl_lock();
+            if (lvgl_set_partial_buffers(&config) != ESP_OK) {
+                lvgl_unlock();
+                ESP_LOGI(TAG, "%-18s %3" PRId32 " rows: does not fit", placements[p].name, config.strip_height);
+                continue;
+            }
+
+            int64_t frame_us = lvgl_measure_frame_us(scene, frames);
+            lvgl_unlock();
+
+            ESP_LOGI(TAG,
+                     "%-18s %3" PRId32 " rows: %6" PRId64
+                     " us/frame, buffers %u bytes, free internal %u, free psram %u",
+                     placements[p].name, config.strip_height, frame_us,
+                     (unsigned)(draw_buffer_size * (2 + rotation_buffer_count)),
+                     (unsigned)heap_caps_get_free_size(MALLOC_CAP_INTERNAL),
+                     (unsigned)heap_caps_get_free_size(MALLOC_CAP_SPIRAM));
+
+            // Let the idle tasks run between configurations
+            vTaskDelay(pdMS_TO_TICKS(10));
+        }
     }
-    if (keys->key_s != prev_keys->key_s) {
-        key_to_state(keys->key_s, 83);
+
+    lvgl_lock();
+    ESP_ERROR_CHECK(lvgl_set_partial_buffers(&original));
+    lv_screen_load(previous);
+    lv_obj_delete(scene);
+    lvgl_unlock();
+}
+
+void lvgl_render_benchmark(int frames) {
+    lvgl_lock();
+    lv_obj_t* active = lv_screen_active();
+    int64_t active_us = lvgl_measure_frame_us(active, frames);
+
+    lv_obj_t* scene = lvgl_sweep_scene_create();
+    lv_screen_load(scene);
+    int64_t scene_us = lvgl_measure_frame_us(scene, frames);
+    lv_screen_load(active);
+    lv_obj_delete(scene);
+    lvgl_unlock();
+
+    ESP_LOGI(TAG,
+             "Render benchmark with %d draw unit(s): active screen %" PRId64 " us/frame, button scene %" PRId64
+             " us/frame",
+             LV_DRAW_SW_DRAW_UNIT_CNT, active_us, scene_us);
+}
+
+typedef struct {
+    lv_display_rotation_t rotation;
+    int32_t disp_w;
+    int32_t disp_h;
+    int32_t rows;
+    const uint8_t* src;
+    uint8_t* dst;
+} flush_bench_t;
+
+// One operation is one strip, the strips walk down the screen like a full redraw
+static void lvgl_flush_bench_body(void* ctx, uint32_t ops) {
+    flush_bench_t* bench = ctx;
+    int32_t strips = bench->disp_h / bench->rows;
+    for (uint32_t i = 0; i < ops; i++) {
+        int32_t y = (i % strips) * bench->rows;
+        lv_area_t area = {0, y, bench->disp_w - 1, y + bench->rows - 1};
+        lv_area_t rotated_area;
+        lvgl_flush_prepare(bench->rotation, bench->disp_w, bench->disp_h, LV_COLOR_FORMAT_RGB565, &area, bench->src,
+                           bench->dst, &rotated_area);
     }
-    if (keys->key_t != prev_keys->key_t) {
-        key_to_state(keys->key_t, 84);
+}
+
+void lvgl_flush_benchmark(uint32_t strips) {
+    static const lv_display_rotation_t rotations[] = {
+        LV_DISPLAY_ROTATION_90,
+        LV_DISPLAY_ROTATION_180,
+        LV_DISPLAY_ROTATION_270,
+    };
+    size_t size = lvgl_strip_size(&lvgl_config);
+    uint8_t* src = heap_caps_malloc(size, lvgl_config.draw_buffer_caps);
+    uint8_t* dst = heap_caps_malloc(size, lvgl_config.rotation_buffer_caps);
+    if (src == NULL || dst == NULL) {
+        ESP_LOGW(TAG, "Flush benchmark: no memory for the strip buffers");
+        heap_caps_free(src);
+        heap_caps_free(dst);
+        return;
     }
-    if (keys->key_u != prev_keys->key_u) {
-        key_to_state(keys->key_u, 85);
+    for (size_t i = 0; i < size; i++) {
+        src[i] = i * 7;
     }
-    if (keys->key_v != prev_keys->key_v) {
-        key_to_state(keys->key_v, 86);
+
+    for (size_t r = 0; r < sizeof(rotations) / sizeof(rotations[0]); r++) {
+        bool swap = rotations[r] == LV_DISPLAY_ROTATION_90 || rotations[r] == LV_DISPLAY_ROTATION_270;
+        flush_bench_t bench = {
+            .rotation = rotations[r],
+            .disp_w = swap ? panel_vres : panel_hres,
+            .disp_h = swap ? panel_hres : panel_vres,
+            .src = src,
+            .dst = dst,
+        };
+        // As many rows as LVGL renders into a draw buffer of this size
+        bench.rows = size / lv_draw_buf_width_to_stride(bench.disp_w, LV_COLOR_FORMAT_RGB565);
+        if (bench.rows > bench.disp_h) {
+            bench.rows = bench.disp_h;
+        }
+        char name[24];
+        snprintf(name, sizeof(name), "flush_prepare_%d", rotations[r] * 90);
+        bench_run(name, lvgl_flush_bench_body, &bench, strips, 15, NULL);
     }
-    if (keys->key_w != prev_keys->key_w) {
-        key_to_state(keys->key_w, 87);
+    heap_caps_free(src);
+    heap_caps_free(dst);
+}
+
+typedef struct {
+    void (*change)(void* ctx);
+    void* ctx;
+} refresh_bench_t;
+
+static void lvgl_refresh_bench_body(void* ctx, uint32_t ops) {
+    refresh_bench_t* bench = ctx;
+    lvgl_lock();
+    for (uint32_t i = 0; i < ops; i++) {
+        if (bench->change != NULL) {
+            bench->change(bench->ctx);
+        } else {
+            lv_obj_invalidate(lv_screen_active());
+        }
+        lv_refr_now(lvgl_display);
     }
-    if (keys->key_x != prev_keys->key_x) {
-        key_to_state(keys->key_x, 88);
+    // A frame is only done once its last strip reached the panel
+    if (lvgl_config.mode == LVGL_DISPLAY_MODE_PARTIAL) {
+        lvgl_wait_transfers();
+        lvgl_release_transfers();
     }
-    if (keys->key_y != prev_keys->key_y) {
-        key_to_state(keys->key_y, 89);
+    lvgl_unlock();
+}
+
+void lvgl_refresh_benchmark(const char* name, void (*change)(void* ctx), void* ctx, uint32_t frames) {
+    refresh_bench_t bench = {
+        .change = change,
+        .ctx = ctx,
+    };
+    bench_run(name, lvgl_refresh_bench_body, &bench, frames, 9, NULL);
+}
+
+// Gives the default theme a cached copy of the default font, so every screen created afterwards renders its text
+// through the cache, and fills the cache with all printable ASCII characters, which covers the texts of the UI
+static void lvgl_init_glyph_cache(lv_display_t* display, size_t size) {
+    if (size == 0 || glyph_cache_init(size) != ESP_OK) {
+        return;
     }
-    if (keys->key_z != prev_keys->key_z) {
-        key_to_state(keys->key_z, 90);
+    const lv_font_t* font = glyph_cache_font(LV_FONT_DEFAULT);
+    lv_theme_t* theme = lv_theme_default_init(display, lv_palette_main(LV_PALETTE_BLUE),
+                                              lv_palette_main(LV_PALETTE_RED), LV_THEME_DEFAULT_DARK, font);
+    lv_display_set_theme(display, theme);
+    // The layers were created with the previous theme
+    lv_theme_apply(lv_display_get_layer_top(display));
+
+    char charset[0x7F - 0x20 + 1];
+    for (int c = 0x20; c < 0x7F; c++) {
+        charset[c - 0x20] = c;
     }
+    charset[sizeof(charset) - 1] = '\0';
+    glyph_cache_prewarm(font, charset);
 }
 
-void lvgl_init(int32_t hres, int32_t vres, esp_lcd_panel_handle_t mipi_dpi_panel) {
+void lvgl_init(int32_t hres, int32_t vres, esp_lcd_panel_handle_t mipi_dpi_panel, const lvgl_config_t* config) {
     lv_init();
 
     lv_display_t* display = lv_display_create(hres, vres);
+    lvgl_display = display;
+    lvgl_config = *config;
+    panel_hres = hres;
+    panel_vres = vres;
 
     lv_display_set_user_data(display, mipi_dpi_panel);
     lv_display_set_color_format(display, LV_COLOR_FORMAT_RGB565);
-
-    void* buf1 = NULL;
-    void* buf2 = NULL;
-
-    size_t draw_buffer_sz = hres * (vres / 10) * sizeof(lv_color_t);
-    buf1 = heap_caps_malloc(draw_buffer_sz, MALLOC_CAP_SPIRAM);
-    assert(buf1);
-    buf2 = heap_caps_malloc(draw_buffer_sz, MALLOC_CAP_SPIRAM);
-    assert(buf2);
-    rotation_buffer = heap_caps_malloc(draw_buffer_sz, MALLOC_CAP_SPIRAM);
-    assert(rotation_buffer);
-
-    lv_display_set_buffers(display, buf1, buf2, draw_buffer_sz, LV_DISPLAY_RENDER_MODE_PARTIAL);
-    // Set the callback which can copy the rendered image to an area of the display
-    lv_display_set_flush_cb(display, lvgl_flush_cb);
+    // The rotation has to be known before the buffers are set, full-screen buffers use the rotated resolution
     lv_display_set_rotation(display, LV_DISPLAY_ROTATION_270);
 
-    esp_lcd_dpi_panel_event_callbacks_t cbs = {
-        .on_color_trans_done = notify_lvgl_flush_ready,
-    };
-
-    ESP_ERROR_CHECK(esp_lcd_dpi_panel_register_event_callbacks(mipi_dpi_panel, &cbs, display));
+    if (lvgl_config.mode == LVGL_DISPLAY_MODE_DIRECT) {
+        esp_err_t res = lvgl_init_direct(display, mipi_dpi_panel, config);
+        if (res != ESP_OK) {
+            ESP_LOGW(TAG, "Direct mode unavailable (%s), falling back to partial mode", esp_err_to_name(res));
+            lvgl_config.mode = LVGL_DISPLAY_MODE_PARTIAL;
+        }
+    }
 
-    const esp_timer_create_args_t lvgl_tick_timer_args = {.callback = &increase_lvgl_tick, .name = "lvgl_tick"};
-    esp_timer_handle_t lvgl_tick_timer = NULL;
-    ESP_ERROR_CHECK(esp_timer_create(&lvgl_tick_timer_args, &lvgl_tick_timer));
-    ESP_ERROR_CHECK(esp_timer_start_periodic(lvgl_tick_timer, LVGL_TICK_PERIOD_MS * 1000));
+    if (lvgl_config.mode == LVGL_DISPLAY_MODE_PARTIAL) {
+        lvgl_init_partial(display, mipi_dpi_panel, config);
+    }
 
-    ESP_LOGI(TAG, "Create LVGL task");
-    xTaskCreate(lvgl_port_task, "LVGL", EXAMPLE_LVGL_TASK_STACK_SIZE, NULL, EXAMPLE_LVGL_TASK_PRIORITY, NULL);
+    lv_tick_set_cb(lvgl_tick_get_cb);
+    lvgl_init_glyph_cache(display, config->glyph_cache_size);
 
     // Set up keyboard input
-    key_queue = xQueueCreate(20, sizeof(key_event_t));
+    key_ring_init(&key_ring);
+    keymap_init(&keyboard_keymap);
+    keyboard_lock = xSemaphoreCreateMutex();
+    latency_tracker_reset(&latency_tracker);
+    lvgl_profile_init(display);
 
     lv_indev_t* indev = lv_indev_create();
     lv_indev_set_type(indev, LV_INDEV_TYPE_KEYPAD);
     lv_indev_set_read_cb(indev, read_keyboard);
+    lv_indev_set_mode(indev, LV_INDEV_MODE_EVENT);
+    keyboard_indev = indev;
 
     lv_group_t* group = lv_group_create();
     lv_indev_set_group(indev, group);
     lv_group_set_default(group);
+
+    // Start the task last, LVGL must be fully set up before lv_timer_handler() runs concurrently with this function
+    ESP_LOGI(TAG, "Create LVGL task");
+    xTaskCreatePinnedToCore(lvgl_port_task, "LVGL", EXAMPLE_LVGL_TASK_STACK_SIZE, NULL, EXAMPLE_LVGL_TASK_PRIORITY,
+                            &lvgl_task, EXAMPLE_LVGL_TASK_CORE);
 }
@@ -1,9 +1,83 @@
+#pragma once
+
+#include <stddef.h>
+#include <stdint.h>
 #include "esp_lcd_types.h"
 #include "tanmatsu_coprocessor.h"
 
+typedef enum {
+    // LVGL renders strips into two draw buffers which are rotated and copied into the panel
+    LVGL_DISPLAY_MODE_PARTIAL,
+    // LVGL renders the whole screen into one buffer and only redrawn areas are rotated into the panel's frame buffer
+    LVGL_DISPLAY_MODE_DIRECT,
+} lvgl_display_mode_t;
+
+typedef struct {
+    lvgl_display_mode_t mode;
+    // Rows of the rotated display rendered per strip in partial mode, 0 keeps the default of a tenth of the screen
+    int32_t strip_height;
+    // heap_caps_malloc() capabilities for the buffers LVGL renders into and for the rotation buffers
+    uint32_t draw_buffer_caps;
+    uint32_t rotation_buffer_caps;
+    // PSRAM budget of the glyph cache the UI's font renders through, 0 renders without it
+    size_t glyph_cache_size;
+} lvgl_config_t;
+
+// Per-stage timing of the flush pipeline, accumulated since the last reset
+typedef struct {
+    uint32_t flushes;             // Areas handed to the flush callback by LVGL
+    uint32_t transfers;           // Writes to the panel after merging areas
+    uint32_t overlapped;          // Strips rotated while an earlier strip was still being transferred
+    uint64_t pixels_invalidated;  // Pixels in the areas handed to the flush callback
+    uint64_t pixels;              // Pixels rotated and pushed to the panel
+    uint64_t wait_us;             // Time spent waiting for a free rotation buffer
+    uint64_t rotate_us;           // Time spent rotating
+    uint64_t transfer_us;         // Time from draw_bitmap until the transfer done event
+    uint32_t wait_max_us;
+    uint32_t rotate_max_us;
+    uint32_t transfer_max_us;
+} lvgl_flush_stats_t;
+
+// Activity of the LVGL task, accumulated since the last reset. Compare wakeups per second of an idle UI against
+// the 500 per second the periodic tick timer used to add.
+typedef struct {
+    uint32_t wakeups;        // Iterations of the LVGL task loop
+    uint32_t timer_wakeups;  // Wakeups because an LVGL timer was due
+    uint32_t input_wakeups;  // Wakeups caused by key events
+    uint32_t flush_wakeups;  // Wakeups caused by the panel taking over a frame in direct mode
+    uint32_t api_wakeups;    // Wakeups caused by other tasks using the LVGL API
+    uint64_t busy_us;        // Time spent reading input and in lv_timer_handler()
+} lvgl_task_stats_t;
+
 void lvgl_lock();
 void lvgl_unlock();
 
-void lvgl_init(int32_t hres, int32_t vres, esp_lcd_panel_handle_t mipi_dpi_panel);
+void lvgl_init(int32_t hres, int32_t vres, esp_lcd_panel_handle_t mipi_dpi_panel, const lvgl_config_t* config);
+// Renders a fixed scene with every combination of buffer placement and strip height and logs frame time and memory
+void lvgl_buffer_sweep(int frames);
+// Fully redraws the active screen and a fixed scene and logs the frame time for the configured draw unit count
+void lvgl_render_benchmark(int frames);
+// Benchmarks the rotation and area mapping of lvgl_flush_cb at 90, 180 and 270 degrees on strips of the configured
+// size, without the panel transfer, reported per strip as flush_prepare_<degrees>
+void lvgl_flush_benchmark(uint32_t strips);
+// Benchmarks the refresh of the active screen, per frame. change is called with the LVGL lock held before every frame
+// and should modify the screen, NULL invalidates all of it.
+void lvgl_refresh_benchmark(const char* name, void (*change)(void* ctx), void* ctx, uint32_t frames);
+void lvgl_get_flush_stats(lvgl_flush_stats_t* stats, bool reset);
+void lvgl_get_task_stats(lvgl_task_stats_t* stats, bool reset);
+// Logs the LVGL task's wakeups per second and busy time over the given period
+void lvgl_idle_report(int seconds);
+// Key events dropped because the key ring was full
+uint32_t lvgl_get_dropped_keys();
+// Prints the input-to-photon latency histograms of the key events seen so far to the serial console
+void lvgl_latency_print(bool reset);
+// Queues alternating focus key events with made-up interrupt times at the given interval, then prints the latencies
+void lvgl_latency_synthetic(int events, uint32_t interval_ms);
+// Prints min/avg/p99 of handler, render, rotate and flush wait time over the recent frames to the serial console
+void lvgl_profile_print(bool reset);
+// Shows or hides the frame time overlay, the F6 key does the same
+void lvgl_profile_toggle_overlay();
+// Waits until the first frame was handed to the panel and returns its esp_timer time, false on timeout
+bool lvgl_wait_first_frame(uint32_t timeout_ms, int64_t* frame_us);
 void coprocessor_keyboard_callback(tanmatsu_coprocessor_handle_t handle, tanmatsu_coprocessor_keys_t* prev_keys,
                                    tanmatsu_coprocessor_keys_t* keys);
\ No newline at end of file
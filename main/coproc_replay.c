@@ -0,0 +1,238 @@
+#include "coproc_replay.h"
+#include <errno.h>
+#include <inttypes.h>
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "coproc_trace.h"
+#include "esp_err.h"
+#include "esp_heap_caps.h"
+#include "esp_log.h"
+#include "esp_timer.h"
+#include "freertos/FreeRTOS.h"
+#include "freertos/task.h"
+#include "pmic_snapshot.h"
+#include "tanmatsu_coprocessor.h"
+
+static char const TAG[] = "coproc-replay";
+
+#define REPLAY_TASK_STACK_SIZE 4096
+// Above the telemetry task, events are due at fixed times
+#define REPLAY_TASK_PRIORITY   2
+
+static uint8_t* trace = NULL;
+static size_t trace_size = 0;
+static tanmatsu_coprocessor_handle_t replay_handle = NULL;
+static volatile bool running = false;
+
+static portMUX_TYPE pmic_lock = portMUX_INITIALIZER_UNLOCKED;
+static pmic_snapshot_t replay_pmic;
+static bool replay_pmic_ok = false;
+static bool replay_pmic_valid = false;
+
+static uint32_t events_played = 0;
+static uint32_t rounds_played = 0;
+static uint32_t calls_skipped = 0;
+static int64_t off_total_us = 0;
+static int64_t off_max_us = 0;
+
+// Like the encoder, but stops at the end of the trace. Returns 0 for a truncated value.
+static size_t get_varint(const uint8_t* in, size_t available, uint32_t* value) {
+    uint32_t result = 0;
+    for (size_t length = 0; length < available && length < 5; length++) {
+        result |= (uint32_t)(in[length] & 0x7F) << (7 * length);
+        if (!(in[length] & 0x80)) {
+            *value = result;
+            return length + 1;
+        }
+    }
+    return 0;
+}
+
+// Payload length of the record at data, 0 when it is cut off or of an unknown type
+static size_t payload_length(uint8_t type, const uint8_t* data, size_t available) {
+    uint32_t value;
+    size_t length;
+    switch (type) {
+        case COPROC_TRACE_KEYS:
+            length = sizeof(((tanmatsu_coprocessor_keys_t*)NULL)->raw);
+            break;
+        case COPROC_TRACE_INPUTS:
+            length = sizeof(((tanmatsu_coprocessor_inputs_t*)NULL)->raw);
+            break;
+        case COPROC_TRACE_CALL: {
+            size_t duration = available > 3 ? get_varint(&data[3], available - 3, &value) : 0;
+            size_t result = duration > 0 ? get_varint(&data[3 + duration], available - 3 - duration, &value) : 0;
+            length = result > 0 ? 3 + duration + result : 0;
+            break;
+        }
+        case COPROC_TRACE_PMIC: {
+            size_t metrics = get_varint(data, available, &value);
+            length = metrics > 0 ? metrics + 1 + PMIC_SNAPSHOT_BLOCK_SIZE : 0;
+            break;
+        }
+        default:
+            length = 0;
+            break;
+    }
+    return length <= available ? length : 0;
+}
+
+// Waits for the tick closest to due_us and accounts how far off that was. A delay can end up to a tick early,
+// it counts from the current tick.
+static void wait_until(int64_t due_us) {
+    int64_t wait_us = due_us - esp_timer_get_time();
+    TickType_t ticks = wait_us > 0 ? pdMS_TO_TICKS((wait_us + 500) / 1000) : 0;
+    if (ticks > 0) {
+        vTaskDelay(ticks);
+    }
+    int64_t off_us = llabs(esp_timer_get_time() - due_us);
+    off_total_us += off_us;
+    if (off_us > off_max_us) {
+        off_max_us = off_us;
+    }
+}
+
+static void play(uint8_t type, const uint8_t* payload, tanmatsu_coprocessor_keys_t* keys,
+                 tanmatsu_coprocessor_inputs_t* inputs) {
+    switch (type) {
+        case COPROC_TRACE_KEYS: {
+            tanmatsu_coprocessor_keys_t prev_keys = *keys;
+            memcpy(keys->raw, payload, sizeof(keys->raw));
+            coproc_trace_keyboard_callback(replay_handle, &prev_keys, keys);
+            events_played++;
+            break;
+        }
+        case COPROC_TRACE_INPUTS: {
+            tanmatsu_coprocessor_inputs_t prev_inputs = *inputs;
+            memcpy(inputs->raw, payload, sizeof(inputs->raw));
+            coproc_trace_input_callback(replay_handle, &prev_inputs, inputs);
+            events_played++;
+            break;
+        }
+        case COPROC_TRACE_PMIC: {
+            uint32_t metrics;
+            size_t length = get_varint(payload, 5, &metrics);
+            pmic_snapshot_t pmic;
+            pmic_snapshot_decode(&payload[length + 1], &pmic);
+            portENTER_CRITICAL(&pmic_lock);
+            replay_pmic = pmic;
+            replay_pmic_ok = payload[length];
+            replay_pmic_valid = true;
+            portEXIT_CRITICAL(&pmic_lock);
+            rounds_played++;
+            break;
+        }
+        default:
+            calls_skipped++;
+            break;
+    }
+}
+
+static void replay_task(void* arg) {
+    tanmatsu_coprocessor_keys_t keys = {0};
+    tanmatsu_coprocessor_inputs_t inputs = {0};
+    int64_t start_us = esp_timer_get_time();
+    int64_t record_us = 0;
+    size_t offset = COPROC_TRACE_HEADER_SIZE;
+
+    while (offset < trace_size) {
+        uint8_t type = trace[offset];
+        uint32_t delta_us;
+        size_t time_length = get_varint(&trace[offset + 1], trace_size - offset - 1, &delta_us);
+        size_t header_length = 1 + time_length;
+        size_t length = time_length > 0 ? payload_length(type, &trace[offset + header_length],
+                                                         trace_size - offset - header_length)
+                                        : 0;
+        if (length == 0) {
+            ESP_LOGW(TAG, "Damaged record at offset %u, stopping", (unsigned)offset);
+            break;
+        }
+        record_us += delta_us;
+        // Calls only carry timing, they are not waited for
+        if (type != COPROC_TRACE_CALL) {
+            wait_until(start_us + record_us);
+        }
+        play(type, &trace[offset + header_length], &keys, &inputs);
+        offset += header_length + length;
+    }
+
+    ESP_LOGI(TAG, "Replay finished after %" PRId64 " ms", (esp_timer_get_time() - start_us) / 1000);
+    running = false;
+    vTaskDelete(NULL);
+}
+
+esp_err_t coproc_replay_start(const char* path, tanmatsu_coprocessor_handle_t handle) {
+    if (running) {
+        return ESP_ERR_INVALID_STATE;
+    }
+    FILE* file = fopen(path, "rb");
+    if (file == NULL) {
+        ESP_LOGE(TAG, "Failed to open %s: %s", path, strerror(errno));
+        return ESP_ERR_NOT_FOUND;
+    }
+    fseek(file, 0, SEEK_END);
+    long size = ftell(file);
+    fseek(file, 0, SEEK_SET);
+
+    heap_caps_free(trace);
+    trace = size >= COPROC_TRACE_HEADER_SIZE ? heap_caps_malloc(size, MALLOC_CAP_SPIRAM) : NULL;
+    if (size >= COPROC_TRACE_HEADER_SIZE && trace == NULL) {
+        fclose(file);
+        return ESP_ERR_NO_MEM;
+    }
+    bool ok = trace != NULL && fread(trace, 1, size, file) == (size_t)size;
+    fclose(file);
+    uint32_t magic = ok ? trace[0] | trace[1] << 8 | trace[2] << 16 | (uint32_t)trace[3] << 24 : 0;
+    if (magic != COPROC_TRACE_MAGIC || trace[4] != COPROC_TRACE_VERSION) {
+        ESP_LOGE(TAG, "%s is not a coprocessor trace of version %d", path, COPROC_TRACE_VERSION);
+        heap_caps_free(trace);
+        trace = NULL;
+        return ESP_ERR_INVALID_VERSION;
+    }
+    trace_size = size;
+    replay_handle = handle;
+
+    replay_pmic_valid = false;
+    events_played = 0;
+    rounds_played = 0;
+    calls_skipped = 0;
+    off_total_us = 0;
+    off_max_us = 0;
+    running = true;
+    if (xTaskCreate(replay_task, "coproc-replay", REPLAY_TASK_STACK_SIZE, NULL, REPLAY_TASK_PRIORITY, NULL) != pdPASS) {
+        running = false;
+        return ESP_ERR_NO_MEM;
+    }
+    ESP_LOGI(TAG, "Replaying %ld bytes of trace from %s", size, path);
+    return ESP_OK;
+}
+
+bool coproc_replay_running() {
+    return running;
+}
+
+bool coproc_replay_pmic(pmic_snapshot_t* pmic, bool* ok) {
+    if (!running) {
+        return false;
+    }
+    portENTER_CRITICAL(&pmic_lock);
+    bool valid = replay_pmic_valid;
+    *pmic = replay_pmic;
+    *ok = replay_pmic_ok;
+    portEXIT_CRITICAL(&pmic_lock);
+    return valid;
+}
+
+void coproc_replay_print_stats() {
+    uint32_t waited = events_played + rounds_played;
+    printf("Coprocessor replay: %s, %" PRIu32 " events, %" PRIu32 " telemetry rounds, %" PRIu32 " calls skipped\r\n",
+           running ? "running" : "stopped", events_played, rounds_played, calls_skipped);
+    if (waited > 0) {
+        printf("Delivered %" PRId64 " us off the recorded time on average, %" PRId64 " us at most\r\n",
+               off_total_us / waited, off_max_us);
+    }
+}
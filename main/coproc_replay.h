@@ -0,0 +1,26 @@
+#pragma once
+
+#include <stdbool.h>
+#include "esp_err.h"
+#include "pmic_snapshot.h"
+#include "tanmatsu_coprocessor.h"
+
+// Plays a trace written by coproc_trace_save() back into the firmware. Keyboard and input events go to the trace
+// callbacks, and from there to the firmware's handlers, in their recorded order and within a tick of their recorded
+// time. The driver's own events have to be dropped meanwhile, main.c does that in its driver callbacks.
+// The PMIC state of the recorded telemetry rounds replaces what telemetry reads, so the UI sees the same values in
+// the same order on every run. Recorded driver calls are not repeated. The events are recorded again when a trace
+// is running, so a replay on two firmware versions gives two traces tools/coproc_trace.py can compare.
+
+// Loads the trace into PSRAM and starts playing it, handle is passed on to the callbacks
+esp_err_t coproc_replay_start(const char* path, tanmatsu_coprocessor_handle_t handle);
+
+// True from the start until the last record was played
+bool coproc_replay_running();
+
+// The PMIC state of the last replayed telemetry round and whether that round succeeded. Returns false when no
+// replay runs or it did not reach the first round yet.
+bool coproc_replay_pmic(pmic_snapshot_t* pmic, bool* ok);
+
+// Prints the records played so far and how far the events were off their recorded time
+void coproc_replay_print_stats();
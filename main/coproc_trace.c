@@ -0,0 +1,183 @@
+#include "coproc_trace.h"
+#include <errno.h>
+#include <inttypes.h>
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <string.h>
+#include "esp_err.h"
+#include "esp_heap_caps.h"
+#include "esp_log.h"
+#include "esp_timer.h"
+#include "freertos/FreeRTOS.h"
+#include "pmic_snapshot.h"
+#include "tanmatsu_coprocessor.h"
+
+static char const TAG[] = "coproc-trace";
+
+// Largest record: type, time and a PMIC snapshot with its varint metrics mask
+#define TRACE_MAX_RECORD_SIZE (1 + 5 + 5 + 1 + PMIC_SNAPSHOT_BLOCK_SIZE)
+
+static coproc_trace_handlers_t handlers = {0};
+
+static portMUX_TYPE trace_lock = portMUX_INITIALIZER_UNLOCKED;
+static uint8_t* buffer = NULL;
+static size_t buffer_size = 0;
+static size_t used = 0;
+static bool recording = false;
+static int64_t last_us = 0;
+static uint32_t records = 0;
+static uint32_t dropped = 0;
+
+// Calls of different tasks interleave, each keeps its own start time
+static _Thread_local int64_t call_start_us;
+
+static size_t put_varint(uint8_t* out, uint32_t value) {
+    size_t length = 0;
+    while (value >= 0x80) {
+        out[length++] = (value & 0x7F) | 0x80;
+        value >>= 7;
+    }
+    out[length++] = value;
+    return length;
+}
+
+// Appends one record. The time is taken under the lock, so the records of all tasks are in time order.
+static void append(coproc_trace_record_t type, const uint8_t* payload, size_t length) {
+    uint8_t header[6];
+    portENTER_CRITICAL(&trace_lock);
+    if (!recording) {
+        portEXIT_CRITICAL(&trace_lock);
+        return;
+    }
+    int64_t now_us = esp_timer_get_time();
+    header[0] = type;
+    size_t header_length = 1 + put_varint(&header[1], now_us - last_us);
+    if (used + header_length + length > buffer_size) {
+        recording = false;
+        dropped++;
+    } else {
+        memcpy(&buffer[used], header, header_length);
+        memcpy(&buffer[used + header_length], payload, length);
+        used += header_length + length;
+        last_us = now_us;
+        records++;
+    }
+    portEXIT_CRITICAL(&trace_lock);
+}
+
+void coproc_trace_set_handlers(const coproc_trace_handlers_t* new_handlers) {
+    handlers = *new_handlers;
+}
+
+void coproc_trace_keyboard_callback(tanmatsu_coprocessor_handle_t handle, tanmatsu_coprocessor_keys_t* prev_keys,
+                                    tanmatsu_coprocessor_keys_t* keys) {
+    append(COPROC_TRACE_KEYS, keys->raw, sizeof(keys->raw));
+    if (handlers.on_keyboard_change != NULL) {
+        handlers.on_keyboard_change(handle, prev_keys, keys);
+    }
+}
+
+void coproc_trace_input_callback(tanmatsu_coprocessor_handle_t handle, tanmatsu_coprocessor_inputs_t* prev_inputs,
+                                 tanmatsu_coprocessor_inputs_t* inputs) {
+    append(COPROC_TRACE_INPUTS, inputs->raw, sizeof(inputs->raw));
+    if (handlers.on_input_change != NULL) {
+        handlers.on_input_change(handle, prev_inputs, inputs);
+    }
+}
+
+esp_err_t coproc_trace_start(size_t size) {
+    if (buffer == NULL) {
+        // Callers never write while there is no buffer, recording is still off
+        uint8_t* allocated = heap_caps_malloc(size, MALLOC_CAP_SPIRAM);
+        if (allocated == NULL) {
+            return ESP_ERR_NO_MEM;
+        }
+        buffer = allocated;
+        buffer_size = size;
+    }
+    portENTER_CRITICAL(&trace_lock);
+    used = 0;
+    records = 0;
+    dropped = 0;
+    last_us = esp_timer_get_time();
+    recording = true;
+    portEXIT_CRITICAL(&trace_lock);
+    ESP_LOGI(TAG, "Recording into %u bytes", (unsigned)buffer_size);
+    return ESP_OK;
+}
+
+void coproc_trace_stop() {
+    portENTER_CRITICAL(&trace_lock);
+    recording = false;
+    portEXIT_CRITICAL(&trace_lock);
+}
+
+esp_err_t coproc_trace_save(const char* path) {
+    if (buffer == NULL) {
+        return ESP_ERR_INVALID_STATE;
+    }
+    // Records are only ever appended, everything up to the length read here is complete
+    portENTER_CRITICAL(&trace_lock);
+    size_t length = used;
+    portEXIT_CRITICAL(&trace_lock);
+
+    FILE* file = fopen(path, "wb");
+    if (file == NULL) {
+        ESP_LOGE(TAG, "Failed to create %s: %s", path, strerror(errno));
+        return ESP_FAIL;
+    }
+    const uint8_t header[COPROC_TRACE_HEADER_SIZE] = {
+        COPROC_TRACE_MAGIC & 0xFF, (COPROC_TRACE_MAGIC >> 8) & 0xFF, (COPROC_TRACE_MAGIC >> 16) & 0xFF,
+        COPROC_TRACE_MAGIC >> 24,  COPROC_TRACE_VERSION,
+    };
+    bool ok = fwrite(header, 1, sizeof(header), file) == sizeof(header) && fwrite(buffer, 1, length, file) == length;
+    ok &= fclose(file) == 0;
+    if (!ok) {
+        ESP_LOGE(TAG, "Failed to write %s: %s", path, strerror(errno));
+        return ESP_FAIL;
+    }
+    ESP_LOGI(TAG, "Saved %u bytes of trace to %s", (unsigned)(length + sizeof(header)), path);
+    return ESP_OK;
+}
+
+void coproc_trace_print_status() {
+    portENTER_CRITICAL(&trace_lock);
+    bool active = recording;
+    size_t length = used;
+    uint32_t count = records;
+    uint32_t lost = dropped;
+    portEXIT_CRITICAL(&trace_lock);
+    printf("Coprocessor trace: %s, %" PRIu32 " records in %u of %u bytes%s\r\n", active ? "recording" : "stopped",
+           count, (unsigned)length, (unsigned)buffer_size, lost ? ", stopped because it was full" : "");
+}
+
+void coproc_trace_begin() {
+    call_start_us = esp_timer_get_time();
+}
+
+esp_err_t coproc_trace_end(coproc_op_t op, uint8_t arg0, uint8_t arg1, esp_err_t result) {
+    if (!recording) {
+        return result;
+    }
+    uint8_t payload[3 + 5 + 5];
+    payload[0] = op;
+    payload[1] = arg0;
+    payload[2] = arg1;
+    size_t length = 3 + put_varint(&payload[3], esp_timer_get_time() - call_start_us);
+    length += put_varint(&payload[length], (uint32_t)result);
+    append(COPROC_TRACE_CALL, payload, length);
+    return result;
+}
+
+void coproc_trace_pmic(uint32_t metrics, bool ok, const pmic_snapshot_t* pmic) {
+    if (!recording) {
+        return;
+    }
+    uint8_t payload[TRACE_MAX_RECORD_SIZE];
+    size_t length = put_varint(payload, metrics);
+    payload[length++] = ok;
+    pmic_snapshot_encode(pmic, &payload[length]);
+    append(COPROC_TRACE_PMIC, payload, length + PMIC_SNAPSHOT_BLOCK_SIZE);
+}
@@ -0,0 +1,82 @@
+#pragma once
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+#include "esp_err.h"
+#include "pmic_snapshot.h"
+#include "tanmatsu_coprocessor.h"
+
+// Trace of the traffic with the coprocessor, for reproducing what a device saw in the field: every driver call with
+// its duration and result, every keyboard and input event, and the PMIC state of every telemetry round. Records are
+// appended to a RAM buffer, coproc_replay.h plays a saved trace back and tools/coproc_trace.py dumps and compares
+// traces.
+//
+// File layout: the header, then records. Every record starts with its type and the time since the previous record in
+// us as a varint, followed by the payload of the type:
+#define COPROC_TRACE_MAGIC       0x43525443  // "CTRC", little endian
+#define COPROC_TRACE_VERSION     1
+#define COPROC_TRACE_HEADER_SIZE 8  // Magic (4), version (1), reserved (3)
+
+typedef enum {
+    COPROC_TRACE_KEYS = 1,  // The key bitmap after the change, 9 bytes
+    COPROC_TRACE_INPUTS,    // The inputs after the change, 1 byte
+    COPROC_TRACE_CALL,      // Operation, arg0 and arg1 (1 byte each), then duration in us and result as varints
+    COPROC_TRACE_PMIC,      // Metrics read as varint, 1 if the read succeeded, the snapshot as pmic_snapshot_encode()
+} coproc_trace_record_t;
+
+// Driver calls. The duration of a call includes the wait for the bus, a record is written when the call returned.
+typedef enum {
+    COPROC_OP_GET_FAULTS = 1,
+    COPROC_OP_GET_VBAT,
+    COPROC_OP_GET_VSYS,
+    COPROC_OP_GET_TS,
+    COPROC_OP_GET_VBUS,
+    COPROC_OP_GET_ICHGR,
+    COPROC_OP_GET_COMM_FAULT,
+    COPROC_OP_GET_CHARGING_CONTROL,
+    COPROC_OP_GET_CHARGING_STATUS,
+    COPROC_OP_GET_REAL_TIME,
+    COPROC_OP_SET_ADC_CONTROL,       // arg0: trigger, arg1: continuous
+    COPROC_OP_SET_CHARGING_CONTROL,  // arg0: disable, arg1: speed
+    COPROC_OP_SET_OTG_CONTROL,       // arg0: enable
+    COPROC_OP_SET_BACKLIGHT,         // arg0: brightness
+    COPROC_OP_RADIO,                 // arg0: 0 disabled, 1 application, 2 bootloader
+    COPROC_OP_READ_REGISTERS,        // Register block read without the driver, arg0: register, arg1: length. No longer
+                                     // recorded, the number stays taken for older traces.
+} coproc_op_t;
+
+// Evaluates call, usually an I2C_SCHED_CALL, records it as op with the two arguments and evaluates to its result
+#define COPROC_TRACE_CALL(op, arg0, arg1, call) (coproc_trace_begin(), coproc_trace_end(op, arg0, arg1, (call)))
+
+// The firmware's handlers, the callbacks below record each event and then pass it on
+typedef struct {
+    void (*on_keyboard_change)(tanmatsu_coprocessor_handle_t handle, tanmatsu_coprocessor_keys_t* prev_keys,
+                               tanmatsu_coprocessor_keys_t* keys);
+    void (*on_input_change)(tanmatsu_coprocessor_handle_t handle, tanmatsu_coprocessor_inputs_t* prev_inputs,
+                            tanmatsu_coprocessor_inputs_t* inputs);
+} coproc_trace_handlers_t;
+
+void coproc_trace_set_handlers(const coproc_trace_handlers_t* handlers);
+
+// To be given to the driver as its callbacks
+void coproc_trace_keyboard_callback(tanmatsu_coprocessor_handle_t handle, tanmatsu_coprocessor_keys_t* prev_keys,
+                                    tanmatsu_coprocessor_keys_t* keys);
+void coproc_trace_input_callback(tanmatsu_coprocessor_handle_t handle, tanmatsu_coprocessor_inputs_t* prev_inputs,
+                                 tanmatsu_coprocessor_inputs_t* inputs);
+
+// Starts a new trace in a PSRAM buffer of the given size, allocated on first use. Recording stops by itself when the
+// buffer is full.
+esp_err_t coproc_trace_start(size_t size);
+void coproc_trace_stop();
+
+// Writes the header and the records so far to a file, recording goes on
+esp_err_t coproc_trace_save(const char* path);
+
+void coproc_trace_print_status();
+
+void coproc_trace_begin();
+esp_err_t coproc_trace_end(coproc_op_t op, uint8_t arg0, uint8_t arg1, esp_err_t result);
+
+// The state one telemetry round read, metrics is the telemetry_metric_t mask of the values it asked for
+void coproc_trace_pmic(uint32_t metrics, bool ok, const pmic_snapshot_t* pmic);
@@ -0,0 +1,26 @@
+#include "fake_coprocessor.h"
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+#include <string.h>
+
+void fake_coprocessor_init(fake_coprocessor_t* fake, uint32_t bus_hz, uint32_t overhead_us) {
+    memset(fake, 0, sizeof(*fake));
+    fake->bus_hz = bus_hz;
+    fake->overhead_us = overhead_us;
+}
+
+bool fake_coprocessor_read(void* ctx, uint8_t reg, uint8_t* data, size_t length) {
+    fake_coprocessor_t* fake = ctx;
+    if (reg + length > sizeof(fake->registers)) {
+        return false;
+    }
+    memcpy(data, &fake->registers[reg], length);
+
+    // Start, address and register byte, repeated start and address, the data bytes and a stop. Every byte takes
+    // nine clocks including its acknowledge.
+    uint32_t bits = 1 + 9 + 9 + 1 + 9 + 9 * length + 1;
+    fake->transactions++;
+    fake->bus_ns += (uint64_t)bits * 1000000000 / fake->bus_hz + fake->overhead_us * 1000;
+    return true;
+}
@@ -0,0 +1,21 @@
+#pragma once
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+// Stand-in for the coprocessor's I2C register interface. It serves reads from a plain register array and models the
+// bus time every transaction would take, so bus traffic can be simulated without the hardware.
+typedef struct {
+    uint8_t registers[256];
+    uint32_t bus_hz;
+    uint32_t overhead_us;  // Fixed cost per transaction: driver, bus arbitration and the concurrency semaphore
+    uint32_t transactions;
+    uint64_t bus_ns;
+} fake_coprocessor_t;
+
+void fake_coprocessor_init(fake_coprocessor_t* fake, uint32_t bus_hz, uint32_t overhead_us);
+
+// Reads length registers starting at reg in one transaction, ctx is the fake_coprocessor_t. Returns false for a read
+// past the register file.
+bool fake_coprocessor_read(void* ctx, uint8_t reg, uint8_t* data, size_t length);
@@ -0,0 +1,88 @@
+#include "flush_batch.h"
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+static inline int32_t area_size(const lv_area_t* a) {
+    return (a->x2 - a->x1 + 1) * (a->y2 - a->y1 + 1);
+}
+
+static inline void area_union(const lv_area_t* a, const lv_area_t* b, lv_area_t* out) {
+    out->x1 = a->x1 < b->x1 ? a->x1 : b->x1;
+    out->y1 = a->y1 < b->y1 ? a->y1 : b->y1;
+    out->x2 = a->x2 > b->x2 ? a->x2 : b->x2;
+    out->y2 = a->y2 > b->y2 ? a->y2 : b->y2;
+}
+
+static inline int32_t area_overlap(const lv_area_t* a, const lv_area_t* b) {
+    int32_t x1 = a->x1 > b->x1 ? a->x1 : b->x1;
+    int32_t y1 = a->y1 > b->y1 ? a->y1 : b->y1;
+    int32_t x2 = a->x2 < b->x2 ? a->x2 : b->x2;
+    int32_t y2 = a->y2 < b->y2 ? a->y2 : b->y2;
+    if (x1 > x2 || y1 > y2) {
+        return 0;
+    }
+    return (x2 - x1 + 1) * (y2 - y1 + 1);
+}
+
+// Extra pixels that merging a and b would push compared to keeping them apart, minus the saved transfer
+static inline int32_t merge_cost(const lv_area_t* a, const lv_area_t* b, lv_area_t* merged) {
+    area_union(a, b, merged);
+    int32_t separate = area_size(a) + area_size(b) - area_overlap(a, b) + FLUSH_BATCH_TRANSFER_COST_PX;
+    return area_size(merged) - separate;
+}
+
+void flush_batch_clear(flush_batch_t* batch) {
+    batch->count = 0;
+}
+
+void flush_batch_add(flush_batch_t* batch, const lv_area_t* area) {
+    if (batch->count < FLUSH_BATCH_MAX_AREAS) {
+        batch->areas[batch->count++] = *area;
+        return;
+    }
+
+    size_t best = 0;
+    int32_t best_growth = INT32_MAX;
+    lv_area_t best_merged = {0};
+    for (size_t i = 0; i < batch->count; i++) {
+        lv_area_t merged;
+        area_union(&batch->areas[i], area, &merged);
+        int32_t growth = area_size(&merged) - area_size(&batch->areas[i]);
+        if (growth < best_growth) {
+            best = i;
+            best_growth = growth;
+            best_merged = merged;
+        }
+    }
+    batch->areas[best] = best_merged;
+}
+
+size_t flush_batch_merge(flush_batch_t* batch) {
+    bool merged_any = true;
+    while (merged_any && batch->count > 1) {
+        merged_any = false;
+        for (size_t i = 0; i < batch->count; i++) {
+            for (size_t j = i + 1; j < batch->count; j++) {
+                lv_area_t merged;
+                if (merge_cost(&batch->areas[i], &batch->areas[j], &merged) <= 0) {
+                    batch->areas[i] = merged;
+                    batch->areas[j] = batch->areas[--batch->count];
+                    merged_any = true;
+                    // Rescan from i + 1: the grown area may now pay off against areas it was compared with before, and
+                    // slot j holds what was the last area
+                    j = i;
+                }
+            }
+        }
+    }
+    return batch->count;
+}
+
+uint32_t flush_batch_pixels(const flush_batch_t* batch) {
+    uint32_t pixels = 0;
+    for (size_t i = 0; i < batch->count; i++) {
+        pixels += area_size(&batch->areas[i]);
+    }
+    return pixels;
+}
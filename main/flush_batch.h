@@ -0,0 +1,28 @@
+#pragma once
+
+#include <stddef.h>
+#include <stdint.h>
+#include "misc/lv_area.h"
+
+// Upper bound on the areas collected during one refresh cycle, matches LVGL's default LV_INV_BUF_SIZE
+#define FLUSH_BATCH_MAX_AREAS 32
+
+// Fixed cost of a single panel transfer expressed in pixels. Two areas are merged when pushing the pixels of their
+// bounding box costs less than pushing both separately plus this overhead.
+#define FLUSH_BATCH_TRANSFER_COST_PX 2048
+
+typedef struct {
+    lv_area_t areas[FLUSH_BATCH_MAX_AREAS];
+    size_t count;
+} flush_batch_t;
+
+void flush_batch_clear(flush_batch_t* batch);
+
+// Collects an area. When the batch is full the area is merged into the area whose bounding box grows the least.
+void flush_batch_add(flush_batch_t* batch, const lv_area_t* area);
+
+// Merges overlapping and nearby areas while that lowers the total cost, returns the resulting number of areas
+size_t flush_batch_merge(flush_batch_t* batch);
+
+// Sum of the pixels in the current areas, after merging this is the number of pixels that will be pushed
+uint32_t flush_batch_pixels(const flush_batch_t* batch);
@@ -0,0 +1,71 @@
+#include "frame_profile.h"
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+static const char* const metric_names[FRAME_PROFILE_METRIC_COUNT] = {
+    [FRAME_PROFILE_HANDLER] = "handler",
+    [FRAME_PROFILE_RENDER] = "render",
+    [FRAME_PROFILE_ROTATE] = "rotate",
+    [FRAME_PROFILE_FLUSH_WAIT] = "wait",
+};
+
+static int compare_u32(const void* a, const void* b) {
+    uint32_t x = *(const uint32_t*)a;
+    uint32_t y = *(const uint32_t*)b;
+    return (x > y) - (x < y);
+}
+
+void frame_profile_reset(frame_profile_t* profile) {
+    profile->next = 0;
+    profile->count = 0;
+    profile->frames = 0;
+}
+
+void frame_profile_add(frame_profile_t* profile, const uint32_t sample[FRAME_PROFILE_METRIC_COUNT]) {
+    for (size_t m = 0; m < FRAME_PROFILE_METRIC_COUNT; m++) {
+        profile->samples[m][profile->next] = sample[m];
+    }
+    profile->next = (profile->next + 1) % FRAME_PROFILE_WINDOW;
+    if (profile->count < FRAME_PROFILE_WINDOW) {
+        profile->count++;
+    }
+    profile->frames++;
+}
+
+void frame_profile_summarize(const frame_profile_t* profile, frame_profile_metric_t metric,
+                             frame_profile_summary_t* summary) {
+    memset(summary, 0, sizeof(*summary));
+    if (profile->count == 0) {
+        return;
+    }
+
+    // The window is small, sorting a copy is cheaper than keeping an order statistic up to date for every frame
+    uint32_t sorted[FRAME_PROFILE_WINDOW];
+    uint64_t sum = 0;
+    for (size_t i = 0; i < profile->count; i++) {
+        sorted[i] = profile->samples[metric][i];
+        sum += sorted[i];
+    }
+    qsort(sorted, profile->count, sizeof(sorted[0]), compare_u32);
+
+    size_t p99 = (profile->count * 99 + 99) / 100;
+    summary->min_us = sorted[0];
+    summary->avg_us = sum / profile->count;
+    summary->p99_us = sorted[p99 - 1];
+}
+
+int frame_profile_format(const frame_profile_t* profile, char* buffer, size_t size, bool multiline) {
+    int length = snprintf(buffer, size, "%u frames", (unsigned)profile->count);
+    for (size_t m = 0; m < FRAME_PROFILE_METRIC_COUNT; m++) {
+        frame_profile_summary_t summary;
+        frame_profile_summarize(profile, m, &summary);
+        size_t used = (size_t)length < size ? (size_t)length : size;
+        length += snprintf(buffer + used, size - used, "%s%s %.2f/%.2f/%.2f", multiline ? "\n" : ", ",
+                           metric_names[m], summary.min_us / 1000.0, summary.avg_us / 1000.0, summary.p99_us / 1000.0);
+    }
+    return length;
+}
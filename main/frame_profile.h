@@ -0,0 +1,42 @@
+#pragma once
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+// Number of most recent frames the statistics are computed over
+#define FRAME_PROFILE_WINDOW 256
+
+typedef enum {
+    FRAME_PROFILE_HANDLER,     // The whole lv_timer_handler() call the frame was refreshed in
+    FRAME_PROFILE_RENDER,      // Refresh time outside the flush callback
+    FRAME_PROFILE_ROTATE,      // Rotating strips or areas into the panel's orientation
+    FRAME_PROFILE_FLUSH_WAIT,  // Waiting in the flush callback for a transfer to the panel to complete
+    FRAME_PROFILE_METRIC_COUNT,
+} frame_profile_metric_t;
+
+typedef struct {
+    uint32_t samples[FRAME_PROFILE_METRIC_COUNT][FRAME_PROFILE_WINDOW];
+    size_t next;
+    size_t count;     // Valid samples, at most FRAME_PROFILE_WINDOW
+    uint32_t frames;  // Frames added since the last reset
+} frame_profile_t;
+
+typedef struct {
+    uint32_t min_us;
+    uint32_t avg_us;
+    uint32_t p99_us;
+} frame_profile_summary_t;
+
+void frame_profile_reset(frame_profile_t* profile);
+
+// Adds the times of one frame in us, indexed by frame_profile_metric_t
+void frame_profile_add(frame_profile_t* profile, const uint32_t sample[FRAME_PROFILE_METRIC_COUNT]);
+
+// Min, average and p99 over the window, all zero when no frame was added
+void frame_profile_summarize(const frame_profile_t* profile, frame_profile_metric_t metric,
+                             frame_profile_summary_t* summary);
+
+// Formats min/avg/p99 of every metric in ms, one metric per line when multiline is set and on one line otherwise.
+// Returns the length snprintf() would have written.
+int frame_profile_format(const frame_profile_t* profile, char* buffer, size_t size, bool multiline);
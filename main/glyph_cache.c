@@ -0,0 +1,303 @@
+#include "glyph_cache.h"
+#include <inttypes.h>
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <string.h>
+#include "bench.h"
+#include "esp_err.h"
+#include "esp_heap_caps.h"
+#include "esp_log.h"
+#include "freertos/FreeRTOS.h"
+#include "freertos/semphr.h"
+#include "lvgl.h"
+
+static char const TAG[] = "glyph-cache";
+
+#define GLYPH_CACHE_MAX_FONTS 4
+#define GLYPH_CACHE_BUCKETS   256  // Power of two, a few times the glyphs a small UI uses
+// Scratch bitmap for pre-warming and the benchmark, larger than any glyph of the built-in fonts
+#define GLYPH_SCRATCH_SIZE    (64 * 64)
+
+// The font LVGL sees comes first, so the glyph's resolved font leads back to the cache font
+typedef struct {
+    lv_font_t font;
+    const lv_font_t* base;
+} cached_font_t;
+
+typedef struct glyph_entry {
+    struct glyph_entry* hash_next;
+    struct glyph_entry* newer;
+    struct glyph_entry* older;
+    const cached_font_t* font;
+    uint32_t index;  // Glyph id in the font
+    uint32_t stride;
+    uint32_t height;
+    uint8_t data[];
+} glyph_entry_t;
+
+static cached_font_t fonts[GLYPH_CACHE_MAX_FONTS];
+static size_t font_count = 0;
+
+static SemaphoreHandle_t cache_mutex = NULL;
+static glyph_entry_t* buckets[GLYPH_CACHE_BUCKETS];
+static glyph_entry_t* newest = NULL;
+static glyph_entry_t* oldest = NULL;
+static volatile bool enabled = true;
+static glyph_cache_stats_t stats;
+
+static uint32_t scratch[GLYPH_SCRATCH_SIZE / sizeof(uint32_t)];  // Words for the draw buffer alignment
+
+static glyph_entry_t** bucket_of(const cached_font_t* font, uint32_t index) {
+    uint32_t hash = (index * 2654435761u) ^ (uint32_t)((uintptr_t)font >> 4);
+    return &buckets[hash & (GLYPH_CACHE_BUCKETS - 1)];
+}
+
+static void unlink_lru(glyph_entry_t* entry) {
+    if (entry->newer != NULL) {
+        entry->newer->older = entry->older;
+    } else {
+        newest = entry->older;
+    }
+    if (entry->older != NULL) {
+        entry->older->newer = entry->newer;
+    } else {
+        oldest = entry->newer;
+    }
+}
+
+static void push_newest(glyph_entry_t* entry) {
+    entry->newer = NULL;
+    entry->older = newest;
+    if (newest != NULL) {
+        newest->newer = entry;
+    } else {
+        oldest = entry;
+    }
+    newest = entry;
+}
+
+static glyph_entry_t* find(const cached_font_t* font, uint32_t index) {
+    for (glyph_entry_t* entry = *bucket_of(font, index); entry != NULL; entry = entry->hash_next) {
+        if (entry->font == font && entry->index == index) {
+            return entry;
+        }
+    }
+    return NULL;
+}
+
+static size_t entry_size(const glyph_entry_t* entry) {
+    return sizeof(*entry) + entry->stride * entry->height;
+}
+
+static void evict_oldest() {
+    glyph_entry_t* entry = oldest;
+    glyph_entry_t** link = bucket_of(entry->font, entry->index);
+    while (*link != entry) {
+        link = &(*link)->hash_next;
+    }
+    *link = entry->hash_next;
+    unlink_lru(entry);
+    stats.bytes -= entry_size(entry);
+    stats.glyphs--;
+    stats.evictions++;
+    heap_caps_free(entry);
+}
+
+// Keeps a copy of the bitmap the base font rendered, dropping old glyphs until it fits
+static void insert(const cached_font_t* font, uint32_t index, const lv_draw_buf_t* draw_buf) {
+    size_t length = draw_buf->header.stride * draw_buf->header.h;
+    if (sizeof(glyph_entry_t) + length > stats.budget || find(font, index) != NULL) {
+        return;
+    }
+    while (stats.bytes + sizeof(glyph_entry_t) + length > stats.budget) {
+        evict_oldest();
+    }
+    glyph_entry_t* entry = heap_caps_malloc(sizeof(glyph_entry_t) + length, MALLOC_CAP_SPIRAM);
+    if (entry == NULL) {
+        return;
+    }
+    entry->font = font;
+    entry->index = index;
+    entry->stride = draw_buf->header.stride;
+    entry->height = draw_buf->header.h;
+    memcpy(entry->data, draw_buf->data, length);
+    glyph_entry_t** bucket = bucket_of(font, index);
+    entry->hash_next = *bucket;
+    *bucket = entry;
+    push_newest(entry);
+    stats.bytes += entry_size(entry);
+    stats.glyphs++;
+}
+
+static const void* cached_get_glyph_bitmap(lv_font_glyph_dsc_t* g_dsc, lv_draw_buf_t* draw_buf) {
+    const cached_font_t* font = (const cached_font_t*)g_dsc->resolved_font;
+    if (!enabled || draw_buf == NULL) {
+        return font->base->get_glyph_bitmap(g_dsc, draw_buf);
+    }
+
+    uint32_t index = g_dsc->gid.index;
+    xSemaphoreTake(cache_mutex, portMAX_DELAY);
+    glyph_entry_t* entry = find(font, index);
+    // The caller shaped the buffer for this glyph, a mismatch would be a glyph id reused for another bitmap
+    if (entry != NULL && entry->stride == draw_buf->header.stride && entry->height == draw_buf->header.h) {
+        memcpy(draw_buf->data, entry->data, entry->stride * entry->height);
+        unlink_lru(entry);
+        push_newest(entry);
+        stats.hits++;
+        xSemaphoreGive(cache_mutex);
+        return draw_buf;
+    }
+    stats.misses++;
+    xSemaphoreGive(cache_mutex);
+
+    // Rendered outside the lock, the other draw unit keeps hitting in the meantime
+    const void* bitmap = font->base->get_glyph_bitmap(g_dsc, draw_buf);
+    if (bitmap == draw_buf) {
+        xSemaphoreTake(cache_mutex, portMAX_DELAY);
+        insert(font, index, draw_buf);
+        xSemaphoreGive(cache_mutex);
+    }
+    return bitmap;
+}
+
+esp_err_t glyph_cache_init(size_t budget) {
+    if (cache_mutex == NULL) {
+        cache_mutex = xSemaphoreCreateMutex();
+        if (cache_mutex == NULL) {
+            return ESP_ERR_NO_MEM;
+        }
+    }
+    stats.budget = budget;
+    return ESP_OK;
+}
+
+const lv_font_t* glyph_cache_font(const lv_font_t* base) {
+    for (size_t i = 0; i < font_count; i++) {
+        if (fonts[i].base == base) {
+            return &fonts[i].font;
+        }
+    }
+    if (cache_mutex == NULL || font_count == GLYPH_CACHE_MAX_FONTS) {
+        return NULL;
+    }
+    // Shares the glyph descriptions with the base, bitmap fonts find them through the copied dsc
+    cached_font_t* font = &fonts[font_count++];
+    font->font = *base;
+    font->font.get_glyph_bitmap = cached_get_glyph_bitmap;
+    font->base = base;
+    return &font->font;
+}
+
+static size_t utf8_next(const char* text, uint32_t* letter) {
+    const uint8_t* s = (const uint8_t*)text;
+    if (s[0] < 0x80) {
+        *letter = s[0];
+        return 1;
+    }
+    size_t length = s[0] >= 0xF0 ? 4 : s[0] >= 0xE0 ? 3 : 2;
+    uint32_t value = s[0] & (0x3F >> (length - 1));
+    for (size_t i = 1; i < length; i++) {
+        if ((s[i] & 0xC0) != 0x80) {
+            *letter = 0xFFFD;
+            return i;
+        }
+        value = (value << 6) | (s[i] & 0x3F);
+    }
+    *letter = value;
+    return length;
+}
+
+// Renders one glyph like the label drawing does, into the scratch buffer
+static void render_glyph(const lv_font_t* font, uint32_t letter, lv_draw_buf_t* draw_buf) {
+    lv_font_glyph_dsc_t g;
+    if (!lv_font_get_glyph_dsc(font, &g, letter, 0) || g.box_w == 0 || g.box_h == 0) {
+        return;
+    }
+    if (lv_draw_buf_reshape(draw_buf, LV_COLOR_FORMAT_A8, g.box_w, g.box_h, LV_STRIDE_AUTO) != NULL) {
+        lv_font_get_glyph_bitmap(&g, draw_buf);
+    }
+    if (g.resolved_font->release_glyph != NULL) {
+        g.resolved_font->release_glyph(g.resolved_font, &g);
+    }
+}
+
+static void init_scratch(lv_draw_buf_t* draw_buf) {
+    lv_draw_buf_init(draw_buf, GLYPH_SCRATCH_SIZE, 1, LV_COLOR_FORMAT_A8, LV_STRIDE_AUTO, scratch, sizeof(scratch));
+}
+
+uint32_t glyph_cache_prewarm(const lv_font_t* font, const char* text) {
+    lv_draw_buf_t draw_buf;
+    init_scratch(&draw_buf);
+    while (*text != '\0') {
+        uint32_t letter;
+        text += utf8_next(text, &letter);
+        render_glyph(font, letter, &draw_buf);
+    }
+    xSemaphoreTake(cache_mutex, portMAX_DELAY);
+    uint32_t glyphs = stats.glyphs;
+    size_t bytes = stats.bytes;
+    xSemaphoreGive(cache_mutex);
+    ESP_LOGI(TAG, "Pre-warmed to %" PRIu32 " glyphs in %u bytes", glyphs, (unsigned)bytes);
+    return glyphs;
+}
+
+void glyph_cache_set_enabled(bool enable) {
+    enabled = enable;
+}
+
+void glyph_cache_get_stats(glyph_cache_stats_t* out, bool reset) {
+    if (cache_mutex == NULL) {
+        memset(out, 0, sizeof(*out));
+        return;
+    }
+    xSemaphoreTake(cache_mutex, portMAX_DELAY);
+    *out = stats;
+    if (reset) {
+        stats.hits = 0;
+        stats.misses = 0;
+        stats.evictions = 0;
+    }
+    xSemaphoreGive(cache_mutex);
+}
+
+void glyph_cache_print_stats(bool reset) {
+    glyph_cache_stats_t current;
+    glyph_cache_get_stats(&current, reset);
+    uint32_t lookups = current.hits + current.misses;
+    printf("Glyph cache: %" PRIu32 " glyphs in %u of %u bytes, %" PRIu32 " hits, %" PRIu32
+           " misses (%.1f%% hits), %" PRIu32 " evictions\r\n",
+           current.glyphs, (unsigned)current.bytes, (unsigned)current.budget, current.hits, current.misses,
+           lookups > 0 ? current.hits * 100.0 / lookups : 0.0, current.evictions);
+}
+
+typedef struct {
+    const lv_font_t* font;
+    lv_draw_buf_t draw_buf;
+} glyph_bench_t;
+
+// A line like the status panel shows, every glyph once per operation
+static const char bench_text[] = "Battery voltage 3.912 V Charging current 1024 mA";
+
+static void glyph_bench_body(void* ctx, uint32_t ops) {
+    glyph_bench_t* bench = ctx;
+    for (uint32_t i = 0; i < ops; i++) {
+        for (const char* c = bench_text; *c != '\0'; c++) {
+            render_glyph(bench->font, (uint8_t)*c, &bench->draw_buf);
+        }
+    }
+}
+
+void glyph_cache_benchmark(const lv_font_t* font, uint32_t rounds) {
+    glyph_bench_t bench = {
+        .font = font,
+    };
+    init_scratch(&bench.draw_buf);
+    bool was_enabled = enabled;
+    glyph_cache_set_enabled(false);
+    bench_run("glyph_render_uncached", glyph_bench_body, &bench, rounds, 15, NULL);
+    glyph_cache_set_enabled(true);
+    bench_run("glyph_render_cached", glyph_bench_body, &bench, rounds, 15, NULL);
+    glyph_cache_set_enabled(was_enabled);
+}
@@ -0,0 +1,41 @@
+#pragma once
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+#include "esp_err.h"
+#include "lvgl.h"
+
+// Cache of rendered glyph bitmaps in PSRAM. LVGL's bitmap fonts store glyphs with 1 to 4 bits per pixel and unpack
+// them to 8 bit alpha for every glyph of every redraw. A font returned by glyph_cache_font() draws like the font it
+// wraps, but keeps the unpacked bitmaps, and a hit is one copy. The least recently used glyphs are dropped when
+// the cache reaches its budget. Safe to use from several draw units at once.
+
+typedef struct {
+    uint32_t hits;
+    uint32_t misses;
+    uint32_t evictions;
+    uint32_t glyphs;  // Glyphs in the cache
+    size_t bytes;     // PSRAM used by them, bookkeeping included
+    size_t budget;
+} glyph_cache_stats_t;
+
+// Sets the budget in bytes, call once before the first glyph_cache_font()
+esp_err_t glyph_cache_init(size_t budget);
+
+// Returns a font that renders through the cache, the same one for every call with the same base. NULL when the
+// cache is not initialized or too many fonts are wrapped already, use base then.
+const lv_font_t* glyph_cache_font(const lv_font_t* base);
+
+// Renders the glyphs of the UTF-8 text into the cache and returns how many are cached afterwards
+uint32_t glyph_cache_prewarm(const lv_font_t* font, const char* text);
+
+// Lets the cached fonts render like their base fonts without touching the cache, for comparisons
+void glyph_cache_set_enabled(bool enabled);
+
+void glyph_cache_get_stats(glyph_cache_stats_t* stats, bool reset);
+void glyph_cache_print_stats(bool reset);
+
+// Reports the cost of rendering a line of status text glyph by glyph through font, with and without the cache.
+// font has to come from glyph_cache_font().
+void glyph_cache_benchmark(const lv_font_t* font, uint32_t rounds);
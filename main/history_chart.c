@@ -0,0 +1,76 @@
+#include "history_chart.h"
+#include <stddef.h>
+#include <stdint.h>
+#include "lvgl.h"
+#include "telemetry_history.h"
+
+#define HISTORY_CHART_HEIGHT    120
+#define HISTORY_CHART_MAX_MV    5500
+#define HISTORY_CHART_MAX_MA    2200
+#define HISTORY_CHART_DIVISIONS 5
+
+static lv_obj_t* chart = NULL;
+static lv_chart_series_t* series[TELEMETRY_HISTORY_CHANNEL_COUNT];
+
+static void chart_delete_cb(lv_event_t* event) {
+    chart = NULL;
+}
+
+static void add_point(const telemetry_history_sample_t* sample) {
+    for (int channel = 0; channel < TELEMETRY_HISTORY_CHANNEL_COUNT; channel++) {
+        lv_chart_set_next_value(chart, series[channel], sample->values[channel]);
+    }
+}
+
+// Visits the stored samples, ctx counts down the older ones that do not fit
+static void fill_point(void* ctx, const telemetry_history_sample_t* sample) {
+    uint32_t* skip = ctx;
+    if (*skip > 0) {
+        (*skip)--;
+        return;
+    }
+    add_point(sample);
+}
+
+lv_obj_t* history_chart_create(lv_obj_t* parent, const telemetry_history_t* history) {
+    chart = lv_chart_create(parent);
+    lv_obj_add_event_cb(chart, chart_delete_cb, LV_EVENT_DELETE, NULL);
+    lv_obj_set_size(chart, lv_pct(100), HISTORY_CHART_HEIGHT);
+    lv_chart_set_type(chart, LV_CHART_TYPE_LINE);
+    lv_chart_set_update_mode(chart, LV_CHART_UPDATE_MODE_CIRCULAR);
+    lv_chart_set_point_count(chart, HISTORY_CHART_POINTS);
+    lv_chart_set_div_line_count(chart, HISTORY_CHART_DIVISIONS, 0);
+    lv_chart_set_range(chart, LV_CHART_AXIS_PRIMARY_Y, 0, HISTORY_CHART_MAX_MV);
+    lv_chart_set_range(chart, LV_CHART_AXIS_SECONDARY_Y, 0, HISTORY_CHART_MAX_MA);
+    // Single points would otherwise be drawn as dots on top of the lines
+    lv_obj_set_style_size(chart, 0, 0, LV_PART_INDICATOR);
+
+    series[TELEMETRY_HISTORY_VBAT] =
+        lv_chart_add_series(chart, lv_palette_main(LV_PALETTE_GREEN), LV_CHART_AXIS_PRIMARY_Y);
+    series[TELEMETRY_HISTORY_VSYS] =
+        lv_chart_add_series(chart, lv_palette_main(LV_PALETTE_BLUE), LV_CHART_AXIS_PRIMARY_Y);
+    series[TELEMETRY_HISTORY_VBUS] =
+        lv_chart_add_series(chart, lv_palette_main(LV_PALETTE_ORANGE), LV_CHART_AXIS_PRIMARY_Y);
+    series[TELEMETRY_HISTORY_ICHGR] =
+        lv_chart_add_series(chart, lv_palette_main(LV_PALETTE_RED), LV_CHART_AXIS_SECONDARY_Y);
+    history_chart_fill(history);
+    return chart;
+}
+
+void history_chart_fill(const telemetry_history_t* history) {
+    if (chart == NULL) {
+        return;
+    }
+    for (int channel = 0; channel < TELEMETRY_HISTORY_CHANNEL_COUNT; channel++) {
+        lv_chart_set_all_value(chart, series[channel], LV_CHART_POINT_NONE);
+    }
+    uint32_t skip = history->samples > HISTORY_CHART_POINTS ? history->samples - HISTORY_CHART_POINTS : 0;
+    telemetry_history_for_each(history, fill_point, &skip);
+}
+
+void history_chart_append(const telemetry_history_t* history) {
+    if (chart == NULL || history->samples == 0) {
+        return;
+    }
+    add_point(&history->last);
+}
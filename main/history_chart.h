@@ -0,0 +1,19 @@
+#pragma once
+
+#include "lvgl.h"
+#include "telemetry_history.h"
+
+// Points the chart shows, the oldest one is overwritten by the next sample
+#define HISTORY_CHART_POINTS 120
+
+// Chart of the telemetry history with the voltages on the left axis and the charging current on the right one. It
+// shows what the history holds: it is filled from the history when it is created and then takes the newest sample
+// after every append. It runs in circular mode, so a new sample only invalidates the column of its point and not the
+// whole chart. All functions need the LVGL lock, which also guards the history against the appends.
+lv_obj_t* history_chart_create(lv_obj_t* parent, const telemetry_history_t* history);
+
+// Replaces the points with the newest samples of the history
+void history_chart_fill(const telemetry_history_t* history);
+
+// Adds the sample the last telemetry_history_append() stored
+void history_chart_append(const telemetry_history_t* history);
@@ -0,0 +1,151 @@
+#include "i2c_discovery.h"
+#include <inttypes.h>
+#include <stdatomic.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <string.h>
+#include "driver/i2c_master.h"
+#include "esp_err.h"
+#include "esp_log.h"
+#include "esp_timer.h"
+#include "freertos/FreeRTOS.h"
+#include "freertos/task.h"
+#include "i2c_sched.h"
+#include "nvs.h"
+
+static char const TAG[] = "i2c_discovery";
+
+#define DISCOVERY_NVS_NAMESPACE "i2c_discovery"
+#define DISCOVERY_NVS_KEY       "bus_map"
+// The expected device is probed with the timeout the old scan used, all other addresses only get a short one
+#define DISCOVERY_EXPECTED_TIMEOUT_MS 50
+#define DISCOVERY_SCAN_TIMEOUT_MS     5
+#define DISCOVERY_TASK_STACK_SIZE     3072
+#define DISCOVERY_TASK_PRIORITY       1
+// Addresses outside this range are reserved by the I2C specification
+#define DISCOVERY_FIRST_ADDRESS 0x08
+#define DISCOVERY_LAST_ADDRESS  0x77
+
+static i2c_master_bus_handle_t scan_bus = NULL;
+// The current map, written word by word before the source that describes it. Readers copy it without locking.
+static atomic_uint current_words[4];
+static atomic_int current_source = I2C_DISCOVERY_NONE;
+
+// Appended to the logged device list
+static const char* const source_suffixes[] = {
+    [I2C_DISCOVERY_NONE] = " (not started)",
+    [I2C_DISCOVERY_PENDING] = " (scan running)",
+    [I2C_DISCOVERY_CACHED] = " (cached)",
+    [I2C_DISCOVERY_SCANNED] = "",
+};
+
+// Returns false when there is no map of a previous boot
+static bool load_cached_map(i2c_bus_map_t* map) {
+    nvs_handle_t handle;
+    if (nvs_open(DISCOVERY_NVS_NAMESPACE, NVS_READONLY, &handle) != ESP_OK) {
+        return false;
+    }
+    size_t size = sizeof(*map);
+    bool loaded = nvs_get_blob(handle, DISCOVERY_NVS_KEY, map, &size) == ESP_OK && size == sizeof(*map);
+    nvs_close(handle);
+    return loaded;
+}
+
+static void store_map(const i2c_bus_map_t* map) {
+    nvs_handle_t handle;
+    esp_err_t res = nvs_open(DISCOVERY_NVS_NAMESPACE, NVS_READWRITE, &handle);
+    if (res != ESP_OK) {
+        ESP_LOGW(TAG, "Failed to open NVS, bus map not cached: %s", esp_err_to_name(res));
+        return;
+    }
+    res = nvs_set_blob(handle, DISCOVERY_NVS_KEY, map, sizeof(*map));
+    if (res == ESP_OK) {
+        res = nvs_commit(handle);
+    }
+    if (res != ESP_OK) {
+        ESP_LOGW(TAG, "Failed to store bus map: %s", esp_err_to_name(res));
+    }
+    nvs_close(handle);
+}
+
+static void publish(const i2c_bus_map_t* map, i2c_discovery_source_t source) {
+    for (int i = 0; i < 4; i++) {
+        atomic_store_explicit(&current_words[i], map->words[i], memory_order_relaxed);
+    }
+    atomic_store_explicit(&current_source, source, memory_order_release);
+}
+
+static void log_map(const i2c_bus_map_t* map, i2c_discovery_source_t source) {
+    char list[128 * 3 + 1] = "";
+    size_t length = 0;
+    for (int address = 0; address < 128; address++) {
+        if (i2c_bus_map_has(map, address)) {
+            length += snprintf(list + length, sizeof(list) - length, " %02x", address);
+        }
+    }
+    ESP_LOGI(TAG, "Devices:%s%s", length > 0 ? list : " none", source_suffixes[source]);
+}
+
+static void scan_task(void* arg) {
+    i2c_bus_map_t map = {0};
+    int64_t start = esp_timer_get_time();
+    for (int address = DISCOVERY_FIRST_ADDRESS; address <= DISCOVERY_LAST_ADDRESS; address++) {
+        // One slot per probe, so a running scan never holds back keyboard or control traffic for long
+        if (i2c_sched_probe(I2C_SCHED_TELEMETRY, scan_bus, address, DISCOVERY_SCAN_TIMEOUT_MS) == ESP_OK) {
+            i2c_bus_map_set(&map, address);
+        }
+    }
+    int64_t scan_us = esp_timer_get_time() - start;
+
+    publish(&map, I2C_DISCOVERY_SCANNED);
+    ESP_LOGI(TAG, "Bus scan took %" PRId64 " ms", scan_us / 1000);
+    log_map(&map, I2C_DISCOVERY_SCANNED);
+    store_map(&map);
+    vTaskDelete(NULL);
+}
+
+esp_err_t i2c_discovery_start(i2c_master_bus_handle_t bus, uint8_t expected_address, bool* found) {
+    scan_bus = bus;
+    *found = i2c_sched_probe(I2C_SCHED_CONTROL, bus, expected_address, DISCOVERY_EXPECTED_TIMEOUT_MS) == ESP_OK;
+
+    // The devices are soldered on, the map of an earlier boot holds as long as the expected device answers like then
+    i2c_bus_map_t cached_map;
+    if (load_cached_map(&cached_map) && i2c_bus_map_has(&cached_map, expected_address) == *found) {
+        publish(&cached_map, I2C_DISCOVERY_CACHED);
+        log_map(&cached_map, I2C_DISCOVERY_CACHED);
+        return ESP_OK;
+    }
+
+    i2c_bus_map_t pending_map = {0};
+    if (*found) {
+        i2c_bus_map_set(&pending_map, expected_address);
+    }
+    publish(&pending_map, I2C_DISCOVERY_PENDING);
+    if (xTaskCreate(scan_task, "i2c-discovery", DISCOVERY_TASK_STACK_SIZE, NULL, DISCOVERY_TASK_PRIORITY, NULL) !=
+        pdPASS) {
+        return ESP_ERR_NO_MEM;
+    }
+    return ESP_OK;
+}
+
+i2c_discovery_source_t i2c_discovery_get(i2c_bus_map_t* map) {
+    i2c_discovery_source_t source = atomic_load_explicit(&current_source, memory_order_acquire);
+    for (int i = 0; i < 4; i++) {
+        map->words[i] = atomic_load_explicit(&current_words[i], memory_order_relaxed);
+    }
+    return source;
+}
+
+bool i2c_discovery_present(uint8_t address) {
+    if (address >= 128) {
+        return false;
+    }
+    return (atomic_load_explicit(&current_words[address >> 5], memory_order_relaxed) >> (address & 31)) & 1;
+}
+
+void i2c_discovery_print() {
+    i2c_bus_map_t map;
+    i2c_discovery_source_t source = i2c_discovery_get(&map);
+    log_map(&map, source);
+}
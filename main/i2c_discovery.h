@@ -0,0 +1,45 @@
+#pragma once
+
+#include <stdbool.h>
+#include <stdint.h>
+#include "driver/i2c_master.h"
+#include "esp_err.h"
+
+// One bit per 7-bit I2C address
+typedef struct {
+    uint32_t words[4];
+} i2c_bus_map_t;
+
+static inline bool i2c_bus_map_has(const i2c_bus_map_t* map, uint8_t address) {
+    return address < 128 && (map->words[address >> 5] >> (address & 31)) & 1;
+}
+
+static inline void i2c_bus_map_set(i2c_bus_map_t* map, uint8_t address) {
+    if (address < 128) {
+        map->words[address >> 5] |= 1u << (address & 31);
+    }
+}
+
+// Where the current bus map comes from
+typedef enum {
+    I2C_DISCOVERY_NONE,     // Discovery has not started, the map is empty
+    I2C_DISCOVERY_PENDING,  // The scan is running, the map only holds the expected device if it answered
+    I2C_DISCOVERY_CACHED,   // The map of an earlier boot, which the expected device confirmed
+    I2C_DISCOVERY_SCANNED,  // The scan of this boot finished
+} i2c_discovery_source_t;
+
+// Probes the expected device first and returns as soon as that is done, found tells whether it answered. The bus map
+// of the previous boot is kept in NVS: when there is one and the expected device answered as it did then, the cached
+// map becomes the current one and the bus is not scanned. Otherwise the full scan runs in a background task at
+// telemetry priority, then publishes and stores the map it finds. NVS has to be initialized before, without it every
+// boot scans.
+esp_err_t i2c_discovery_start(i2c_master_bus_handle_t bus, uint8_t expected_address, bool* found);
+
+// Copies the current bus map and returns where it comes from. A cached or scanned map does not change any more.
+i2c_discovery_source_t i2c_discovery_get(i2c_bus_map_t* map);
+
+// Whether the address is in the current bus map
+bool i2c_discovery_present(uint8_t address);
+
+// Logs the current bus map and where it comes from
+void i2c_discovery_print();
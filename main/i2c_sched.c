@@ -0,0 +1,328 @@
+#include "i2c_sched.h"
+#include <inttypes.h>
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <string.h>
+#include "driver/i2c_master.h"
+#include "esp_err.h"
+#include "esp_log.h"
+#include "esp_rom_sys.h"
+#include "esp_timer.h"
+#include "fake_coprocessor.h"
+#include "freertos/FreeRTOS.h"
+#include "freertos/semphr.h"
+#include "freertos/task.h"
+
+static char const TAG[] = "i2c_sched";
+
+// Longest time a request of each class waits for the bus before it gives up
+static const uint32_t max_wait_ms[I2C_SCHED_CLASS_COUNT] = {
+    [I2C_SCHED_CONTROL] = 200,
+    [I2C_SCHED_TELEMETRY] = 1000,
+};
+
+static const char* const class_names[I2C_SCHED_CLASS_COUNT] = {
+    [I2C_SCHED_CONTROL] = "control",
+    [I2C_SCHED_TELEMETRY] = "telemetry",
+};
+
+// A request that waits for the bus. It lives on the waiting task's stack and is handed the bus by the task that
+// releases it, the semaphore is what the waiting task blocks on.
+typedef struct waiter {
+    struct waiter* next;
+    StaticSemaphore_t semaphore_buffer;
+    SemaphoreHandle_t semaphore;
+    bool granted;
+} waiter_t;
+
+typedef struct {
+    waiter_t* head;
+    waiter_t* tail;
+} waiter_queue_t;
+
+// A binary semaphore like the driver was written for: it has no owner, so the driver may give it from whichever task
+// it likes
+static SemaphoreHandle_t bus_semaphore = NULL;
+// Guards everything below, it is only ever held for a few instructions
+static SemaphoreHandle_t state_mutex = NULL;
+static bool bus_granted = false;
+static i2c_sched_class_t owner_class;
+static int64_t owner_since_us;
+static waiter_queue_t queues[I2C_SCHED_CLASS_COUNT];
+static i2c_sched_stats_t stats;
+static int64_t stats_since_us;
+
+esp_err_t i2c_sched_init() {
+    if (state_mutex != NULL) {
+        return ESP_OK;
+    }
+    state_mutex = xSemaphoreCreateMutex();
+    bus_semaphore = xSemaphoreCreateBinary();
+    if (state_mutex == NULL || bus_semaphore == NULL) {
+        return ESP_ERR_NO_MEM;
+    }
+    xSemaphoreGive(bus_semaphore);
+    stats_since_us = esp_timer_get_time();
+    return ESP_OK;
+}
+
+SemaphoreHandle_t i2c_sched_get_bus_semaphore() {
+    return bus_semaphore;
+}
+
+static void queue_remove(waiter_queue_t* queue, waiter_t* waiter) {
+    waiter_t* previous = NULL;
+    for (waiter_t* entry = queue->head; entry != NULL; previous = entry, entry = entry->next) {
+        if (entry == waiter) {
+            if (previous == NULL) {
+                queue->head = entry->next;
+            } else {
+                previous->next = entry->next;
+            }
+            if (queue->tail == entry) {
+                queue->tail = previous;
+            }
+            return;
+        }
+    }
+}
+
+esp_err_t i2c_sched_acquire(i2c_sched_class_t cls) {
+    int64_t start = esp_timer_get_time();
+    waiter_t waiter = {0};
+
+    xSemaphoreTake(state_mutex, portMAX_DELAY);
+    if (!bus_granted) {
+        bus_granted = true;
+        owner_class = cls;
+        owner_since_us = start;
+        stats.classes[cls].grants++;
+        xSemaphoreGive(state_mutex);
+        return ESP_OK;
+    }
+    waiter.semaphore = xSemaphoreCreateBinaryStatic(&waiter.semaphore_buffer);
+    if (queues[cls].tail == NULL) {
+        queues[cls].head = &waiter;
+    } else {
+        queues[cls].tail->next = &waiter;
+    }
+    queues[cls].tail = &waiter;
+    xSemaphoreGive(state_mutex);
+
+    bool signalled = xSemaphoreTake(waiter.semaphore, pdMS_TO_TICKS(max_wait_ms[cls])) == pdTRUE;
+
+    // The releasing task grants and signals while it holds the state mutex, so once that is taken here a grant that
+    // raced with the timeout has also been signalled
+    xSemaphoreTake(state_mutex, portMAX_DELAY);
+    esp_err_t res = ESP_OK;
+    if (waiter.granted) {
+        if (!signalled) {
+            xSemaphoreTake(waiter.semaphore, 0);
+        }
+        uint32_t wait_us = (uint32_t)(esp_timer_get_time() - start);
+        stats.classes[cls].wait_us += wait_us;
+        if (wait_us > stats.classes[cls].wait_max_us) {
+            stats.classes[cls].wait_max_us = wait_us;
+        }
+    } else {
+        queue_remove(&queues[cls], &waiter);
+        stats.classes[cls].timeouts++;
+        res = ESP_ERR_TIMEOUT;
+    }
+    xSemaphoreGive(state_mutex);
+    vSemaphoreDelete(waiter.semaphore);
+    return res;
+}
+
+void i2c_sched_release() {
+    int64_t now = esp_timer_get_time();
+    xSemaphoreTake(state_mutex, portMAX_DELAY);
+    uint32_t busy_us = (uint32_t)(now - owner_since_us);
+    stats.classes[owner_class].busy_us += busy_us;
+    if (busy_us > stats.classes[owner_class].busy_max_us) {
+        stats.classes[owner_class].busy_max_us = busy_us;
+    }
+
+    // The bus goes straight to the next waiter so that no other task can slip in between
+    bus_granted = false;
+    for (int cls = 0; cls < I2C_SCHED_CLASS_COUNT; cls++) {
+        waiter_t* waiter = queues[cls].head;
+        if (waiter == NULL) {
+            continue;
+        }
+        queues[cls].head = waiter->next;
+        if (queues[cls].head == NULL) {
+            queues[cls].tail = NULL;
+        }
+        waiter->granted = true;
+        bus_granted = true;
+        owner_class = cls;
+        owner_since_us = now;
+        stats.classes[cls].grants++;
+        xSemaphoreGive(waiter->semaphore);
+        break;
+    }
+    xSemaphoreGive(state_mutex);
+}
+
+esp_err_t i2c_sched_release_result(esp_err_t result) {
+    i2c_sched_release();
+    return result;
+}
+
+esp_err_t i2c_sched_transmit_receive(i2c_sched_class_t cls, i2c_master_dev_handle_t device, const uint8_t* write,
+                                     size_t write_size, uint8_t* read, size_t read_size, int timeout_ms) {
+    esp_err_t res = i2c_sched_acquire(cls);
+    if (res != ESP_OK) {
+        return res;
+    }
+    // Only the coprocessor driver's key reads compete for the bus semaphore here
+    xSemaphoreTake(bus_semaphore, portMAX_DELAY);
+    res = i2c_master_transmit_receive(device, write, write_size, read, read_size, timeout_ms);
+    xSemaphoreGive(bus_semaphore);
+    i2c_sched_release();
+    return res;
+}
+
+esp_err_t i2c_sched_probe(i2c_sched_class_t cls, i2c_master_bus_handle_t bus, uint16_t address, int timeout_ms) {
+    esp_err_t res = i2c_sched_acquire(cls);
+    if (res != ESP_OK) {
+        return res;
+    }
+    xSemaphoreTake(bus_semaphore, portMAX_DELAY);
+    res = i2c_master_probe(bus, address, timeout_ms);
+    xSemaphoreGive(bus_semaphore);
+    i2c_sched_release();
+    return res;
+}
+
+void i2c_sched_get_stats(i2c_sched_stats_t* result, bool reset) {
+    xSemaphoreTake(state_mutex, portMAX_DELAY);
+    int64_t now = esp_timer_get_time();
+    *result = stats;
+    result->elapsed_us = now - stats_since_us;
+    if (reset) {
+        memset(&stats, 0, sizeof(stats));
+        stats_since_us = now;
+    }
+    xSemaphoreGive(state_mutex);
+}
+
+static void print_stats(const i2c_sched_stats_t* snapshot) {
+    printf("I2C bus over %.1f s:\n", snapshot->elapsed_us / 1000000.0);
+    for (int cls = 0; cls < I2C_SCHED_CLASS_COUNT; cls++) {
+        const i2c_sched_class_stats_t* c = &snapshot->classes[cls];
+        uint32_t waited = c->grants > 0 ? c->grants : 1;
+        printf("  %-9s %6" PRIu32 " grants %4" PRIu32 " timeouts, wait avg %" PRIu64 " max %" PRIu32
+               " us, busy %.1f%% max %" PRIu32 " us\n",
+               class_names[cls], c->grants, c->timeouts, c->wait_us / waited, c->wait_max_us,
+               snapshot->elapsed_us > 0 ? c->busy_us * 100.0 / snapshot->elapsed_us : 0.0, c->busy_max_us);
+    }
+}
+
+void i2c_sched_print_stats(bool reset) {
+    i2c_sched_stats_t snapshot;
+    i2c_sched_get_stats(&snapshot, reset);
+    print_stats(&snapshot);
+}
+
+// Simulated device: the fake coprocessor on a slow bus with clock stretching, every read blocks the bus for the time
+// the fake models
+#define SIMULATE_BUS_HZ      100000
+#define SIMULATE_OVERHEAD_US 500
+#define SIMULATE_TASKS       5
+// Allowance for waking the task that waited on top of the transaction it waited for
+#define SIMULATE_SCHEDULING_US 1000
+
+typedef struct {
+    bool keys;  // Reads like the driver's interrupt task instead of going through the scheduler
+    i2c_sched_class_t cls;
+    size_t read_size;
+    uint32_t period_ms;
+    int64_t end_us;
+    SemaphoreHandle_t done;
+} simulate_task_t;
+
+static fake_coprocessor_t simulate_device;
+static uint32_t simulate_key_reads;
+static uint32_t simulate_key_wait_max_us;
+
+// One transaction under the bus semaphore, the way the coprocessor driver makes it. Returns how long it waited for
+// the semaphore.
+static uint32_t simulate_transaction(size_t read_size) {
+    uint8_t data[32];
+    int64_t start = esp_timer_get_time();
+    xSemaphoreTake(bus_semaphore, portMAX_DELAY);
+    uint32_t wait_us = (uint32_t)(esp_timer_get_time() - start);
+    uint64_t bus_ns = simulate_device.bus_ns;
+    fake_coprocessor_read(&simulate_device, 0, data, read_size);
+    esp_rom_delay_us((uint32_t)((simulate_device.bus_ns - bus_ns) / 1000));
+    xSemaphoreGive(bus_semaphore);
+    return wait_us;
+}
+
+static void simulate_task(void* arg) {
+    simulate_task_t* task = arg;
+    while (esp_timer_get_time() < task->end_us) {
+        if (task->keys) {
+            // The scheduler's statistics do not see these, the wait is measured here
+            uint32_t wait_us = simulate_transaction(task->read_size);
+            simulate_key_reads++;
+            if (wait_us > simulate_key_wait_max_us) {
+                simulate_key_wait_max_us = wait_us;
+            }
+        } else if (i2c_sched_acquire(task->cls) == ESP_OK) {
+            simulate_transaction(task->read_size);
+            i2c_sched_release();
+        }
+        vTaskDelay(pdMS_TO_TICKS(task->period_ms));
+    }
+    xSemaphoreGive(task->done);
+    vTaskDelete(NULL);
+}
+
+bool i2c_sched_simulate(int duration_ms) {
+    fake_coprocessor_init(&simulate_device, SIMULATE_BUS_HZ, SIMULATE_OVERHEAD_US);
+    simulate_key_reads = 0;
+    simulate_key_wait_max_us = 0;
+    SemaphoreHandle_t done = xSemaphoreCreateCounting(SIMULATE_TASKS, 0);
+    int64_t end_us = esp_timer_get_time() + duration_ms * 1000;
+    // Three telemetry tasks keep the bus saturated with long bursts and a telemetry queue, control calls and the
+    // driver's reads of keys and inputs come in between with short transactions
+    simulate_task_t tasks[SIMULATE_TASKS] = {
+        {true, I2C_SCHED_CONTROL, 10, 20, end_us, done},
+        {false, I2C_SCHED_CONTROL, 4, 50, end_us, done},
+        {false, I2C_SCHED_TELEMETRY, 19, 1, end_us, done},
+        {false, I2C_SCHED_TELEMETRY, 19, 1, end_us, done},
+        {false, I2C_SCHED_TELEMETRY, 19, 1, end_us, done},
+    };
+
+    i2c_sched_stats_t result;
+    i2c_sched_get_stats(&result, true);
+    int started = 0;
+    for (int i = 0; i < SIMULATE_TASKS; i++) {
+        const char* name = tasks[i].keys ? "keys" : class_names[tasks[i].cls];
+        // The driver's interrupt task runs above the callers of the scheduler
+        UBaseType_t priority = tasks[i].keys ? 3 : 2;
+        if (xTaskCreate(simulate_task, name, 3072, &tasks[i], priority, NULL) != pdPASS) {
+            ESP_LOGE(TAG, "Failed to start a %s simulation task", name);
+            break;
+        }
+        started++;
+    }
+    for (int i = 0; i < started; i++) {
+        xSemaphoreTake(done, portMAX_DELAY);
+    }
+    vSemaphoreDelete(done);
+
+    i2c_sched_get_stats(&result, true);
+    print_stats(&result);
+    // Key reads may wait for the transaction in progress, but never for the queue behind it
+    uint32_t bound_us = result.classes[I2C_SCHED_TELEMETRY].busy_max_us + SIMULATE_SCHEDULING_US;
+    bool ok = started == SIMULATE_TASKS && simulate_key_reads > 0 && simulate_key_wait_max_us <= bound_us;
+    printf("I2C scheduler simulation: %" PRIu32 " key reads waited at most %" PRIu32 " us, bound %" PRIu32 " us, %s\n",
+           simulate_key_reads, simulate_key_wait_max_us, bound_us, ok ? "ok" : "FAILED");
+    return ok;
+}
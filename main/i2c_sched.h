@@ -0,0 +1,69 @@
+#pragma once
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+#include "driver/i2c_master.h"
+#include "esp_err.h"
+#include "freertos/FreeRTOS.h"
+#include "freertos/semphr.h"
+
+// Traffic classes in order of priority. When the bus is released it goes to the oldest waiter of the highest class.
+// Key and input reads are not a class: the coprocessor driver's interrupt task takes the bus semaphore directly for
+// each of them, so they overtake every queued request and wait for at most the transaction in progress.
+typedef enum {
+    I2C_SCHED_CONTROL,
+    I2C_SCHED_TELEMETRY,
+    I2C_SCHED_CLASS_COUNT,
+} i2c_sched_class_t;
+
+typedef struct {
+    uint32_t grants;
+    uint32_t timeouts;     // Requests that gave up after waiting the class's maximum
+    uint64_t wait_us;      // Queueing delay of granted requests
+    uint32_t wait_max_us;
+    uint64_t busy_us;      // Time the class held the bus
+    uint32_t busy_max_us;
+} i2c_sched_class_stats_t;
+
+typedef struct {
+    i2c_sched_class_stats_t classes[I2C_SCHED_CLASS_COUNT];
+    uint64_t elapsed_us;  // Time since the statistics were last reset
+} i2c_sched_stats_t;
+
+// Creates the scheduler, it has to exist before anything uses the bus
+esp_err_t i2c_sched_init();
+
+// Binary semaphore that guards the bus for one transaction. The coprocessor driver gets it as its concurrency
+// semaphore and takes it around each of its transactions, the granted slot of I2C_SCHED_CALL included.
+SemaphoreHandle_t i2c_sched_get_bus_semaphore();
+
+// Waits for the bus in the given class, up to the class's maximum wait. Returns ESP_ERR_TIMEOUT when that passed.
+// Every successful acquire has to be followed by i2c_sched_release() from the same task.
+esp_err_t i2c_sched_acquire(i2c_sched_class_t cls);
+void i2c_sched_release();
+
+// Releases the bus and passes result through, see I2C_SCHED_CALL
+esp_err_t i2c_sched_release_result(esp_err_t result);
+
+// Runs one coprocessor driver call as its own slot on the bus and evaluates to its result, or to ESP_ERR_TIMEOUT
+// when the bus could not be acquired in time
+#define I2C_SCHED_CALL(cls, call) \
+    (i2c_sched_acquire(cls) == ESP_OK ? i2c_sched_release_result(call) : ESP_ERR_TIMEOUT)
+
+// One write-then-read transaction with a device that is not driven through the coprocessor driver
+esp_err_t i2c_sched_transmit_receive(i2c_sched_class_t cls, i2c_master_dev_handle_t device, const uint8_t* write,
+                                     size_t write_size, uint8_t* read, size_t read_size, int timeout_ms);
+
+// Checks whether a device acknowledges the address, as one slot on the bus
+esp_err_t i2c_sched_probe(i2c_sched_class_t cls, i2c_master_bus_handle_t bus, uint16_t address, int timeout_ms);
+
+void i2c_sched_get_stats(i2c_sched_stats_t* stats, bool reset);
+
+// Prints queueing delay and bus occupancy per class to the serial console
+void i2c_sched_print_stats(bool reset);
+
+// Runs tasks against a simulated slow device for the given time: one reads the keys the way the coprocessor driver
+// does, the others make control and telemetry calls through the scheduler. Prints the statistics and checks that the
+// key reads never waited longer than one telemetry transaction. Returns false when they did.
+bool i2c_sched_simulate(int duration_ms);
@@ -0,0 +1,111 @@
+#include "irq_timestamp.h"
+#include <stdbool.h>
+#include <stdint.h>
+#include "driver/gpio.h"
+#include "driver/gpio_etm.h"
+#include "driver/gptimer.h"
+#include "esp_err.h"
+#include "esp_etm.h"
+#include "esp_log.h"
+#include "esp_timer.h"
+
+static char const TAG[] = "irq-timestamp";
+
+#define IRQ_TIMESTAMP_RESOLUTION_HZ 1000000
+
+static gptimer_handle_t capture_timer = NULL;
+static uint64_t last_captured = 0;
+
+esp_err_t irq_timestamp_init(gpio_num_t gpio) {
+    gptimer_config_t timer_config = {
+        .clk_src = GPTIMER_CLK_SRC_DEFAULT,
+        .direction = GPTIMER_COUNT_UP,
+        .resolution_hz = IRQ_TIMESTAMP_RESOLUTION_HZ,
+    };
+    esp_err_t res = gptimer_new_timer(&timer_config, &capture_timer);
+    if (res != ESP_OK) {
+        return res;
+    }
+
+    esp_etm_event_handle_t edge_event = NULL;
+    gpio_etm_event_config_t event_config = {
+        .edge = GPIO_ETM_EVENT_EDGE_NEG,
+    };
+    res = gpio_new_etm_event(&event_config, &edge_event);
+    if (res == ESP_OK) {
+        res = gpio_etm_event_bind_gpio(edge_event, gpio);
+    }
+
+    esp_etm_task_handle_t capture_task = NULL;
+    gptimer_etm_task_conf_t task_config = {
+        .task_type = GPTIMER_ETM_TASK_CAPTURE,
+    };
+    if (res == ESP_OK) {
+        res = gptimer_new_etm_task(capture_timer, &task_config, &capture_task);
+    }
+
+    esp_etm_channel_handle_t channel = NULL;
+    esp_etm_channel_config_t channel_config = {0};
+    if (res == ESP_OK) {
+        res = esp_etm_new_channel(&channel_config, &channel);
+    }
+    if (res == ESP_OK) {
+        res = esp_etm_channel_connect(channel, edge_event, capture_task);
+    }
+    bool channel_enabled = false;
+    if (res == ESP_OK) {
+        res = esp_etm_channel_enable(channel);
+        channel_enabled = res == ESP_OK;
+    }
+    bool timer_enabled = false;
+    if (res == ESP_OK) {
+        res = gptimer_enable(capture_timer);
+        timer_enabled = res == ESP_OK;
+    }
+    if (res == ESP_OK) {
+        res = gptimer_start(capture_timer);
+    }
+    if (res == ESP_OK) {
+        return ESP_OK;
+    }
+
+    // Release whatever was set up, in reverse order
+    ESP_LOGW(TAG, "Failed to route GPIO %d to a timer capture: %s", gpio, esp_err_to_name(res));
+    if (channel_enabled) {
+        esp_etm_channel_disable(channel);
+    }
+    if (channel != NULL) {
+        esp_etm_del_channel(channel);
+    }
+    if (capture_task != NULL) {
+        esp_etm_del_task(capture_task);
+    }
+    if (edge_event != NULL) {
+        esp_etm_del_event(edge_event);
+    }
+    if (timer_enabled) {
+        gptimer_disable(capture_timer);
+    }
+    gptimer_del_timer(capture_timer);
+    capture_timer = NULL;
+    return res;
+}
+
+bool irq_timestamp_take(int64_t* us) {
+    if (capture_timer == NULL) {
+        return false;
+    }
+
+    uint64_t captured = 0;
+    uint64_t now = 0;
+    int64_t now_us = esp_timer_get_time();
+    if (gptimer_get_captured_count(capture_timer, &captured) != ESP_OK ||
+        gptimer_get_raw_count(capture_timer, &now) != ESP_OK || captured == last_captured) {
+        return false;
+    }
+    last_captured = captured;
+
+    // The timer counts in us, so its distance to the edge converts directly to esp_timer time
+    *us = now_us - (int64_t)(now - captured);
+    return true;
+}
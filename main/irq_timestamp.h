@@ -0,0 +1,14 @@
+#pragma once
+
+#include <stdbool.h>
+#include <stdint.h>
+#include "driver/gpio.h"
+#include "esp_err.h"
+
+// Captures the time of the last falling edge on an interrupt line in hardware. The GPIO edge triggers a capture of a
+// general purpose timer through the event task matrix, so no interrupt handler is needed and the handler a driver
+// already installed on the pin stays untouched.
+esp_err_t irq_timestamp_init(gpio_num_t gpio);
+
+// Stores the esp_timer time of the last edge in us and returns true when an edge happened since the previous call
+bool irq_timestamp_take(int64_t* us);
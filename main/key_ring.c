@@ -0,0 +1,56 @@
+#include "key_ring.h"
+#include <stdatomic.h>
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+#define KEY_RING_MASK (KEY_RING_SIZE - 1)
+
+_Static_assert((KEY_RING_SIZE & KEY_RING_MASK) == 0, "KEY_RING_SIZE must be a power of two");
+_Static_assert(KEY_RING_RELEASE_RESERVE < KEY_RING_SIZE, "KEY_RING_RELEASE_RESERVE must leave room for presses");
+
+void key_ring_init(key_ring_t* ring) {
+    atomic_init(&ring->head, 0);
+    atomic_init(&ring->tail, 0);
+    atomic_init(&ring->dropped, 0);
+}
+
+bool key_ring_push(key_ring_t* ring, const key_event_t* event) {
+    unsigned int head = atomic_load_explicit(&ring->head, memory_order_relaxed);
+    unsigned int tail = atomic_load_explicit(&ring->tail, memory_order_acquire);
+    unsigned int limit = event->pressed ? KEY_RING_SIZE - KEY_RING_RELEASE_RESERVE : KEY_RING_SIZE;
+
+    if (head - tail >= limit) {
+        atomic_fetch_add_explicit(&ring->dropped, 1, memory_order_relaxed);
+        return false;
+    }
+
+    ring->events[head & KEY_RING_MASK] = *event;
+    atomic_store_explicit(&ring->head, head + 1, memory_order_release);
+    return true;
+}
+
+size_t key_ring_pop_batch(key_ring_t* ring, key_event_t* out, size_t max) {
+    unsigned int tail = atomic_load_explicit(&ring->tail, memory_order_relaxed);
+    unsigned int head = atomic_load_explicit(&ring->head, memory_order_acquire);
+    size_t count = head - tail;
+
+    if (count > max) {
+        count = max;
+    }
+    for (size_t i = 0; i < count; i++) {
+        out[i] = ring->events[(tail + i) & KEY_RING_MASK];
+    }
+    atomic_store_explicit(&ring->tail, tail + count, memory_order_release);
+    return count;
+}
+
+size_t key_ring_count(key_ring_t* ring) {
+    unsigned int tail = atomic_load_explicit(&ring->tail, memory_order_acquire);
+    unsigned int head = atomic_load_explicit(&ring->head, memory_order_acquire);
+    return head - tail;
+}
+
+uint32_t key_ring_dropped(key_ring_t* ring) {
+    return atomic_load_explicit(&ring->dropped, memory_order_relaxed);
+}
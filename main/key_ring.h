@@ -0,0 +1,44 @@
+#pragma once
+
+#include <stdatomic.h>
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+#include "latency.h"
+
+// Number of slots, must be a power of two
+#define KEY_RING_SIZE 256
+// Slots only release events may use. When the ring is nearly full new presses are dropped first, so the matching
+// releases of keys that are already queued still get through and no key is left stuck down.
+#define KEY_RING_RELEASE_RESERVE 16
+
+typedef struct {
+    uint32_t key;
+    bool pressed;
+    latency_stamp_t stamp;  // When the coprocessor raised its interrupt and when the callback queued the event
+} key_event_t;
+
+// Lock-free ring between exactly one producer (the coprocessor keyboard callback) and one consumer (the LVGL indev).
+// Neither side ever blocks.
+typedef struct {
+    key_event_t events[KEY_RING_SIZE];
+    atomic_uint head;     // Written by the producer only
+    atomic_uint tail;     // Written by the consumer only
+    atomic_uint dropped;  // Events rejected because the ring was full
+} key_ring_t;
+
+void key_ring_init(key_ring_t* ring);
+
+// Producer side. Returns false and counts the event as dropped when there is no room for it.
+bool key_ring_push(key_ring_t* ring, const key_event_t* event);
+
+// Consumer side. Copies up to max events into out and returns how many were copied.
+size_t key_ring_pop_batch(key_ring_t* ring, key_event_t* out, size_t max);
+
+size_t key_ring_count(key_ring_t* ring);
+uint32_t key_ring_dropped(key_ring_t* ring);
+
+// Pushes synthetic events at events_per_second from a separate task while the caller drains them in batches, then
+// checks that every event arrived in order or was counted as dropped. Logs the result and returns false on a lost,
+// duplicated or reordered event. Defined in key_ring_flood.c, which needs FreeRTOS.
+bool key_ring_flood(uint32_t events, uint32_t events_per_second);
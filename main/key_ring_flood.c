@@ -0,0 +1,86 @@
+#include "key_ring.h"
+#include <inttypes.h>
+#include <stdatomic.h>
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+#include "esp_log.h"
+#include "esp_timer.h"
+#include "freertos/FreeRTOS.h"
+#include "freertos/task.h"
+
+// The on-device flood check, kept apart from key_ring.c so the ring builds without ESP-IDF for test/host
+
+static char const TAG[] = "key-ring";
+
+typedef struct {
+    key_ring_t ring;
+    uint32_t events;
+    uint32_t events_per_second;
+    atomic_bool done;
+} key_ring_flood_t;
+
+static void key_ring_flood_producer(void* arg) {
+    key_ring_flood_t* flood = arg;
+    uint32_t per_tick = flood->events_per_second / configTICK_RATE_HZ;
+    if (per_tick == 0) {
+        per_tick = 1;
+    }
+
+    for (uint32_t sent = 0; sent < flood->events;) {
+        for (uint32_t i = 0; i < per_tick && sent < flood->events; i++, sent++) {
+            key_event_t event = {.key = sent, .pressed = (sent & 1) == 0};
+            key_ring_push(&flood->ring, &event);
+        }
+        vTaskDelay(1);
+    }
+
+    atomic_store(&flood->done, true);
+    vTaskDelete(NULL);
+}
+
+bool key_ring_flood(uint32_t events, uint32_t events_per_second) {
+    static key_ring_flood_t flood;
+    key_ring_init(&flood.ring);
+    flood.events = events;
+    flood.events_per_second = events_per_second;
+    atomic_init(&flood.done, false);
+
+    int64_t start = esp_timer_get_time();
+    if (xTaskCreate(key_ring_flood_producer, "key-flood", 4096, &flood, uxTaskPriorityGet(NULL) + 1, NULL) != pdPASS) {
+        ESP_LOGE(TAG, "Failed to start flood producer");
+        return false;
+    }
+
+    key_event_t batch[16];
+    uint32_t expected = 0;
+    uint32_t received = 0;
+    uint32_t gaps = 0;
+    bool ok = true;
+    while (true) {
+        bool done = atomic_load(&flood.done);
+        size_t count = key_ring_pop_batch(&flood.ring, batch, sizeof(batch) / sizeof(batch[0]));
+        for (size_t i = 0; i < count; i++) {
+            if (batch[i].key < expected || batch[i].pressed != ((batch[i].key & 1) == 0)) {
+                ok = false;
+            }
+            gaps += batch[i].key - expected;
+            expected = batch[i].key + 1;
+        }
+        received += count;
+        if (count == 0) {
+            if (done) {
+                break;
+            }
+            vTaskDelay(1);
+        }
+    }
+    gaps += events - expected;
+
+    int64_t elapsed_us = esp_timer_get_time() - start;
+    uint32_t dropped = key_ring_dropped(&flood.ring);
+    ok = ok && (received + dropped == events) && (gaps == dropped);
+    ESP_LOGI(TAG, "Flood %s: %" PRIu32 " events in %" PRId64 " ms, %" PRIu32 " received, %" PRIu32 " dropped",
+             ok ? "passed" : "FAILED", events, elapsed_us / 1000, received, dropped);
+    return ok;
+}
@@ -0,0 +1,158 @@
+#include "keymap.h"
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+#include "lvgl.h"
+
+#define KEYMAP_MOD_SHIFT (1 << 0)
+#define KEYMAP_MOD_FN    (1 << 1)
+#define KEYMAP_MOD_CTRL  (1 << 2)
+#define KEYMAP_MOD_ALT   (1 << 3)
+#define KEYMAP_MOD_META  (1 << 4)
+
+// X(field, modifier, normal, shift, fn) for every field of tanmatsu_coprocessor_keys_t, in the order they are declared.
+// Modifier keys only change the layer the other keys are looked up in and are not reported themselves.
+// clang-format off
+#define KEYMAP_KEYS(X)                                                                  \
+    X(key_esc,             0,                LV_KEY_ESC,           LV_KEY_ESC,           LV_KEY_ESC)           \
+    X(key_f1,              0,                KEYMAP_KEY_F1,        KEYMAP_KEY_F1,        KEYMAP_KEY_F1)        \
+    X(key_f2,              0,                KEYMAP_KEY_F2,        KEYMAP_KEY_F2,        KEYMAP_KEY_F2)        \
+    X(key_f3,              0,                KEYMAP_KEY_F3,        KEYMAP_KEY_F3,        KEYMAP_KEY_F3)        \
+    X(key_tilde,           0,                '`',                  '~',                  '`')                  \
+    X(key_1,               0,                '1',                  '!',                  '1')                  \
+    X(key_2,               0,                '2',                  '@',                  '2')                  \
+    X(key_3,               0,                '3',                  '#',                  '3')                  \
+    X(key_tab,             0,                LV_KEY_NEXT,          LV_KEY_PREV,          LV_KEY_NEXT)          \
+    X(key_q,               0,                'q',                  'Q',                  'q')                  \
+    X(key_w,               0,                'w',                  'W',                  'w')                  \
+    X(key_e,               0,                'e',                  'E',                  'e')                  \
+    X(key_fn,              KEYMAP_MOD_FN,    0,                    0,                    0)                    \
+    X(key_a,               0,                'a',                  'A',                  'a')                  \
+    X(key_s,               0,                's',                  'S',                  's')                  \
+    X(key_d,               0,                'd',                  'D',                  'd')                  \
+    X(key_shift_l,         KEYMAP_MOD_SHIFT, 0,                    0,                    0)                    \
+    X(key_z,               0,                'z',                  'Z',                  'z')                  \
+    X(key_x,               0,                'x',                  'X',                  'x')                  \
+    X(key_c,               0,                'c',                  'C',                  'c')                  \
+    X(key_ctrl,            KEYMAP_MOD_CTRL,  0,                    0,                    0)                    \
+    X(key_meta,            KEYMAP_MOD_META,  0,                    0,                    0)                    \
+    X(key_alt_l,           KEYMAP_MOD_ALT,   0,                    0,                    0)                    \
+    X(key_backslash,       0,                '\\',                 '|',                  '\\')                 \
+    X(key_4,               0,                '4',                  '$',                  '4')                  \
+    X(key_5,               0,                '5',                  '%',                  '5')                  \
+    X(key_6,               0,                '6',                  '^',                  '6')                  \
+    X(key_7,               0,                '7',                  '&',                  '7')                  \
+    X(key_r,               0,                'r',                  'R',                  'r')                  \
+    X(key_t,               0,                't',                  'T',                  't')                  \
+    X(key_y,               0,                'y',                  'Y',                  'y')                  \
+    X(key_u,               0,                'u',                  'U',                  'u')                  \
+    X(key_f,               0,                'f',                  'F',                  'f')                  \
+    X(key_g,               0,                'g',                  'G',                  'g')                  \
+    X(key_h,               0,                'h',                  'H',                  'h')                  \
+    X(key_j,               0,                'j',                  'J',                  'j')                  \
+    X(key_v,               0,                'v',                  'V',                  'v')                  \
+    X(key_b,               0,                'b',                  'B',                  'b')                  \
+    X(key_n,               0,                'n',                  'N',                  'n')                  \
+    X(key_m,               0,                'm',                  'M',                  'm')                  \
+    X(key_f4,              0,                KEYMAP_KEY_F4,        KEYMAP_KEY_F4,        KEYMAP_KEY_F4)        \
+    X(key_f5,              0,                KEYMAP_KEY_F5,        KEYMAP_KEY_F5,        KEYMAP_KEY_F5)        \
+    X(key_f6,              0,                KEYMAP_KEY_F6,        KEYMAP_KEY_F6,        KEYMAP_KEY_F6)        \
+    X(key_backspace,       0,                LV_KEY_BACKSPACE,     LV_KEY_BACKSPACE,     LV_KEY_DEL)           \
+    X(key_9,               0,                '9',                  '(',                  '9')                  \
+    X(key_0,               0,                '0',                  ')',                  '0')                  \
+    X(key_minus,           0,                '-',                  '_',                  '-')                  \
+    X(key_equals,          0,                '=',                  '+',                  '=')                  \
+    X(key_o,               0,                'o',                  'O',                  'o')                  \
+    X(key_p,               0,                'p',                  'P',                  'p')                  \
+    X(key_sqbracket_open,  0,                '[',                  '{',                  '[')                  \
+    X(key_sqbracket_close, 0,                ']',                  '}',                  ']')                  \
+    X(key_l,               0,                'l',                  'L',                  'l')                  \
+    X(key_semicolon,       0,                ';',                  ':',                  ';')                  \
+    X(key_quote,           0,                '\'',                 '"',                  '\'')                 \
+    X(key_return,          0,                LV_KEY_ENTER,         LV_KEY_ENTER,         LV_KEY_ENTER)         \
+    X(key_dot,             0,                '.',                  '>',                  '.')                  \
+    X(key_slash,           0,                '/',                  '?',                  '/')                  \
+    X(key_up,              0,                LV_KEY_UP,            LV_KEY_UP,            LV_KEY_PREV)          \
+    X(key_shift_r,         KEYMAP_MOD_SHIFT, 0,                    0,                    0)                    \
+    X(key_alt_r,           KEYMAP_MOD_ALT,   0,                    0,                    0)                    \
+    X(key_left,            0,                LV_KEY_LEFT,          LV_KEY_LEFT,          LV_KEY_HOME)          \
+    X(key_down,            0,                LV_KEY_DOWN,          LV_KEY_DOWN,          LV_KEY_NEXT)          \
+    X(key_right,           0,                LV_KEY_RIGHT,         LV_KEY_RIGHT,         LV_KEY_END)           \
+    X(key_8,               0,                '8',                  '*',                  '8')                  \
+    X(key_i,               0,                'i',                  'I',                  'i')                  \
+    X(key_k,               0,                'k',                  'K',                  'k')                  \
+    X(key_comma,           0,                ',',                  '<',                  ',')                  \
+    X(key_space_l,         0,                ' ',                  ' ',                  ' ')                  \
+    X(key_space_m,         0,                ' ',                  ' ',                  ' ')                  \
+    X(key_space_r,         0,                ' ',                  ' ',                  ' ')                  \
+    X(key_volume_up,       0,                KEYMAP_KEY_VOLUME_UP, KEYMAP_KEY_VOLUME_UP, KEYMAP_KEY_VOLUME_UP)
+// clang-format on
+
+typedef struct {
+    uint8_t modifier;
+    uint32_t normal;
+    uint32_t shift;
+    uint32_t fn;
+} keymap_entry_t;
+
+// The fields are consecutive one-bit bitfields, which GCC allocates from the least significant bit of raw[0] on in the
+// order they are declared. So the table, in the same order, is indexed by the bit of each key in the raw bitmap.
+// test/host/test_keymap.c checks every field against its entry.
+static const keymap_entry_t keymap[] = {
+#define KEYMAP_ENTRY(field, modifier, normal, shift, fn) {modifier, normal, shift, fn},
+    KEYMAP_KEYS(KEYMAP_ENTRY)
+#undef KEYMAP_ENTRY
+};
+
+_Static_assert(sizeof(keymap) / sizeof(keymap[0]) == KEYMAP_BITS, "Every bit of the key bitmap needs an entry");
+_Static_assert(__BYTE_ORDER__ == __ORDER_LITTLE_ENDIAN__, "Bitfields are allocated from the least significant bit");
+
+// Modifiers held in keys. Expands to a test of the modifier key fields only, the other fields fold away.
+static uint8_t keymap_modifiers(const tanmatsu_coprocessor_keys_t* keys) {
+    uint8_t modifiers = 0;
+#define KEYMAP_MODIFIER(field, modifier, normal, shift, fn) modifiers |= keys->field ? (modifier) : 0;
+    KEYMAP_KEYS(KEYMAP_MODIFIER)
+#undef KEYMAP_MODIFIER
+    return modifiers;
+}
+
+void keymap_init(keymap_state_t* state) {
+    for (size_t entry = 0; entry < KEYMAP_BITS; entry++) {
+        state->pressed_codes[entry] = keymap[entry].normal;
+    }
+}
+
+void keymap_decode(keymap_state_t* state, const tanmatsu_coprocessor_keys_t* prev_keys,
+                   const tanmatsu_coprocessor_keys_t* keys, keymap_emit_t emit) {
+    // Looked up on the first press only, releases and modifier changes alone do not need it
+    uint8_t modifiers = 0;
+    bool modifiers_read = false;
+
+    for (size_t byte = 0; byte < sizeof(keys->raw); byte++) {
+        uint8_t changed = prev_keys->raw[byte] ^ keys->raw[byte];
+        while (changed) {
+            size_t bit = __builtin_ctz(changed);
+            changed &= changed - 1;
+
+            size_t entry = byte * 8 + bit;
+            const keymap_entry_t* key = &keymap[entry];
+            if (key->modifier) {
+                continue;
+            }
+
+            if ((keys->raw[byte] >> bit) & 1) {
+                if (!modifiers_read) {
+                    modifiers = keymap_modifiers(keys);
+                    modifiers_read = true;
+                }
+                uint32_t code = (modifiers & KEYMAP_MOD_FN)      ? key->fn
+                                : (modifiers & KEYMAP_MOD_SHIFT) ? key->shift
+                                                                 : key->normal;
+                state->pressed_codes[entry] = code;
+                emit(1, code);
+            } else {
+                emit(0, state->pressed_codes[entry]);
+            }
+        }
+    }
+}
@@ -0,0 +1,35 @@
+#pragma once
+
+#include <stdint.h>
+#include "tanmatsu_coprocessor.h"
+
+// Keys without an LVGL equivalent are reported with codes from the Unicode private use area
+#define KEYMAP_KEY_F1        0xE001
+#define KEYMAP_KEY_F2        0xE002
+#define KEYMAP_KEY_F3        0xE003
+#define KEYMAP_KEY_F4        0xE004
+#define KEYMAP_KEY_F5        0xE005
+#define KEYMAP_KEY_F6        0xE006
+#define KEYMAP_KEY_VOLUME_UP 0xE010
+
+// Bits in the coprocessor's key bitmap, every one of them is a key
+#define KEYMAP_BITS (sizeof(((tanmatsu_coprocessor_keys_t*)0)->raw) * 8)
+
+typedef void (*keymap_emit_t)(uint8_t pressed, uint32_t key);
+
+// Decoder state of one source of key bitmaps. Every source decodes with its own state, the decoder keeps no other.
+typedef struct {
+    uint32_t pressed_codes[KEYMAP_BITS];  // Code reported by the last press of every key
+} keymap_state_t;
+
+// Starts with every key released, a release without a press reports the key's normal code
+void keymap_init(keymap_state_t* state);
+
+// Compares both key bitmaps, walks only the bits that changed and emits a press or release for each key. Shift and Fn
+// select the layer a key is looked up in, a release always reports the code of the matching press.
+void keymap_decode(keymap_state_t* state, const tanmatsu_coprocessor_keys_t* prev_keys,
+                   const tanmatsu_coprocessor_keys_t* keys, keymap_emit_t emit);
+
+// Decodes a fixed sequence of key bitmaps iterations times with keymap_decode() and with a per-field branch chain and
+// reports the time per decoded bitmap for both, as key_decode and key_decode_branch_chain. Defined in keymap_bench.c.
+void keymap_benchmark(int iterations);
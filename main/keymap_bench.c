@@ -0,0 +1,112 @@
+#include "keymap.h"
+#include <inttypes.h>
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+#include "bench.h"
+#include "esp_log.h"
+#include "lvgl.h"
+
+static char const TAG[] = "keymap";
+
+static uint32_t benchmark_events = 0;
+
+static void keymap_benchmark_emit(uint8_t pressed, uint32_t key) {
+    benchmark_events += key + pressed;
+}
+
+// The field-by-field comparison bsp_lvgl.c used before keymap_decode(), kept here as the benchmark reference
+static void keymap_branch_chain(const tanmatsu_coprocessor_keys_t* prev_keys, const tanmatsu_coprocessor_keys_t* keys,
+                                keymap_emit_t emit) {
+#define KEYMAP_CHAIN(field, code)             \
+    if (keys->field != prev_keys->field) {    \
+        emit(keys->field, code);              \
+    }
+    KEYMAP_CHAIN(key_up, LV_KEY_UP)
+    KEYMAP_CHAIN(key_down, LV_KEY_DOWN)
+    KEYMAP_CHAIN(key_left, LV_KEY_LEFT)
+    KEYMAP_CHAIN(key_right, LV_KEY_RIGHT)
+    KEYMAP_CHAIN(key_return, LV_KEY_ENTER)
+    KEYMAP_CHAIN(key_esc, LV_KEY_ESC)
+    KEYMAP_CHAIN(key_tab, LV_KEY_NEXT)
+    KEYMAP_CHAIN(key_backspace, LV_KEY_BACKSPACE)
+    KEYMAP_CHAIN(key_a, 'A')
+    KEYMAP_CHAIN(key_b, 'B')
+    KEYMAP_CHAIN(key_c, 'C')
+    KEYMAP_CHAIN(key_d, 'D')
+    KEYMAP_CHAIN(key_e, 'E')
+    KEYMAP_CHAIN(key_f, 'F')
+    KEYMAP_CHAIN(key_g, 'G')
+    KEYMAP_CHAIN(key_h, 'H')
+    KEYMAP_CHAIN(key_i, 'I')
+    KEYMAP_CHAIN(key_j, 'J')
+    KEYMAP_CHAIN(key_k, 'K')
+    KEYMAP_CHAIN(key_l, 'L')
+    KEYMAP_CHAIN(key_m, 'M')
+    KEYMAP_CHAIN(key_n, 'N')
+    KEYMAP_CHAIN(key_o, 'O')
+    KEYMAP_CHAIN(key_p, 'P')
+    KEYMAP_CHAIN(key_q, 'Q')
+    KEYMAP_CHAIN(key_r, 'R')
+    KEYMAP_CHAIN(key_s, 'S')
+    KEYMAP_CHAIN(key_t, 'T')
+    KEYMAP_CHAIN(key_u, 'U')
+    KEYMAP_CHAIN(key_v, 'V')
+    KEYMAP_CHAIN(key_w, 'W')
+    KEYMAP_CHAIN(key_x, 'X')
+    KEYMAP_CHAIN(key_y, 'Y')
+    KEYMAP_CHAIN(key_z, 'Z')
+#undef KEYMAP_CHAIN
+}
+
+typedef struct {
+    const tanmatsu_coprocessor_keys_t* sequence;
+    size_t steps;
+    bool table;
+    keymap_state_t state;  // The benchmark's own, the live keyboard keeps decoding with its state meanwhile
+} keymap_bench_t;
+
+// One operation is one bitmap of the sequence
+static void keymap_bench_body(void* ctx, uint32_t ops) {
+    keymap_bench_t* bench = ctx;
+    for (uint32_t i = 0; i < ops; i++) {
+        size_t s = i % bench->steps;
+        const tanmatsu_coprocessor_keys_t* prev_keys = &bench->sequence[s ? s - 1 : bench->steps - 1];
+        if (bench->table) {
+            keymap_decode(&bench->state, prev_keys, &bench->sequence[s], keymap_benchmark_emit);
+        } else {
+            keymap_branch_chain(prev_keys, &bench->sequence[s], keymap_benchmark_emit);
+        }
+    }
+}
+
+void keymap_benchmark(int iterations) {
+    // Typing-like sequence: every step toggles one or two pseudo-random keys
+    static tanmatsu_coprocessor_keys_t sequence[64];
+    size_t steps = sizeof(sequence) / sizeof(sequence[0]);
+    uint32_t seed = 0x12345678;
+    for (size_t i = 0; i < steps; i++) {
+        sequence[i] = sequence[i ? i - 1 : steps - 1];
+        for (int toggles = 1 + (seed & 1); toggles > 0; toggles--) {
+            seed = seed * 1664525u + 1013904223u;
+            size_t bit = (seed >> 16) % KEYMAP_BITS;
+            sequence[i].raw[bit >> 3] ^= 1 << (bit & 7);
+        }
+    }
+
+    static keymap_bench_t bench;
+    bench.sequence = sequence;
+    bench.steps = steps;
+    bench.table = true;
+    keymap_init(&bench.state);
+    bench_result_t table;
+    bench_run("key_decode", keymap_bench_body, &bench, iterations * steps, 9, &table);
+    bench.table = false;
+    bench_result_t chain;
+    bench_run("key_decode_branch_chain", keymap_bench_body, &bench, iterations * steps, 9, &chain);
+
+    ESP_LOGI(TAG,
+             "Key decode: table %" PRIu64 " ns/bitmap (%u keys), branch chain %" PRIu64
+             " ns/bitmap (34 keys), checksum %" PRIu32,
+             table.median_ns, (unsigned)KEYMAP_BITS, chain.median_ns, benchmark_events);
+}
@@ -0,0 +1,130 @@
+#include "latency.h"
+#include <inttypes.h>
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <string.h>
+
+#define LATENCY_SUB_BUCKETS (1u << LATENCY_SUB_BUCKET_BITS)
+
+static const char* const span_names[LATENCY_SPAN_COUNT] = {
+    [LATENCY_IRQ_TO_CALLBACK] = "irq->callback",
+    [LATENCY_CALLBACK_TO_READ] = "callback->read",
+    [LATENCY_READ_TO_FLUSH] = "read->flush",
+    [LATENCY_IRQ_TO_FLUSH] = "irq->flush",
+};
+
+static size_t bucket_index(uint32_t us) {
+    if (us < 2 * LATENCY_SUB_BUCKETS) {
+        return us;
+    }
+    uint32_t exponent = 31 - __builtin_clz(us);
+    if (exponent >= LATENCY_MAX_EXPONENT) {
+        return LATENCY_BUCKETS - 1;
+    }
+    uint32_t sub = (us >> (exponent - LATENCY_SUB_BUCKET_BITS)) & (LATENCY_SUB_BUCKETS - 1);
+    return ((exponent - LATENCY_SUB_BUCKET_BITS + 1) << LATENCY_SUB_BUCKET_BITS) | sub;
+}
+
+static uint32_t bucket_upper_bound(size_t index) {
+    if (index < 2 * LATENCY_SUB_BUCKETS) {
+        return index;
+    }
+    if (index == LATENCY_BUCKETS - 1) {
+        return UINT32_MAX;  // Also holds everything beyond the covered range
+    }
+    uint32_t exponent = (index >> LATENCY_SUB_BUCKET_BITS) + LATENCY_SUB_BUCKET_BITS - 1;
+    uint32_t sub = index & (LATENCY_SUB_BUCKETS - 1);
+    uint32_t width = 1u << (exponent - LATENCY_SUB_BUCKET_BITS);
+    return ((LATENCY_SUB_BUCKETS + sub) << (exponent - LATENCY_SUB_BUCKET_BITS)) + width - 1;
+}
+
+void latency_histogram_reset(latency_histogram_t* histogram) {
+    memset(histogram, 0, sizeof(*histogram));
+    histogram->min_us = UINT32_MAX;
+}
+
+void latency_histogram_add(latency_histogram_t* histogram, uint32_t us) {
+    histogram->counts[bucket_index(us)]++;
+    histogram->total++;
+    histogram->sum_us += us;
+    if (us < histogram->min_us) {
+        histogram->min_us = us;
+    }
+    if (us > histogram->max_us) {
+        histogram->max_us = us;
+    }
+}
+
+uint32_t latency_histogram_percentile(const latency_histogram_t* histogram, uint32_t permille) {
+    if (histogram->total == 0) {
+        return 0;
+    }
+    uint64_t rank = ((uint64_t)histogram->total * permille + 999) / 1000;
+    if (rank == 0) {
+        rank = 1;
+    }
+    uint64_t seen = 0;
+    for (size_t i = 0; i < LATENCY_BUCKETS; i++) {
+        seen += histogram->counts[i];
+        if (seen >= rank) {
+            uint32_t bound = bucket_upper_bound(i);
+            return bound < histogram->max_us ? bound : histogram->max_us;
+        }
+    }
+    return histogram->max_us;
+}
+
+void latency_tracker_reset(latency_tracker_t* tracker) {
+    for (size_t i = 0; i < LATENCY_SPAN_COUNT; i++) {
+        latency_histogram_reset(&tracker->spans[i]);
+    }
+    tracker->pending_count = 0;
+    tracker->without_flush = 0;
+    tracker->untracked = 0;
+}
+
+void latency_tracker_read(latency_tracker_t* tracker, const latency_stamp_t* stamp, uint32_t read_us) {
+    latency_histogram_add(&tracker->spans[LATENCY_IRQ_TO_CALLBACK], stamp->callback_us - stamp->irq_us);
+    latency_histogram_add(&tracker->spans[LATENCY_CALLBACK_TO_READ], read_us - stamp->callback_us);
+
+    if (tracker->pending_count == LATENCY_MAX_PENDING) {
+        tracker->untracked++;
+        return;
+    }
+    tracker->pending[tracker->pending_count++] = (latency_pending_t){
+        .irq_us = stamp->irq_us,
+        .read_us = read_us,
+    };
+}
+
+void latency_tracker_flush(latency_tracker_t* tracker, uint32_t flush_us) {
+    for (size_t i = 0; i < tracker->pending_count; i++) {
+        const latency_pending_t* pending = &tracker->pending[i];
+        uint32_t read_to_flush = flush_us - pending->read_us;
+        if (read_to_flush > LATENCY_FLUSH_TIMEOUT_US) {
+            tracker->without_flush++;
+            continue;
+        }
+        latency_histogram_add(&tracker->spans[LATENCY_READ_TO_FLUSH], read_to_flush);
+        latency_histogram_add(&tracker->spans[LATENCY_IRQ_TO_FLUSH], flush_us - pending->irq_us);
+    }
+    tracker->pending_count = 0;
+}
+
+void latency_tracker_print(const latency_tracker_t* tracker) {
+    for (size_t i = 0; i < LATENCY_SPAN_COUNT; i++) {
+        const latency_histogram_t* h = &tracker->spans[i];
+        if (h->total == 0) {
+            printf("%-15s no events\n", span_names[i]);
+            continue;
+        }
+        printf("%-15s n=%" PRIu32 " min=%" PRIu32 " avg=%" PRIu64 " p50=%" PRIu32 " p90=%" PRIu32 " p99=%" PRIu32
+               " p99.9=%" PRIu32 " max=%" PRIu32 " us\n",
+               span_names[i], h->total, h->min_us, h->sum_us / h->total, latency_histogram_percentile(h, 500),
+               latency_histogram_percentile(h, 900), latency_histogram_percentile(h, 990),
+               latency_histogram_percentile(h, 999), h->max_us);
+    }
+    printf("%" PRIu32 " events without a flush, %" PRIu32 " untracked\n", tracker->without_flush, tracker->untracked);
+}
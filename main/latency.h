@@ -0,0 +1,77 @@
+#pragma once
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+// Histogram buckets are exact below 16 us and split every power of two above that into 8 buckets, so a reported
+// percentile is at most 1/8 above the real value. Latencies of 2^LATENCY_MAX_EXPONENT us and more go to one more
+// bucket after those.
+#define LATENCY_SUB_BUCKET_BITS 3
+#define LATENCY_MAX_EXPONENT    24
+#define LATENCY_BUCKETS         (((LATENCY_MAX_EXPONENT - LATENCY_SUB_BUCKET_BITS + 1) << LATENCY_SUB_BUCKET_BITS) + 1)
+
+// Key events read but not yet followed by a flush
+#define LATENCY_MAX_PENDING      32
+// An event whose first flush comes later than this after it was read did not cause a redraw, the flush belongs to
+// something else and the event is only counted
+#define LATENCY_FLUSH_TIMEOUT_US 500000
+
+typedef enum {
+    LATENCY_IRQ_TO_CALLBACK,   // Coprocessor interrupt to coprocessor_keyboard_callback
+    LATENCY_CALLBACK_TO_READ,  // Callback to the keypad indev reading the event
+    LATENCY_READ_TO_FLUSH,     // Indev read to the end of the first flush after it
+    LATENCY_IRQ_TO_FLUSH,      // Interrupt to the end of the first flush, the whole input-to-photon path
+    LATENCY_SPAN_COUNT,
+} latency_span_t;
+
+typedef struct {
+    uint32_t counts[LATENCY_BUCKETS];
+    uint32_t total;
+    uint32_t min_us;
+    uint32_t max_us;
+    uint64_t sum_us;
+} latency_histogram_t;
+
+// Times are microseconds from one free-running clock, truncated to 32 bits. Only differences are used, so the
+// wrap-around after 71 minutes does not matter.
+typedef struct {
+    uint32_t irq_us;
+    uint32_t callback_us;
+} latency_stamp_t;
+
+typedef struct {
+    uint32_t irq_us;
+    uint32_t read_us;
+} latency_pending_t;
+
+// Follows key events through the input pipeline. The tracker has no locking and no platform dependencies, the owner
+// serializes access and feeds it the timestamps.
+typedef struct {
+    latency_histogram_t spans[LATENCY_SPAN_COUNT];
+    latency_pending_t pending[LATENCY_MAX_PENDING];
+    size_t pending_count;
+    uint32_t without_flush;  // Events not followed by a flush within LATENCY_FLUSH_TIMEOUT_US
+    uint32_t untracked;      // Events read while LATENCY_MAX_PENDING events were already waiting for a flush
+} latency_tracker_t;
+
+void latency_histogram_reset(latency_histogram_t* histogram);
+void latency_histogram_add(latency_histogram_t* histogram, uint32_t us);
+
+// Upper bound of the bucket that holds the given percentile, in tenths of a percent (990 is p99). 0 when empty.
+uint32_t latency_histogram_percentile(const latency_histogram_t* histogram, uint32_t permille);
+
+void latency_tracker_reset(latency_tracker_t* tracker);
+
+// A key event was read by the indev at read_us
+void latency_tracker_read(latency_tracker_t* tracker, const latency_stamp_t* stamp, uint32_t read_us);
+
+// A flush ended at flush_us, completes every event read since the previous flush
+void latency_tracker_flush(latency_tracker_t* tracker, uint32_t flush_us);
+
+static inline bool latency_tracker_pending(const latency_tracker_t* tracker) {
+    return tracker->pending_count > 0;
+}
+
+// Prints one line per span with count, min, average, percentiles and max to stdout
+void latency_tracker_print(const latency_tracker_t* tracker);
@@ -0,0 +1,404 @@
+#include "lvgl_alloc.h"
+#include <inttypes.h>
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <string.h>
+#include "bench.h"
+#include "bsp_lvgl.h"
+#include "esp_heap_caps.h"
+#include "esp_log.h"
+#include "esp_timer.h"
+#include "freertos/FreeRTOS.h"
+#include "lvgl.h"
+
+static char const TAG[] = "lvgl-alloc";
+
+#define ALLOC_HEADER_SIZE    8
+#define ALLOC_LARGE          0xFE  // Class of an allocation in PSRAM
+#define ALLOC_LARGE_INTERNAL 0xFF  // Class of a large allocation that fell back to internal RAM
+#define ALLOC_SLAB_SIZE      4096
+#define ALLOC_SLAB_HEADER    8  // Link to the next slab, padded to keep the slots 8 byte aligned
+#define ALLOC_INTERNAL_CAPS  (MALLOC_CAP_INTERNAL | MALLOC_CAP_8BIT)
+
+// Steps of 16 bytes for the small objects that make up most of a widget, then wider steps
+static const uint16_t slot_sizes[LVGL_ALLOC_CLASS_COUNT] = {16, 32, 48, 64, 96, 128, 192, 256, 384, 512};
+
+typedef struct {
+    uint32_t size;  // Bytes asked for
+    uint32_t cls;   // Index into slot_sizes, or ALLOC_LARGE*
+} alloc_header_t;
+
+typedef struct free_slot {
+    struct free_slot* next;
+} free_slot_t;
+
+typedef struct slab {
+    struct slab* next;
+} slab_t;
+
+static portMUX_TYPE alloc_lock = portMUX_INITIALIZER_UNLOCKED;
+static free_slot_t* free_lists[LVGL_ALLOC_CLASS_COUNT];
+static slab_t* slabs = NULL;
+// Class for each size with header in steps of 16 bytes, rounded up
+static uint8_t class_of[512 / 16 + 1];
+static lvgl_alloc_stats_t stats;
+
+static void count_alloc(size_t size) {
+    stats.in_use += size;
+    if (stats.in_use > stats.peak_in_use) {
+        stats.peak_in_use = stats.in_use;
+    }
+}
+
+// Adds a slab to the class, allocated outside the lock since heap_caps_malloc() may block
+static bool grow(size_t cls) {
+    slab_t* slab = heap_caps_malloc(ALLOC_SLAB_SIZE, ALLOC_INTERNAL_CAPS);
+    if (slab == NULL) {
+        return false;
+    }
+    uint32_t slot_size = slot_sizes[cls];
+    uint32_t count = (ALLOC_SLAB_SIZE - ALLOC_SLAB_HEADER) / slot_size;
+    uint8_t* first = (uint8_t*)slab + ALLOC_SLAB_HEADER;
+    for (uint32_t i = 0; i + 1 < count; i++) {
+        ((free_slot_t*)&first[i * slot_size])->next = (free_slot_t*)&first[(i + 1) * slot_size];
+    }
+    free_slot_t* last = (free_slot_t*)&first[(count - 1) * slot_size];
+
+    portENTER_CRITICAL(&alloc_lock);
+    last->next = free_lists[cls];
+    free_lists[cls] = (free_slot_t*)first;
+    slab->next = slabs;
+    slabs = slab;
+    stats.classes[cls].slots += count;
+    stats.slab_bytes += ALLOC_SLAB_SIZE;
+    portEXIT_CRITICAL(&alloc_lock);
+    return true;
+}
+
+static alloc_header_t* pool_alloc(size_t cls, size_t size) {
+    while (true) {
+        portENTER_CRITICAL(&alloc_lock);
+        free_slot_t* slot = free_lists[cls];
+        if (slot != NULL) {
+            free_lists[cls] = slot->next;
+            lvgl_alloc_class_stats_t* class_stats = &stats.classes[cls];
+            class_stats->used++;
+            if (class_stats->used > class_stats->peak_used) {
+                class_stats->peak_used = class_stats->used;
+            }
+            class_stats->requested += size;
+            count_alloc(size);
+            portEXIT_CRITICAL(&alloc_lock);
+            return (alloc_header_t*)slot;
+        }
+        portEXIT_CRITICAL(&alloc_lock);
+        // Another task may take the new slots first, then this one grows the class again
+        if (!grow(cls)) {
+            return NULL;
+        }
+    }
+}
+
+static alloc_header_t* large_alloc(size_t size) {
+    uint32_t cls = ALLOC_LARGE;
+    alloc_header_t* header = heap_caps_malloc(ALLOC_HEADER_SIZE + size, MALLOC_CAP_SPIRAM);
+    if (header == NULL) {
+        cls = ALLOC_LARGE_INTERNAL;
+        header = heap_caps_malloc(ALLOC_HEADER_SIZE + size, ALLOC_INTERNAL_CAPS);
+    }
+    portENTER_CRITICAL(&alloc_lock);
+    if (header == NULL) {
+        stats.failed++;
+    } else {
+        header->cls = cls;
+        stats.large_count++;
+        stats.large_internal += cls == ALLOC_LARGE_INTERNAL;
+        stats.large_bytes += size;
+        count_alloc(size);
+    }
+    portEXIT_CRITICAL(&alloc_lock);
+    return header;
+}
+
+void lv_mem_init(void) {
+    size_t cls = 0;
+    for (size_t i = 0; i < sizeof(class_of); i++) {
+        while (slot_sizes[cls] < i * 16) {
+            cls++;
+        }
+        class_of[i] = cls;
+    }
+    for (cls = 0; cls < LVGL_ALLOC_CLASS_COUNT; cls++) {
+        stats.classes[cls].slot_size = slot_sizes[cls];
+    }
+}
+
+void lv_mem_deinit(void) {
+    while (slabs != NULL) {
+        slab_t* next = slabs->next;
+        heap_caps_free(slabs);
+        slabs = next;
+    }
+    memset(free_lists, 0, sizeof(free_lists));
+    memset(&stats, 0, sizeof(stats));
+}
+
+// The pools grow by themselves, there is nothing to add
+lv_mem_pool_t lv_mem_add_pool(void* mem, size_t bytes) {
+    return NULL;
+}
+
+void lv_mem_remove_pool(lv_mem_pool_t pool) {}
+
+void* lv_malloc_core(size_t size) {
+    alloc_header_t* header = NULL;
+    if (size <= LVGL_ALLOC_POOLED_MAX) {
+        size_t cls = class_of[(ALLOC_HEADER_SIZE + size + 15) / 16];
+        header = pool_alloc(cls, size);
+        if (header != NULL) {
+            header->cls = cls;
+        }
+    }
+    // Small objects also go here when internal RAM has no room for another slab
+    if (header == NULL) {
+        header = large_alloc(size);
+    }
+    if (header == NULL) {
+        return NULL;
+    }
+    header->size = size;
+    return (uint8_t*)header + ALLOC_HEADER_SIZE;
+}
+
+void lv_free_core(void* p) {
+    if (p == NULL) {
+        return;
+    }
+    alloc_header_t* header = (alloc_header_t*)((uint8_t*)p - ALLOC_HEADER_SIZE);
+    uint32_t cls = header->cls;
+    size_t size = header->size;
+    if (cls >= LVGL_ALLOC_CLASS_COUNT) {
+        heap_caps_free(header);
+    }
+    portENTER_CRITICAL(&alloc_lock);
+    if (cls < LVGL_ALLOC_CLASS_COUNT) {
+        free_slot_t* slot = (free_slot_t*)header;
+        slot->next = free_lists[cls];
+        free_lists[cls] = slot;
+        stats.classes[cls].used--;
+        stats.classes[cls].requested -= size;
+    } else {
+        stats.large_count--;
+        stats.large_internal -= cls == ALLOC_LARGE_INTERNAL;
+        stats.large_bytes -= size;
+    }
+    stats.in_use -= size;
+    portEXIT_CRITICAL(&alloc_lock);
+}
+
+void* lv_realloc_core(void* p, size_t new_size) {
+    if (p == NULL) {
+        return lv_malloc_core(new_size);
+    }
+    alloc_header_t* header = (alloc_header_t*)((uint8_t*)p - ALLOC_HEADER_SIZE);
+    // Pool slots have room up to the slot size, growing within it only changes the numbers
+    if (header->cls < LVGL_ALLOC_CLASS_COUNT && ALLOC_HEADER_SIZE + new_size <= slot_sizes[header->cls]) {
+        portENTER_CRITICAL(&alloc_lock);
+        stats.classes[header->cls].requested += new_size - header->size;
+        stats.in_use += new_size - header->size;
+        if (stats.in_use > stats.peak_in_use) {
+            stats.peak_in_use = stats.in_use;
+        }
+        portEXIT_CRITICAL(&alloc_lock);
+        header->size = new_size;
+        return p;
+    }
+    void* moved = lv_malloc_core(new_size);
+    if (moved == NULL) {
+        return NULL;
+    }
+    memcpy(moved, p, header->size < new_size ? header->size : new_size);
+    lv_free_core(p);
+    return moved;
+}
+
+// The pools are the heap LVGL sees, large allocations count as used. Fragmentation is the PSRAM heap's, the pools
+// themselves cannot fragment.
+void lv_mem_monitor_core(lv_mem_monitor_t* mon_p) {
+    lvgl_alloc_stats_t current;
+    lvgl_alloc_get_stats(&current);
+    size_t free_slots = 0;
+    size_t free_bytes = 0;
+    size_t used_slots = 0;
+    for (size_t cls = 0; cls < LVGL_ALLOC_CLASS_COUNT; cls++) {
+        const lvgl_alloc_class_stats_t* class_stats = &current.classes[cls];
+        free_slots += class_stats->slots - class_stats->used;
+        free_bytes += (class_stats->slots - class_stats->used) * class_stats->slot_size;
+        used_slots += class_stats->used;
+    }
+    size_t psram_free = heap_caps_get_free_size(MALLOC_CAP_SPIRAM);
+    size_t psram_largest = heap_caps_get_largest_free_block(MALLOC_CAP_SPIRAM);
+
+    memset(mon_p, 0, sizeof(*mon_p));
+    mon_p->total_size = current.slab_bytes + current.large_bytes;
+    mon_p->free_cnt = free_slots;
+    mon_p->free_size = free_bytes;
+    mon_p->free_biggest_size = psram_largest;
+    mon_p->used_cnt = used_slots + current.large_count;
+    mon_p->max_used = current.peak_in_use;
+    mon_p->used_pct = mon_p->total_size > 0 ? current.in_use * 100 / mon_p->total_size : 0;
+    mon_p->frag_pct = psram_free > 0 ? 100 - psram_largest * 100 / psram_free : 0;
+}
+
+// Checks that every free list holds exactly the free slots of its class and only points into the slabs
+lv_result_t lv_mem_test_core(void) {
+    lv_result_t result = LV_RESULT_OK;
+    portENTER_CRITICAL(&alloc_lock);
+    for (size_t cls = 0; cls < LVGL_ALLOC_CLASS_COUNT && result == LV_RESULT_OK; cls++) {
+        uint32_t count = 0;
+        for (free_slot_t* slot = free_lists[cls]; slot != NULL && result == LV_RESULT_OK; slot = slot->next) {
+            bool in_slab = false;
+            for (slab_t* slab = slabs; slab != NULL && !in_slab; slab = slab->next) {
+                uint8_t* start = (uint8_t*)slab + ALLOC_SLAB_HEADER;
+                in_slab = (uint8_t*)slot >= start && (uint8_t*)slot < (uint8_t*)slab + ALLOC_SLAB_SIZE &&
+                          ((uint8_t*)slot - start) % slot_sizes[cls] == 0;
+            }
+            count++;
+            if (!in_slab || count > stats.classes[cls].slots) {
+                result = LV_RESULT_INVALID;
+            }
+        }
+        if (count != stats.classes[cls].slots - stats.classes[cls].used) {
+            result = LV_RESULT_INVALID;
+        }
+    }
+    portEXIT_CRITICAL(&alloc_lock);
+    return result;
+}
+
+void lvgl_alloc_get_stats(lvgl_alloc_stats_t* out) {
+    portENTER_CRITICAL(&alloc_lock);
+    *out = stats;
+    portEXIT_CRITICAL(&alloc_lock);
+}
+
+void lvgl_alloc_print_stats() {
+    lvgl_alloc_stats_t current;
+    lvgl_alloc_get_stats(&current);
+    size_t slot_bytes = 0;
+    size_t requested = 0;
+    printf("LVGL memory: %u bytes in use, peak %u, %" PRIu32 " failed allocations\r\n", (unsigned)current.in_use,
+           (unsigned)current.peak_in_use, current.failed);
+    for (size_t cls = 0; cls < LVGL_ALLOC_CLASS_COUNT; cls++) {
+        const lvgl_alloc_class_stats_t* class_stats = &current.classes[cls];
+        if (class_stats->slots == 0) {
+            continue;
+        }
+        printf("  %3" PRIu32 " byte slots: %5" PRIu32 " of %5" PRIu32 " used, peak %5" PRIu32
+               ", %6u bytes requested\r\n",
+               class_stats->slot_size, class_stats->used, class_stats->slots, class_stats->peak_used,
+               (unsigned)class_stats->requested);
+        slot_bytes += class_stats->slots * class_stats->slot_size;
+        requested += class_stats->requested;
+    }
+    // Unused is what the free slots, the headers and the rounding up to the slot size cost
+    printf("Pools: %u bytes of internal RAM, %.1f%% unused\r\n", (unsigned)current.slab_bytes,
+           slot_bytes > 0 ? 100.0 - requested * 100.0 / slot_bytes : 0.0);
+    size_t psram_free = heap_caps_get_free_size(MALLOC_CAP_SPIRAM);
+    size_t psram_largest = heap_caps_get_largest_free_block(MALLOC_CAP_SPIRAM);
+    printf("Large: %" PRIu32 " allocations with %u bytes, %" PRIu32 " in internal RAM. PSRAM: %u bytes free, "
+           "largest block %u, %.1f%% fragmented\r\n",
+           current.large_count, (unsigned)current.large_bytes, current.large_internal,
+           (unsigned)psram_free, (unsigned)psram_largest,
+           psram_free > 0 ? 100.0 - psram_largest * 100.0 / psram_free : 0.0);
+}
+
+// A screen with the widget mix of a settings page, a bit different every round so all classes see traffic
+static lv_obj_t* stress_screen_create(uint32_t round) {
+    lv_obj_t* screen = lv_obj_create(NULL);
+    lv_obj_set_flex_flow(screen, LV_FLEX_FLOW_COLUMN);
+
+    lv_obj_t* list = lv_list_create(screen);
+    lv_obj_set_size(list, lv_pct(100), lv_pct(50));
+    uint32_t items = 10 + round % 11;
+    for (uint32_t i = 0; i < items; i++) {
+        char text[32];
+        snprintf(text, sizeof(text), "Item %" PRIu32 " of round %" PRIu32, i, round);
+        lv_list_add_button(list, NULL, text);
+    }
+
+    lv_obj_t* row = lv_obj_create(screen);
+    lv_obj_set_size(row, lv_pct(100), LV_SIZE_CONTENT);
+    lv_obj_set_flex_flow(row, LV_FLEX_FLOW_ROW_WRAP);
+    for (uint32_t i = 0; i < 4 + round % 3; i++) {
+        lv_obj_t* checkbox = lv_checkbox_create(row);
+        lv_checkbox_set_text(checkbox, "Option");
+    }
+    lv_obj_t* roller = lv_roller_create(row);
+    lv_roller_set_options(roller, "512\n1024\n1536\n2048", LV_ROLLER_MODE_INFINITE);
+    lv_obj_t* slider = lv_slider_create(row);
+    lv_slider_set_value(slider, round % 100, LV_ANIM_OFF);
+
+    lv_obj_t* label = lv_label_create(screen);
+    lv_label_set_long_mode(label, LV_LABEL_LONG_WRAP);
+    lv_obj_set_width(label, lv_pct(100));
+    lv_label_set_text_fmt(label,
+                          "Round %" PRIu32 ": a longer text that wraps over several lines and is long enough to "
+                          "need an allocation outside the pools.",
+                          round);
+    lv_obj_set_style_text_color(label, lv_palette_main(LV_PALETTE_BLUE), 0);
+    return screen;
+}
+
+// Creates, renders and deletes one screen. The widgets stay out of the default group, so the focus of the real UI
+// does not change.
+static void stress_round(uint32_t round) {
+    lvgl_lock();
+    lv_group_t* group = lv_group_get_default();
+    lv_group_set_default(NULL);
+    lv_obj_t* previous = lv_screen_active();
+    lv_obj_t* screen = stress_screen_create(round);
+    lv_screen_load(screen);
+    lv_refr_now(NULL);
+    lv_screen_load(previous);
+    lv_obj_delete(screen);
+    lv_group_set_default(group);
+    lvgl_unlock();
+}
+
+bool lvgl_alloc_stress(uint32_t rounds) {
+    // The first round also sets up what LVGL keeps for good, like the draw layers
+    stress_round(0);
+    lvgl_alloc_stats_t before;
+    lvgl_alloc_get_stats(&before);
+
+    int64_t start = esp_timer_get_time();
+    for (uint32_t round = 1; round <= rounds; round++) {
+        stress_round(round);
+    }
+    int64_t elapsed_us = esp_timer_get_time() - start;
+
+    lvgl_alloc_stats_t after;
+    lvgl_alloc_get_stats(&after);
+    bool ok = after.in_use == before.in_use && lv_mem_test_core() == LV_RESULT_OK;
+    ESP_LOGI(TAG,
+             "%" PRIu32 " screens created and deleted, %" PRId64 " us each, %u bytes in use before and %u after: %s",
+             rounds, elapsed_us / (rounds > 0 ? rounds : 1), (unsigned)before.in_use,
+             (unsigned)after.in_use, ok ? "ok" : "LEAK OR CORRUPTION");
+    lvgl_alloc_print_stats();
+    return ok;
+}
+
+static void stress_bench_body(void* ctx, uint32_t ops) {
+    uint32_t* round = ctx;
+    for (uint32_t i = 0; i < ops; i++) {
+        stress_round((*round)++);
+    }
+}
+
+void lvgl_alloc_benchmark(uint32_t rounds) {
+    uint32_t round = 0;
+    bench_run("screen_create_destroy", stress_bench_body, &round, rounds, 9, NULL);
+}
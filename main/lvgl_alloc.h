@@ -0,0 +1,45 @@
+#pragma once
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+// LVGL's memory backend (CONFIG_LV_USE_CUSTOM_MALLOC). Allocations up to LVGL_ALLOC_POOLED_MAX bytes, which are
+// almost all objects, styles and event lists, come from per-size-class pools in internal RAM. Each class grows in
+// 4 KiB slabs, kept until lv_deinit(), and keeps freed slots on a free list, so creating and deleting widgets never
+// fragments the heap. Larger allocations, like layer and image buffers, go to PSRAM through heap_caps_malloc() and
+// to internal RAM only when PSRAM is full. Every allocation carries an 8 byte header with its size and class.
+
+#define LVGL_ALLOC_CLASS_COUNT 10
+#define LVGL_ALLOC_POOLED_MAX  (512 - 8)  // Largest request served from a pool, the largest slot minus the header
+
+typedef struct {
+    uint32_t slot_size;  // Bytes per slot, header included
+    uint32_t slots;      // Slots in the slabs of the class
+    uint32_t used;       // Slots handed out
+    uint32_t peak_used;
+    size_t requested;  // Bytes asked for by the allocations in the used slots
+} lvgl_alloc_class_stats_t;
+
+typedef struct {
+    lvgl_alloc_class_stats_t classes[LVGL_ALLOC_CLASS_COUNT];
+    size_t slab_bytes;        // Internal RAM taken by the pools
+    uint32_t large_count;     // Allocations outside the pools
+    uint32_t large_internal;  // Of those, allocations that fell back to internal RAM
+    size_t large_bytes;       // Bytes asked for by them
+    size_t in_use;            // Bytes asked for by all live allocations
+    size_t peak_in_use;
+    uint32_t failed;  // Allocations that found no memory
+} lvgl_alloc_stats_t;
+
+void lvgl_alloc_get_stats(lvgl_alloc_stats_t* stats);
+
+// Prints the statistics with the unused share of the pool slots and the fragmentation of the PSRAM heap
+void lvgl_alloc_print_stats();
+
+// Creates a screen full of widgets, shows it, deletes it again, rounds times, and reports the time per round and
+// whether memory in use returned to where it started. Takes the LVGL lock for every round.
+bool lvgl_alloc_stress(uint32_t rounds);
+
+// Runs the same rounds through bench_run() as screen_create_destroy, with rounds per sample
+void lvgl_alloc_benchmark(uint32_t rounds);
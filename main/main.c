@@ -10,7 +10,11 @@
 #include <string.h>
 #include <sys/time.h>
 #include <time.h>
+#include "bench.h"
+#include "boot_graph.h"
 #include "bsp_lvgl.h"
+#include "coproc_replay.h"
+#include "coproc_trace.h"
 #include "core/lv_group.h"
 #include "core/lv_obj.h"
 #include "core/lv_obj_event.h"
@@ -21,8 +25,10 @@
 #include "display/lv_display.h"
 #include "driver/gpio.h"
 #include "driver/i2c_master.h"
+#include "driver/uart.h"
 #include "dsi_panel_nicolaielectronics_st7701.h"
 #include "esp_err.h"
+#include "esp_heap_caps.h"
 #include "esp_lcd_mipi_dsi.h"
 #include "esp_lcd_panel_ops.h"
 #include "esp_ldo_regulator.h"
@@ -33,19 +39,36 @@
 #include "freertos/projdefs.h"
 #include "freertos/semphr.h"
 #include "freertos/task.h"
+#include "glyph_cache.h"
+#include "history_chart.h"
+#include "i2c_discovery.h"
+#include "i2c_sched.h"
+#include "irq_timestamp.h"
+#include "key_ring.h"
+#include "keymap.h"
 #include "layouts/flex/lv_flex.h"
 #include "libs/freetype/lv_freetype.h"
 #include "lv_demos.h"
 #include "lv_examples.h"
+#include "lvgl_alloc.h"
 #include "misc/lv_area.h"
 #include "misc/lv_event.h"
 #include "misc/lv_style.h"
 #include "misc/lv_style_gen.h"
 #include "nvs.h"
+#include "nvs_flash.h"
 #include "others/gridnav/lv_gridnav.h"
+#include "pmic_snapshot.h"
 #include "sdkconfig.h"
 #include "soc/gpio_num.h"
+#if CONFIG_IDF_TARGET_LINUX
+#include "sim_board.h"
+#endif
+#include "status_panel.h"
 #include "tanmatsu_coprocessor.h"
+#include "telemetry.h"
+#include "telemetry_history.h"
+#include "telemetry_log.h"
 #include "widgets/button/lv_button.h"
 #include "widgets/checkbox/lv_checkbox.h"
 #include "widgets/image/lv_image.h"
@@ -63,7 +86,35 @@
 #define EXAMPLE_LCD_BK_LIGHT_ON_LEVEL         1
 #define EXAMPLE_LCD_BK_LIGHT_OFF_LEVEL        !EXAMPLE_LCD_BK_LIGHT_ON_LEVEL
 #define EXAMPLE_PIN_NUM_LCD_RST               -1  // 14 Doesn't work for some reason'
+#define EXAMPLE_PIN_NUM_COPROCESSOR_INT       6
+#define EXAMPLE_COPROCESSOR_I2C_ADDRESS       0x5F
+#define EXAMPLE_TELEMETRY_DISPLAY_PERIOD_MS   250
+#define EXAMPLE_BOOT_FIRST_FRAME_TIMEOUT_MS   1000
+#define EXAMPLE_TELEMETRY_HISTORY_SIZE        8192  // Bytes of PSRAM for the history, about 0.7 KiB per hour
+#define EXAMPLE_TELEMETRY_HISTORY_PERIOD_S    30
+#define EXAMPLE_TELEMETRY_LOG_PERIOD_S        60
+#define EXAMPLE_TELEMETRY_LOG_FLUSH_S         600           // Longest time log records stay in RAM only
+#define EXAMPLE_TELEMETRY_LOG_MAX_SIZE        (1 << 20)     // The previous megabyte is kept as the old log
+#define EXAMPLE_COPROC_TRACE_SIZE             (256 * 1024)  // Bytes of PSRAM for a coprocessor trace
+#define EXAMPLE_COPROC_TRACE_PATH             "/fat/TRACE.BIN"
 #define EXAMPLE_DISPLAY_TYPE                  DISPLAY_TYPE_ST7701
+#define EXAMPLE_LVGL_DISPLAY_MODE             LVGL_DISPLAY_MODE_PARTIAL
+#define EXAMPLE_LVGL_STRIP_HEIGHT             0  // 0 renders a tenth of the screen per strip
+#define EXAMPLE_LVGL_DRAW_BUFFER_CAPS         MALLOC_CAP_SPIRAM
+#define EXAMPLE_LVGL_ROTATION_BUFFER_CAPS     MALLOC_CAP_SPIRAM
+#define EXAMPLE_LVGL_GLYPH_CACHE_SIZE         (64 * 1024)  // Bytes of PSRAM for rendered glyphs, 0 disables the cache
+#define EXAMPLE_LVGL_BUFFER_SWEEP             0  // Set to 1 to log frame time for each buffer configuration at boot
+#define EXAMPLE_LVGL_RENDER_BENCHMARK         0  // Set to 1 to log frame time with the configured draw units at boot
+#define EXAMPLE_LVGL_IDLE_REPORT              0  // Set to 1 to log LVGL task wakeups of the idle UI at boot
+#define EXAMPLE_KEY_RING_FLOOD                0  // Set to 1 to push 50000 events through a key ring at boot
+#define EXAMPLE_KEYMAP_BENCHMARK              0  // Set to 1 to compare the keyboard decoders at boot
+#define EXAMPLE_LATENCY_SYNTHETIC             0  // Set to 1 to measure key latency with 200 synthetic events at boot
+#define EXAMPLE_STATUS_PANEL_REPORT           0  // Set to 1 to log the status panel's flush load at boot
+#define EXAMPLE_I2C_SCHED_SIMULATION          0  // Set to 1 to run the I2C scheduler against a simulated slow device
+#define EXAMPLE_LVGL_ALLOC_STRESS             0  // Set to 1 to create and delete a widget screen 200 times at boot
+#define EXAMPLE_BENCHMARK_SUITE               0  // Set to 1 to run the benchmark suite at boot
+#define EXAMPLE_COPROC_TRACE_AT_BOOT          0  // Set to 1 to record the coprocessor trace from boot on
+#define EXAMPLE_SERIAL_COMMANDS               1  // Set to 0 to leave the console UART to the log output only
 
 static const char* TAG = "example";
 
@@ -80,39 +131,15 @@ i2c_master_bus_handle_t i2c_bus_handle_internal = NULL;
 
 tanmatsu_coprocessor_handle_t coprocessor_handle = NULL;
 
-SemaphoreHandle_t i2c_concurrency_semaphore = NULL;
-
-void example_initialize_i2c_bus() {
-    ESP_ERROR_CHECK(i2c_new_master_bus(&i2c_master_config_internal, &i2c_bus_handle_internal));
-    i2c_concurrency_semaphore = xSemaphoreCreateBinary();
-    xSemaphoreGive(i2c_concurrency_semaphore);
-}
-
-static int i2c_scan(i2c_master_bus_handle_t bus_handle) {
-    int retval = 0;
-    uint8_t address;
-    printf("     0  1  2  3  4  5  6  7  8  9  a  b  c  d  e  f\r\n");
-    for (int i = 0; i < 128; i += 16) {
-        printf("%02x: ", i);
-        for (int j = 0; j < 16; j++) {
-            fflush(stdout);
-            address = i + j;
-            esp_err_t ret = i2c_master_probe(bus_handle, address, 50);
-            if (ret == ESP_OK) {
-                if (address == 0x5f) {
-                    retval = 1;
-                }
-                printf("%02x ", address);
-            } else if (ret == ESP_ERR_TIMEOUT) {
-                printf("UU ");
-            } else {
-                printf("-- ");
-            }
-        }
-        printf("\r\n");
-    }
+// Runs a driver call in a control slot on the bus and traces it as op
+#define CONTROL_CALL(op, arg0, arg1, call) COPROC_TRACE_CALL(op, arg0, arg1, I2C_SCHED_CALL(I2C_SCHED_CONTROL, call))
 
-    return retval;
+esp_err_t example_initialize_i2c_bus() {
+    esp_err_t res = i2c_new_master_bus(&i2c_master_config_internal, &i2c_bus_handle_internal);
+    if (res != ESP_OK) {
+        return res;
+    }
+    return i2c_sched_init();
 }
 
 void example_bsp_enable_dsi_phy_power(void) {
@@ -409,22 +436,25 @@ static void enable_charging_cb(lv_event_t* event) {
     lv_obj_t* obj = lv_event_get_target(event);
     bool checked = lv_obj_get_state(obj) & LV_STATE_CHECKED;
     charging_enabled = checked;
-    tanmatsu_coprocessor_set_pmic_charging_control(coprocessor_handle, !charging_enabled, charging_current);
+    CONTROL_CALL(COPROC_OP_SET_CHARGING_CONTROL, !charging_enabled, charging_current,
+                 tanmatsu_coprocessor_set_pmic_charging_control(coprocessor_handle, !charging_enabled,
+                                                                charging_current));
 }
 
 static void enable_otg_cb(lv_event_t* event) {
     lv_obj_t* obj = lv_event_get_target(event);
     bool checked = lv_obj_get_state(obj) & LV_STATE_CHECKED;
-    tanmatsu_coprocessor_set_pmic_otg_control(coprocessor_handle, checked);
+    CONTROL_CALL(COPROC_OP_SET_OTG_CONTROL, checked, 0,
+                 tanmatsu_coprocessor_set_pmic_otg_control(coprocessor_handle, checked));
 }
 
 static void enable_c6_cb(lv_event_t* event) {
     lv_obj_t* obj = lv_event_get_target(event);
     bool checked = lv_obj_get_state(obj) & LV_STATE_CHECKED;
     if (checked) {
-        tanmatsu_coprocessor_radio_enable_application(coprocessor_handle);
+        CONTROL_CALL(COPROC_OP_RADIO, 1, 0, tanmatsu_coprocessor_radio_enable_application(coprocessor_handle));
     } else {
-        tanmatsu_coprocessor_radio_disable(coprocessor_handle);
+        CONTROL_CALL(COPROC_OP_RADIO, 0, 0, tanmatsu_coprocessor_radio_disable(coprocessor_handle));
     }
 }
 
@@ -436,7 +466,7 @@ static void set_charging_current(lv_obj_t* roller) {
 
     uint32_t value = (uint32_t)strtol(buf, NULL, 10);
 
-    printf("Value: %lu\r\n", value);
+    printf("Value: %" PRIu32 "\r\n", value);
 
     if (value == 512) {
         charging_current = 0;
@@ -449,7 +479,9 @@ static void set_charging_current(lv_obj_t* roller) {
     }
 
     if (coprocessor_handle) {
-        tanmatsu_coprocessor_set_pmic_charging_control(coprocessor_handle, !charging_enabled, charging_current);
+        CONTROL_CALL(COPROC_OP_SET_CHARGING_CONTROL, !charging_enabled, charging_current,
+                     tanmatsu_coprocessor_set_pmic_charging_control(coprocessor_handle, !charging_enabled,
+                                                                    charging_current));
     } else {
         printf("NOT READY\r\n");
     }
@@ -473,7 +505,8 @@ static void inc_charging_current_cb(lv_event_t* e) {
     on_charging_current_change(e, LV_KEY_RIGHT);
 }
 
-lv_obj_t* status_label = NULL;
+// Samples of the PMIC values, shown by the history chart. The LVGL lock guards it.
+static telemetry_history_t history;
 
 lv_obj_t* get_pmic_info_screen() {
     lv_obj_t* settings_screen = lv_obj_create(NULL);
@@ -550,24 +583,237 @@ lv_obj_t* get_pmic_info_screen() {
     lv_obj_set_flex_flow(settings_right, LV_FLEX_FLOW_COLUMN);
     lv_obj_set_size(settings_right, lv_pct(50), lv_pct(100));
 
-    status_label = lv_label_create(settings_right);
-    lv_label_set_text(status_label, "Please wait...");
-    lv_obj_set_size(status_label, lv_pct(100), lv_pct(100));
+    status_panel_create(settings_right);
+
+    history_chart_create(settings_screen, &history);
 
     return settings_screen;
 }
 
+// The status line the display loop prints for every new snapshot
+static size_t format_status_line(char* buf, size_t size, const pmic_snapshot_t* pmic) {
+    char ts[16];
+    status_format_fixed(ts, sizeof(ts), pmic->ts, 2, "%");
+    return snprintf(buf, size,
+                    "Vbat: %u mV, vsys: %u mV, ts: %s, vbus: %u mV, ichgr: %u mA, comm: %s, chrg: %s (%u), %s, %s, "
+                    "charger status: %s\r\n",
+                    pmic->vbat_mv, pmic->vsys_mv, ts, pmic->vbus_mv, pmic->ichgr_ma, status_comm_text(pmic),
+                    status_charging_text(pmic), pmic->charging_speed,
+                    pmic->battery_attached ? "battery attached" : "no battery",
+                    pmic->usb_attached ? "usb attached" : "no usb", status_charger_text(pmic));
+}
+
 void set_label(char* text) {
     lvgl_lock();
-    if (status_label) {
-        lv_label_set_text(status_label, text);
+    status_panel_set_message(text);
+    lvgl_unlock();
+}
+
+#if EXAMPLE_STATUS_PANEL_REPORT
+// Compares the flush load of the status panel with per-value updates against redrawing the whole panel on every
+// update, which is what the single status label did
+static void status_panel_report_task(void* arg) {
+    const int seconds = 20;
+    for (int pass = 0; pass < 2; pass++) {
+        bool full_redraw = pass == 1;
+        lvgl_lock();
+        status_panel_set_full_redraw(full_redraw);
+        lvgl_unlock();
+
+        lvgl_flush_stats_t stats;
+        lvgl_get_flush_stats(&stats, true);
+        vTaskDelay(pdMS_TO_TICKS(seconds * 1000));
+        lvgl_get_flush_stats(&stats, true);
+        ESP_LOGI(TAG, "Status panel %s: %" PRIu64 " px/s invalidated, %" PRIu64 " bytes/s flushed",
+                 full_redraw ? "redrawn on every update" : "updated per value", stats.pixels_invalidated / seconds,
+                 stats.pixels * sizeof(uint16_t) / seconds);
     }
+    lvgl_lock();
+    status_panel_set_full_redraw(false);
     lvgl_unlock();
+    vTaskDelete(NULL);
 }
+#endif
 
-void app_main(void) {
-    gpio_install_isr_service(0);
+#if EXAMPLE_BENCHMARK_SUITE || EXAMPLE_SERIAL_COMMANDS || CONFIG_IDF_TARGET_LINUX
+// Snapshot the benchmarks format and show, with values that change every operation like a charging battery's
+static pmic_snapshot_t bench_pmic = {
+    .rtc = 1700000000,
+    .vbat_mv = 3900,
+    .vsys_mv = 4400,
+    .ts = 4875,
+    .vbus_mv = 5000,
+    .ichgr_ma = 1000,
+    .charging_speed = 1,
+    .battery_attached = true,
+    .usb_attached = true,
+    .charging_status = TANMATSU_CHARGE_STATUS_FAST_CHARGING,
+};
+
+static void bench_pmic_step() {
+    bench_pmic.rtc++;
+    bench_pmic.vbat_mv = 3900 + bench_pmic.rtc % 7;
+    bench_pmic.ts = 4875 + bench_pmic.rtc % 3;
+    bench_pmic.ichgr_ma = 1000 + bench_pmic.rtc % 11;
+}
+
+static size_t bench_status_length = 0;
+
+static void bench_status_format(void* ctx, uint32_t ops) {
+    char line[256];
+    for (uint32_t i = 0; i < ops; i++) {
+        bench_pmic_step();
+        bench_status_length += format_status_line(line, sizeof(line), &bench_pmic);
+    }
+}
+
+static void bench_status_update(void* ctx) {
+    bench_pmic_step();
+    status_panel_update(&bench_pmic);
+}
+
+// Replaces the made-up values of the update benchmarks with the latest snapshot, the way the display loop shows it
+static void bench_status_restore() {
+    telemetry_snapshot_t telemetry;
+    lvgl_lock();
+    if (telemetry_get(&telemetry) && telemetry.valid != 0) {
+        status_panel_update(&telemetry.pmic);
+        status_panel_set_message(telemetry.error);
+    } else {
+        status_panel_reset();
+    }
+    lvgl_unlock();
+}
+
+// Runs every microbenchmark and prints the results for tools/bench_compare.py. The PMIC info screen has to be the
+// active screen.
+static void run_benchmark_suite() {
+    bench_suite_begin("firmware");
+    lvgl_flush_benchmark(200);
+    keymap_benchmark(500);
+    bench_run("status_format", bench_status_format, NULL, 2000, 15, NULL);
+    const lv_font_t* font = glyph_cache_font(LV_FONT_DEFAULT);
+    if (font != NULL) {
+        lvgl_lock();
+        glyph_cache_benchmark(font, 200);
+        lvgl_unlock();
+    }
+    lvgl_refresh_benchmark("pmic_screen_refresh", NULL, NULL, 5);
+    lvgl_refresh_benchmark("pmic_screen_update", bench_status_update, NULL, 50);
+    // The same redraws with every glyph unpacked again, as without the cache
+    glyph_cache_set_enabled(false);
+    lvgl_refresh_benchmark("pmic_screen_refresh_uncached", NULL, NULL, 5);
+    lvgl_refresh_benchmark("pmic_screen_update_uncached", bench_status_update, NULL, 50);
+    glyph_cache_set_enabled(true);
+    bench_status_restore();
+    glyph_cache_print_stats(false);
+    lvgl_alloc_benchmark(10);
+    lvgl_alloc_print_stats();
+    bench_suite_end("firmware");
+}
+#endif
+
+#if EXAMPLE_SERIAL_COMMANDS
+// Single character commands on the console UART: 'l' prints the key latency histograms and 'p' the frame times, the
+// upper case letters also reset them. 'o' toggles the frame time overlay, 'i' prints the I2C bus statistics and 'I'
+// also resets them, 'd' prints the devices found on the bus. 't' prints the telemetry log status and 'T' writes the
+// pending records first. 'b' runs the benchmark suite. 'c' starts a coprocessor trace, 'C' stops it and saves it to the
+// FAT partition, 'y' replays the saved trace and 'Y' prints the trace and replay status. 'g' prints the glyph cache
+// statistics and 'G' also resets them. 'm' prints the LVGL memory statistics.
+static void serial_command_task(void* arg) {
+    while (true) {
+        uint8_t command = 0;
+        if (uart_read_bytes(CONFIG_ESP_CONSOLE_UART_NUM, &command, 1, portMAX_DELAY) != 1) {
+            continue;
+        }
+        switch (command) {
+            case 'l':
+                lvgl_latency_print(false);
+                break;
+            case 'L':
+                lvgl_latency_print(true);
+                break;
+            case 'p':
+                lvgl_profile_print(false);
+                break;
+            case 'P':
+                lvgl_profile_print(true);
+                break;
+            case 'o':
+                lvgl_profile_toggle_overlay();
+                break;
+            case 'i':
+                i2c_sched_print_stats(false);
+                break;
+            case 'I':
+                i2c_sched_print_stats(true);
+                break;
+            case 'd':
+                i2c_discovery_print();
+                break;
+            case 'T':
+                telemetry_log_flush();
+                // fall through
+            case 't':
+                telemetry_log_print_status();
+                break;
+            case 'b':
+                run_benchmark_suite();
+                break;
+            case 'c':
+                coproc_trace_start(EXAMPLE_COPROC_TRACE_SIZE);
+                break;
+            case 'C':
+                coproc_trace_stop();
+                coproc_trace_save(EXAMPLE_COPROC_TRACE_PATH);
+                break;
+            case 'y':
+                coproc_replay_start(EXAMPLE_COPROC_TRACE_PATH, coprocessor_handle);
+                break;
+            case 'Y':
+                coproc_trace_print_status();
+                coproc_replay_print_stats();
+                break;
+            case 'g':
+                glyph_cache_print_stats(false);
+                break;
+            case 'G':
+                glyph_cache_print_stats(true);
+                break;
+            case 'm':
+                lvgl_alloc_print_stats();
+                break;
+            default:
+                break;
+        }
+    }
+}
+#endif
+
+// Boot steps, each runs as soon as the steps it depends on are done. The panel and the UI come up in parallel with
+// the I2C bus and the coprocessor, the backlight waits for both and for the first frame.
+enum {
+    BOOT_PANEL,
+    BOOT_UI,
+    BOOT_NVS,
+    BOOT_LOG,
+    BOOT_I2C,
+    BOOT_DISCOVERY,
+    BOOT_COPROCESSOR,
+    BOOT_RTC,
+    BOOT_CHARGING,
+    BOOT_OTG,
+    BOOT_BACKLIGHT,
+    BOOT_TELEMETRY,
+    BOOT_SERIAL,
+    BOOT_STEP_COUNT,
+};
 
+static esp_lcd_panel_handle_t mipi_dpi_panel = NULL;
+static size_t h_res = 0;
+static size_t v_res = 0;
+
+static esp_err_t boot_panel() {
     example_bsp_enable_dsi_phy_power();
 
     gpio_config_t pmod_conf = {
@@ -585,48 +831,120 @@ void app_main(void) {
     gpio_set_level(14, true);
     vTaskDelay(pdMS_TO_TICKS(100));
 
-    esp_lcd_panel_handle_t mipi_dpi_panel = NULL;
-    size_t h_res = 0;
-    size_t v_res = 0;
     lcd_color_rgb_pixel_format_t color_fmt = LCD_COLOR_PIXEL_FORMAT_RGB565;
     st7701_initialize(EXAMPLE_PIN_NUM_LCD_RST);
     mipi_dpi_panel = st7701_get_panel();
     st7701_get_parameters(&h_res, &v_res, &color_fmt);
+    return ESP_OK;
+}
 
-    lvgl_init(h_res, v_res, mipi_dpi_panel);
+static esp_err_t boot_ui() {
+    lvgl_config_t lvgl_config = {
+        .mode = EXAMPLE_LVGL_DISPLAY_MODE,
+        .strip_height = EXAMPLE_LVGL_STRIP_HEIGHT,
+        .draw_buffer_caps = EXAMPLE_LVGL_DRAW_BUFFER_CAPS,
+        .rotation_buffer_caps = EXAMPLE_LVGL_ROTATION_BUFFER_CAPS,
+        .glyph_cache_size = EXAMPLE_LVGL_GLYPH_CACHE_SIZE,
+    };
+    lvgl_init(h_res, v_res, mipi_dpi_panel, &lvgl_config);
 
     lvgl_lock();
     // lv_group_set_focus_cb(lv_group_get_default(), focus_cb);
     lv_screen_load(get_pmic_info_screen());
     lvgl_unlock();
+    return ESP_OK;
+}
 
-    set_label("Starting I2C bus...");
-    example_initialize_i2c_bus();
+// NVS only holds the I2C bus map, without it discovery scans the bus at every boot
+static esp_err_t boot_nvs() {
+    esp_err_t res = nvs_flash_init();
+    if (res == ESP_ERR_NVS_NO_FREE_PAGES || res == ESP_ERR_NVS_NEW_VERSION_FOUND) {
+        nvs_flash_erase();
+        res = nvs_flash_init();
+    }
+    if (res != ESP_OK) {
+        ESP_LOGW(TAG, "Failed to initialize NVS: %s", esp_err_to_name(res));
+    }
+    return ESP_OK;
+}
 
-    set_label("Scanning I2C bus...");
-    if (!i2c_scan(i2c_bus_handle_internal)) {
-        show_error("Coprocessor not visible on I2C bus");
-        return;
+// The log is optional as well, the device works the same without it
+static esp_err_t boot_log() {
+    const telemetry_log_config_t config = {
+        .partition_label = "fat",
+        .base_path = "/fat",
+        .max_file_size = EXAMPLE_TELEMETRY_LOG_MAX_SIZE,
+        .flush_interval_s = EXAMPLE_TELEMETRY_LOG_FLUSH_S,
+    };
+    esp_err_t res = telemetry_log_start(&config);
+    if (res != ESP_OK) {
+        ESP_LOGW(TAG, "Telemetry log not available: %s", esp_err_to_name(res));
     }
+    return ESP_OK;
+}
 
-    set_label("Initializing coprocessor...");
-    tanmatsu_coprocessor_config_t coprocessor_config = {
-        .int_io_num = 6,
-        .i2c_bus = i2c_bus_handle_internal,
-        .i2c_address = 0x5F,
-        .concurrency_semaphore = i2c_concurrency_semaphore,
+static esp_err_t boot_i2c() {
+    return example_initialize_i2c_bus();
+}
+
+static esp_err_t boot_discovery() {
+    bool coprocessor_found = false;
+    esp_err_t res = i2c_discovery_start(i2c_bus_handle_internal, EXAMPLE_COPROCESSOR_I2C_ADDRESS, &coprocessor_found);
+    if (res != ESP_OK) {
+        return res;
+    }
+    return coprocessor_found ? ESP_OK : ESP_ERR_NOT_FOUND;
+}
+
+// The driver's callbacks. A replay is the only source of events while it runs, live events would race the replay task
+// on the key ring and end up between the recorded ones.
+static void live_keyboard_callback(tanmatsu_coprocessor_handle_t handle, tanmatsu_coprocessor_keys_t* prev_keys,
+                                   tanmatsu_coprocessor_keys_t* keys) {
+    if (!coproc_replay_running()) {
+        coproc_trace_keyboard_callback(handle, prev_keys, keys);
+    }
+}
+
+static void live_input_callback(tanmatsu_coprocessor_handle_t handle, tanmatsu_coprocessor_inputs_t* prev_inputs,
+                                tanmatsu_coprocessor_inputs_t* inputs) {
+    if (!coproc_replay_running()) {
+        coproc_trace_input_callback(handle, prev_inputs, inputs);
+    }
+}
+
+static esp_err_t boot_coprocessor() {
+    // Only used to measure key latency, the keyboard works without it
+    irq_timestamp_init(EXAMPLE_PIN_NUM_COPROCESSOR_INT);
+    bool trace = EXAMPLE_COPROC_TRACE_AT_BOOT;
+#if CONFIG_IDF_TARGET_LINUX
+    trace |= sim_board_trace_path() != NULL;
+#endif
+    if (trace && coproc_trace_start(EXAMPLE_COPROC_TRACE_SIZE) != ESP_OK) {
+        ESP_LOGW(TAG, "Failed to start the coprocessor trace");
+    }
+    // Events pass the trace on their way to the handlers, so they can be recorded and replayed
+    const coproc_trace_handlers_t handlers = {
         .on_keyboard_change = coprocessor_keyboard_callback,
         .on_input_change = coprocessor_input_callback,
     };
-    if (tanmatsu_coprocessor_initialize(&coprocessor_config, &coprocessor_handle) != ESP_OK) {
-        show_error("Failed to initialize coprocessor driver");
-        return;
-    }
+    coproc_trace_set_handlers(&handlers);
+    tanmatsu_coprocessor_config_t coprocessor_config = {
+        .int_io_num = EXAMPLE_PIN_NUM_COPROCESSOR_INT,
+        .i2c_bus = i2c_bus_handle_internal,
+        .i2c_address = EXAMPLE_COPROCESSOR_I2C_ADDRESS,
+        .concurrency_semaphore = i2c_sched_get_bus_semaphore(),
+        .on_keyboard_change = live_keyboard_callback,
+        .on_input_change = live_input_callback,
+    };
+    return tanmatsu_coprocessor_initialize(&coprocessor_config, &coprocessor_handle);
+}
 
+static esp_err_t boot_rtc() {
     uint32_t rtc;
-    if (tanmatsu_coprocessor_get_real_time(coprocessor_handle, &rtc) != ESP_OK) {
-        show_error("Failed to read RTC value");
-        return;
+    esp_err_t res =
+        CONTROL_CALL(COPROC_OP_GET_REAL_TIME, 0, 0, tanmatsu_coprocessor_get_real_time(coprocessor_handle, &rtc));
+    if (res != ESP_OK) {
+        return res;
     }
 
     struct timeval rtc_timeval = {
@@ -635,159 +953,224 @@ void app_main(void) {
     };
 
     settimeofday(&rtc_timeval, NULL);
+    return ESP_OK;
+}
 
-    if (tanmatsu_coprocessor_set_display_backlight(coprocessor_handle, 255) != ESP_OK) {
-        show_error("Failed to set display backlight brightness");
-        return;
-    }
+static esp_err_t boot_charging() {
+    return CONTROL_CALL(COPROC_OP_SET_CHARGING_CONTROL, !charging_enabled, charging_current,
+                        tanmatsu_coprocessor_set_pmic_charging_control(coprocessor_handle, !charging_enabled,
+                                                                       charging_current));
+}
 
-    if (tanmatsu_coprocessor_set_pmic_charging_control(coprocessor_handle, !charging_enabled, charging_current) !=
-        ESP_OK) {
-        show_error("Failed to configure battery charging");
-        return;
+static esp_err_t boot_otg() {
+    return CONTROL_CALL(COPROC_OP_SET_OTG_CONTROL, true, 0,
+                        tanmatsu_coprocessor_set_pmic_otg_control(coprocessor_handle, true));
+}
+
+static esp_err_t boot_backlight() {
+    // The panel stays dark until there is something on it
+    int64_t first_frame_us;
+    if (!lvgl_wait_first_frame(EXAMPLE_BOOT_FIRST_FRAME_TIMEOUT_MS, &first_frame_us)) {
+        ESP_LOGW(TAG, "No frame after %d ms, turning the backlight on anyway", EXAMPLE_BOOT_FIRST_FRAME_TIMEOUT_MS);
     }
+    return CONTROL_CALL(COPROC_OP_SET_BACKLIGHT, 255, 0,
+                        tanmatsu_coprocessor_set_display_backlight(coprocessor_handle, 255));
+}
 
-    if (tanmatsu_coprocessor_set_pmic_otg_control(coprocessor_handle, true) != ESP_OK) {
-        show_error("Failed to enable OTG booster");
-        return;
+static esp_err_t boot_telemetry() {
+    telemetry_config_t telemetry_config = {
+        .coprocessor = coprocessor_handle,
+    };
+    return telemetry_start(&telemetry_config);
+}
+
+static esp_err_t boot_serial() {
+#if EXAMPLE_SERIAL_COMMANDS
+    esp_err_t res = uart_driver_install(CONFIG_ESP_CONSOLE_UART_NUM, 256, 0, 0, NULL, 0);
+    if (res != ESP_OK) {
+        return res;
     }
+    if (xTaskCreate(serial_command_task, "serial-commands", 4096, NULL, 1, NULL) != pdPASS) {
+        return ESP_ERR_NO_MEM;
+    }
+#endif
+    return ESP_OK;
+}
 
-    while (true) {
-        if (tanmatsu_coprocessor_set_pmic_adc_control(coprocessor_handle, true, false) != ESP_OK) {
-            set_label("Failed to trigger ADC read");
-            vTaskDelay(pdMS_TO_TICKS(1000));
-            continue;
-        }
-        vTaskDelay(pdMS_TO_TICKS(600));
+static const boot_step_t boot_steps[BOOT_STEP_COUNT] = {
+    [BOOT_PANEL] = {"panel", boot_panel, 0, 0, "Failed to initialize the panel"},
+    [BOOT_UI] = {"ui", boot_ui, BOOT_STEP(BOOT_PANEL), 8192, "Failed to start the UI"},
+    [BOOT_NVS] = {"nvs", boot_nvs, 0, 0, "Failed to initialize NVS"},
+    [BOOT_LOG] = {"log", boot_log, 0, 0, "Failed to start the telemetry log"},
+    [BOOT_I2C] = {"i2c", boot_i2c, 0, 0, "Failed to start the I2C bus"},
+    [BOOT_DISCOVERY] = {"discovery", boot_discovery, BOOT_STEP(BOOT_I2C) | BOOT_STEP(BOOT_NVS), 0,
+                        "Coprocessor not visible on I2C bus"},
+    [BOOT_COPROCESSOR] = {"coprocessor", boot_coprocessor, BOOT_STEP(BOOT_DISCOVERY), 0,
+                          "Failed to initialize coprocessor driver"},
+    [BOOT_RTC] = {"rtc", boot_rtc, BOOT_STEP(BOOT_COPROCESSOR), 0, "Failed to read RTC value"},
+    [BOOT_CHARGING] = {"charging", boot_charging, BOOT_STEP(BOOT_COPROCESSOR), 0,
+                       "Failed to configure battery charging"},
+    [BOOT_OTG] = {"otg", boot_otg, BOOT_STEP(BOOT_COPROCESSOR), 0, "Failed to enable OTG booster"},
+    [BOOT_BACKLIGHT] = {"backlight", boot_backlight, BOOT_STEP(BOOT_COPROCESSOR) | BOOT_STEP(BOOT_UI), 0,
+                        "Failed to set display backlight brightness"},
+    // Only starts once every coprocessor setup step succeeded, a failed one stops it like the sequential boot did
+    [BOOT_TELEMETRY] = {"telemetry", boot_telemetry,
+                        BOOT_STEP(BOOT_RTC) | BOOT_STEP(BOOT_CHARGING) | BOOT_STEP(BOOT_OTG) |
+                            BOOT_STEP(BOOT_BACKLIGHT),
+                        0, "Failed to start telemetry"},
+    [BOOT_SERIAL] = {"serial", boot_serial, BOOT_STEP(BOOT_UI) | BOOT_STEP(BOOT_I2C), 0,
+                     "Failed to start the serial commands"},
+};
 
-        tanmatsu_coprocessor_pmic_faults_t faults;
-        if (tanmatsu_coprocessor_get_pmic_faults(coprocessor_handle, &faults) != ESP_OK) {
-            set_label("Failed to read PMIC faults");
-            vTaskDelay(pdMS_TO_TICKS(1000));
-            continue;
-        }
+static boot_step_trace_t boot_trace[BOOT_STEP_COUNT];
 
-        uint16_t vbat;
-        if (tanmatsu_coprocessor_get_pmic_vbat(coprocessor_handle, &vbat) != ESP_OK) {
-            set_label("Failed to read vbat");
-            vTaskDelay(pdMS_TO_TICKS(1000));
-            continue;
-        }
+void app_main(void) {
+    gpio_install_isr_service(0);
 
-        uint16_t vsys;
-        if (tanmatsu_coprocessor_get_pmic_vsys(coprocessor_handle, &vsys) != ESP_OK) {
-            set_label("Failed to read vsys");
-            vTaskDelay(pdMS_TO_TICKS(1000));
-            continue;
-        }
+    int failed = boot_graph_run(boot_steps, BOOT_STEP_COUNT, boot_trace);
+    int64_t first_frame_us = 0;
+    lvgl_wait_first_frame(0, &first_frame_us);
+    boot_graph_print(boot_steps, BOOT_STEP_COUNT, boot_trace, first_frame_us);
 
-        uint16_t ts;
-        if (tanmatsu_coprocessor_get_pmic_ts(coprocessor_handle, &ts) != ESP_OK) {
-            set_label("Failed to read ts");
-            vTaskDelay(pdMS_TO_TICKS(1000));
-            continue;
+    if (failed >= 0) {
+        if (boot_trace[BOOT_UI].result == ESP_OK) {
+            lvgl_lock();
+            show_error((char*)boot_steps[failed].error);
+            lvgl_unlock();
         }
+        return;
+    }
 
-        uint16_t vbus;
-        if (tanmatsu_coprocessor_get_pmic_vbus(coprocessor_handle, &vbus) != ESP_OK) {
-            set_label("Failed to read vbus");
-            vTaskDelay(pdMS_TO_TICKS(1000));
-            continue;
-        }
+#if EXAMPLE_LVGL_BUFFER_SWEEP
+    lvgl_buffer_sweep(10);
+#endif
+#if EXAMPLE_LVGL_RENDER_BENCHMARK
+    lvgl_render_benchmark(20);
+#endif
+#if EXAMPLE_LVGL_IDLE_REPORT
+    lvgl_idle_report(10);
+#endif
+#if EXAMPLE_KEY_RING_FLOOD
+    key_ring_flood(50000, 10000);
+#endif
+#if EXAMPLE_KEYMAP_BENCHMARK
+    keymap_benchmark(10000);
+#endif
+#if EXAMPLE_LATENCY_SYNTHETIC
+    lvgl_latency_synthetic(200, 50);
+#endif
+#if EXAMPLE_I2C_SCHED_SIMULATION
+    i2c_sched_simulate(5000);
+#endif
+#if EXAMPLE_LVGL_ALLOC_STRESS
+    lvgl_alloc_stress(200);
+#endif
+#if EXAMPLE_BENCHMARK_SUITE
+    run_benchmark_suite();
+#endif
+#if CONFIG_IDF_TARGET_LINUX
+    // SIM_BENCH runs the suite in the simulator and ends it, for make bench
+    if (sim_board_benchmark()) {
+        run_benchmark_suite();
+        sim_board_report();
+        exit(0);
+    }
+    // SIM_REPLAY plays a recorded trace into the simulator, the run ends with it
+    const char* replay_path = sim_board_replay_path();
+    if (replay_path != NULL && coproc_replay_start(replay_path, coprocessor_handle) != ESP_OK) {
+        exit(1);
+    }
+#endif
+#if EXAMPLE_STATUS_PANEL_REPORT
+    xTaskCreate(status_panel_report_task, "status-report", 3072, NULL, 1, NULL);
+#endif
 
-        uint16_t ichgr;
-        if (tanmatsu_coprocessor_get_pmic_ichgr(coprocessor_handle, &ichgr) != ESP_OK) {
-            set_label("Failed to read ichgr");
-            vTaskDelay(pdMS_TO_TICKS(1000));
-            continue;
-        }
+    void* history_storage = heap_caps_malloc(EXAMPLE_TELEMETRY_HISTORY_SIZE, MALLOC_CAP_SPIRAM);
+    if (history_storage == NULL) {
+        ESP_LOGW(TAG, "Failed to allocate the telemetry history");
+    }
+    lvgl_lock();
+    telemetry_history_init(&history, history_storage, history_storage != NULL ? EXAMPLE_TELEMETRY_HISTORY_SIZE : 0);
+    lvgl_unlock();
+    const uint32_t history_metrics = 1u << TELEMETRY_VBAT | 1u << TELEMETRY_VSYS | 1u << TELEMETRY_VBUS |
+                                     1u << TELEMETRY_ICHGR | 1u << TELEMETRY_RTC;
+    uint32_t history_due_s = 0;
+    int64_t log_due_us = 0;
 
-        bool last, latch;
-        if (tanmatsu_coprocessor_get_pmic_communication_fault(coprocessor_handle, &last, &latch) != ESP_OK) {
-            set_label("Failed to read PMIC comm fault state");
-            vTaskDelay(pdMS_TO_TICKS(1000));
-            continue;
+    // The telemetry task samples the PMIC, this loop only shows each new snapshot it publishes
+    uint32_t shown_sequence = 0;
+    while (true) {
+        vTaskDelay(pdMS_TO_TICKS(EXAMPLE_TELEMETRY_DISPLAY_PERIOD_MS));
+
+#if CONFIG_IDF_TARGET_LINUX
+        // A timed simulator run ends with the numbers the serial commands would print
+        if (sim_board_done() || (replay_path != NULL && !coproc_replay_running())) {
+            lvgl_profile_print(false);
+            lvgl_latency_print(false);
+            i2c_sched_print_stats(false);
+            if (replay_path != NULL) {
+                coproc_replay_print_stats();
+            }
+            if (sim_board_trace_path() != NULL) {
+                coproc_trace_stop();
+                coproc_trace_save(sim_board_trace_path());
+            }
+            sim_board_report();
+            exit(0);
         }
+#endif
 
-        bool chrg_disable_setting;
-        uint8_t chrg_speed;
-        if (tanmatsu_coprocessor_get_pmic_charging_control(coprocessor_handle, &chrg_disable_setting, &chrg_speed) !=
-            ESP_OK) {
-            set_label("Failed to read charging control");
-            vTaskDelay(pdMS_TO_TICKS(1000));
+        telemetry_snapshot_t telemetry;
+        if (!telemetry_get(&telemetry) || telemetry.sequence == shown_sequence) {
             continue;
         }
+        shown_sequence = telemetry.sequence;
 
-        bool battery_attached, usb_attached, chrg_disabled;
-        uint8_t chrg_status;
-        if (tanmatsu_coprocessor_get_pmic_charging_status(coprocessor_handle, &battery_attached, &usb_attached,
-                                                          &chrg_disabled, &chrg_status) != ESP_OK) {
-            set_label("Failed to read charging status");
-            vTaskDelay(pdMS_TO_TICKS(1000));
-            continue;
+        // Failed rounds are logged too, a trace from the field should show them
+        int64_t now_us = esp_timer_get_time();
+        if (now_us >= log_due_us) {
+            telemetry_log_record(&telemetry);
+            log_due_us = now_us + EXAMPLE_TELEMETRY_LOG_PERIOD_S * 1000000LL;
         }
 
-        if (tanmatsu_coprocessor_get_real_time(coprocessor_handle, &rtc) != ESP_OK) {
-            set_label("Failed to read RTC");
-            vTaskDelay(pdMS_TO_TICKS(1000));
+        if (telemetry.error != NULL) {
+            set_label((char*)telemetry.error);
             continue;
         }
-
-        if (faults.watchdog | faults.boost | faults.chrg_input | faults.chrg_thermal | faults.chrg_safety |
-            faults.batt_ovp | faults.ntc_cold | faults.ntc_hot | faults.ntc_boost) {
-            printf("Active faults: %s %s %s %s %s %s %s %s %s\r\n", faults.watchdog ? "WATCHDOG" : "",
-                   faults.boost ? "BOOST" : "", faults.chrg_input ? "CHRG_INPUT" : "",
-                   faults.chrg_thermal ? "CHRG_THERMAL" : "", faults.chrg_safety ? "CHRG_SAFETY" : "",
-                   faults.batt_ovp ? "BATT_OVP" : "", faults.ntc_cold ? "NTC_COLD" : "",
-                   faults.ntc_hot ? "NTC_HOT" : "", faults.ntc_boost ? "NTC_BOOST" : "");
+        const pmic_snapshot_t pmic = telemetry.pmic;
+
+        if (pmic.faults) {
+            uint16_t faults = pmic.faults;
+            printf("Active faults: %s %s %s %s %s %s %s %s %s\r\n", (faults & PMIC_FAULT_WATCHDOG) ? "WATCHDOG" : "",
+                   (faults & PMIC_FAULT_BOOST) ? "BOOST" : "", (faults & PMIC_FAULT_CHRG_INPUT) ? "CHRG_INPUT" : "",
+                   (faults & PMIC_FAULT_CHRG_THERMAL) ? "CHRG_THERMAL" : "",
+                   (faults & PMIC_FAULT_CHRG_SAFETY) ? "CHRG_SAFETY" : "",
+                   (faults & PMIC_FAULT_BATT_OVP) ? "BATT_OVP" : "", (faults & PMIC_FAULT_NTC_COLD) ? "NTC_COLD" : "",
+                   (faults & PMIC_FAULT_NTC_HOT) ? "NTC_HOT" : "", (faults & PMIC_FAULT_NTC_BOOST) ? "NTC_BOOST" : "");
         }
 
-        printf(
-            "Vbat: %u mV, vsys: %u mV, ts: %2.2f%%, vbus: %u mV, ichgr: %u mA, comm: %s, chrg: %s (%u), %s, %s, "
-            "charger status: %s\r\n",
-            vbat, vsys, ts / 100.0, vbus, ichgr, last ? "last" : (latch ? "latch" : "ok"),
-            chrg_disabled ? ((!chrg_disable_setting) ? "enabling" : "disabled")
-                          : ((!chrg_disable_setting) ? "enabled" : "disabling"),
-            chrg_speed, battery_attached ? "battery attached" : "no battery", usb_attached ? "usb attached" : "no usb",
-            (chrg_status == TANMATSU_CHARGE_STATUS_NOT_CHARGING)              ? "not charging"
-            : (chrg_status == TANMATSU_CHARGE_STATUS_PRE_CHARGING)            ? "pre-charging"
-            : (chrg_status == TANMATSU_CHARGE_STATUS_FAST_CHARGING)           ? "fast charging"
-            : (chrg_status == TANMATSU_CHARGE_STATUS_CHARGE_TERMINATION_DONE) ? "charging done"
-                                                                              : "unknown");
-
-        char buffer2[1024] = {0};
-        sprintf(buffer2,
-                "Battery voltage: %u mV\r\n"
-                "System voltage: %u mV\r\n"
-                "USB voltage: %u mV\r\n"
-                "Charging current: %u mA\r\n"
-                "TS: %2.2f%%\r\n"
-                "Communication: %s\r\n"
-                "Charging: %s (%u)\r\n"
-                "Battery: %s\r\n"
-                "USB: %s\r\n"
-                "Charging status: %s\r\n",
-                vbat, vsys, vbus, ichgr, ts / 100.0, last ? "last" : (latch ? "latch" : "ok"),
-                chrg_disabled ? ((!chrg_disable_setting) ? "enabling" : "disabled")
-                              : ((!chrg_disable_setting) ? "enabled" : "disabling"),
-                chrg_speed, battery_attached ? "attached" : "not detected", usb_attached ? "attached" : "not detected",
-                (chrg_status == TANMATSU_CHARGE_STATUS_NOT_CHARGING)              ? "not charging"
-                : (chrg_status == TANMATSU_CHARGE_STATUS_PRE_CHARGING)            ? "pre-charging"
-                : (chrg_status == TANMATSU_CHARGE_STATUS_FAST_CHARGING)           ? "fast charging"
-                : (chrg_status == TANMATSU_CHARGE_STATUS_CHARGE_TERMINATION_DONE) ? "charging done"
-                                                                                  : "unknown");
-
-        char buffer[2048] = {0};
-        sprintf(buffer,
-                "%s\r\n"
-                "RTC: %" PRIu32 "\r\n",
-                buffer2, rtc);
-
+        char line[256];
+        format_status_line(line, sizeof(line), &pmic);
+        fputs(line, stdout);
+
+        bool record = (telemetry.valid & history_metrics) == history_metrics &&
+                      (pmic.rtc >= history_due_s || pmic.rtc + EXAMPLE_TELEMETRY_HISTORY_PERIOD_S < history_due_s);
+        telemetry_history_sample_t sample = {
+            .time_s = pmic.rtc,
+            .values = {
+                [TELEMETRY_HISTORY_VBAT] = pmic.vbat_mv,
+                [TELEMETRY_HISTORY_VSYS] = pmic.vsys_mv,
+                [TELEMETRY_HISTORY_VBUS] = pmic.vbus_mv,
+                [TELEMETRY_HISTORY_ICHGR] = pmic.ichgr_ma,
+            },
+        };
         lvgl_lock();
-        if (status_label) {
-            lv_label_set_text(status_label, buffer);
+        status_panel_update(&pmic);
+        if (record) {
+            telemetry_history_append(&history, &sample);
+            history_chart_append(&history);
+            history_due_s = pmic.rtc + EXAMPLE_TELEMETRY_HISTORY_PERIOD_S;
         }
         lvgl_unlock();
-        vTaskDelay(pdMS_TO_TICKS(400));
     }
 }
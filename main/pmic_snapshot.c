@@ -0,0 +1,68 @@
+#include "pmic_snapshot.h"
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+#include <string.h>
+
+static inline uint16_t get_u16(const uint8_t* p) {
+    return p[0] | (p[1] << 8);
+}
+
+static inline void put_u16(uint8_t* p, uint16_t value) {
+    p[0] = value;
+    p[1] = value >> 8;
+}
+
+void pmic_snapshot_decode(const uint8_t block[PMIC_SNAPSHOT_BLOCK_SIZE], pmic_snapshot_t* snapshot) {
+    const uint8_t* rtc = &block[PMIC_SNAPSHOT_OFFSET_RTC];
+    uint8_t comm = block[PMIC_SNAPSHOT_OFFSET_COMM_FAULT];
+    uint8_t control = block[PMIC_SNAPSHOT_OFFSET_CHARGING_CONTROL];
+    uint8_t status = block[PMIC_SNAPSHOT_OFFSET_CHARGING_STATUS];
+
+    snapshot->rtc = rtc[0] | (rtc[1] << 8) | (rtc[2] << 16) | ((uint32_t)rtc[3] << 24);
+    snapshot->comm_fault_last = comm & (1 << 0);
+    snapshot->comm_fault_latch = comm & (1 << 1);
+    snapshot->faults = get_u16(&block[PMIC_SNAPSHOT_OFFSET_FAULTS]);
+    snapshot->vbat_mv = get_u16(&block[PMIC_SNAPSHOT_OFFSET_VBAT]);
+    snapshot->vsys_mv = get_u16(&block[PMIC_SNAPSHOT_OFFSET_VSYS]);
+    snapshot->ts = get_u16(&block[PMIC_SNAPSHOT_OFFSET_TS]);
+    snapshot->vbus_mv = get_u16(&block[PMIC_SNAPSHOT_OFFSET_VBUS]);
+    snapshot->ichgr_ma = get_u16(&block[PMIC_SNAPSHOT_OFFSET_ICHGR]);
+    snapshot->charging_disable_setting = control & (1 << 0);
+    snapshot->charging_speed = (control >> 1) & 3;
+    snapshot->battery_attached = status & (1 << 0);
+    snapshot->usb_attached = status & (1 << 1);
+    snapshot->charging_disabled = status & (1 << 2);
+    snapshot->charging_status = (status >> 3) & 3;
+}
+
+void pmic_snapshot_encode(const pmic_snapshot_t* snapshot, uint8_t block[PMIC_SNAPSHOT_BLOCK_SIZE]) {
+    uint8_t* rtc = &block[PMIC_SNAPSHOT_OFFSET_RTC];
+
+    memset(block, 0, PMIC_SNAPSHOT_BLOCK_SIZE);
+    rtc[0] = snapshot->rtc;
+    rtc[1] = snapshot->rtc >> 8;
+    rtc[2] = snapshot->rtc >> 16;
+    rtc[3] = snapshot->rtc >> 24;
+    block[PMIC_SNAPSHOT_OFFSET_COMM_FAULT] = snapshot->comm_fault_last | (snapshot->comm_fault_latch << 1);
+    put_u16(&block[PMIC_SNAPSHOT_OFFSET_FAULTS], snapshot->faults);
+    put_u16(&block[PMIC_SNAPSHOT_OFFSET_VBAT], snapshot->vbat_mv);
+    put_u16(&block[PMIC_SNAPSHOT_OFFSET_VSYS], snapshot->vsys_mv);
+    put_u16(&block[PMIC_SNAPSHOT_OFFSET_TS], snapshot->ts);
+    put_u16(&block[PMIC_SNAPSHOT_OFFSET_VBUS], snapshot->vbus_mv);
+    put_u16(&block[PMIC_SNAPSHOT_OFFSET_ICHGR], snapshot->ichgr_ma);
+    block[PMIC_SNAPSHOT_OFFSET_CHARGING_CONTROL] =
+        snapshot->charging_disable_setting | ((snapshot->charging_speed & 3) << 1);
+    block[PMIC_SNAPSHOT_OFFSET_CHARGING_STATUS] = snapshot->battery_attached | (snapshot->usb_attached << 1) |
+                                                  (snapshot->charging_disabled << 2) |
+                                                  ((snapshot->charging_status & 3) << 3);
+}
+
+bool pmic_snapshot_equal(const pmic_snapshot_t* a, const pmic_snapshot_t* b) {
+    uint8_t block_a[PMIC_SNAPSHOT_BLOCK_SIZE];
+    uint8_t block_b[PMIC_SNAPSHOT_BLOCK_SIZE];
+    // Comparing the encoded form ignores struct padding
+    pmic_snapshot_encode(a, block_a);
+    pmic_snapshot_encode(b, block_b);
+    return memcmp(block_a, block_b, sizeof(block_a)) == 0;
+}
@@ -0,0 +1,53 @@
+#pragma once
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+// Packed form of a snapshot, as the telemetry log and coprocessor traces store it. This is the firmware's own record
+// layout, not the coprocessor's register map: the values are read through the driver's getters. Multi-byte values
+// are little endian.
+#define PMIC_SNAPSHOT_OFFSET_RTC              0   // uint32_t, seconds
+#define PMIC_SNAPSHOT_OFFSET_COMM_FAULT       4   // Bit 0: last transaction failed, bit 1: latched failure
+#define PMIC_SNAPSHOT_OFFSET_FAULTS           5   // uint16_t, PMIC_FAULT_* bits
+#define PMIC_SNAPSHOT_OFFSET_VBAT             7   // uint16_t, mV
+#define PMIC_SNAPSHOT_OFFSET_VSYS             9   // uint16_t, mV
+#define PMIC_SNAPSHOT_OFFSET_TS               11  // uint16_t, 0.01 %
+#define PMIC_SNAPSHOT_OFFSET_VBUS             13  // uint16_t, mV
+#define PMIC_SNAPSHOT_OFFSET_ICHGR            15  // uint16_t, mA
+#define PMIC_SNAPSHOT_OFFSET_CHARGING_CONTROL 17  // Bit 0: charging disabled, bits 1-2: speed
+#define PMIC_SNAPSHOT_OFFSET_CHARGING_STATUS  18  // Bit 0: battery, 1: USB, 2: charging disabled, 3-4: status
+#define PMIC_SNAPSHOT_BLOCK_SIZE              19
+
+#define PMIC_FAULT_WATCHDOG     (1 << 0)
+#define PMIC_FAULT_BOOST        (1 << 1)
+#define PMIC_FAULT_CHRG_INPUT   (1 << 2)
+#define PMIC_FAULT_CHRG_THERMAL (1 << 3)
+#define PMIC_FAULT_CHRG_SAFETY  (1 << 4)
+#define PMIC_FAULT_BATT_OVP     (1 << 5)
+#define PMIC_FAULT_NTC_COLD     (1 << 6)
+#define PMIC_FAULT_NTC_HOT      (1 << 7)
+#define PMIC_FAULT_NTC_BOOST    (1 << 8)
+
+typedef struct {
+    uint32_t rtc;
+    bool comm_fault_last;
+    bool comm_fault_latch;
+    uint16_t faults;
+    uint16_t vbat_mv;
+    uint16_t vsys_mv;
+    uint16_t ts;  // 0.01 %
+    uint16_t vbus_mv;
+    uint16_t ichgr_ma;
+    bool charging_disable_setting;
+    uint8_t charging_speed;
+    bool battery_attached;
+    bool usb_attached;
+    bool charging_disabled;
+    uint8_t charging_status;  // TANMATSU_CHARGE_STATUS_*
+} pmic_snapshot_t;
+
+void pmic_snapshot_decode(const uint8_t block[PMIC_SNAPSHOT_BLOCK_SIZE], pmic_snapshot_t* snapshot);
+void pmic_snapshot_encode(const pmic_snapshot_t* snapshot, uint8_t block[PMIC_SNAPSHOT_BLOCK_SIZE]);
+
+bool pmic_snapshot_equal(const pmic_snapshot_t* a, const pmic_snapshot_t* b);
@@ -0,0 +1,142 @@
+#include "rotate_rgb565.h"
+#include <stdbool.h>
+#include <stdint.h>
+#include <string.h>
+
+// Tile edge in pixels. A 32x32 RGB565 tile is 2 KiB, so the source and destination tiles of one
+// block stay in the L1 data cache while the strided side of the transpose is walked.
+#define ROTATE_TILE 32
+
+static inline int32_t min_i32(int32_t a, int32_t b) {
+    return a < b ? a : b;
+}
+
+// The paired paths move two pixels per 32-bit load/store and transpose 2x2 blocks in registers.
+// They need every row to start on a word boundary and an even number of rows and columns.
+static inline bool can_pair(const void* src, const void* dst, int32_t width, int32_t height, int32_t src_stride,
+                            int32_t dst_stride) {
+    return ((((uintptr_t)src | (uintptr_t)dst | (uintptr_t)src_stride | (uintptr_t)dst_stride) & 3) == 0) &&
+           ((width & 1) == 0) && ((height & 1) == 0);
+}
+
+// dst[(width - 1 - x) * dst_stride + y] = src[y * src_stride + x]
+static void rotate90(const uint16_t* src, uint16_t* dst, int32_t width, int32_t height, int32_t ss, int32_t ds) {
+    for (int32_t ty = 0; ty < height; ty += ROTATE_TILE) {
+        int32_t ey = min_i32(ty + ROTATE_TILE, height);
+        for (int32_t tx = 0; tx < width; tx += ROTATE_TILE) {
+            int32_t ex = min_i32(tx + ROTATE_TILE, width);
+            for (int32_t x = tx; x < ex; x++) {
+                uint16_t* d = dst + (width - 1 - x) * ds;
+                const uint16_t* s = src + x;
+                for (int32_t y = ty; y < ey; y++) {
+                    d[y] = s[y * ss];
+                }
+            }
+        }
+    }
+}
+
+static void rotate90_paired(const uint16_t* src, uint16_t* dst, int32_t width, int32_t height, int32_t ss,
+                            int32_t ds) {
+    for (int32_t ty = 0; ty < height; ty += ROTATE_TILE) {
+        int32_t ey = min_i32(ty + ROTATE_TILE, height);
+        for (int32_t tx = 0; tx < width; tx += ROTATE_TILE) {
+            int32_t ex = min_i32(tx + ROTATE_TILE, width);
+            for (int32_t x = tx; x < ex; x += 2) {
+                uint32_t* d0 = (uint32_t*)(dst + (width - 1 - x) * ds);
+                uint32_t* d1 = (uint32_t*)(dst + (width - 2 - x) * ds);
+                for (int32_t y = ty; y < ey; y += 2) {
+                    uint32_t r0 = *(const uint32_t*)(src + y * ss + x);
+                    uint32_t r1 = *(const uint32_t*)(src + (y + 1) * ss + x);
+                    d0[y >> 1] = (r0 & 0xFFFF) | (r1 << 16);
+                    d1[y >> 1] = (r0 >> 16) | (r1 & 0xFFFF0000);
+                }
+            }
+        }
+    }
+}
+
+// dst[(height - 1 - y) * dst_stride + (width - 1 - x)] = src[y * src_stride + x]
+static void rotate180(const uint16_t* src, uint16_t* dst, int32_t width, int32_t height, int32_t ss, int32_t ds) {
+    for (int32_t y = 0; y < height; y++) {
+        const uint16_t* s = src + y * ss;
+        uint16_t* d = dst + (height - 1 - y) * ds + (width - 1);
+        for (int32_t x = 0; x < width; x++) {
+            d[-x] = s[x];
+        }
+    }
+}
+
+static void rotate180_paired(const uint16_t* src, uint16_t* dst, int32_t width, int32_t height, int32_t ss,
+                             int32_t ds) {
+    int32_t words = width >> 1;
+    for (int32_t y = 0; y < height; y++) {
+        const uint32_t* s = (const uint32_t*)(src + y * ss);
+        uint32_t* d = (uint32_t*)(dst + (height - 1 - y) * ds) + (words - 1);
+        for (int32_t x = 0; x < words; x++) {
+            uint32_t v = s[x];
+            d[-x] = (v >> 16) | (v << 16);
+        }
+    }
+}
+
+// dst[x * dst_stride + (height - 1 - y)] = src[y * src_stride + x]
+static void rotate270(const uint16_t* src, uint16_t* dst, int32_t width, int32_t height, int32_t ss, int32_t ds) {
+    for (int32_t ty = 0; ty < height; ty += ROTATE_TILE) {
+        int32_t ey = min_i32(ty + ROTATE_TILE, height);
+        for (int32_t tx = 0; tx < width; tx += ROTATE_TILE) {
+            int32_t ex = min_i32(tx + ROTATE_TILE, width);
+            for (int32_t x = tx; x < ex; x++) {
+                uint16_t* d = dst + x * ds + (height - 1);
+                const uint16_t* s = src + x;
+                for (int32_t y = ty; y < ey; y++) {
+                    d[-y] = s[y * ss];
+                }
+            }
+        }
+    }
+}
+
+static void rotate270_paired(const uint16_t* src, uint16_t* dst, int32_t width, int32_t height, int32_t ss,
+                             int32_t ds) {
+    for (int32_t ty = 0; ty < height; ty += ROTATE_TILE) {
+        int32_t ey = min_i32(ty + ROTATE_TILE, height);
+        for (int32_t tx = 0; tx < width; tx += ROTATE_TILE) {
+            int32_t ex = min_i32(tx + ROTATE_TILE, width);
+            for (int32_t x = tx; x < ex; x += 2) {
+                uint32_t* d0 = (uint32_t*)(dst + x * ds + (height - 2));
+                uint32_t* d1 = (uint32_t*)(dst + (x + 1) * ds + (height - 2));
+                for (int32_t y = ty; y < ey; y += 2) {
+                    uint32_t r0 = *(const uint32_t*)(src + y * ss + x);
+                    uint32_t r1 = *(const uint32_t*)(src + (y + 1) * ss + x);
+                    d0[-(y >> 1)] = (r1 & 0xFFFF) | (r0 << 16);
+                    d1[-(y >> 1)] = (r1 >> 16) | (r0 & 0xFFFF0000);
+                }
+            }
+        }
+    }
+}
+
+void rotate_rgb565(const uint16_t* src, uint16_t* dst, int32_t width, int32_t height, int32_t src_stride,
+                   int32_t dst_stride, lv_display_rotation_t rotation) {
+    bool paired = can_pair(src, dst, width, height, src_stride, dst_stride);
+    int32_t ss = src_stride / (int32_t)sizeof(uint16_t);
+    int32_t ds = dst_stride / (int32_t)sizeof(uint16_t);
+
+    switch (rotation) {
+        case LV_DISPLAY_ROTATION_90:
+            (paired ? rotate90_paired : rotate90)(src, dst, width, height, ss, ds);
+            break;
+        case LV_DISPLAY_ROTATION_180:
+            (paired ? rotate180_paired : rotate180)(src, dst, width, height, ss, ds);
+            break;
+        case LV_DISPLAY_ROTATION_270:
+            (paired ? rotate270_paired : rotate270)(src, dst, width, height, ss, ds);
+            break;
+        default:
+            for (int32_t y = 0; y < height; y++) {
+                memcpy(dst + y * ds, src + y * ss, width * sizeof(uint16_t));
+            }
+            break;
+    }
+}
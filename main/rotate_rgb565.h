@@ -0,0 +1,9 @@
+#pragma once
+
+#include <stdint.h>
+#include "display/lv_display.h"
+
+// Tiled RGB565 rotation, bit-exact with lv_draw_sw_rotate(). Strides are in bytes, like LVGL.
+// For 90 and 270 degrees the destination is height pixels wide and width pixels tall.
+void rotate_rgb565(const uint16_t* src, uint16_t* dst, int32_t width, int32_t height, int32_t src_stride,
+                   int32_t dst_stride, lv_display_rotation_t rotation);
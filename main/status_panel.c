@@ -0,0 +1,239 @@
+#include "status_panel.h"
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+#include <string.h>
+#include "lvgl.h"
+#include "pmic_snapshot.h"
+#include "tanmatsu_coprocessor.h"
+
+typedef enum {
+    STATUS_FIELD_VBAT,
+    STATUS_FIELD_VSYS,
+    STATUS_FIELD_VBUS,
+    STATUS_FIELD_ICHGR,
+    STATUS_FIELD_TS,
+    STATUS_FIELD_COMM,
+    STATUS_FIELD_CHARGING,
+    STATUS_FIELD_BATTERY,
+    STATUS_FIELD_USB,
+    STATUS_FIELD_CHARGER,
+    STATUS_FIELD_RTC,
+    STATUS_FIELD_COUNT,
+} status_field_t;
+
+static const char* const field_names[STATUS_FIELD_COUNT] = {
+    [STATUS_FIELD_VBAT] = "Battery voltage",
+    [STATUS_FIELD_VSYS] = "System voltage",
+    [STATUS_FIELD_VBUS] = "USB voltage",
+    [STATUS_FIELD_ICHGR] = "Charging current",
+    [STATUS_FIELD_TS] = "TS",
+    [STATUS_FIELD_COMM] = "Communication",
+    [STATUS_FIELD_CHARGING] = "Charging",
+    [STATUS_FIELD_BATTERY] = "Battery",
+    [STATUS_FIELD_USB] = "USB",
+    [STATUS_FIELD_CHARGER] = "Charging status",
+    [STATUS_FIELD_RTC] = "RTC",
+};
+
+#define STATUS_ROW_HEIGHT   22
+#define STATUS_VALUE_SIZE   24
+#define STATUS_WAIT_MESSAGE "Please wait..."
+
+typedef struct {
+    lv_obj_t* value;
+    uint32_t shown;  // Raw value the label currently shows
+    bool valid;
+} status_row_t;
+
+static lv_obj_t* panel = NULL;
+static lv_obj_t* message_label = NULL;
+static status_row_t rows[STATUS_FIELD_COUNT];
+static bool redraw_all = false;
+
+static void put_char(char* buf, size_t size, size_t* length, char c) {
+    if (*length + 1 < size) {
+        buf[*length] = c;
+    }
+    (*length)++;
+}
+
+size_t status_format_fixed(char* buf, size_t size, int64_t value, unsigned decimals, const char* suffix) {
+    char digits[24];
+    size_t count = 0;
+    uint64_t magnitude = value < 0 ? -(uint64_t)value : (uint64_t)value;
+    // Digits in reverse order, at least one before the decimal point
+    do {
+        digits[count++] = '0' + magnitude % 10;
+        magnitude /= 10;
+    } while (magnitude > 0 || count <= decimals);
+
+    size_t length = 0;
+    if (value < 0) {
+        put_char(buf, size, &length, '-');
+    }
+    while (count > 0) {
+        if (count == decimals) {
+            put_char(buf, size, &length, '.');
+        }
+        put_char(buf, size, &length, digits[--count]);
+    }
+    for (const char* c = suffix; c != NULL && *c != '\0'; c++) {
+        put_char(buf, size, &length, *c);
+    }
+    if (size > 0) {
+        buf[length < size ? length : size - 1] = '\0';
+    }
+    return length;
+}
+
+const char* status_comm_text(const pmic_snapshot_t* pmic) {
+    return pmic->comm_fault_last ? "last" : (pmic->comm_fault_latch ? "latch" : "ok");
+}
+
+const char* status_charging_text(const pmic_snapshot_t* pmic) {
+    if (pmic->charging_disabled) {
+        return !pmic->charging_disable_setting ? "enabling" : "disabled";
+    }
+    return !pmic->charging_disable_setting ? "enabled" : "disabling";
+}
+
+const char* status_charger_text(const pmic_snapshot_t* pmic) {
+    switch (pmic->charging_status) {
+        case TANMATSU_CHARGE_STATUS_NOT_CHARGING:
+            return "not charging";
+        case TANMATSU_CHARGE_STATUS_PRE_CHARGING:
+            return "pre-charging";
+        case TANMATSU_CHARGE_STATUS_FAST_CHARGING:
+            return "fast charging";
+        case TANMATSU_CHARGE_STATUS_CHARGE_TERMINATION_DONE:
+            return "charging done";
+        default:
+            return "unknown";
+    }
+}
+
+lv_obj_t* status_panel_create(lv_obj_t* parent) {
+    panel = lv_obj_create(parent);
+    lv_obj_remove_style_all(panel);
+    lv_obj_set_size(panel, lv_pct(100), lv_pct(100));
+    lv_obj_set_flex_flow(panel, LV_FLEX_FLOW_COLUMN);
+
+    message_label = lv_label_create(panel);
+    lv_obj_set_width(message_label, lv_pct(100));
+    lv_label_set_text(message_label, STATUS_WAIT_MESSAGE);
+
+    for (int field = 0; field < STATUS_FIELD_COUNT; field++) {
+        lv_obj_t* row = lv_obj_create(panel);
+        lv_obj_remove_style_all(row);
+        lv_obj_set_size(row, lv_pct(100), STATUS_ROW_HEIGHT);
+
+        lv_obj_t* name = lv_label_create(row);
+        lv_label_set_text_static(name, field_names[field]);
+        lv_obj_set_width(name, lv_pct(55));
+        lv_label_set_long_mode(name, LV_LABEL_LONG_CLIP);
+
+        // A fixed size keeps text changes from resizing the label and reflowing the row
+        lv_obj_t* value = lv_label_create(row);
+        lv_label_set_text(value, "");
+        lv_obj_set_size(value, lv_pct(45), STATUS_ROW_HEIGHT);
+        lv_obj_align(value, LV_ALIGN_TOP_RIGHT, 0, 0);
+        lv_label_set_long_mode(value, LV_LABEL_LONG_CLIP);
+
+        rows[field] = (status_row_t){.value = value};
+    }
+    return panel;
+}
+
+static void set_value(status_field_t field, uint32_t raw, const char* text) {
+    status_row_t* row = &rows[field];
+    if (row->valid && row->shown == raw) {
+        return;
+    }
+    row->valid = true;
+    row->shown = raw;
+    lv_label_set_text(row->value, text);
+}
+
+// Formats only when the value changed
+static void set_number(status_field_t field, uint32_t value, unsigned decimals, const char* suffix) {
+    if (rows[field].valid && rows[field].shown == value) {
+        return;
+    }
+    char text[STATUS_VALUE_SIZE];
+    status_format_fixed(text, sizeof(text), value, decimals, suffix);
+    set_value(field, value, text);
+}
+
+void status_panel_update(const pmic_snapshot_t* pmic) {
+    if (panel == NULL) {
+        return;
+    }
+    status_panel_set_message(NULL);
+
+    set_number(STATUS_FIELD_VBAT, pmic->vbat_mv, 0, " mV");
+    set_number(STATUS_FIELD_VSYS, pmic->vsys_mv, 0, " mV");
+    set_number(STATUS_FIELD_VBUS, pmic->vbus_mv, 0, " mV");
+    set_number(STATUS_FIELD_ICHGR, pmic->ichgr_ma, 0, " mA");
+    // The PMIC reports TS in hundredths of a percent
+    set_number(STATUS_FIELD_TS, pmic->ts, 2, "%");
+    set_number(STATUS_FIELD_RTC, pmic->rtc, 0, NULL);
+
+    // Text values are keyed on the raw state they are derived from
+    set_value(STATUS_FIELD_COMM, pmic->comm_fault_last << 1 | pmic->comm_fault_latch, status_comm_text(pmic));
+    set_value(STATUS_FIELD_BATTERY, pmic->battery_attached, pmic->battery_attached ? "attached" : "not detected");
+    set_value(STATUS_FIELD_USB, pmic->usb_attached, pmic->usb_attached ? "attached" : "not detected");
+    set_value(STATUS_FIELD_CHARGER, pmic->charging_status, status_charger_text(pmic));
+
+    uint32_t charging_key = pmic->charging_disabled << 9 | pmic->charging_disable_setting << 8 | pmic->charging_speed;
+    if (!rows[STATUS_FIELD_CHARGING].valid || rows[STATUS_FIELD_CHARGING].shown != charging_key) {
+        const char* charging = status_charging_text(pmic);
+        char text[STATUS_VALUE_SIZE];
+        size_t length = strlen(charging);
+        memcpy(text, charging, length);
+        text[length++] = ' ';
+        text[length++] = '(';
+        status_format_fixed(&text[length], sizeof(text) - length, pmic->charging_speed, 0, ")");
+        set_value(STATUS_FIELD_CHARGING, charging_key, text);
+    }
+
+    if (redraw_all) {
+        lv_obj_invalidate(panel);
+    }
+}
+
+void status_panel_reset() {
+    if (panel == NULL) {
+        return;
+    }
+    for (int field = 0; field < STATUS_FIELD_COUNT; field++) {
+        if (rows[field].valid) {
+            lv_label_set_text(rows[field].value, "");
+            rows[field].valid = false;
+        }
+    }
+    status_panel_set_message(STATUS_WAIT_MESSAGE);
+}
+
+void status_panel_set_message(const char* message) {
+    if (message_label == NULL) {
+        return;
+    }
+    bool hidden = lv_obj_has_flag(message_label, LV_OBJ_FLAG_HIDDEN);
+    if (message == NULL) {
+        if (!hidden) {
+            lv_obj_add_flag(message_label, LV_OBJ_FLAG_HIDDEN);
+        }
+        return;
+    }
+    if (hidden || strcmp(lv_label_get_text(message_label), message) != 0) {
+        lv_label_set_text(message_label, message);
+    }
+    if (hidden) {
+        lv_obj_remove_flag(message_label, LV_OBJ_FLAG_HIDDEN);
+    }
+}
+
+void status_panel_set_full_redraw(bool full_redraw) {
+    redraw_all = full_redraw;
+}
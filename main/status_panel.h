@@ -0,0 +1,31 @@
+#pragma once
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+#include "lvgl.h"
+#include "pmic_snapshot.h"
+
+// Status panel with one row per value. Every value has its own label that is only changed, and therefore only
+// redrawn, when the value itself changed. Rows have a fixed size, so a new value never moves anything else. All
+// functions except the formatting helpers need the LVGL lock.
+lv_obj_t* status_panel_create(lv_obj_t* parent);
+
+void status_panel_update(const pmic_snapshot_t* pmic);
+
+// Empties the values and shows the waiting message again, as right after status_panel_create()
+void status_panel_reset();
+
+// Shows a line above the values, NULL hides it
+void status_panel_set_message(const char* message);
+
+// Invalidates the whole panel on every update like the single status label did, only for comparing the flush load
+void status_panel_set_full_redraw(bool full_redraw);
+
+// Writes value / 10^decimals with exactly that many decimals and the suffix, without floating point. Returns the
+// length, the output is truncated to size - 1 characters.
+size_t status_format_fixed(char* buf, size_t size, int64_t value, unsigned decimals, const char* suffix);
+
+const char* status_comm_text(const pmic_snapshot_t* pmic);
+const char* status_charging_text(const pmic_snapshot_t* pmic);
+const char* status_charger_text(const pmic_snapshot_t* pmic);
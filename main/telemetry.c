@@ -0,0 +1,295 @@
+#include "telemetry.h"
+#include <stdatomic.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include <string.h>
+#include "coproc_replay.h"
+#include "coproc_trace.h"
+#include "esp_err.h"
+#include "esp_timer.h"
+#include "freertos/FreeRTOS.h"
+#include "freertos/task.h"
+#include "i2c_sched.h"
+#include "pmic_snapshot.h"
+#include "tanmatsu_coprocessor.h"
+
+#define TELEMETRY_TASK_STACK_SIZE 4096
+#define TELEMETRY_TASK_PRIORITY   1
+// Time the PMIC needs for one ADC conversion after it was triggered
+#define TELEMETRY_ADC_CONVERSION_MS 600
+// Failed reads are retried after this delay instead of at the metric's own rate
+#define TELEMETRY_RETRY_MS          1000
+
+#define METRIC(metric) (1u << (metric))
+// Metrics that come from the PMIC's ADC and need a conversion to be triggered first
+#define TELEMETRY_ADC_METRICS                                                                              \
+    (METRIC(TELEMETRY_VBAT) | METRIC(TELEMETRY_ICHGR) | METRIC(TELEMETRY_VSYS) | METRIC(TELEMETRY_VBUS) | \
+     METRIC(TELEMETRY_TS))
+
+static const uint32_t default_period_ms[TELEMETRY_METRIC_COUNT] = {
+    [TELEMETRY_VBAT] = 1000,
+    [TELEMETRY_ICHGR] = 1000,
+    [TELEMETRY_VSYS] = 5000,
+    [TELEMETRY_VBUS] = 2000,
+    [TELEMETRY_TS] = 10000,
+    [TELEMETRY_FAULTS] = 1000,
+    [TELEMETRY_COMM_FAULT] = 5000,
+    [TELEMETRY_CHARGING_STATUS] = 2000,
+    [TELEMETRY_CHARGING_CONTROL] = 10000,
+    [TELEMETRY_RTC] = 1000,
+};
+
+static telemetry_config_t config;
+
+// Seqlock over two buffers. An even sequence means published[(sequence >> 1) & 1] is complete, an odd one means the
+// other buffer is being written. Readers therefore never wait for the writer, they only retry when the writer went
+// on to overwrite the buffer they were copying.
+static telemetry_snapshot_t published[2];
+static atomic_uint published_sequence = 0;
+
+static void telemetry_publish(const telemetry_snapshot_t* snapshot) {
+    unsigned int sequence = atomic_load_explicit(&published_sequence, memory_order_relaxed);
+    telemetry_snapshot_t* target = &published[((sequence >> 1) + 1) & 1];
+
+    atomic_store_explicit(&published_sequence, sequence + 1, memory_order_relaxed);
+    atomic_thread_fence(memory_order_release);
+    *target = *snapshot;
+    target->sequence = (sequence >> 1) + 1;
+    atomic_store_explicit(&published_sequence, sequence + 2, memory_order_release);
+}
+
+bool telemetry_get(telemetry_snapshot_t* snapshot) {
+    while (true) {
+        unsigned int sequence = atomic_load_explicit(&published_sequence, memory_order_acquire);
+        if (sequence < 2) {
+            return false;
+        }
+        *snapshot = published[(sequence >> 1) & 1];
+        atomic_thread_fence(memory_order_acquire);
+        // The buffer just copied is only written again once the sequence reaches the next odd value after the
+        // following publish
+        if (atomic_load_explicit(&published_sequence, memory_order_relaxed) - (sequence & ~1u) < 3) {
+            return true;
+        }
+    }
+}
+
+// Runs one driver call in its own telemetry slot, so queued input and control traffic goes in between the getters.
+// The call is traced as op.
+#define TELEMETRY_CALL(op, call) COPROC_TRACE_CALL(op, 0, 0, I2C_SCHED_CALL(I2C_SCHED_TELEMETRY, call))
+
+// Reads the requested metrics through the driver's getters, one I2C transaction each. Returns NULL on success and
+// the error otherwise.
+static const char* read_getters(uint32_t metrics, pmic_snapshot_t* pmic) {
+    tanmatsu_coprocessor_handle_t handle = config.coprocessor;
+
+    if (metrics & METRIC(TELEMETRY_FAULTS)) {
+        tanmatsu_coprocessor_pmic_faults_t faults;
+        if (TELEMETRY_CALL(COPROC_OP_GET_FAULTS, tanmatsu_coprocessor_get_pmic_faults(handle, &faults)) != ESP_OK) {
+            return "Failed to read PMIC faults";
+        }
+        pmic->faults = (faults.watchdog ? PMIC_FAULT_WATCHDOG : 0) | (faults.boost ? PMIC_FAULT_BOOST : 0) |
+                       (faults.chrg_input ? PMIC_FAULT_CHRG_INPUT : 0) |
+                       (faults.chrg_thermal ? PMIC_FAULT_CHRG_THERMAL : 0) |
+                       (faults.chrg_safety ? PMIC_FAULT_CHRG_SAFETY : 0) | (faults.batt_ovp ? PMIC_FAULT_BATT_OVP : 0) |
+                       (faults.ntc_cold ? PMIC_FAULT_NTC_COLD : 0) | (faults.ntc_hot ? PMIC_FAULT_NTC_HOT : 0) |
+                       (faults.ntc_boost ? PMIC_FAULT_NTC_BOOST : 0);
+    }
+    if ((metrics & METRIC(TELEMETRY_VBAT)) &&
+        TELEMETRY_CALL(COPROC_OP_GET_VBAT, tanmatsu_coprocessor_get_pmic_vbat(handle, &pmic->vbat_mv)) != ESP_OK) {
+        return "Failed to read vbat";
+    }
+    if ((metrics & METRIC(TELEMETRY_VSYS)) &&
+        TELEMETRY_CALL(COPROC_OP_GET_VSYS, tanmatsu_coprocessor_get_pmic_vsys(handle, &pmic->vsys_mv)) != ESP_OK) {
+        return "Failed to read vsys";
+    }
+    if ((metrics & METRIC(TELEMETRY_TS)) &&
+        TELEMETRY_CALL(COPROC_OP_GET_TS, tanmatsu_coprocessor_get_pmic_ts(handle, &pmic->ts)) != ESP_OK) {
+        return "Failed to read ts";
+    }
+    if ((metrics & METRIC(TELEMETRY_VBUS)) &&
+        TELEMETRY_CALL(COPROC_OP_GET_VBUS, tanmatsu_coprocessor_get_pmic_vbus(handle, &pmic->vbus_mv)) != ESP_OK) {
+        return "Failed to read vbus";
+    }
+    if ((metrics & METRIC(TELEMETRY_ICHGR)) &&
+        TELEMETRY_CALL(COPROC_OP_GET_ICHGR, tanmatsu_coprocessor_get_pmic_ichgr(handle, &pmic->ichgr_ma)) != ESP_OK) {
+        return "Failed to read ichgr";
+    }
+    if ((metrics & METRIC(TELEMETRY_COMM_FAULT)) &&
+        TELEMETRY_CALL(COPROC_OP_GET_COMM_FAULT,
+                       tanmatsu_coprocessor_get_pmic_communication_fault(handle, &pmic->comm_fault_last,
+                                                                         &pmic->comm_fault_latch)) != ESP_OK) {
+        return "Failed to read PMIC comm fault state";
+    }
+    if ((metrics & METRIC(TELEMETRY_CHARGING_CONTROL)) &&
+        TELEMETRY_CALL(COPROC_OP_GET_CHARGING_CONTROL,
+                       tanmatsu_coprocessor_get_pmic_charging_control(handle, &pmic->charging_disable_setting,
+                                                                      &pmic->charging_speed)) != ESP_OK) {
+        return "Failed to read charging control";
+    }
+    if ((metrics & METRIC(TELEMETRY_CHARGING_STATUS)) &&
+        TELEMETRY_CALL(COPROC_OP_GET_CHARGING_STATUS,
+                       tanmatsu_coprocessor_get_pmic_charging_status(handle, &pmic->battery_attached,
+                                                                     &pmic->usb_attached, &pmic->charging_disabled,
+                                                                     &pmic->charging_status)) != ESP_OK) {
+        return "Failed to read charging status";
+    }
+    if ((metrics & METRIC(TELEMETRY_RTC)) &&
+        TELEMETRY_CALL(COPROC_OP_GET_REAL_TIME, tanmatsu_coprocessor_get_real_time(handle, &pmic->rtc)) != ESP_OK) {
+        return "Failed to read RTC";
+    }
+    return NULL;
+}
+
+// Copies the requested metrics from src to dst
+static void merge_metrics(pmic_snapshot_t* dst, const pmic_snapshot_t* src, uint32_t metrics) {
+    if (metrics & METRIC(TELEMETRY_VBAT)) {
+        dst->vbat_mv = src->vbat_mv;
+    }
+    if (metrics & METRIC(TELEMETRY_ICHGR)) {
+        dst->ichgr_ma = src->ichgr_ma;
+    }
+    if (metrics & METRIC(TELEMETRY_VSYS)) {
+        dst->vsys_mv = src->vsys_mv;
+    }
+    if (metrics & METRIC(TELEMETRY_VBUS)) {
+        dst->vbus_mv = src->vbus_mv;
+    }
+    if (metrics & METRIC(TELEMETRY_TS)) {
+        dst->ts = src->ts;
+    }
+    if (metrics & METRIC(TELEMETRY_FAULTS)) {
+        dst->faults = src->faults;
+    }
+    if (metrics & METRIC(TELEMETRY_COMM_FAULT)) {
+        dst->comm_fault_last = src->comm_fault_last;
+        dst->comm_fault_latch = src->comm_fault_latch;
+    }
+    if (metrics & METRIC(TELEMETRY_CHARGING_STATUS)) {
+        dst->battery_attached = src->battery_attached;
+        dst->usb_attached = src->usb_attached;
+        dst->charging_disabled = src->charging_disabled;
+        dst->charging_status = src->charging_status;
+    }
+    if (metrics & METRIC(TELEMETRY_CHARGING_CONTROL)) {
+        dst->charging_disable_setting = src->charging_disable_setting;
+        dst->charging_speed = src->charging_speed;
+    }
+    if (metrics & METRIC(TELEMETRY_RTC)) {
+        dst->rtc = src->rtc;
+    }
+}
+
+static const char* read_metrics(uint32_t metrics, pmic_snapshot_t* pmic) {
+    pmic_snapshot_t sample = *pmic;
+    const char* error = NULL;
+    bool replayed_ok;
+    if (coproc_replay_pmic(&sample, &replayed_ok)) {
+        // A replay decides the values, so they match the recording however the rounds line up
+        if (!replayed_ok) {
+            error = "Replayed PMIC read failed";
+        }
+    } else {
+        error = read_getters(metrics, &sample);
+    }
+    coproc_trace_pmic(metrics, error == NULL, &sample);
+    if (error == NULL) {
+        merge_metrics(pmic, &sample, metrics);
+    }
+    return error;
+}
+
+static void postpone(int64_t* next_due_us, uint32_t metrics, int64_t until_us) {
+    for (int m = 0; m < TELEMETRY_METRIC_COUNT; m++) {
+        if (metrics & METRIC(m)) {
+            next_due_us[m] = until_us;
+        }
+    }
+}
+
+static void telemetry_task(void* arg) {
+    telemetry_snapshot_t current = {0};
+    int64_t next_due_us[TELEMETRY_METRIC_COUNT] = {0};
+    bool adc_converting = false;
+    int64_t adc_ready_us = 0;
+
+    while (true) {
+        int64_t now = esp_timer_get_time();
+        uint32_t due = 0;
+        for (int m = 0; m < TELEMETRY_METRIC_COUNT; m++) {
+            if (next_due_us[m] <= now) {
+                due |= METRIC(m);
+            }
+        }
+
+        // ADC metrics that fall due start a conversion and are read once it finished, the other metrics keep
+        // their own schedule in the meantime
+        const char* error = NULL;
+        uint32_t adc_due = due & TELEMETRY_ADC_METRICS;
+        if (adc_due && !adc_converting) {
+            esp_err_t res = COPROC_TRACE_CALL(
+                COPROC_OP_SET_ADC_CONTROL, true, false,
+                I2C_SCHED_CALL(I2C_SCHED_TELEMETRY,
+                               tanmatsu_coprocessor_set_pmic_adc_control(config.coprocessor, true, false)));
+            if (res == ESP_OK) {
+                adc_converting = true;
+                adc_ready_us = now + TELEMETRY_ADC_CONVERSION_MS * 1000;
+            } else {
+                error = "Failed to trigger ADC read";
+                postpone(next_due_us, adc_due, now + TELEMETRY_RETRY_MS * 1000);
+            }
+        }
+        uint32_t read = due & ~TELEMETRY_ADC_METRICS;
+        if (adc_converting && now >= adc_ready_us) {
+            read |= adc_due;
+            adc_converting = false;
+        }
+
+        if (read != 0) {
+            error = read_metrics(read, &current.pmic);
+            if (error == NULL) {
+                for (int m = 0; m < TELEMETRY_METRIC_COUNT; m++) {
+                    if (read & METRIC(m)) {
+                        next_due_us[m] = now + config.period_ms[m] * 1000;
+                        current.sampled_us[m] = now;
+                    }
+                }
+                current.valid |= read;
+            } else {
+                postpone(next_due_us, read, now + TELEMETRY_RETRY_MS * 1000);
+            }
+        }
+        if (read != 0 || error != NULL) {
+            current.error = error;
+            telemetry_publish(&current);
+        }
+
+        // Sleep until the next metric is due, ADC metrics wait for a running conversion instead
+        int64_t wake_us = INT64_MAX;
+        for (int m = 0; m < TELEMETRY_METRIC_COUNT; m++) {
+            bool waits_for_adc = adc_converting && (TELEMETRY_ADC_METRICS & METRIC(m));
+            int64_t due_us = waits_for_adc ? adc_ready_us : next_due_us[m];
+            if (due_us < wake_us) {
+                wake_us = due_us;
+            }
+        }
+        int64_t sleep_us = wake_us - esp_timer_get_time();
+        TickType_t ticks = sleep_us > 0 ? pdMS_TO_TICKS((sleep_us + 999) / 1000) : 0;
+        vTaskDelay(ticks > 0 ? ticks : 1);
+    }
+}
+
+esp_err_t telemetry_start(const telemetry_config_t* telemetry_config) {
+    config = *telemetry_config;
+    for (int m = 0; m < TELEMETRY_METRIC_COUNT; m++) {
+        if (config.period_ms[m] == 0) {
+            config.period_ms[m] = default_period_ms[m];
+        }
+    }
+
+    if (xTaskCreate(telemetry_task, "telemetry", TELEMETRY_TASK_STACK_SIZE, NULL, TELEMETRY_TASK_PRIORITY, NULL) !=
+        pdPASS) {
+        return ESP_ERR_NO_MEM;
+    }
+    return ESP_OK;
+}
@@ -0,0 +1,41 @@
+#pragma once
+
+#include <stdbool.h>
+#include <stdint.h>
+#include "esp_err.h"
+#include "pmic_snapshot.h"
+#include "tanmatsu_coprocessor.h"
+
+typedef enum {
+    TELEMETRY_VBAT,
+    TELEMETRY_ICHGR,
+    TELEMETRY_VSYS,
+    TELEMETRY_VBUS,
+    TELEMETRY_TS,
+    TELEMETRY_FAULTS,
+    TELEMETRY_COMM_FAULT,
+    TELEMETRY_CHARGING_STATUS,
+    TELEMETRY_CHARGING_CONTROL,
+    TELEMETRY_RTC,
+    TELEMETRY_METRIC_COUNT,
+} telemetry_metric_t;
+
+typedef struct {
+    tanmatsu_coprocessor_handle_t coprocessor;
+    uint32_t period_ms[TELEMETRY_METRIC_COUNT];  // Sampling period per metric, 0 selects the default
+} telemetry_config_t;
+
+typedef struct {
+    uint32_t sequence;                           // Increments with every published sample round
+    pmic_snapshot_t pmic;                        // Latest value of every metric
+    uint32_t valid;                              // Bit per metric that has been sampled at least once
+    int64_t sampled_us[TELEMETRY_METRIC_COUNT];  // esp_timer time each metric was last sampled
+    const char* error;                           // Error of the last sample round, NULL when it succeeded
+} telemetry_snapshot_t;
+
+// Starts the sampler task. It reads every due metric through the driver's getter, one I2C transaction each.
+esp_err_t telemetry_start(const telemetry_config_t* config);
+
+// Copies the latest published snapshot without locking and without touching I2C, safe from any task. Returns false
+// before the first sample round was published.
+bool telemetry_get(telemetry_snapshot_t* snapshot);
@@ -0,0 +1,135 @@
+#include "telemetry_history.h"
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+#include <string.h>
+
+// Block header: time (4), the values of the first sample (2 each) and the number of samples in the block (1)
+#define HISTORY_HEADER_SIZE (4 + 2 * TELEMETRY_HISTORY_CHANNEL_COUNT + 1)
+#define HISTORY_COUNT_OFFSET (HISTORY_HEADER_SIZE - 1)
+// Largest delta sample: a time step of up to 16 bits and a 17 bit zigzag delta per channel, 3 bytes each
+#define HISTORY_MAX_DELTA_SIZE (3 + 3 * TELEMETRY_HISTORY_CHANNEL_COUNT)
+#define HISTORY_MAX_TIME_STEP  0xFFFF
+
+static uint8_t* block_at(const telemetry_history_t* history, size_t index) {
+    return &history->blocks[((history->first + index) % history->block_count) * TELEMETRY_HISTORY_BLOCK_SIZE];
+}
+
+static size_t put_varint(uint8_t* out, uint32_t value) {
+    size_t length = 0;
+    while (value >= 0x80) {
+        out[length++] = (value & 0x7F) | 0x80;
+        value >>= 7;
+    }
+    out[length++] = value;
+    return length;
+}
+
+static size_t get_varint(const uint8_t* in, uint32_t* value) {
+    size_t length = 0;
+    uint32_t result = 0;
+    int shift = 0;
+    do {
+        result |= (uint32_t)(in[length] & 0x7F) << shift;
+        shift += 7;
+    } while (in[length++] & 0x80);
+    *value = result;
+    return length;
+}
+
+static uint32_t zigzag(int32_t value) {
+    return ((uint32_t)value << 1) ^ (uint32_t)(value >> 31);
+}
+
+static int32_t unzigzag(uint32_t value) {
+    return (int32_t)(value >> 1) ^ -(int32_t)(value & 1);
+}
+
+void telemetry_history_init(telemetry_history_t* history, void* storage, size_t size) {
+    memset(history, 0, sizeof(*history));
+    history->blocks = storage;
+    history->block_count = size / TELEMETRY_HISTORY_BLOCK_SIZE;
+}
+
+static void start_block(telemetry_history_t* history, const telemetry_history_sample_t* sample) {
+    if (history->used == history->block_count) {
+        history->samples -= block_at(history, 0)[HISTORY_COUNT_OFFSET];
+        history->first = (history->first + 1) % history->block_count;
+        history->used--;
+    }
+    uint8_t* block = block_at(history, history->used);
+    history->used++;
+
+    block[0] = sample->time_s;
+    block[1] = sample->time_s >> 8;
+    block[2] = sample->time_s >> 16;
+    block[3] = sample->time_s >> 24;
+    for (int channel = 0; channel < TELEMETRY_HISTORY_CHANNEL_COUNT; channel++) {
+        block[4 + 2 * channel] = sample->values[channel];
+        block[5 + 2 * channel] = sample->values[channel] >> 8;
+    }
+    block[HISTORY_COUNT_OFFSET] = 1;
+    history->write_offset = HISTORY_HEADER_SIZE;
+}
+
+void telemetry_history_append(telemetry_history_t* history, const telemetry_history_sample_t* sample) {
+    if (history->block_count == 0) {
+        return;
+    }
+
+    // A time that goes backwards or jumps far starts a new block with the full sample
+    bool new_block = history->used == 0 || sample->time_s < history->last.time_s ||
+                     sample->time_s - history->last.time_s > HISTORY_MAX_TIME_STEP;
+    uint8_t* block = new_block ? NULL : block_at(history, history->used - 1);
+    if (!new_block) {
+        uint8_t encoded[HISTORY_MAX_DELTA_SIZE];
+        size_t length = put_varint(encoded, sample->time_s - history->last.time_s);
+        for (int channel = 0; channel < TELEMETRY_HISTORY_CHANNEL_COUNT; channel++) {
+            int32_t delta = (int32_t)sample->values[channel] - history->last.values[channel];
+            length += put_varint(&encoded[length], zigzag(delta));
+        }
+        if (history->write_offset + length <= TELEMETRY_HISTORY_BLOCK_SIZE && block[HISTORY_COUNT_OFFSET] < UINT8_MAX) {
+            memcpy(&block[history->write_offset], encoded, length);
+            history->write_offset += length;
+            block[HISTORY_COUNT_OFFSET]++;
+        } else {
+            new_block = true;
+        }
+    }
+    if (new_block) {
+        start_block(history, sample);
+    }
+    history->last = *sample;
+    history->samples++;
+}
+
+void telemetry_history_for_each(const telemetry_history_t* history, telemetry_history_visit_t visit, void* ctx) {
+    for (size_t index = 0; index < history->used; index++) {
+        const uint8_t* block = block_at(history, index);
+        telemetry_history_sample_t sample;
+        sample.time_s = block[0] | block[1] << 8 | block[2] << 16 | (uint32_t)block[3] << 24;
+        for (int channel = 0; channel < TELEMETRY_HISTORY_CHANNEL_COUNT; channel++) {
+            sample.values[channel] = block[4 + 2 * channel] | block[5 + 2 * channel] << 8;
+        }
+        visit(ctx, &sample);
+
+        size_t offset = HISTORY_HEADER_SIZE;
+        for (int i = 1; i < block[HISTORY_COUNT_OFFSET]; i++) {
+            uint32_t value;
+            offset += get_varint(&block[offset], &value);
+            sample.time_s += value;
+            for (int channel = 0; channel < TELEMETRY_HISTORY_CHANNEL_COUNT; channel++) {
+                offset += get_varint(&block[offset], &value);
+                sample.values[channel] += unzigzag(value);
+            }
+            visit(ctx, &sample);
+        }
+    }
+}
+
+size_t telemetry_history_bytes_used(const telemetry_history_t* history) {
+    if (history->used == 0) {
+        return 0;
+    }
+    return (history->used - 1) * TELEMETRY_HISTORY_BLOCK_SIZE + history->write_offset;
+}
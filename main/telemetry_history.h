@@ -0,0 +1,50 @@
+#pragma once
+
+#include <stddef.h>
+#include <stdint.h>
+
+typedef enum {
+    TELEMETRY_HISTORY_VBAT,
+    TELEMETRY_HISTORY_VSYS,
+    TELEMETRY_HISTORY_VBUS,
+    TELEMETRY_HISTORY_ICHGR,
+    TELEMETRY_HISTORY_CHANNEL_COUNT,
+} telemetry_history_channel_t;
+
+typedef struct {
+    uint32_t time_s;  // RTC time
+    uint16_t values[TELEMETRY_HISTORY_CHANNEL_COUNT];
+} telemetry_history_sample_t;
+
+// History in a fixed buffer, split into blocks of TELEMETRY_HISTORY_BLOCK_SIZE bytes. A block starts with one full
+// sample and a sample count, every further sample is stored as variable-length deltas to the previous one: the time
+// step and one zigzag delta per channel, 7 bits per byte. Once the buffer is full the oldest block is dropped.
+//
+// A sample of a steady battery trace therefore takes 5 bytes, 1 for the time step and 1 per channel. At one sample
+// every 30 s that is about 0.7 KiB per hour including the block headers, so 8 KiB hold more than 11 hours. The host
+// test measures it on a synthetic trace.
+#define TELEMETRY_HISTORY_BLOCK_SIZE 64
+
+typedef struct {
+    uint8_t* blocks;
+    size_t block_count;
+    size_t first;         // Oldest block
+    size_t used;          // Blocks in use, the newest one is being written
+    size_t write_offset;  // Bytes used in the newest block
+    telemetry_history_sample_t last;
+    uint32_t samples;  // Samples currently stored
+} telemetry_history_t;
+
+typedef void (*telemetry_history_visit_t)(void* ctx, const telemetry_history_sample_t* sample);
+
+// The history uses storage as is, the caller owns it. size is rounded down to whole blocks.
+void telemetry_history_init(telemetry_history_t* history, void* storage, size_t size);
+
+void telemetry_history_append(telemetry_history_t* history, const telemetry_history_sample_t* sample);
+
+// Decodes every stored sample from the oldest to the newest
+void telemetry_history_for_each(const telemetry_history_t* history, telemetry_history_visit_t visit, void* ctx);
+
+// Bytes taken by the stored samples
+size_t telemetry_history_bytes_used(const telemetry_history_t* history);
+
@@ -0,0 +1,289 @@
+#include "telemetry_log.h"
+#include <errno.h>
+#include <inttypes.h>
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <string.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#include "esp_err.h"
+#include "esp_log.h"
+#include "esp_timer.h"
+#include "esp_vfs_fat.h"
+#include "freertos/FreeRTOS.h"
+#include "freertos/semphr.h"
+#include "pmic_snapshot.h"
+#include "sdkconfig.h"
+#include "telemetry.h"
+#include "wear_levelling.h"
+
+static char const TAG[] = "telemetry_log";
+
+// Long file names are disabled, so both names have to fit 8.3
+#define LOG_FILE_NAME     "TELEM.BIN"
+#define LOG_OLD_FILE_NAME "TELEM.OLD"
+#define LOG_PATH_SIZE     32
+
+static telemetry_log_config_t log_config;
+static wl_handle_t wl_handle = WL_INVALID_HANDLE;
+static SemaphoreHandle_t log_mutex = NULL;
+static FILE* log_file = NULL;
+static char log_path[LOG_PATH_SIZE];
+static char old_path[LOG_PATH_SIZE];
+
+// Block being collected, it is written once at block_offset
+static uint8_t block[TELEMETRY_LOG_BLOCK_SIZE];
+static long block_offset;
+static uint32_t block_sequence;
+static uint16_t block_count;
+static int64_t pending_since_us;
+static bool first_record = true;
+static uint32_t records_logged;
+static uint32_t blocks_written;
+
+static inline uint16_t get_u16(const uint8_t* p) {
+    return p[0] | (p[1] << 8);
+}
+
+static inline uint32_t get_u32(const uint8_t* p) {
+    return p[0] | (p[1] << 8) | (p[2] << 16) | ((uint32_t)p[3] << 24);
+}
+
+static inline void put_u16(uint8_t* p, uint16_t value) {
+    p[0] = value;
+    p[1] = value >> 8;
+}
+
+static inline void put_u32(uint8_t* p, uint32_t value) {
+    put_u16(p, value);
+    put_u16(&p[2], value >> 16);
+}
+
+// Plain CRC-32 as zlib computes it, so the decoder can check blocks with the standard library
+static uint32_t crc32(const uint8_t* data, size_t length) {
+    uint32_t crc = 0xFFFFFFFF;
+    for (size_t i = 0; i < length; i++) {
+        crc ^= data[i];
+        for (int bit = 0; bit < 8; bit++) {
+            crc = (crc >> 1) ^ (0xEDB88320 & -(crc & 1));
+        }
+    }
+    return ~crc;
+}
+
+static bool block_valid(const uint8_t* data) {
+    uint16_t count = get_u16(&data[TELEMETRY_LOG_OFFSET_COUNT]);
+    return get_u32(&data[TELEMETRY_LOG_OFFSET_MAGIC]) == TELEMETRY_LOG_MAGIC &&
+           get_u16(&data[TELEMETRY_LOG_OFFSET_RECORD_SIZE]) == TELEMETRY_LOG_RECORD_SIZE &&
+           count <= TELEMETRY_LOG_RECORDS_PER_BLOCK &&
+           get_u32(&data[TELEMETRY_LOG_OFFSET_CRC]) ==
+               crc32(&data[TELEMETRY_LOG_HEADER_SIZE], count * TELEMETRY_LOG_RECORD_SIZE);
+}
+
+static void start_block(uint32_t sequence, long offset) {
+    memset(block, 0, sizeof(block));
+    block_offset = offset;
+    block_sequence = sequence;
+    block_count = 0;
+}
+
+// A block is always written whole and at a block boundary, which with 4 KiB FAT sectors is exactly one sector
+static esp_err_t store_block() {
+    put_u32(&block[TELEMETRY_LOG_OFFSET_MAGIC], TELEMETRY_LOG_MAGIC);
+    put_u32(&block[TELEMETRY_LOG_OFFSET_SEQUENCE], block_sequence);
+    put_u16(&block[TELEMETRY_LOG_OFFSET_COUNT], block_count);
+    put_u16(&block[TELEMETRY_LOG_OFFSET_RECORD_SIZE], TELEMETRY_LOG_RECORD_SIZE);
+    put_u32(&block[TELEMETRY_LOG_OFFSET_CRC],
+            crc32(&block[TELEMETRY_LOG_HEADER_SIZE], block_count * TELEMETRY_LOG_RECORD_SIZE));
+
+    if (fseek(log_file, block_offset, SEEK_SET) != 0 || fwrite(block, 1, sizeof(block), log_file) != sizeof(block) ||
+        fflush(log_file) != 0 || fsync(fileno(log_file)) != 0) {
+        ESP_LOGE(TAG, "Failed to write block %" PRIu32 ": %s", block_sequence, strerror(errno));
+        return ESP_FAIL;
+    }
+    blocks_written++;
+    return ESP_OK;
+}
+
+static esp_err_t rotate() {
+    fclose(log_file);
+    log_file = NULL;
+    remove(old_path);
+    if (rename(log_path, old_path) != 0) {
+        ESP_LOGW(TAG, "Failed to keep the old log: %s", strerror(errno));
+    }
+    log_file = fopen(log_path, "w+b");
+    if (log_file == NULL) {
+        ESP_LOGE(TAG, "Failed to create %s: %s", log_path, strerror(errno));
+        return ESP_FAIL;
+    }
+    ESP_LOGI(TAG, "Log reached %u bytes, moved it to %s", (unsigned)log_config.max_file_size, old_path);
+    return ESP_OK;
+}
+
+static esp_err_t next_block() {
+    long offset = block_offset + TELEMETRY_LOG_BLOCK_SIZE;
+    if (log_config.max_file_size > 0 && offset >= (long)log_config.max_file_size) {
+        esp_err_t res = rotate();
+        if (res != ESP_OK) {
+            return res;
+        }
+        offset = 0;
+    }
+    start_block(block_sequence + 1, offset);
+    return ESP_OK;
+}
+
+// Appends the collected records as a new block. When the write fails they stay in RAM for the next try, unless the
+// block is full, then they are lost.
+static esp_err_t write_block() {
+    esp_err_t res = store_block();
+    if (res == ESP_OK) {
+        return next_block();
+    }
+    if (block_count == TELEMETRY_LOG_RECORDS_PER_BLOCK) {
+        start_block(block_sequence, block_offset);
+    }
+    return res;
+}
+
+// Appends after the last intact block. A torn last block is what a reset during a write leaves behind, it only held
+// records that were not on flash yet and is cut off.
+static esp_err_t open_log() {
+    log_file = fopen(log_path, "r+b");
+    if (log_file == NULL) {
+        log_file = fopen(log_path, "w+b");
+    }
+    if (log_file == NULL) {
+        ESP_LOGE(TAG, "Failed to open %s: %s", log_path, strerror(errno));
+        return ESP_FAIL;
+    }
+
+    fseek(log_file, 0, SEEK_END);
+    long size = ftell(log_file);
+    long end = size - size % TELEMETRY_LOG_BLOCK_SIZE;
+    if (end != size) {
+        ESP_LOGW(TAG, "Cutting %ld bytes of a partial block off the log", size - end);
+    }
+    // The sequence continues after the last intact block, also when the damaged ones come before it
+    uint32_t sequence = 0;
+    long last = end - TELEMETRY_LOG_BLOCK_SIZE;
+    for (; last >= 0; last -= TELEMETRY_LOG_BLOCK_SIZE) {
+        if (fseek(log_file, last, SEEK_SET) != 0 || fread(block, 1, sizeof(block), log_file) != sizeof(block)) {
+            ESP_LOGE(TAG, "Failed to read the block at %ld: %s", last, strerror(errno));
+            return ESP_FAIL;
+        }
+        if (block_valid(block)) {
+            sequence = get_u32(&block[TELEMETRY_LOG_OFFSET_SEQUENCE]) + 1;
+            break;
+        }
+    }
+    if (end > 0 && last != end - TELEMETRY_LOG_BLOCK_SIZE) {
+        ESP_LOGW(TAG, "Last block of the log is damaged, cutting it off");
+        end -= TELEMETRY_LOG_BLOCK_SIZE;
+    }
+    if (end != size && ftruncate(fileno(log_file), end) != 0) {
+        ESP_LOGE(TAG, "Failed to truncate %s: %s", log_path, strerror(errno));
+        return ESP_FAIL;
+    }
+    block_offset = end - TELEMETRY_LOG_BLOCK_SIZE;
+    block_sequence = sequence - 1;
+    return next_block();
+}
+
+esp_err_t telemetry_log_start(const telemetry_log_config_t* config) {
+    log_config = *config;
+    snprintf(log_path, sizeof(log_path), "%s/%s", config->base_path, LOG_FILE_NAME);
+    snprintf(old_path, sizeof(old_path), "%s/%s", config->base_path, LOG_OLD_FILE_NAME);
+
+    const esp_vfs_fat_mount_config_t mount_config = {
+        .format_if_mount_failed = true,
+        .max_files = 2,
+        .allocation_unit_size = CONFIG_WL_SECTOR_SIZE,
+    };
+    esp_err_t res =
+        esp_vfs_fat_spiflash_mount_rw_wl(config->base_path, config->partition_label, &mount_config, &wl_handle);
+    if (res != ESP_OK) {
+        ESP_LOGE(TAG, "Failed to mount partition %s: %s", config->partition_label, esp_err_to_name(res));
+        return res;
+    }
+
+    res = open_log();
+    if (res != ESP_OK) {
+        return res;
+    }
+    ESP_LOGI(TAG, "Logging to %s from block %" PRIu32, log_path, block_sequence);
+
+    log_mutex = xSemaphoreCreateMutex();
+    if (log_mutex == NULL) {
+        return ESP_ERR_NO_MEM;
+    }
+    return ESP_OK;
+}
+
+esp_err_t telemetry_log_record(const telemetry_snapshot_t* snapshot) {
+    if (log_mutex == NULL) {
+        return ESP_ERR_INVALID_STATE;
+    }
+    xSemaphoreTake(log_mutex, portMAX_DELAY);
+    if (log_file == NULL) {
+        xSemaphoreGive(log_mutex);
+        return ESP_ERR_INVALID_STATE;
+    }
+
+    uint8_t* record = &block[TELEMETRY_LOG_HEADER_SIZE + block_count * TELEMETRY_LOG_RECORD_SIZE];
+    memset(record, 0, TELEMETRY_LOG_RECORD_SIZE);
+    pmic_snapshot_encode(&snapshot->pmic, record);
+    put_u16(&record[TELEMETRY_LOG_RECORD_VALID], snapshot->valid);
+    record[TELEMETRY_LOG_RECORD_FLAGS] =
+        (snapshot->error != NULL ? TELEMETRY_LOG_FLAG_ERROR : 0) | (first_record ? TELEMETRY_LOG_FLAG_BOOT : 0);
+    first_record = false;
+    block_count++;
+    records_logged++;
+
+    int64_t now_us = esp_timer_get_time();
+    if (block_count == 1) {
+        pending_since_us = now_us;
+    }
+    bool full = block_count == TELEMETRY_LOG_RECORDS_PER_BLOCK;
+    bool due = log_config.flush_interval_s > 0 && now_us - pending_since_us >= log_config.flush_interval_s * 1000000LL;
+    esp_err_t res = ESP_OK;
+    if (full || due) {
+        res = write_block();
+    }
+    xSemaphoreGive(log_mutex);
+    return res;
+}
+
+esp_err_t telemetry_log_flush() {
+    if (log_mutex == NULL) {
+        return ESP_ERR_INVALID_STATE;
+    }
+    xSemaphoreTake(log_mutex, portMAX_DELAY);
+    esp_err_t res = ESP_OK;
+    if (log_file == NULL) {
+        res = ESP_ERR_INVALID_STATE;
+    } else if (block_count > 0) {
+        res = write_block();
+    }
+    xSemaphoreGive(log_mutex);
+    return res;
+}
+
+void telemetry_log_print_status() {
+    if (log_mutex == NULL) {
+        printf("Telemetry log not started\r\n");
+        return;
+    }
+    struct stat current = {0};
+    struct stat old = {0};
+    stat(log_path, &current);
+    stat(old_path, &old);
+    xSemaphoreTake(log_mutex, portMAX_DELAY);
+    printf("Telemetry log: %s %ld bytes, %s %ld bytes, block %" PRIu32 " with %u records in RAM\r\n", log_path,
+           (long)current.st_size, old_path, (long)old.st_size, block_sequence, block_count);
+    printf("Since boot: %" PRIu32 " records, %" PRIu32 " block writes\r\n", records_logged, blocks_written);
+    xSemaphoreGive(log_mutex);
+}
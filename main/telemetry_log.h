@@ -0,0 +1,60 @@
+#pragma once
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+#include "esp_err.h"
+#include "pmic_snapshot.h"
+#include "telemetry.h"
+
+// Append-only binary log of telemetry snapshots on the FAT partition, for battery traces from devices in the field.
+// tools/telemetry_log_to_csv.py turns a copied log into CSV.
+//
+// The file is a sequence of TELEMETRY_LOG_BLOCK_SIZE byte blocks, one FAT sector each. Records are collected in RAM
+// and appended as a new block when they fill one, when the flush interval passed or on telemetry_log_flush(), so the
+// flash sees one sector write per flush instead of one per record. A block is never written again, a reset loses the
+// records since the last flush and a reset during the write only the block being written. Reopening cuts off a torn
+// last block and continues the sequence after the last intact one.
+//
+// A flush of a few records still takes a whole block: at one record per minute and a flush every 10 minutes a
+// megabyte holds about two days.
+//
+// Block header, little endian:
+#define TELEMETRY_LOG_OFFSET_MAGIC       0   // uint32_t, TELEMETRY_LOG_MAGIC
+#define TELEMETRY_LOG_OFFSET_SEQUENCE    4   // uint32_t, increments with every block
+#define TELEMETRY_LOG_OFFSET_COUNT       8   // uint16_t, records in the block
+#define TELEMETRY_LOG_OFFSET_RECORD_SIZE 10  // uint16_t, TELEMETRY_LOG_RECORD_SIZE
+#define TELEMETRY_LOG_OFFSET_CRC         12  // uint32_t, CRC-32 (as zlib) of the records in the block
+#define TELEMETRY_LOG_HEADER_SIZE        16
+// Record: the PMIC snapshot as pmic_snapshot_encode() packs it, which includes the RTC time, then
+#define TELEMETRY_LOG_RECORD_VALID 19  // uint16_t, bit per telemetry_metric_t that has been sampled
+#define TELEMETRY_LOG_RECORD_FLAGS 21  // uint8_t, TELEMETRY_LOG_FLAG_* bits
+#define TELEMETRY_LOG_RECORD_SIZE  24  // The last two bytes are reserved and zero
+
+#define TELEMETRY_LOG_MAGIC      0x474F4C54  // "TLOG"
+#define TELEMETRY_LOG_BLOCK_SIZE 4096
+// 170 records, almost three hours at one record per minute
+#define TELEMETRY_LOG_RECORDS_PER_BLOCK \
+    ((TELEMETRY_LOG_BLOCK_SIZE - TELEMETRY_LOG_HEADER_SIZE) / TELEMETRY_LOG_RECORD_SIZE)
+
+#define TELEMETRY_LOG_FLAG_ERROR (1 << 0)  // The sample round failed, the values are the last good ones
+#define TELEMETRY_LOG_FLAG_BOOT  (1 << 1)  // First record after a reset
+
+typedef struct {
+    const char* partition_label;  // Data partition with subtype fat, formatted when it does not mount
+    const char* base_path;        // Mount point
+    size_t max_file_size;         // The log is renamed to the old log at this size, replacing the previous one
+    uint32_t flush_interval_s;    // Longest time records stay in RAM only, 0 writes blocks only when they are full
+} telemetry_log_config_t;
+
+// Mounts the partition and opens or continues the log
+esp_err_t telemetry_log_start(const telemetry_log_config_t* config);
+
+// Adds the snapshot, writes the block when it is full or due. Returns ESP_ERR_INVALID_STATE before the log started.
+esp_err_t telemetry_log_record(const telemetry_snapshot_t* snapshot);
+
+// Writes the records that are still only in RAM
+esp_err_t telemetry_log_flush();
+
+// Prints the file sizes and the number of records written since boot
+void telemetry_log_print_status();
@@ -0,0 +1,18 @@
+#pragma once
+
+#include "esp_err.h"
+#include "esp_etm.h"
+#include "soc/gpio_num.h"
+
+typedef enum {
+    GPIO_ETM_EVENT_EDGE_POS,
+    GPIO_ETM_EVENT_EDGE_NEG,
+    GPIO_ETM_EVENT_EDGE_ANY,
+} gpio_etm_event_edge_t;
+
+typedef struct {
+    gpio_etm_event_edge_t edge;
+} gpio_etm_event_config_t;
+
+esp_err_t gpio_new_etm_event(const gpio_etm_event_config_t* config, esp_etm_event_handle_t* ret_event);
+esp_err_t gpio_etm_event_bind_gpio(esp_etm_event_handle_t event, gpio_num_t gpio_num);
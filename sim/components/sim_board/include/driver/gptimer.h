@@ -0,0 +1,44 @@
+#pragma once
+
+#include <stdint.h>
+#include "esp_err.h"
+#include "esp_etm.h"
+
+// Host stand-in for the general purpose timer, there is no timer to capture with. Creating one fails, so callers
+// take their fallback path.
+typedef struct gptimer* gptimer_handle_t;
+
+typedef enum {
+    GPTIMER_CLK_SRC_DEFAULT,
+} gptimer_clock_source_t;
+
+typedef enum {
+    GPTIMER_COUNT_DOWN,
+    GPTIMER_COUNT_UP,
+} gptimer_count_direction_t;
+
+typedef struct {
+    gptimer_clock_source_t clk_src;
+    gptimer_count_direction_t direction;
+    uint32_t resolution_hz;
+} gptimer_config_t;
+
+typedef enum {
+    GPTIMER_ETM_TASK_START_COUNT,
+    GPTIMER_ETM_TASK_STOP_COUNT,
+    GPTIMER_ETM_TASK_CAPTURE,
+} gptimer_etm_task_type_t;
+
+typedef struct {
+    gptimer_etm_task_type_t task_type;
+} gptimer_etm_task_conf_t;
+
+esp_err_t gptimer_new_timer(const gptimer_config_t* config, gptimer_handle_t* ret_timer);
+esp_err_t gptimer_del_timer(gptimer_handle_t timer);
+esp_err_t gptimer_new_etm_task(gptimer_handle_t timer, const gptimer_etm_task_conf_t* config,
+                               esp_etm_task_handle_t* out_task);
+esp_err_t gptimer_enable(gptimer_handle_t timer);
+esp_err_t gptimer_disable(gptimer_handle_t timer);
+esp_err_t gptimer_start(gptimer_handle_t timer);
+esp_err_t gptimer_get_raw_count(gptimer_handle_t timer, uint64_t* value);
+esp_err_t gptimer_get_captured_count(gptimer_handle_t timer, uint64_t* value);
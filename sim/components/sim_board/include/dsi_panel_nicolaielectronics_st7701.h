@@ -0,0 +1,12 @@
+#pragma once
+
+#include <stddef.h>
+#include "esp_err.h"
+#include "esp_lcd_types.h"
+#include "soc/gpio_num.h"
+
+// Host stand-in for the ST7701 panel of the mipi_dsi_abstraction component: a headless RGB565 frame buffer with
+// the resolution of the real panel
+esp_err_t st7701_initialize(gpio_num_t reset_pin);
+esp_lcd_panel_handle_t st7701_get_panel();
+esp_err_t st7701_get_parameters(size_t* h_res, size_t* v_res, lcd_color_rgb_pixel_format_t* color_fmt);
@@ -0,0 +1,22 @@
+#pragma once
+
+#include <stdint.h>
+#include "esp_err.h"
+
+// Host stand-in for the event task matrix, every call fails with ESP_ERR_NOT_SUPPORTED
+typedef struct esp_etm_event* esp_etm_event_handle_t;
+typedef struct esp_etm_task* esp_etm_task_handle_t;
+typedef struct esp_etm_channel* esp_etm_channel_handle_t;
+
+typedef struct {
+    uint32_t flags;
+} esp_etm_channel_config_t;
+
+esp_err_t esp_etm_new_channel(const esp_etm_channel_config_t* config, esp_etm_channel_handle_t* ret_chan);
+esp_err_t esp_etm_channel_connect(esp_etm_channel_handle_t chan, esp_etm_event_handle_t event,
+                                  esp_etm_task_handle_t task);
+esp_err_t esp_etm_channel_enable(esp_etm_channel_handle_t chan);
+esp_err_t esp_etm_channel_disable(esp_etm_channel_handle_t chan);
+esp_err_t esp_etm_del_channel(esp_etm_channel_handle_t chan);
+esp_err_t esp_etm_del_event(esp_etm_event_handle_t event);
+esp_err_t esp_etm_del_task(esp_etm_task_handle_t task);
@@ -0,0 +1,28 @@
+#pragma once
+
+#include <stdbool.h>
+#include <stdint.h>
+#include "esp_err.h"
+#include "esp_lcd_types.h"
+
+typedef struct {
+} esp_lcd_dpi_panel_event_data_t;
+
+typedef bool (*esp_lcd_dpi_panel_color_trans_done_cb_t)(esp_lcd_panel_handle_t panel,
+                                                        esp_lcd_dpi_panel_event_data_t* edata, void* user_ctx);
+typedef bool (*esp_lcd_dpi_panel_refresh_done_cb_t)(esp_lcd_panel_handle_t panel,
+                                                    esp_lcd_dpi_panel_event_data_t* edata, void* user_ctx);
+
+typedef struct {
+    esp_lcd_dpi_panel_color_trans_done_cb_t on_color_trans_done;
+    esp_lcd_dpi_panel_refresh_done_cb_t on_refresh_done;
+} esp_lcd_dpi_panel_event_callbacks_t;
+
+esp_err_t esp_lcd_dpi_panel_register_event_callbacks(esp_lcd_panel_handle_t dpi_panel,
+                                                     const esp_lcd_dpi_panel_event_callbacks_t* cbs, void* user_ctx);
+
+// Only one frame buffer exists, fb_num has to be 1
+esp_err_t esp_lcd_dpi_panel_get_frame_buffer(esp_lcd_panel_handle_t dpi_panel, uint32_t fb_num, void** fb0, ...);
+
+// There is no DMA2D, always returns ESP_ERR_NOT_SUPPORTED
+esp_err_t esp_lcd_dpi_panel_enable_dma2d(esp_lcd_panel_handle_t dpi_panel);
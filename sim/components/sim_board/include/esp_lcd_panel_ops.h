@@ -0,0 +1,8 @@
+#pragma once
+
+#include "esp_err.h"
+#include "esp_lcd_types.h"
+
+// Copies the bitmap into the panel's frame buffer and reports the transfer as done before returning
+esp_err_t esp_lcd_panel_draw_bitmap(esp_lcd_panel_handle_t panel, int x_start, int y_start, int x_end, int y_end,
+                                    const void* color_data);
@@ -0,0 +1,10 @@
+#pragma once
+
+// Host stand-in for the LCD driver types, the only panel is the headless one in sim_panel.c
+typedef struct esp_lcd_panel_t* esp_lcd_panel_handle_t;
+
+typedef enum {
+    LCD_COLOR_PIXEL_FORMAT_RGB565,
+    LCD_COLOR_PIXEL_FORMAT_RGB666,
+    LCD_COLOR_PIXEL_FORMAT_RGB888,
+} lcd_color_rgb_pixel_format_t;
@@ -0,0 +1,18 @@
+#pragma once
+
+#include <stdbool.h>
+#include <stddef.h>
+#include "esp_err.h"
+#include "wear_levelling.h"
+
+// Host stand-in: there is no flash to mount, mounting fails with ESP_ERR_NOT_SUPPORTED
+typedef struct {
+    bool format_if_mount_failed;
+    int max_files;
+    size_t allocation_unit_size;
+    bool disk_status_check_enable;
+    bool use_one_fat;
+} esp_vfs_fat_mount_config_t;
+
+esp_err_t esp_vfs_fat_spiflash_mount_rw_wl(const char* base_path, const char* partition_label,
+                                           const esp_vfs_fat_mount_config_t* mount_config, wl_handle_t* wl_handle);
@@ -0,0 +1,62 @@
+#pragma once
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+#include "tanmatsu_coprocessor.h"
+
+// Simulated Tanmatsu for the host build. The firmware runs unchanged on the stand-ins of this component: a headless
+// panel that completes every transfer immediately, an I2C bus that accounts bus time instead of waiting for it and
+// a coprocessor model with registers, interrupt line, keyboard and a battery. Nothing waits for hardware, so the
+// run is only bound by the host CPU.
+//
+// Environment variables select the scenario:
+//   SIM_DURATION_S       Stop after this many seconds, sim_board_done() turns true. Runs forever when unset.
+//   SIM_KEY_INTERVAL_MS  Type a fixed navigation sequence with a key press or release at this interval
+//   SIM_USB_AFTER_S      Plug in USB after this many seconds, so charging starts
+//   SIM_SCREENSHOT       Path sim_board_report() writes the panel contents to, as a binary PPM
+//   SIM_BENCH            Set to 1 to run the benchmark suite after boot and stop, sim_board_benchmark() turns true
+//   SIM_TRACE            Path the coprocessor trace recorded from boot on is saved to at the end of the run
+//   SIM_REPLAY           Path of a coprocessor trace to replay after boot, the run ends when it is played
+
+typedef struct {
+    void* ctx;
+    // Register pointer write followed by a read, and register pointer write followed by data
+    bool (*read)(void* ctx, uint8_t reg, uint8_t* data, size_t length);
+    bool (*write)(void* ctx, uint8_t reg, const uint8_t* data, size_t length);
+} sim_i2c_device_t;
+
+typedef struct {
+    uint32_t transactions;
+    uint32_t nacks;   // Transactions to addresses without a device, probes included
+    uint64_t bus_ns;  // Time the transactions would have taken on the bus
+} sim_i2c_stats_t;
+
+typedef struct {
+    uint32_t draws;
+    uint64_t pixels;
+    uint64_t copy_ns;
+} sim_panel_stats_t;
+
+// Adds a device to every simulated bus, the coprocessor model is added by the board itself
+void sim_i2c_add_device(uint16_t address, const sim_i2c_device_t* device);
+void sim_i2c_get_stats(sim_i2c_stats_t* stats);
+
+void sim_panel_get_stats(sim_panel_stats_t* stats);
+bool sim_panel_save_ppm(const char* path);
+
+// Sets the keyboard bitmap of the model and raises its interrupt line when it changed
+void sim_coprocessor_set_keys(const tanmatsu_coprocessor_keys_t* keys);
+void sim_coprocessor_set_inputs(const tanmatsu_coprocessor_inputs_t* inputs);
+void sim_coprocessor_set_usb(bool attached);
+uint8_t sim_coprocessor_get_backlight();
+
+// True once SIM_DURATION_S passed
+bool sim_board_done();
+// True when SIM_BENCH asks for a benchmark run
+bool sim_board_benchmark();
+// The SIM_TRACE and SIM_REPLAY paths, NULL when unset
+const char* sim_board_trace_path();
+const char* sim_board_replay_path();
+// Prints the panel and bus statistics and writes the screenshot
+void sim_board_report();
@@ -0,0 +1,7 @@
+#pragma once
+
+// Host stand-in: GPIO numbers are only passed through, nothing is driven
+typedef enum {
+    GPIO_NUM_NC = -1,
+    GPIO_NUM_MAX = 55,
+} gpio_num_t;
@@ -0,0 +1,171 @@
+#pragma once
+
+#include <stdbool.h>
+#include <stdint.h>
+#include "driver/i2c_master.h"
+#include "esp_err.h"
+#include "freertos/FreeRTOS.h"
+#include "freertos/semphr.h"
+#include "soc/gpio_num.h"
+
+// Host stand-in for the tanmatsu_coprocessor component, with the part of its API the firmware uses. Every call is
+// one transaction on the simulated I2C bus to the coprocessor model in sim_coprocessor.c, under the concurrency
+// semaphore like in the real driver. The interrupt line is modelled as well: the driver task reads the keys and
+// inputs when the model raises it and calls the change callbacks.
+
+typedef struct tanmatsu_coprocessor* tanmatsu_coprocessor_handle_t;
+
+typedef union {
+    struct {
+        bool key_esc : 1;
+        bool key_f1 : 1;
+        bool key_f2 : 1;
+        bool key_f3 : 1;
+        bool key_tilde : 1;
+        bool key_1 : 1;
+        bool key_2 : 1;
+        bool key_3 : 1;
+        bool key_tab : 1;
+        bool key_q : 1;
+        bool key_w : 1;
+        bool key_e : 1;
+        bool key_fn : 1;
+        bool key_a : 1;
+        bool key_s : 1;
+        bool key_d : 1;
+        bool key_shift_l : 1;
+        bool key_z : 1;
+        bool key_x : 1;
+        bool key_c : 1;
+        bool key_ctrl : 1;
+        bool key_meta : 1;
+        bool key_alt_l : 1;
+        bool key_backslash : 1;
+        bool key_4 : 1;
+        bool key_5 : 1;
+        bool key_6 : 1;
+        bool key_7 : 1;
+        bool key_r : 1;
+        bool key_t : 1;
+        bool key_y : 1;
+        bool key_u : 1;
+        bool key_f : 1;
+        bool key_g : 1;
+        bool key_h : 1;
+        bool key_j : 1;
+        bool key_v : 1;
+        bool key_b : 1;
+        bool key_n : 1;
+        bool key_m : 1;
+        bool key_f4 : 1;
+        bool key_f5 : 1;
+        bool key_f6 : 1;
+        bool key_backspace : 1;
+        bool key_9 : 1;
+        bool key_0 : 1;
+        bool key_minus : 1;
+        bool key_equals : 1;
+        bool key_o : 1;
+        bool key_p : 1;
+        bool key_sqbracket_open : 1;
+        bool key_sqbracket_close : 1;
+        bool key_l : 1;
+        bool key_semicolon : 1;
+        bool key_quote : 1;
+        bool key_return : 1;
+        bool key_dot : 1;
+        bool key_slash : 1;
+        bool key_up : 1;
+        bool key_shift_r : 1;
+        bool key_alt_r : 1;
+        bool key_left : 1;
+        bool key_down : 1;
+        bool key_right : 1;
+        bool key_8 : 1;
+        bool key_i : 1;
+        bool key_k : 1;
+        bool key_comma : 1;
+        bool key_space_l : 1;
+        bool key_space_m : 1;
+        bool key_space_r : 1;
+        bool key_volume_up : 1;
+    };
+    uint8_t raw[9];
+} tanmatsu_coprocessor_keys_t;
+
+typedef union {
+    struct {
+        bool sd_card_detect : 1;
+        bool headphone_detect : 1;
+        bool power_button : 1;
+    };
+    uint8_t raw[1];
+} tanmatsu_coprocessor_inputs_t;
+
+typedef struct {
+    bool watchdog;
+    bool boost;
+    bool chrg_input;
+    bool chrg_thermal;
+    bool chrg_safety;
+    bool batt_ovp;
+    bool ntc_cold;
+    bool ntc_hot;
+    bool ntc_boost;
+} tanmatsu_coprocessor_pmic_faults_t;
+
+typedef enum {
+    TANMATSU_CHARGE_STATUS_NOT_CHARGING = 0,
+    TANMATSU_CHARGE_STATUS_PRE_CHARGING = 1,
+    TANMATSU_CHARGE_STATUS_FAST_CHARGING = 2,
+    TANMATSU_CHARGE_STATUS_CHARGE_TERMINATION_DONE = 3,
+} tanmatsu_coprocessor_charge_status_t;
+
+typedef void (*tanmatsu_coprocessor_keyboard_cb_t)(tanmatsu_coprocessor_handle_t handle,
+                                                   tanmatsu_coprocessor_keys_t* prev_keys,
+                                                   tanmatsu_coprocessor_keys_t* keys);
+typedef void (*tanmatsu_coprocessor_input_cb_t)(tanmatsu_coprocessor_handle_t handle,
+                                                tanmatsu_coprocessor_inputs_t* prev_inputs,
+                                                tanmatsu_coprocessor_inputs_t* inputs);
+typedef void (*tanmatsu_coprocessor_faults_cb_t)(tanmatsu_coprocessor_handle_t handle,
+                                                 tanmatsu_coprocessor_pmic_faults_t* prev_faults,
+                                                 tanmatsu_coprocessor_pmic_faults_t* faults);
+
+typedef struct {
+    gpio_num_t int_io_num;
+    i2c_master_bus_handle_t i2c_bus;
+    uint16_t i2c_address;
+    SemaphoreHandle_t concurrency_semaphore;
+    tanmatsu_coprocessor_keyboard_cb_t on_keyboard_change;
+    tanmatsu_coprocessor_input_cb_t on_input_change;
+    tanmatsu_coprocessor_faults_cb_t on_faults_change;
+} tanmatsu_coprocessor_config_t;
+
+esp_err_t tanmatsu_coprocessor_initialize(const tanmatsu_coprocessor_config_t* config,
+                                          tanmatsu_coprocessor_handle_t* out_handle);
+
+esp_err_t tanmatsu_coprocessor_set_display_backlight(tanmatsu_coprocessor_handle_t handle, uint8_t brightness);
+esp_err_t tanmatsu_coprocessor_radio_disable(tanmatsu_coprocessor_handle_t handle);
+esp_err_t tanmatsu_coprocessor_radio_enable_application(tanmatsu_coprocessor_handle_t handle);
+esp_err_t tanmatsu_coprocessor_radio_enable_bootloader(tanmatsu_coprocessor_handle_t handle);
+esp_err_t tanmatsu_coprocessor_get_real_time(tanmatsu_coprocessor_handle_t handle, uint32_t* out_value);
+
+esp_err_t tanmatsu_coprocessor_set_pmic_adc_control(tanmatsu_coprocessor_handle_t handle, bool trigger,
+                                                    bool continuous);
+esp_err_t tanmatsu_coprocessor_set_pmic_charging_control(tanmatsu_coprocessor_handle_t handle, bool disable,
+                                                         uint8_t speed);
+esp_err_t tanmatsu_coprocessor_get_pmic_charging_control(tanmatsu_coprocessor_handle_t handle, bool* out_disable,
+                                                         uint8_t* out_speed);
+esp_err_t tanmatsu_coprocessor_set_pmic_otg_control(tanmatsu_coprocessor_handle_t handle, bool enable);
+esp_err_t tanmatsu_coprocessor_get_pmic_faults(tanmatsu_coprocessor_handle_t handle,
+                                               tanmatsu_coprocessor_pmic_faults_t* out_faults);
+esp_err_t tanmatsu_coprocessor_get_pmic_communication_fault(tanmatsu_coprocessor_handle_t handle, bool* out_last,
+                                                            bool* out_latch);
+esp_err_t tanmatsu_coprocessor_get_pmic_charging_status(tanmatsu_coprocessor_handle_t handle,
+                                                        bool* out_battery_attached, bool* out_usb_attached,
+                                                        bool* out_charging_disabled, uint8_t* out_status);
+esp_err_t tanmatsu_coprocessor_get_pmic_vbat(tanmatsu_coprocessor_handle_t handle, uint16_t* out_value);
+esp_err_t tanmatsu_coprocessor_get_pmic_vsys(tanmatsu_coprocessor_handle_t handle, uint16_t* out_value);
+esp_err_t tanmatsu_coprocessor_get_pmic_ts(tanmatsu_coprocessor_handle_t handle, uint16_t* out_value);
+esp_err_t tanmatsu_coprocessor_get_pmic_vbus(tanmatsu_coprocessor_handle_t handle, uint16_t* out_value);
+esp_err_t tanmatsu_coprocessor_get_pmic_ichgr(tanmatsu_coprocessor_handle_t handle, uint16_t* out_value);
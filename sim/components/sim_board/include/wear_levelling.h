@@ -0,0 +1,7 @@
+#pragma once
+
+#include <stdint.h>
+
+typedef int32_t wl_handle_t;
+
+#define WL_INVALID_HANDLE -1
@@ -0,0 +1,137 @@
+#include "sim_board.h"
+#include <inttypes.h>
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include "driver/i2c_master.h"
+#include "esp_log.h"
+#include "esp_timer.h"
+#include "freertos/FreeRTOS.h"
+#include "freertos/task.h"
+#include "sim_private.h"
+#include "tanmatsu_coprocessor.h"
+
+static char const TAG[] = "sim-board";
+
+#define SIM_COPROCESSOR_ADDRESS 0x5F  // On the internal bus, like on the board
+#define SIM_SCENARIO_STACK_SIZE 2048
+
+typedef enum {
+    SIM_KEY_TAB,
+    SIM_KEY_DOWN,
+    SIM_KEY_UP,
+    SIM_KEY_RETURN,
+    SIM_KEY_ESC,
+} sim_key_t;
+
+// Moves through the widgets and activates them, then backs out again
+static const sim_key_t key_sequence[] = {
+    SIM_KEY_TAB, SIM_KEY_DOWN, SIM_KEY_DOWN, SIM_KEY_RETURN, SIM_KEY_UP, SIM_KEY_TAB, SIM_KEY_RETURN, SIM_KEY_ESC,
+};
+
+static int64_t done_after_us = -1;
+
+static long get_env(const char* name, long fallback) {
+    const char* value = getenv(name);
+    return value != NULL && value[0] != '\0' ? strtol(value, NULL, 10) : fallback;
+}
+
+static void set_key(tanmatsu_coprocessor_keys_t* keys, sim_key_t key, bool pressed) {
+    switch (key) {
+        case SIM_KEY_TAB:
+            keys->key_tab = pressed;
+            break;
+        case SIM_KEY_DOWN:
+            keys->key_down = pressed;
+            break;
+        case SIM_KEY_UP:
+            keys->key_up = pressed;
+            break;
+        case SIM_KEY_RETURN:
+            keys->key_return = pressed;
+            break;
+        case SIM_KEY_ESC:
+            keys->key_esc = pressed;
+            break;
+    }
+}
+
+static void scenario_task(void* arg) {
+    long key_interval_ms = get_env("SIM_KEY_INTERVAL_MS", 0);
+    long usb_after_s = get_env("SIM_USB_AFTER_S", -1);
+    int64_t start_us = esp_timer_get_time();
+    size_t step = 0;
+    tanmatsu_coprocessor_keys_t keys = {0};
+
+    while (true) {
+        vTaskDelay(pdMS_TO_TICKS(key_interval_ms > 0 ? key_interval_ms : 1000));
+        if (usb_after_s >= 0 && esp_timer_get_time() - start_us >= usb_after_s * 1000000LL) {
+            ESP_LOGI(TAG, "Plugging in USB");
+            sim_coprocessor_set_usb(true);
+            usb_after_s = -1;
+        }
+        if (key_interval_ms > 0) {
+            // Even steps press a key, odd steps release it
+            sim_key_t key = key_sequence[(step / 2) % (sizeof(key_sequence) / sizeof(key_sequence[0]))];
+            set_key(&keys, key, step % 2 == 0);
+            sim_coprocessor_set_keys(&keys);
+            step++;
+        }
+    }
+}
+
+void sim_board_bus_created(i2c_master_bus_handle_t bus, int port) {
+    if (port != 0) {
+        return;
+    }
+    long duration_s = get_env("SIM_DURATION_S", -1);
+    if (duration_s >= 0) {
+        done_after_us = esp_timer_get_time() + duration_s * 1000000LL;
+    }
+    sim_coprocessor_start(SIM_COPROCESSOR_ADDRESS);
+    xTaskCreate(scenario_task, "sim-scenario", SIM_SCENARIO_STACK_SIZE, NULL, 1, NULL);
+}
+
+bool sim_board_done() {
+    return done_after_us >= 0 && esp_timer_get_time() >= done_after_us;
+}
+
+bool sim_board_benchmark() {
+    return get_env("SIM_BENCH", 0) != 0;
+}
+
+static const char* get_path(const char* name) {
+    const char* value = getenv(name);
+    return value != NULL && value[0] != '\0' ? value : NULL;
+}
+
+const char* sim_board_trace_path() {
+    return get_path("SIM_TRACE");
+}
+
+const char* sim_board_replay_path() {
+    return get_path("SIM_REPLAY");
+}
+
+void sim_board_report() {
+    sim_panel_stats_t panel;
+    sim_i2c_stats_t i2c;
+    sim_panel_get_stats(&panel);
+    sim_i2c_get_stats(&i2c);
+    printf("Simulated panel: %" PRIu32 " draws, %" PRIu64 " pixels, %.1f ms copying\n", panel.draws, panel.pixels,
+           panel.copy_ns / 1e6);
+    printf("Simulated I2C: %" PRIu32 " transactions, %" PRIu32 " without a device, %.1f ms of bus time\n",
+           i2c.transactions, i2c.nacks, i2c.bus_ns / 1e6);
+    printf("Simulated backlight: %u\n", sim_coprocessor_get_backlight());
+
+    const char* screenshot = getenv("SIM_SCREENSHOT");
+    if (screenshot != NULL && screenshot[0] != '\0') {
+        if (sim_panel_save_ppm(screenshot)) {
+            printf("Screenshot written to %s\n", screenshot);
+        } else {
+            printf("Failed to write the screenshot to %s\n", screenshot);
+        }
+    }
+}
@@ -0,0 +1,400 @@
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include "driver/i2c_master.h"
+#include "esp_err.h"
+#include "esp_log.h"
+#include "freertos/FreeRTOS.h"
+#include "freertos/semphr.h"
+#include "freertos/task.h"
+#include "sim_board.h"
+#include "sim_private.h"
+#include "tanmatsu_coprocessor.h"
+
+static char const TAG[] = "sim-coprocessor";
+
+// Register map of the model. The PMIC block has the layout of the coprocessor firmware that pmic_snapshot.h
+// mirrors, so the firmware's burst read and the getters below see the same values.
+#define SIM_REG_KEYS             0x01  // 9 bytes, followed by the inputs so the interrupt handler reads both at once
+#define SIM_REG_INPUTS           0x0A
+#define SIM_REG_BACKLIGHT        0x0B
+#define SIM_REG_RADIO            0x0C  // 0: off, 1: application, 2: bootloader
+#define SIM_REG_PMIC_ADC         0x10  // Bit 0: trigger, bit 1: continuous
+#define SIM_REG_PMIC_OTG         0x11
+#define SIM_REG_RTC              0x20  // uint32_t
+#define SIM_REG_COMM_FAULT       0x24  // Bit 0: last, bit 1: latch
+#define SIM_REG_FAULTS           0x25  // uint16_t, watchdog, boost, chrg input, thermal, safety, batt ovp, ntc
+#define SIM_REG_VBAT             0x27
+#define SIM_REG_VSYS             0x29
+#define SIM_REG_TS               0x2B
+#define SIM_REG_VBUS             0x2D
+#define SIM_REG_ICHGR            0x2F
+#define SIM_REG_CHARGING_CONTROL 0x31  // Bit 0: disabled, bits 1-2: speed
+#define SIM_REG_CHARGING_STATUS  0x32  // Bit 0: battery, 1: USB, 2: charging disabled, 3-4: status
+
+#define SIM_COPROCESSOR_TIMEOUT_MS 100
+#define SIM_WORLD_PERIOD_MS        1000
+#define SIM_DRIVER_STACK_SIZE      4096
+#define SIM_DRIVER_PRIORITY        3
+
+// Firmware side: the register file and the state it is derived from
+static SemaphoreHandle_t model_lock = NULL;
+static uint8_t registers[256];
+static bool usb_attached = false;
+static uint32_t battery_mv = 4100;
+static uint32_t adc_conversions = 0;
+static TaskHandle_t interrupt_task = NULL;  // Driver task waiting on the interrupt line
+
+static inline uint16_t get_u16(const uint8_t* p) {
+    return p[0] | (p[1] << 8);
+}
+
+static inline void put_u16(uint8_t* p, uint16_t value) {
+    p[0] = value;
+    p[1] = value >> 8;
+}
+
+static void raise_interrupt() {
+    if (interrupt_task != NULL) {
+        xTaskNotifyGive(interrupt_task);
+    }
+}
+
+// Battery model: discharges by 1 mV every ten seconds, charges by 2 mV a second with the current the charging speed
+// selects. Must be called with the model lock held.
+static void update_pmic(uint32_t elapsed_s) {
+    uint8_t control = registers[SIM_REG_CHARGING_CONTROL];
+    bool charging_disabled = control & 1;
+    uint8_t speed = (control >> 1) & 3;
+    bool charging = usb_attached && !charging_disabled && battery_mv < 4200;
+
+    if (charging) {
+        battery_mv = battery_mv + 2 * elapsed_s > 4200 ? 4200 : battery_mv + 2 * elapsed_s;
+    } else if (elapsed_s > 0 && !usb_attached) {
+        static uint32_t discharge_s = 0;
+        discharge_s += elapsed_s;
+        battery_mv -= battery_mv > 3300 ? discharge_s / 10 : 0;
+        discharge_s %= 10;
+    }
+
+    uint32_t rtc = registers[SIM_REG_RTC] | (registers[SIM_REG_RTC + 1] << 8) | (registers[SIM_REG_RTC + 2] << 16) |
+                   ((uint32_t)registers[SIM_REG_RTC + 3] << 24);
+    rtc += elapsed_s;
+    for (int i = 0; i < 4; i++) {
+        registers[SIM_REG_RTC + i] = rtc >> (8 * i);
+    }
+    put_u16(&registers[SIM_REG_VBAT], battery_mv);
+    put_u16(&registers[SIM_REG_VSYS], usb_attached ? 4400 : battery_mv - 40);
+    put_u16(&registers[SIM_REG_TS], 5000);
+    put_u16(&registers[SIM_REG_VBUS], usb_attached ? 5000 : 0);
+    put_u16(&registers[SIM_REG_ICHGR], charging ? 500 * (speed + 1) : 0);
+    uint8_t status = charging ? TANMATSU_CHARGE_STATUS_FAST_CHARGING
+                              : (usb_attached && !charging_disabled ? TANMATSU_CHARGE_STATUS_CHARGE_TERMINATION_DONE
+                                                                    : TANMATSU_CHARGE_STATUS_NOT_CHARGING);
+    registers[SIM_REG_CHARGING_STATUS] = 1 | (usb_attached << 1) | (charging_disabled << 2) | (status << 3);
+}
+
+static void world_task(void* arg) {
+    while (true) {
+        vTaskDelay(pdMS_TO_TICKS(SIM_WORLD_PERIOD_MS));
+        xSemaphoreTake(model_lock, portMAX_DELAY);
+        update_pmic(SIM_WORLD_PERIOD_MS / 1000);
+        xSemaphoreGive(model_lock);
+    }
+}
+
+static bool model_read(void* ctx, uint8_t reg, uint8_t* data, size_t length) {
+    if (reg + length > sizeof(registers)) {
+        return false;
+    }
+    xSemaphoreTake(model_lock, portMAX_DELAY);
+    memcpy(data, &registers[reg], length);
+    xSemaphoreGive(model_lock);
+    return true;
+}
+
+static bool model_write(void* ctx, uint8_t reg, const uint8_t* data, size_t length) {
+    if (reg + length > sizeof(registers)) {
+        return false;
+    }
+    xSemaphoreTake(model_lock, portMAX_DELAY);
+    memcpy(&registers[reg], data, length);
+    if (reg <= SIM_REG_PMIC_ADC && reg + length > SIM_REG_PMIC_ADC && (registers[SIM_REG_PMIC_ADC] & 1)) {
+        // Conversions complete immediately, the trigger bit clears itself
+        registers[SIM_REG_PMIC_ADC] &= ~1;
+        adc_conversions++;
+    }
+    update_pmic(0);
+    xSemaphoreGive(model_lock);
+    return true;
+}
+
+void sim_coprocessor_start(uint16_t address) {
+    model_lock = xSemaphoreCreateMutex();
+    assert(model_lock);
+    uint32_t rtc = time(NULL);
+    for (int i = 0; i < 4; i++) {
+        registers[SIM_REG_RTC + i] = rtc >> (8 * i);
+    }
+    registers[SIM_REG_CHARGING_CONTROL] = 1;  // Charging stays off until the firmware enables it
+    update_pmic(0);
+
+    const sim_i2c_device_t device = {
+        .read = model_read,
+        .write = model_write,
+    };
+    sim_i2c_add_device(address, &device);
+    xTaskCreate(world_task, "sim-world", 2048, NULL, 1, NULL);
+    ESP_LOGI(TAG, "Coprocessor model at 0x%02X", address);
+}
+
+void sim_coprocessor_set_keys(const tanmatsu_coprocessor_keys_t* keys) {
+    xSemaphoreTake(model_lock, portMAX_DELAY);
+    bool changed = memcmp(&registers[SIM_REG_KEYS], keys->raw, sizeof(keys->raw)) != 0;
+    memcpy(&registers[SIM_REG_KEYS], keys->raw, sizeof(keys->raw));
+    xSemaphoreGive(model_lock);
+    if (changed) {
+        raise_interrupt();
+    }
+}
+
+void sim_coprocessor_set_inputs(const tanmatsu_coprocessor_inputs_t* inputs) {
+    xSemaphoreTake(model_lock, portMAX_DELAY);
+    bool changed = registers[SIM_REG_INPUTS] != inputs->raw[0];
+    registers[SIM_REG_INPUTS] = inputs->raw[0];
+    xSemaphoreGive(model_lock);
+    if (changed) {
+        raise_interrupt();
+    }
+}
+
+void sim_coprocessor_set_usb(bool attached) {
+    xSemaphoreTake(model_lock, portMAX_DELAY);
+    usb_attached = attached;
+    update_pmic(0);
+    xSemaphoreGive(model_lock);
+}
+
+uint8_t sim_coprocessor_get_backlight() {
+    uint8_t backlight = 0;
+    model_read(NULL, SIM_REG_BACKLIGHT, &backlight, 1);
+    return backlight;
+}
+
+// Driver side, the API of the tanmatsu_coprocessor component
+
+struct tanmatsu_coprocessor {
+    tanmatsu_coprocessor_config_t config;
+    i2c_master_dev_handle_t device;
+    tanmatsu_coprocessor_keys_t keys;
+    tanmatsu_coprocessor_inputs_t inputs;
+};
+
+static esp_err_t read_registers(tanmatsu_coprocessor_handle_t handle, uint8_t reg, uint8_t* data, size_t length) {
+    if (handle->config.concurrency_semaphore != NULL) {
+        xSemaphoreTake(handle->config.concurrency_semaphore, portMAX_DELAY);
+    }
+    esp_err_t res = i2c_master_transmit_receive(handle->device, &reg, 1, data, length, SIM_COPROCESSOR_TIMEOUT_MS);
+    if (handle->config.concurrency_semaphore != NULL) {
+        xSemaphoreGive(handle->config.concurrency_semaphore);
+    }
+    return res;
+}
+
+static esp_err_t write_register(tanmatsu_coprocessor_handle_t handle, uint8_t reg, uint8_t value) {
+    uint8_t buffer[2] = {reg, value};
+    if (handle->config.concurrency_semaphore != NULL) {
+        xSemaphoreTake(handle->config.concurrency_semaphore, portMAX_DELAY);
+    }
+    esp_err_t res = i2c_master_transmit(handle->device, buffer, sizeof(buffer), SIM_COPROCESSOR_TIMEOUT_MS);
+    if (handle->config.concurrency_semaphore != NULL) {
+        xSemaphoreGive(handle->config.concurrency_semaphore);
+    }
+    return res;
+}
+
+static esp_err_t read_u16(tanmatsu_coprocessor_handle_t handle, uint8_t reg, uint16_t* out_value) {
+    uint8_t data[2];
+    esp_err_t res = read_registers(handle, reg, data, sizeof(data));
+    if (res == ESP_OK) {
+        *out_value = get_u16(data);
+    }
+    return res;
+}
+
+// Reads keys and inputs in one transaction whenever the model raises the interrupt line
+static void driver_task(void* arg) {
+    tanmatsu_coprocessor_handle_t handle = arg;
+    while (true) {
+        ulTaskNotifyTake(pdTRUE, portMAX_DELAY);
+        uint8_t data[sizeof(handle->keys.raw) + sizeof(handle->inputs.raw)];
+        if (read_registers(handle, SIM_REG_KEYS, data, sizeof(data)) != ESP_OK) {
+            continue;
+        }
+        tanmatsu_coprocessor_keys_t keys;
+        tanmatsu_coprocessor_inputs_t inputs;
+        memcpy(keys.raw, data, sizeof(keys.raw));
+        memcpy(inputs.raw, &data[sizeof(keys.raw)], sizeof(inputs.raw));
+        if (memcmp(keys.raw, handle->keys.raw, sizeof(keys.raw)) != 0) {
+            tanmatsu_coprocessor_keys_t prev_keys = handle->keys;
+            handle->keys = keys;
+            if (handle->config.on_keyboard_change != NULL) {
+                handle->config.on_keyboard_change(handle, &prev_keys, &keys);
+            }
+        }
+        if (inputs.raw[0] != handle->inputs.raw[0]) {
+            tanmatsu_coprocessor_inputs_t prev_inputs = handle->inputs;
+            handle->inputs = inputs;
+            if (handle->config.on_input_change != NULL) {
+                handle->config.on_input_change(handle, &prev_inputs, &inputs);
+            }
+        }
+    }
+}
+
+esp_err_t tanmatsu_coprocessor_initialize(const tanmatsu_coprocessor_config_t* config,
+                                          tanmatsu_coprocessor_handle_t* out_handle) {
+    tanmatsu_coprocessor_handle_t handle = calloc(1, sizeof(*handle));
+    if (handle == NULL) {
+        return ESP_ERR_NO_MEM;
+    }
+    handle->config = *config;
+    const i2c_device_config_t device_config = {
+        .dev_addr_length = I2C_ADDR_BIT_LEN_7,
+        .device_address = config->i2c_address,
+        .scl_speed_hz = 400000,
+    };
+    esp_err_t res = i2c_master_bus_add_device(config->i2c_bus, &device_config, &handle->device);
+    if (res != ESP_OK) {
+        free(handle);
+        return res;
+    }
+    TaskHandle_t task = NULL;
+    if (xTaskCreate(driver_task, "coprocessor", SIM_DRIVER_STACK_SIZE, handle, SIM_DRIVER_PRIORITY, &task) != pdPASS) {
+        free(handle);
+        return ESP_ERR_NO_MEM;
+    }
+    interrupt_task = task;
+    // Like the real coprocessor, the line is raised once at start so the initial state gets read
+    raise_interrupt();
+    *out_handle = handle;
+    return ESP_OK;
+}
+
+esp_err_t tanmatsu_coprocessor_set_display_backlight(tanmatsu_coprocessor_handle_t handle, uint8_t brightness) {
+    return write_register(handle, SIM_REG_BACKLIGHT, brightness);
+}
+
+esp_err_t tanmatsu_coprocessor_radio_disable(tanmatsu_coprocessor_handle_t handle) {
+    return write_register(handle, SIM_REG_RADIO, 0);
+}
+
+esp_err_t tanmatsu_coprocessor_radio_enable_application(tanmatsu_coprocessor_handle_t handle) {
+    return write_register(handle, SIM_REG_RADIO, 1);
+}
+
+esp_err_t tanmatsu_coprocessor_radio_enable_bootloader(tanmatsu_coprocessor_handle_t handle) {
+    return write_register(handle, SIM_REG_RADIO, 2);
+}
+
+esp_err_t tanmatsu_coprocessor_get_real_time(tanmatsu_coprocessor_handle_t handle, uint32_t* out_value) {
+    uint8_t data[4];
+    esp_err_t res = read_registers(handle, SIM_REG_RTC, data, sizeof(data));
+    if (res == ESP_OK) {
+        *out_value = data[0] | (data[1] << 8) | (data[2] << 16) | ((uint32_t)data[3] << 24);
+    }
+    return res;
+}
+
+esp_err_t tanmatsu_coprocessor_set_pmic_adc_control(tanmatsu_coprocessor_handle_t handle, bool trigger,
+                                                    bool continuous) {
+    return write_register(handle, SIM_REG_PMIC_ADC, trigger | (continuous << 1));
+}
+
+esp_err_t tanmatsu_coprocessor_set_pmic_charging_control(tanmatsu_coprocessor_handle_t handle, bool disable,
+                                                         uint8_t speed) {
+    return write_register(handle, SIM_REG_CHARGING_CONTROL, disable | ((speed & 3) << 1));
+}
+
+esp_err_t tanmatsu_coprocessor_get_pmic_charging_control(tanmatsu_coprocessor_handle_t handle, bool* out_disable,
+                                                         uint8_t* out_speed) {
+    uint8_t control;
+    esp_err_t res = read_registers(handle, SIM_REG_CHARGING_CONTROL, &control, 1);
+    if (res == ESP_OK) {
+        *out_disable = control & 1;
+        *out_speed = (control >> 1) & 3;
+    }
+    return res;
+}
+
+esp_err_t tanmatsu_coprocessor_set_pmic_otg_control(tanmatsu_coprocessor_handle_t handle, bool enable) {
+    return write_register(handle, SIM_REG_PMIC_OTG, enable);
+}
+
+esp_err_t tanmatsu_coprocessor_get_pmic_faults(tanmatsu_coprocessor_handle_t handle,
+                                               tanmatsu_coprocessor_pmic_faults_t* out_faults) {
+    uint16_t faults;
+    esp_err_t res = read_u16(handle, SIM_REG_FAULTS, &faults);
+    if (res == ESP_OK) {
+        *out_faults = (tanmatsu_coprocessor_pmic_faults_t){
+            .watchdog = faults & (1 << 0),
+            .boost = faults & (1 << 1),
+            .chrg_input = faults & (1 << 2),
+            .chrg_thermal = faults & (1 << 3),
+            .chrg_safety = faults & (1 << 4),
+            .batt_ovp = faults & (1 << 5),
+            .ntc_cold = faults & (1 << 6),
+            .ntc_hot = faults & (1 << 7),
+            .ntc_boost = faults & (1 << 8),
+        };
+    }
+    return res;
+}
+
+esp_err_t tanmatsu_coprocessor_get_pmic_communication_fault(tanmatsu_coprocessor_handle_t handle, bool* out_last,
+                                                            bool* out_latch) {
+    uint8_t comm;
+    esp_err_t res = read_registers(handle, SIM_REG_COMM_FAULT, &comm, 1);
+    if (res == ESP_OK) {
+        *out_last = comm & 1;
+        *out_latch = (comm >> 1) & 1;
+    }
+    return res;
+}
+
+esp_err_t tanmatsu_coprocessor_get_pmic_charging_status(tanmatsu_coprocessor_handle_t handle,
+                                                        bool* out_battery_attached, bool* out_usb_attached,
+                                                        bool* out_charging_disabled, uint8_t* out_status) {
+    uint8_t status;
+    esp_err_t res = read_registers(handle, SIM_REG_CHARGING_STATUS, &status, 1);
+    if (res == ESP_OK) {
+        *out_battery_attached = status & 1;
+        *out_usb_attached = (status >> 1) & 1;
+        *out_charging_disabled = (status >> 2) & 1;
+        *out_status = (status >> 3) & 3;
+    }
+    return res;
+}
+
+esp_err_t tanmatsu_coprocessor_get_pmic_vbat(tanmatsu_coprocessor_handle_t handle, uint16_t* out_value) {
+    return read_u16(handle, SIM_REG_VBAT, out_value);
+}
+
+esp_err_t tanmatsu_coprocessor_get_pmic_vsys(tanmatsu_coprocessor_handle_t handle, uint16_t* out_value) {
+    return read_u16(handle, SIM_REG_VSYS, out_value);
+}
+
+esp_err_t tanmatsu_coprocessor_get_pmic_ts(tanmatsu_coprocessor_handle_t handle, uint16_t* out_value) {
+    return read_u16(handle, SIM_REG_TS, out_value);
+}
+
+esp_err_t tanmatsu_coprocessor_get_pmic_vbus(tanmatsu_coprocessor_handle_t handle, uint16_t* out_value) {
+    return read_u16(handle, SIM_REG_VBUS, out_value);
+}
+
+esp_err_t tanmatsu_coprocessor_get_pmic_ichgr(tanmatsu_coprocessor_handle_t handle, uint16_t* out_value) {
+    return read_u16(handle, SIM_REG_ICHGR, out_value);
+}
@@ -0,0 +1,136 @@
+#include <fcntl.h>
+#include <stdint.h>
+#include <unistd.h>
+#include "driver/gpio.h"
+#include "driver/gpio_etm.h"
+#include "driver/gptimer.h"
+#include "driver/uart.h"
+#include "esp_err.h"
+#include "esp_etm.h"
+#include "esp_ldo_regulator.h"
+#include "esp_vfs_fat.h"
+#include "freertos/FreeRTOS.h"
+#include "freertos/task.h"
+
+// Peripherals the simulator has nothing behind. Those the firmware can do without report ESP_ERR_NOT_SUPPORTED, so
+// the firmware takes the path it takes for a missing feature on the hardware.
+
+#define SIM_UART_POLL_MS 10
+
+esp_err_t gpio_config(const gpio_config_t* config) {
+    return ESP_OK;
+}
+
+esp_err_t gpio_set_level(gpio_num_t gpio_num, uint32_t level) {
+    return ESP_OK;
+}
+
+esp_err_t gpio_install_isr_service(int intr_alloc_flags) {
+    return ESP_OK;
+}
+
+esp_err_t esp_ldo_acquire_channel(const esp_ldo_channel_config_t* config, esp_ldo_channel_handle_t* out_handle) {
+    *out_handle = NULL;
+    return ESP_OK;
+}
+
+esp_err_t gptimer_new_timer(const gptimer_config_t* config, gptimer_handle_t* ret_timer) {
+    *ret_timer = NULL;
+    return ESP_ERR_NOT_SUPPORTED;
+}
+
+esp_err_t gptimer_del_timer(gptimer_handle_t timer) {
+    return ESP_ERR_NOT_SUPPORTED;
+}
+
+esp_err_t gptimer_new_etm_task(gptimer_handle_t timer, const gptimer_etm_task_conf_t* config,
+                               esp_etm_task_handle_t* out_task) {
+    return ESP_ERR_NOT_SUPPORTED;
+}
+
+esp_err_t gptimer_enable(gptimer_handle_t timer) {
+    return ESP_ERR_NOT_SUPPORTED;
+}
+
+esp_err_t gptimer_disable(gptimer_handle_t timer) {
+    return ESP_ERR_NOT_SUPPORTED;
+}
+
+esp_err_t gptimer_start(gptimer_handle_t timer) {
+    return ESP_ERR_NOT_SUPPORTED;
+}
+
+esp_err_t gptimer_get_raw_count(gptimer_handle_t timer, uint64_t* value) {
+    return ESP_ERR_NOT_SUPPORTED;
+}
+
+esp_err_t gptimer_get_captured_count(gptimer_handle_t timer, uint64_t* value) {
+    return ESP_ERR_NOT_SUPPORTED;
+}
+
+esp_err_t gpio_new_etm_event(const gpio_etm_event_config_t* config, esp_etm_event_handle_t* ret_event) {
+    return ESP_ERR_NOT_SUPPORTED;
+}
+
+esp_err_t gpio_etm_event_bind_gpio(esp_etm_event_handle_t event, gpio_num_t gpio_num) {
+    return ESP_ERR_NOT_SUPPORTED;
+}
+
+esp_err_t esp_etm_new_channel(const esp_etm_channel_config_t* config, esp_etm_channel_handle_t* ret_chan) {
+    return ESP_ERR_NOT_SUPPORTED;
+}
+
+esp_err_t esp_etm_channel_connect(esp_etm_channel_handle_t chan, esp_etm_event_handle_t event,
+                                  esp_etm_task_handle_t task) {
+    return ESP_ERR_NOT_SUPPORTED;
+}
+
+esp_err_t esp_etm_channel_enable(esp_etm_channel_handle_t chan) {
+    return ESP_ERR_NOT_SUPPORTED;
+}
+
+esp_err_t esp_etm_channel_disable(esp_etm_channel_handle_t chan) {
+    return ESP_ERR_NOT_SUPPORTED;
+}
+
+esp_err_t esp_etm_del_channel(esp_etm_channel_handle_t chan) {
+    return ESP_ERR_NOT_SUPPORTED;
+}
+
+esp_err_t esp_etm_del_event(esp_etm_event_handle_t event) {
+    return ESP_ERR_NOT_SUPPORTED;
+}
+
+esp_err_t esp_etm_del_task(esp_etm_task_handle_t task) {
+    return ESP_ERR_NOT_SUPPORTED;
+}
+
+esp_err_t esp_vfs_fat_spiflash_mount_rw_wl(const char* base_path, const char* partition_label,
+                                           const esp_vfs_fat_mount_config_t* mount_config, wl_handle_t* wl_handle) {
+    *wl_handle = WL_INVALID_HANDLE;
+    return ESP_ERR_NOT_SUPPORTED;
+}
+
+esp_err_t uart_driver_install(uart_port_t uart_num, int rx_buffer_size, int tx_buffer_size, int queue_size,
+                              QueueHandle_t* uart_queue, int intr_alloc_flags) {
+    int flags = fcntl(STDIN_FILENO, F_GETFL);
+    if (flags < 0 || fcntl(STDIN_FILENO, F_SETFL, flags | O_NONBLOCK) < 0) {
+        return ESP_FAIL;
+    }
+    return ESP_OK;
+}
+
+int uart_read_bytes(uart_port_t uart_num, void* buf, uint32_t length, TickType_t ticks_to_wait) {
+    TickType_t start = xTaskGetTickCount();
+    while (true) {
+        ssize_t result = read(STDIN_FILENO, buf, length);
+        if (result > 0) {
+            return result;
+        }
+        // Nothing to read, or the end of a piped command file, which leaves the task waiting like an idle UART
+        if (ticks_to_wait != portMAX_DELAY && xTaskGetTickCount() - start >= ticks_to_wait) {
+            return 0;
+        }
+        vTaskDelay(pdMS_TO_TICKS(SIM_UART_POLL_MS));
+    }
+}
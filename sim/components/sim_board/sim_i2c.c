@@ -0,0 +1,125 @@
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include "driver/i2c_master.h"
+#include "esp_err.h"
+#include "freertos/FreeRTOS.h"
+#include "sim_board.h"
+#include "sim_private.h"
+
+#define SIM_I2C_MAX_DEVICES 8
+#define SIM_I2C_PROBE_HZ    100000
+
+struct i2c_master_bus {
+    int port;
+};
+
+struct i2c_master_dev {
+    i2c_master_bus_handle_t bus;
+    uint16_t address;
+    uint32_t speed_hz;
+};
+
+static struct {
+    uint16_t address;
+    sim_i2c_device_t device;
+} devices[SIM_I2C_MAX_DEVICES];
+static size_t device_count = 0;
+
+static portMUX_TYPE stats_lock = portMUX_INITIALIZER_UNLOCKED;
+static sim_i2c_stats_t stats = {0};
+
+void sim_i2c_add_device(uint16_t address, const sim_i2c_device_t* device) {
+    if (device_count < SIM_I2C_MAX_DEVICES) {
+        devices[device_count].address = address;
+        devices[device_count].device = *device;
+        device_count++;
+    }
+}
+
+void sim_i2c_get_stats(sim_i2c_stats_t* out) {
+    portENTER_CRITICAL(&stats_lock);
+    *out = stats;
+    portEXIT_CRITICAL(&stats_lock);
+}
+
+static const sim_i2c_device_t* find_device(uint16_t address) {
+    for (size_t i = 0; i < device_count; i++) {
+        if (devices[i].address == address) {
+            return &devices[i].device;
+        }
+    }
+    return NULL;
+}
+
+// Start, address, the written bytes, optionally a repeated start, address and the read bytes, and a stop. Every byte
+// takes nine clocks including its acknowledge.
+static void account(uint32_t speed_hz, size_t write_size, size_t read_size, bool nack) {
+    uint32_t bits = 1 + 9 + 9 * write_size + 1;
+    if (read_size > 0) {
+        bits += 1 + 9 + 9 * read_size;
+    }
+    portENTER_CRITICAL(&stats_lock);
+    stats.transactions++;
+    stats.nacks += nack;
+    stats.bus_ns += (uint64_t)bits * 1000000000 / speed_hz;
+    portEXIT_CRITICAL(&stats_lock);
+}
+
+esp_err_t i2c_new_master_bus(const i2c_master_bus_config_t* bus_config, i2c_master_bus_handle_t* ret_bus_handle) {
+    i2c_master_bus_handle_t bus = calloc(1, sizeof(*bus));
+    if (bus == NULL) {
+        return ESP_ERR_NO_MEM;
+    }
+    bus->port = bus_config->i2c_port;
+    *ret_bus_handle = bus;
+    sim_board_bus_created(bus, bus->port);
+    return ESP_OK;
+}
+
+esp_err_t i2c_master_bus_add_device(i2c_master_bus_handle_t bus_handle, const i2c_device_config_t* dev_config,
+                                    i2c_master_dev_handle_t* ret_handle) {
+    i2c_master_dev_handle_t dev = calloc(1, sizeof(*dev));
+    if (dev == NULL) {
+        return ESP_ERR_NO_MEM;
+    }
+    dev->bus = bus_handle;
+    dev->address = dev_config->device_address;
+    dev->speed_hz = dev_config->scl_speed_hz > 0 ? dev_config->scl_speed_hz : SIM_I2C_PROBE_HZ;
+    *ret_handle = dev;
+    return ESP_OK;
+}
+
+esp_err_t i2c_master_transmit(i2c_master_dev_handle_t i2c_dev, const uint8_t* write_buffer, size_t write_size,
+                              int xfer_timeout_ms) {
+    const sim_i2c_device_t* device = find_device(i2c_dev->address);
+    account(i2c_dev->speed_hz, write_size, 0, device == NULL);
+    if (device == NULL) {
+        return ESP_ERR_INVALID_STATE;
+    }
+    if (write_size == 0 || device->write == NULL) {
+        return ESP_OK;
+    }
+    return device->write(device->ctx, write_buffer[0], &write_buffer[1], write_size - 1) ? ESP_OK : ESP_FAIL;
+}
+
+esp_err_t i2c_master_transmit_receive(i2c_master_dev_handle_t i2c_dev, const uint8_t* write_buffer,
+                                      size_t write_size, uint8_t* read_buffer, size_t read_size, int xfer_timeout_ms) {
+    const sim_i2c_device_t* device = find_device(i2c_dev->address);
+    account(i2c_dev->speed_hz, write_size, read_size, device == NULL);
+    if (device == NULL) {
+        return ESP_ERR_INVALID_STATE;
+    }
+    // Only the register pointer protocol is modelled, the last written byte selects the register
+    if (write_size == 0 || device->read == NULL) {
+        return ESP_ERR_INVALID_ARG;
+    }
+    return device->read(device->ctx, write_buffer[write_size - 1], read_buffer, read_size) ? ESP_OK : ESP_FAIL;
+}
+
+esp_err_t i2c_master_probe(i2c_master_bus_handle_t bus_handle, uint16_t address, int xfer_timeout_ms) {
+    bool present = find_device(address) != NULL;
+    account(SIM_I2C_PROBE_HZ, 0, 0, !present);
+    return present ? ESP_OK : ESP_ERR_NOT_FOUND;
+}
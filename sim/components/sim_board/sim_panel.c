@@ -0,0 +1,131 @@
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "dsi_panel_nicolaielectronics_st7701.h"
+#include "esp_err.h"
+#include "esp_lcd_mipi_dsi.h"
+#include "esp_lcd_panel_ops.h"
+#include "esp_lcd_types.h"
+#include "esp_log.h"
+#include "esp_timer.h"
+#include "freertos/FreeRTOS.h"
+#include "sim_board.h"
+
+static char const TAG[] = "sim-panel";
+
+// Resolution of the ST7701 panel, in its native portrait orientation
+#define SIM_PANEL_H_RES 480
+#define SIM_PANEL_V_RES 800
+
+struct esp_lcd_panel_t {
+    uint16_t* frame_buffer;
+    esp_lcd_dpi_panel_event_callbacks_t callbacks;
+    void* user_ctx;
+};
+
+static struct esp_lcd_panel_t panel = {0};
+static portMUX_TYPE stats_lock = portMUX_INITIALIZER_UNLOCKED;
+static sim_panel_stats_t stats = {0};
+
+esp_err_t st7701_initialize(gpio_num_t reset_pin) {
+    if (panel.frame_buffer == NULL) {
+        panel.frame_buffer = calloc(SIM_PANEL_H_RES * SIM_PANEL_V_RES, sizeof(uint16_t));
+        if (panel.frame_buffer == NULL) {
+            return ESP_ERR_NO_MEM;
+        }
+    }
+    ESP_LOGI(TAG, "Headless %dx%d RGB565 panel", SIM_PANEL_H_RES, SIM_PANEL_V_RES);
+    return ESP_OK;
+}
+
+esp_lcd_panel_handle_t st7701_get_panel() {
+    return &panel;
+}
+
+esp_err_t st7701_get_parameters(size_t* h_res, size_t* v_res, lcd_color_rgb_pixel_format_t* color_fmt) {
+    *h_res = SIM_PANEL_H_RES;
+    *v_res = SIM_PANEL_V_RES;
+    *color_fmt = LCD_COLOR_PIXEL_FORMAT_RGB565;
+    return ESP_OK;
+}
+
+esp_err_t esp_lcd_dpi_panel_register_event_callbacks(esp_lcd_panel_handle_t dpi_panel,
+                                                     const esp_lcd_dpi_panel_event_callbacks_t* cbs, void* user_ctx) {
+    dpi_panel->callbacks = *cbs;
+    dpi_panel->user_ctx = user_ctx;
+    return ESP_OK;
+}
+
+esp_err_t esp_lcd_dpi_panel_get_frame_buffer(esp_lcd_panel_handle_t dpi_panel, uint32_t fb_num, void** fb0, ...) {
+    if (fb_num != 1 || dpi_panel->frame_buffer == NULL) {
+        return ESP_ERR_INVALID_ARG;
+    }
+    *fb0 = dpi_panel->frame_buffer;
+    return ESP_OK;
+}
+
+esp_err_t esp_lcd_dpi_panel_enable_dma2d(esp_lcd_panel_handle_t dpi_panel) {
+    return ESP_ERR_NOT_SUPPORTED;
+}
+
+esp_err_t esp_lcd_panel_draw_bitmap(esp_lcd_panel_handle_t panel_handle, int x_start, int y_start, int x_end, int y_end,
+                                    const void* color_data) {
+    if (x_start < 0 || y_start < 0 || x_end > SIM_PANEL_H_RES || y_end > SIM_PANEL_V_RES || x_start >= x_end ||
+        y_start >= y_end) {
+        return ESP_ERR_INVALID_ARG;
+    }
+    int64_t start = esp_timer_get_time();
+    int width = x_end - x_start;
+    // A bitmap in the frame buffer itself is already in place, the real driver only writes back the cache
+    if (color_data != panel_handle->frame_buffer) {
+        const uint16_t* src = color_data;
+        for (int y = y_start; y < y_end; y++) {
+            memcpy(&panel_handle->frame_buffer[y * SIM_PANEL_H_RES + x_start], src, width * sizeof(uint16_t));
+            src += width;
+        }
+    }
+    int64_t copy_us = esp_timer_get_time() - start;
+
+    portENTER_CRITICAL(&stats_lock);
+    stats.draws++;
+    stats.pixels += (uint64_t)width * (y_end - y_start);
+    stats.copy_ns += copy_us * 1000;
+    portEXIT_CRITICAL(&stats_lock);
+
+    // There is no DMA, the transfer is done before this returns
+    if (panel_handle->callbacks.on_color_trans_done != NULL) {
+        esp_lcd_dpi_panel_event_data_t edata = {};
+        panel_handle->callbacks.on_color_trans_done(panel_handle, &edata, panel_handle->user_ctx);
+    }
+    return ESP_OK;
+}
+
+void sim_panel_get_stats(sim_panel_stats_t* out) {
+    portENTER_CRITICAL(&stats_lock);
+    *out = stats;
+    portEXIT_CRITICAL(&stats_lock);
+}
+
+bool sim_panel_save_ppm(const char* path) {
+    if (panel.frame_buffer == NULL) {
+        return false;
+    }
+    FILE* file = fopen(path, "wb");
+    if (file == NULL) {
+        return false;
+    }
+    fprintf(file, "P6\n%d %d\n255\n", SIM_PANEL_H_RES, SIM_PANEL_V_RES);
+    for (size_t i = 0; i < SIM_PANEL_H_RES * SIM_PANEL_V_RES; i++) {
+        uint16_t pixel = panel.frame_buffer[i];
+        uint8_t rgb[3] = {
+            (pixel >> 11) << 3,
+            ((pixel >> 5) & 0x3F) << 2,
+            (pixel & 0x1F) << 3,
+        };
+        fwrite(rgb, 1, sizeof(rgb), file);
+    }
+    return fclose(file) == 0;
+}
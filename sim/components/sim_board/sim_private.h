@@ -0,0 +1,8 @@
+#pragma once
+
+#include "driver/i2c_master.h"
+
+// Board wiring: called by i2c_new_master_bus(), the internal bus gets the coprocessor model and starts the scenario
+void sim_board_bus_created(i2c_master_bus_handle_t bus, int port);
+
+void sim_coprocessor_start(uint16_t address);
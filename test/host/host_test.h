@@ -0,0 +1,19 @@
+#pragma once
+
+#include <stdio.h>
+
+// Counts failed checks, a test's main() returns host_test_result() so ctest sees the failure
+static int host_test_failures = 0;
+
+#define CHECK(condition)                                                                     \
+    do {                                                                                     \
+        if (!(condition)) {                                                                  \
+            fprintf(stderr, "%s:%d: check failed: %s\n", __FILE__, __LINE__, #condition); \
+            host_test_failures++;                                                            \
+        }                                                                                    \
+    } while (0)
+
+static inline int host_test_result(const char* name) {
+    printf("%s: %s\n", name, host_test_failures == 0 ? "passed" : "FAILED");
+    return host_test_failures == 0 ? 0 : 1;
+}
@@ -0,0 +1,9 @@
+#pragma once
+
+// The part of LVGL's display API the modules under test use
+typedef enum {
+    LV_DISPLAY_ROTATION_0 = 0,
+    LV_DISPLAY_ROTATION_90,
+    LV_DISPLAY_ROTATION_180,
+    LV_DISPLAY_ROTATION_270,
+} lv_display_rotation_t;
@@ -0,0 +1,9 @@
+#pragma once
+
+// The error codes of ESP-IDF the modules under test use
+typedef int esp_err_t;
+
+#define ESP_OK          0
+#define ESP_FAIL        -1
+#define ESP_ERR_NO_MEM  0x101
+#define ESP_ERR_TIMEOUT 0x107
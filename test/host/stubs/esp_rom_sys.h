@@ -0,0 +1,6 @@
+#pragma once
+
+#include <stdint.h>
+
+// Advances the stubbed clock, see freertos_host.h
+void esp_rom_delay_us(uint32_t us);
@@ -0,0 +1,6 @@
+#pragma once
+
+#include <stdint.h>
+
+// Time of the stubbed clock, see freertos_host.h
+int64_t esp_timer_get_time(void);
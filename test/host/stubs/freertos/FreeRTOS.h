@@ -0,0 +1,16 @@
+#pragma once
+
+#include <stdint.h>
+
+// The FreeRTOS types and macros the modules under test use, see freertos_host.h for the implementation
+typedef uint32_t TickType_t;
+typedef int BaseType_t;
+typedef unsigned int UBaseType_t;
+
+#define configTICK_RATE_HZ 1000
+#define portMAX_DELAY      ((TickType_t)UINT32_MAX)
+#define pdFALSE            0
+#define pdTRUE             1
+#define pdFAIL             pdFALSE
+#define pdPASS             pdTRUE
+#define pdMS_TO_TICKS(ms)  ((TickType_t)((TickType_t)(ms) * (TickType_t)configTICK_RATE_HZ / (TickType_t)1000))
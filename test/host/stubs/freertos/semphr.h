@@ -0,0 +1,21 @@
+#pragma once
+
+#include <stdbool.h>
+#include "freertos/FreeRTOS.h"
+
+// Counting semaphores without priority inheritance, a mutex is a binary semaphore that starts out given
+typedef struct {
+    UBaseType_t count;
+    UBaseType_t max;
+    bool allocated;
+} StaticSemaphore_t;
+
+typedef StaticSemaphore_t* SemaphoreHandle_t;
+
+SemaphoreHandle_t xSemaphoreCreateBinary(void);
+SemaphoreHandle_t xSemaphoreCreateBinaryStatic(StaticSemaphore_t* buffer);
+SemaphoreHandle_t xSemaphoreCreateCounting(UBaseType_t max, UBaseType_t initial);
+SemaphoreHandle_t xSemaphoreCreateMutex(void);
+void vSemaphoreDelete(SemaphoreHandle_t semaphore);
+BaseType_t xSemaphoreTake(SemaphoreHandle_t semaphore, TickType_t ticks);
+BaseType_t xSemaphoreGive(SemaphoreHandle_t semaphore);
@@ -0,0 +1,14 @@
+#pragma once
+
+#include <stdint.h>
+#include "freertos/FreeRTOS.h"
+
+// Tasks are threads, priorities are ignored
+typedef void (*TaskFunction_t)(void* arg);
+typedef struct task_t* TaskHandle_t;
+
+BaseType_t xTaskCreate(TaskFunction_t function, const char* name, uint32_t stack_size, void* arg,
+                       UBaseType_t priority, TaskHandle_t* handle);
+// Only a task deleting itself is supported
+void vTaskDelete(TaskHandle_t task);
+void vTaskDelay(TickType_t ticks);
@@ -0,0 +1,185 @@
+#include "freertos_host.h"
+#include <pthread.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include "driver/i2c_master.h"
+#include "esp_err.h"
+#include "esp_rom_sys.h"
+#include "esp_timer.h"
+#include "freertos/FreeRTOS.h"
+#include "freertos/semphr.h"
+#include "freertos/task.h"
+
+// One lock and one condition guard the clock and every semaphore, any change wakes all blocked tasks
+static pthread_mutex_t lock = PTHREAD_MUTEX_INITIALIZER;
+static pthread_cond_t changed = PTHREAD_COND_INITIALIZER;
+static int64_t clock_us = 0;
+static uint32_t clock_generation = 0;  // Counts the advances of the clock
+static int blocked = 0;                // Tasks blocked in xSemaphoreTake()
+static int unseen = 0;                 // Of those, the ones that have not seen the last advance yet
+
+int64_t esp_timer_get_time(void) {
+    pthread_mutex_lock(&lock);
+    int64_t now = clock_us;
+    pthread_mutex_unlock(&lock);
+    return now;
+}
+
+void host_rtos_advance_us(int64_t us) {
+    pthread_mutex_lock(&lock);
+    clock_us += us;
+    clock_generation++;
+    unseen = blocked;
+    pthread_cond_broadcast(&changed);
+    while (unseen > 0) {
+        pthread_cond_wait(&changed, &lock);
+    }
+    pthread_mutex_unlock(&lock);
+}
+
+void host_rtos_wait_blocked(int count) {
+    pthread_mutex_lock(&lock);
+    while (blocked != count) {
+        pthread_cond_wait(&changed, &lock);
+    }
+    pthread_mutex_unlock(&lock);
+}
+
+int host_rtos_blocked(void) {
+    pthread_mutex_lock(&lock);
+    int count = blocked;
+    pthread_mutex_unlock(&lock);
+    return count;
+}
+
+void esp_rom_delay_us(uint32_t us) {
+    host_rtos_advance_us(us);
+}
+
+static SemaphoreHandle_t semaphore_create(UBaseType_t max, UBaseType_t initial) {
+    SemaphoreHandle_t semaphore = malloc(sizeof(*semaphore));
+    if (semaphore != NULL) {
+        *semaphore = (StaticSemaphore_t){.count = initial, .max = max, .allocated = true};
+    }
+    return semaphore;
+}
+
+SemaphoreHandle_t xSemaphoreCreateBinary(void) {
+    return semaphore_create(1, 0);
+}
+
+SemaphoreHandle_t xSemaphoreCreateBinaryStatic(StaticSemaphore_t* buffer) {
+    *buffer = (StaticSemaphore_t){.count = 0, .max = 1};
+    return buffer;
+}
+
+SemaphoreHandle_t xSemaphoreCreateCounting(UBaseType_t max, UBaseType_t initial) {
+    return semaphore_create(max, initial);
+}
+
+SemaphoreHandle_t xSemaphoreCreateMutex(void) {
+    return semaphore_create(1, 1);
+}
+
+void vSemaphoreDelete(SemaphoreHandle_t semaphore) {
+    if (semaphore->allocated) {
+        free(semaphore);
+    }
+}
+
+BaseType_t xSemaphoreTake(SemaphoreHandle_t semaphore, TickType_t ticks) {
+    pthread_mutex_lock(&lock);
+    int64_t deadline_us = clock_us + (int64_t)ticks * 1000000 / configTICK_RATE_HZ;
+    uint32_t seen = clock_generation;
+    bool waited = false;
+    while (semaphore->count == 0 && (ticks == portMAX_DELAY || clock_us < deadline_us)) {
+        if (!waited) {
+            waited = true;
+            blocked++;
+            pthread_cond_broadcast(&changed);
+        }
+        pthread_cond_wait(&changed, &lock);
+        if (seen != clock_generation) {
+            seen = clock_generation;
+            unseen--;
+            pthread_cond_broadcast(&changed);
+        }
+    }
+    if (waited) {
+        blocked--;
+        pthread_cond_broadcast(&changed);
+    }
+    BaseType_t taken = semaphore->count > 0 ? pdTRUE : pdFALSE;
+    if (taken) {
+        semaphore->count--;
+    }
+    pthread_mutex_unlock(&lock);
+    return taken;
+}
+
+BaseType_t xSemaphoreGive(SemaphoreHandle_t semaphore) {
+    pthread_mutex_lock(&lock);
+    BaseType_t given = semaphore->count < semaphore->max ? pdTRUE : pdFALSE;
+    if (given) {
+        semaphore->count++;
+        pthread_cond_broadcast(&changed);
+    }
+    pthread_mutex_unlock(&lock);
+    return given;
+}
+
+typedef struct {
+    TaskFunction_t function;
+    void* arg;
+} task_start_t;
+
+static void* task_main(void* arg) {
+    task_start_t start = *(task_start_t*)arg;
+    free(arg);
+    start.function(start.arg);
+    return NULL;
+}
+
+BaseType_t xTaskCreate(TaskFunction_t function, const char* name, uint32_t stack_size, void* arg,
+                       UBaseType_t priority, TaskHandle_t* handle) {
+    task_start_t* start = malloc(sizeof(*start));
+    if (start == NULL) {
+        return pdFAIL;
+    }
+    *start = (task_start_t){.function = function, .arg = arg};
+    pthread_t thread;
+    if (pthread_create(&thread, NULL, task_main, start) != 0) {
+        free(start);
+        return pdFAIL;
+    }
+    pthread_detach(thread);
+    if (handle != NULL) {
+        *handle = NULL;
+    }
+    return pdPASS;
+}
+
+void vTaskDelete(TaskHandle_t task) {
+    if (task == NULL) {
+        pthread_exit(NULL);
+    }
+    abort();
+}
+
+void vTaskDelay(TickType_t ticks) {
+    StaticSemaphore_t never;
+    xSemaphoreTake(xSemaphoreCreateBinaryStatic(&never), ticks);
+}
+
+esp_err_t i2c_master_transmit_receive(i2c_master_dev_handle_t device, const uint8_t* write, size_t write_size,
+                                      uint8_t* read, size_t read_size, int timeout_ms) {
+    for (size_t i = 0; i < read_size; i++) {
+        read[i] = 0;
+    }
+    return ESP_OK;
+}
+
+esp_err_t i2c_master_probe(i2c_master_bus_handle_t bus, uint16_t address, int timeout_ms) {
+    return ESP_OK;
+}
@@ -0,0 +1,16 @@
+#pragma once
+
+#include <stdint.h>
+
+// FreeRTOS and esp_timer for host tests, built on threads and a stubbed clock. The clock starts at zero and only moves
+// when a test advances it, so a timed wait ends exactly when the test says it does.
+
+// Advances the clock and waits until every task blocked in xSemaphoreTake() has seen the new time, so on return a
+// take has either timed out or is still waiting
+void host_rtos_advance_us(int64_t us);
+
+// Waits until exactly count tasks are blocked in xSemaphoreTake()
+void host_rtos_wait_blocked(int count);
+
+// Number of tasks blocked in xSemaphoreTake()
+int host_rtos_blocked(void);
@@ -0,0 +1,17 @@
+#pragma once
+
+// The key codes of LVGL 9.2 the modules under test use
+typedef enum {
+    LV_KEY_UP = 17,
+    LV_KEY_DOWN = 18,
+    LV_KEY_RIGHT = 19,
+    LV_KEY_LEFT = 20,
+    LV_KEY_ESC = 27,
+    LV_KEY_DEL = 127,
+    LV_KEY_BACKSPACE = 8,
+    LV_KEY_ENTER = 10,
+    LV_KEY_NEXT = 9,
+    LV_KEY_PREV = 11,
+    LV_KEY_HOME = 2,
+    LV_KEY_END = 3,
+} lv_key_t;
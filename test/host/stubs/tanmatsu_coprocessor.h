@@ -0,0 +1,83 @@
+#pragma once
+
+#include <stdbool.h>
+#include <stdint.h>
+
+// The key bitmap of the tanmatsu_coprocessor component, declared like the component does
+typedef union {
+    struct {
+        bool key_esc : 1;
+        bool key_f1 : 1;
+        bool key_f2 : 1;
+        bool key_f3 : 1;
+        bool key_tilde : 1;
+        bool key_1 : 1;
+        bool key_2 : 1;
+        bool key_3 : 1;
+        bool key_tab : 1;
+        bool key_q : 1;
+        bool key_w : 1;
+        bool key_e : 1;
+        bool key_fn : 1;
+        bool key_a : 1;
+        bool key_s : 1;
+        bool key_d : 1;
+        bool key_shift_l : 1;
+        bool key_z : 1;
+        bool key_x : 1;
+        bool key_c : 1;
+        bool key_ctrl : 1;
+        bool key_meta : 1;
+        bool key_alt_l : 1;
+        bool key_backslash : 1;
+        bool key_4 : 1;
+        bool key_5 : 1;
+        bool key_6 : 1;
+        bool key_7 : 1;
+        bool key_r : 1;
+        bool key_t : 1;
+        bool key_y : 1;
+        bool key_u : 1;
+        bool key_f : 1;
+        bool key_g : 1;
+        bool key_h : 1;
+        bool key_j : 1;
+        bool key_v : 1;
+        bool key_b : 1;
+        bool key_n : 1;
+        bool key_m : 1;
+        bool key_f4 : 1;
+        bool key_f5 : 1;
+        bool key_f6 : 1;
+        bool key_backspace : 1;
+        bool key_9 : 1;
+        bool key_0 : 1;
+        bool key_minus : 1;
+        bool key_equals : 1;
+        bool key_o : 1;
+        bool key_p : 1;
+        bool key_sqbracket_open : 1;
+        bool key_sqbracket_close : 1;
+        bool key_l : 1;
+        bool key_semicolon : 1;
+        bool key_quote : 1;
+        bool key_return : 1;
+        bool key_dot : 1;
+        bool key_slash : 1;
+        bool key_up : 1;
+        bool key_shift_r : 1;
+        bool key_alt_r : 1;
+        bool key_left : 1;
+        bool key_down : 1;
+        bool key_right : 1;
+        bool key_8 : 1;
+        bool key_i : 1;
+        bool key_k : 1;
+        bool key_comma : 1;
+        bool key_space_l : 1;
+        bool key_space_m : 1;
+        bool key_space_r : 1;
+        bool key_volume_up : 1;
+    };
+    uint8_t raw[9];
+} tanmatsu_coprocessor_keys_t;
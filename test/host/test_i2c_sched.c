@@ -0,0 +1,131 @@
+#include <pthread.h>
+#include <stdatomic.h>
+#include <stdint.h>
+#include "esp_err.h"
+#include "freertos_host.h"
+#include "host_test.h"
+#include "i2c_sched.h"
+
+// The longest waits i2c_sched.c allows per class
+#define CONTROL_MAX_WAIT_MS   200
+#define TELEMETRY_MAX_WAIT_MS 1000
+
+// A request from its own task, which holds the bus only long enough to note that it got it
+typedef struct {
+    i2c_sched_class_t cls;
+    pthread_t thread;
+    esp_err_t result;
+} request_t;
+
+static request_t* grant_order[8];
+static atomic_int grant_count;
+
+static void* request_main(void* arg) {
+    request_t* request = arg;
+    request->result = i2c_sched_acquire(request->cls);
+    if (request->result == ESP_OK) {
+        grant_order[atomic_fetch_add(&grant_count, 1)] = request;
+        i2c_sched_release();
+    }
+    return NULL;
+}
+
+// Starts a request while the bus is taken and returns once it is the queued-th task waiting for it
+static void request_start(request_t* request, i2c_sched_class_t cls, int queued) {
+    request->cls = cls;
+    request->result = ESP_FAIL;
+    pthread_create(&request->thread, NULL, request_main, request);
+    host_rtos_wait_blocked(queued);
+}
+
+static void request_join(request_t* request) {
+    pthread_join(request->thread, NULL);
+}
+
+static void reset() {
+    i2c_sched_stats_t stats;
+    i2c_sched_get_stats(&stats, true);
+    atomic_store(&grant_count, 0);
+}
+
+// When the bus is released it goes to the oldest waiter of the highest class, whatever the order they arrived in
+static void check_class_order() {
+    reset();
+    CHECK(i2c_sched_acquire(I2C_SCHED_TELEMETRY) == ESP_OK);
+    request_t requests[4];
+    request_start(&requests[0], I2C_SCHED_TELEMETRY, 1);
+    request_start(&requests[1], I2C_SCHED_TELEMETRY, 2);
+    request_start(&requests[2], I2C_SCHED_CONTROL, 3);
+    request_start(&requests[3], I2C_SCHED_CONTROL, 4);
+    i2c_sched_release();
+    for (int i = 0; i < 4; i++) {
+        request_join(&requests[i]);
+        CHECK(requests[i].result == ESP_OK);
+    }
+
+    CHECK(atomic_load(&grant_count) == 4);
+    CHECK(grant_order[0] == &requests[2]);
+    CHECK(grant_order[1] == &requests[3]);
+    CHECK(grant_order[2] == &requests[0]);
+    CHECK(grant_order[3] == &requests[1]);
+
+    i2c_sched_stats_t stats;
+    i2c_sched_get_stats(&stats, false);
+    CHECK(stats.classes[I2C_SCHED_CONTROL].grants == 2);
+    CHECK(stats.classes[I2C_SCHED_TELEMETRY].grants == 3);
+    CHECK(stats.classes[I2C_SCHED_CONTROL].timeouts == 0);
+    CHECK(stats.classes[I2C_SCHED_TELEMETRY].timeouts == 0);
+}
+
+// A request waits up to its class's maximum and then gives up without ever getting the bus
+static void check_wait_limit(i2c_sched_class_t cls, i2c_sched_class_t other, uint32_t max_wait_ms) {
+    reset();
+    CHECK(i2c_sched_acquire(other) == ESP_OK);
+    request_t request;
+    request_start(&request, cls, 1);
+    host_rtos_advance_us((max_wait_ms - 1) * 1000);
+    CHECK(host_rtos_blocked() == 1);
+    host_rtos_advance_us(1000);
+    CHECK(host_rtos_blocked() == 0);
+    // A request that is still waiting would otherwise keep the join from returning
+    host_rtos_advance_us(10 * TELEMETRY_MAX_WAIT_MS * 1000);
+    request_join(&request);
+    CHECK(request.result == ESP_ERR_TIMEOUT);
+
+    // The request left the queue, so the release frees the bus instead of handing it on
+    i2c_sched_release();
+    i2c_sched_stats_t stats;
+    i2c_sched_get_stats(&stats, false);
+    CHECK(stats.classes[cls].grants == 0);
+    CHECK(stats.classes[cls].timeouts == 1);
+    CHECK(atomic_load(&grant_count) == 0);
+}
+
+// A release just before the maximum still grants the bus, and the wait is accounted to the request's class
+static void check_grant_before_limit(i2c_sched_class_t cls, i2c_sched_class_t other, uint32_t max_wait_ms) {
+    reset();
+    CHECK(i2c_sched_acquire(other) == ESP_OK);
+    request_t request;
+    request_start(&request, cls, 1);
+    host_rtos_advance_us((max_wait_ms - 1) * 1000);
+    i2c_sched_release();
+    request_join(&request);
+    CHECK(request.result == ESP_OK);
+
+    i2c_sched_stats_t stats;
+    i2c_sched_get_stats(&stats, false);
+    CHECK(stats.classes[cls].grants == 1);
+    CHECK(stats.classes[cls].timeouts == 0);
+    CHECK(stats.classes[cls].wait_max_us == (max_wait_ms - 1) * 1000);
+    CHECK(stats.classes[other].busy_max_us == (max_wait_ms - 1) * 1000);
+}
+
+int main(void) {
+    CHECK(i2c_sched_init() == ESP_OK);
+    check_class_order();
+    check_wait_limit(I2C_SCHED_CONTROL, I2C_SCHED_TELEMETRY, CONTROL_MAX_WAIT_MS);
+    check_wait_limit(I2C_SCHED_TELEMETRY, I2C_SCHED_CONTROL, TELEMETRY_MAX_WAIT_MS);
+    check_grant_before_limit(I2C_SCHED_CONTROL, I2C_SCHED_TELEMETRY, CONTROL_MAX_WAIT_MS);
+    check_grant_before_limit(I2C_SCHED_TELEMETRY, I2C_SCHED_CONTROL, TELEMETRY_MAX_WAIT_MS);
+    return host_test_result("i2c_sched");
+}
@@ -0,0 +1,144 @@
+#include <inttypes.h>
+#include <limits.h>
+#include <pthread.h>
+#include <sched.h>
+#include <stdatomic.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include "host_test.h"
+#include "key_ring.h"
+
+#define FLOOD_EVENTS 200000
+
+static key_event_t make_event(uint32_t key) {
+    key_event_t event = {.key = key, .pressed = (key & 1) == 0};
+    return event;
+}
+
+static void check_fifo() {
+    static key_ring_t ring;
+    key_ring_init(&ring);
+    for (uint32_t key = 0; key < 10; key++) {
+        key_event_t event = make_event(key);
+        CHECK(key_ring_push(&ring, &event));
+    }
+    CHECK(key_ring_count(&ring) == 10);
+
+    key_event_t out[4];
+    uint32_t expected = 0;
+    size_t count;
+    while ((count = key_ring_pop_batch(&ring, out, 4)) > 0) {
+        CHECK(count <= 4);
+        for (size_t i = 0; i < count; i++, expected++) {
+            CHECK(out[i].key == expected);
+        }
+    }
+    CHECK(expected == 10);
+    CHECK(key_ring_count(&ring) == 0);
+    CHECK(key_ring_dropped(&ring) == 0);
+}
+
+// Presses stop KEY_RING_RELEASE_RESERVE slots early, releases may fill the ring
+static void check_release_reserve() {
+    static key_ring_t ring;
+    key_ring_init(&ring);
+    key_event_t press = {.key = 1, .pressed = true};
+    key_event_t release = {.key = 1, .pressed = false};
+
+    for (size_t i = 0; i < KEY_RING_SIZE - KEY_RING_RELEASE_RESERVE; i++) {
+        CHECK(key_ring_push(&ring, &press));
+    }
+    CHECK(!key_ring_push(&ring, &press));
+    for (size_t i = 0; i < KEY_RING_RELEASE_RESERVE; i++) {
+        CHECK(key_ring_push(&ring, &release));
+    }
+    CHECK(!key_ring_push(&ring, &release));
+    CHECK(key_ring_count(&ring) == KEY_RING_SIZE);
+    CHECK(key_ring_dropped(&ring) == 2);
+
+    key_event_t out[KEY_RING_SIZE];
+    CHECK(key_ring_pop_batch(&ring, out, KEY_RING_SIZE) == KEY_RING_SIZE);
+    CHECK(out[KEY_RING_SIZE - 1].pressed == false);
+    CHECK(key_ring_push(&ring, &press));
+}
+
+// The indices run freely and wrap at UINT_MAX
+static void check_index_wrap() {
+    static key_ring_t ring;
+    key_ring_init(&ring);
+    atomic_store(&ring.head, UINT_MAX - 5);
+    atomic_store(&ring.tail, UINT_MAX - 5);
+    for (uint32_t key = 0; key < 20; key++) {
+        key_event_t event = make_event(key);
+        CHECK(key_ring_push(&ring, &event));
+    }
+    CHECK(key_ring_count(&ring) == 20);
+    key_event_t out[32];
+    CHECK(key_ring_pop_batch(&ring, out, 32) == 20);
+    for (uint32_t key = 0; key < 20; key++) {
+        CHECK(out[key].key == key);
+    }
+}
+
+typedef struct {
+    key_ring_t ring;
+    atomic_bool done;
+} flood_t;
+
+static void* flood_producer(void* arg) {
+    flood_t* flood = arg;
+    for (uint32_t key = 0; key < FLOOD_EVENTS; key++) {
+        key_event_t event = make_event(key);
+        key_ring_push(&flood->ring, &event);
+        if (key % 1024 == 0) {
+            sched_yield();
+        }
+    }
+    atomic_store(&flood->done, true);
+    return NULL;
+}
+
+// One producer thread against one consumer, like the coprocessor callback and the keypad indev. Every event has to
+// arrive in order or be counted as dropped.
+static void check_flood() {
+    static flood_t flood;
+    key_ring_init(&flood.ring);
+    atomic_init(&flood.done, false);
+    pthread_t producer;
+    CHECK(pthread_create(&producer, NULL, flood_producer, &flood) == 0);
+
+    key_event_t batch[16];
+    uint32_t expected = 0;
+    uint32_t received = 0;
+    uint32_t gaps = 0;
+    bool in_order = true;
+    while (true) {
+        bool done = atomic_load(&flood.done);
+        size_t count = key_ring_pop_batch(&flood.ring, batch, sizeof(batch) / sizeof(batch[0]));
+        for (size_t i = 0; i < count; i++) {
+            in_order &= batch[i].key >= expected && batch[i].pressed == ((batch[i].key & 1) == 0);
+            gaps += batch[i].key - expected;
+            expected = batch[i].key + 1;
+        }
+        received += count;
+        if (count == 0 && done) {
+            break;
+        }
+    }
+    pthread_join(producer, NULL);
+    gaps += FLOOD_EVENTS - expected;
+
+    uint32_t dropped = key_ring_dropped(&flood.ring);
+    printf("flood: %" PRIu32 " received, %" PRIu32 " dropped\n", received, dropped);
+    CHECK(in_order);
+    CHECK(received + dropped == FLOOD_EVENTS);
+    CHECK(gaps == dropped);
+}
+
+int main(void) {
+    check_fifo();
+    check_release_reserve();
+    check_index_wrap();
+    check_flood();
+    return host_test_result("key_ring");
+}
@@ -0,0 +1,214 @@
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+#include "host_test.h"
+#include "keymap.h"
+#include "lvgl.h"
+#include "tanmatsu_coprocessor.h"
+
+#define MAX_EVENTS 16
+
+typedef struct {
+    uint8_t pressed;
+    uint32_t key;
+} emitted_t;
+
+static emitted_t events[MAX_EVENTS];
+static size_t event_count = 0;
+static keymap_state_t state;
+
+static void record(uint8_t pressed, uint32_t key) {
+    if (event_count < MAX_EVENTS) {
+        events[event_count] = (emitted_t){pressed, key};
+    }
+    event_count++;
+}
+
+// Decodes one step and checks that it emitted exactly the given event, or nothing when expect_event is false
+static bool decode_one(const tanmatsu_coprocessor_keys_t* prev, const tanmatsu_coprocessor_keys_t* keys,
+                       bool expect_event, uint8_t pressed, uint32_t key) {
+    event_count = 0;
+    keymap_decode(&state, prev, keys, record);
+    if (!expect_event) {
+        return event_count == 0;
+    }
+    return event_count == 1 && events[0].pressed == pressed && events[0].key == key;
+}
+
+static tanmatsu_coprocessor_keys_t combine(tanmatsu_coprocessor_keys_t a, tanmatsu_coprocessor_keys_t b) {
+    for (size_t i = 0; i < sizeof(a.raw); i++) {
+        a.raw[i] |= b.raw[i];
+    }
+    return a;
+}
+
+typedef struct {
+    const char* name;
+    tanmatsu_coprocessor_keys_t keys;  // Only this key held
+    bool modifier;
+    uint32_t normal;
+    uint32_t shift;
+    uint32_t fn;
+} key_case_t;
+
+// Every field of the bitmap by name with its expected codes, independent of the order of the table in keymap.c
+#define KEY(field, modifier, normal, shift, fn) {#field, {.field = 1}, modifier, normal, shift, fn}
+
+int main(void) {
+    const key_case_t cases[] = {
+        KEY(key_esc, false, LV_KEY_ESC, LV_KEY_ESC, LV_KEY_ESC),
+        KEY(key_f1, false, KEYMAP_KEY_F1, KEYMAP_KEY_F1, KEYMAP_KEY_F1),
+        KEY(key_f2, false, KEYMAP_KEY_F2, KEYMAP_KEY_F2, KEYMAP_KEY_F2),
+        KEY(key_f3, false, KEYMAP_KEY_F3, KEYMAP_KEY_F3, KEYMAP_KEY_F3),
+        KEY(key_tilde, false, '`', '~', '`'),
+        KEY(key_1, false, '1', '!', '1'),
+        KEY(key_2, false, '2', '@', '2'),
+        KEY(key_3, false, '3', '#', '3'),
+        KEY(key_tab, false, LV_KEY_NEXT, LV_KEY_PREV, LV_KEY_NEXT),
+        KEY(key_q, false, 'q', 'Q', 'q'),
+        KEY(key_w, false, 'w', 'W', 'w'),
+        KEY(key_e, false, 'e', 'E', 'e'),
+        KEY(key_fn, true, 0, 0, 0),
+        KEY(key_a, false, 'a', 'A', 'a'),
+        KEY(key_s, false, 's', 'S', 's'),
+        KEY(key_d, false, 'd', 'D', 'd'),
+        KEY(key_shift_l, true, 0, 0, 0),
+        KEY(key_z, false, 'z', 'Z', 'z'),
+        KEY(key_x, false, 'x', 'X', 'x'),
+        KEY(key_c, false, 'c', 'C', 'c'),
+        KEY(key_ctrl, true, 0, 0, 0),
+        KEY(key_meta, true, 0, 0, 0),
+        KEY(key_alt_l, true, 0, 0, 0),
+        KEY(key_backslash, false, '\\', '|', '\\'),
+        KEY(key_4, false, '4', '$', '4'),
+        KEY(key_5, false, '5', '%', '5'),
+        KEY(key_6, false, '6', '^', '6'),
+        KEY(key_7, false, '7', '&', '7'),
+        KEY(key_r, false, 'r', 'R', 'r'),
+        KEY(key_t, false, 't', 'T', 't'),
+        KEY(key_y, false, 'y', 'Y', 'y'),
+        KEY(key_u, false, 'u', 'U', 'u'),
+        KEY(key_f, false, 'f', 'F', 'f'),
+        KEY(key_g, false, 'g', 'G', 'g'),
+        KEY(key_h, false, 'h', 'H', 'h'),
+        KEY(key_j, false, 'j', 'J', 'j'),
+        KEY(key_v, false, 'v', 'V', 'v'),
+        KEY(key_b, false, 'b', 'B', 'b'),
+        KEY(key_n, false, 'n', 'N', 'n'),
+        KEY(key_m, false, 'm', 'M', 'm'),
+        KEY(key_f4, false, KEYMAP_KEY_F4, KEYMAP_KEY_F4, KEYMAP_KEY_F4),
+        KEY(key_f5, false, KEYMAP_KEY_F5, KEYMAP_KEY_F5, KEYMAP_KEY_F5),
+        KEY(key_f6, false, KEYMAP_KEY_F6, KEYMAP_KEY_F6, KEYMAP_KEY_F6),
+        KEY(key_backspace, false, LV_KEY_BACKSPACE, LV_KEY_BACKSPACE, LV_KEY_DEL),
+        KEY(key_9, false, '9', '(', '9'),
+        KEY(key_0, false, '0', ')', '0'),
+        KEY(key_minus, false, '-', '_', '-'),
+        KEY(key_equals, false, '=', '+', '='),
+        KEY(key_o, false, 'o', 'O', 'o'),
+        KEY(key_p, false, 'p', 'P', 'p'),
+        KEY(key_sqbracket_open, false, '[', '{', '['),
+        KEY(key_sqbracket_close, false, ']', '}', ']'),
+        KEY(key_l, false, 'l', 'L', 'l'),
+        KEY(key_semicolon, false, ';', ':', ';'),
+        KEY(key_quote, false, '\'', '"', '\''),
+        KEY(key_return, false, LV_KEY_ENTER, LV_KEY_ENTER, LV_KEY_ENTER),
+        KEY(key_dot, false, '.', '>', '.'),
+        KEY(key_slash, false, '/', '?', '/'),
+        KEY(key_up, false, LV_KEY_UP, LV_KEY_UP, LV_KEY_PREV),
+        KEY(key_shift_r, true, 0, 0, 0),
+        KEY(key_alt_r, true, 0, 0, 0),
+        KEY(key_left, false, LV_KEY_LEFT, LV_KEY_LEFT, LV_KEY_HOME),
+        KEY(key_down, false, LV_KEY_DOWN, LV_KEY_DOWN, LV_KEY_NEXT),
+        KEY(key_right, false, LV_KEY_RIGHT, LV_KEY_RIGHT, LV_KEY_END),
+        KEY(key_8, false, '8', '*', '8'),
+        KEY(key_i, false, 'i', 'I', 'i'),
+        KEY(key_k, false, 'k', 'K', 'k'),
+        KEY(key_comma, false, ',', '<', ','),
+        KEY(key_space_l, false, ' ', ' ', ' '),
+        KEY(key_space_m, false, ' ', ' ', ' '),
+        KEY(key_space_r, false, ' ', ' ', ' '),
+        KEY(key_volume_up, false, KEYMAP_KEY_VOLUME_UP, KEYMAP_KEY_VOLUME_UP, KEYMAP_KEY_VOLUME_UP),
+    };
+    const size_t count = sizeof(cases) / sizeof(cases[0]);
+    const tanmatsu_coprocessor_keys_t none = {0};
+    const tanmatsu_coprocessor_keys_t shift = {.key_shift_l = 1};
+    const tanmatsu_coprocessor_keys_t fn = {.key_fn = 1};
+    keymap_init(&state);
+
+    // The cases cover every bit of the bitmap exactly once
+    CHECK(count == KEYMAP_BITS);
+    tanmatsu_coprocessor_keys_t all = none;
+    size_t bits = 0;
+    for (size_t i = 0; i < count; i++) {
+        for (size_t byte = 0; byte < sizeof(all.raw); byte++) {
+            bits += __builtin_popcount(cases[i].keys.raw[byte]);
+        }
+        all = combine(all, cases[i].keys);
+    }
+    CHECK(bits == KEYMAP_BITS);
+    for (size_t byte = 0; byte < sizeof(all.raw); byte++) {
+        CHECK(all.raw[byte] == 0xFF);
+    }
+
+    for (size_t i = 0; i < count; i++) {
+        const key_case_t* c = &cases[i];
+        bool ok = true;
+        if (c->modifier) {
+            ok &= decode_one(&none, &c->keys, false, 0, 0);
+            ok &= decode_one(&c->keys, &none, false, 0, 0);
+        } else {
+            ok &= decode_one(&none, &c->keys, true, 1, c->normal);
+            ok &= decode_one(&c->keys, &none, true, 0, c->normal);
+
+            tanmatsu_coprocessor_keys_t shifted = combine(shift, c->keys);
+            ok &= decode_one(&shift, &shifted, true, 1, c->shift);
+            // Shift goes up first, the release still reports the shifted code
+            ok &= decode_one(&shifted, &c->keys, false, 0, 0);
+            ok &= decode_one(&c->keys, &none, true, 0, c->shift);
+
+            tanmatsu_coprocessor_keys_t with_fn = combine(fn, c->keys);
+            ok &= decode_one(&fn, &with_fn, true, 1, c->fn);
+            ok &= decode_one(&with_fn, &fn, true, 0, c->fn);
+
+            // Fn takes precedence over shift
+            tanmatsu_coprocessor_keys_t both = combine(combine(fn, shift), c->keys);
+            ok &= decode_one(&none, &both, true, 1, c->fn);
+            ok &= decode_one(&both, &none, true, 0, c->fn);
+        }
+        if (!ok) {
+            fprintf(stderr, "%s decoded wrong\n", c->name);
+        }
+        CHECK(ok);
+    }
+
+    // Several keys changing in one step are all reported, in bit order
+    tanmatsu_coprocessor_keys_t chord = {.key_a = 1, .key_s = 1, .key_volume_up = 1};
+    event_count = 0;
+    keymap_decode(&state, &none, &chord, record);
+    CHECK(event_count == 3);
+    CHECK(events[0].key == 'a' && events[1].key == 's' && events[2].key == KEYMAP_KEY_VOLUME_UP);
+
+    // A modifier pressed in the same step as a key applies to it, wherever its bit is
+    tanmatsu_coprocessor_keys_t shift_r_a = {.key_shift_r = 1, .key_a = 1};
+    CHECK(decode_one(&none, &shift_r_a, true, 1, 'A'));
+    // Releasing one shift key while the other is held keeps the shift layer
+    tanmatsu_coprocessor_keys_t both_shifts = {.key_shift_l = 1, .key_shift_r = 1, .key_a = 1};
+    tanmatsu_coprocessor_keys_t shift_l_a = {.key_shift_l = 1, .key_a = 1};
+    tanmatsu_coprocessor_keys_t shift_l_a_b = {.key_shift_l = 1, .key_a = 1, .key_b = 1};
+    CHECK(decode_one(&shift_r_a, &both_shifts, false, 0, 0));
+    CHECK(decode_one(&both_shifts, &shift_l_a, false, 0, 0));
+    CHECK(decode_one(&shift_l_a, &shift_l_a_b, true, 1, 'B'));
+    CHECK(decode_one(&shift_l_a_b, &shift_l_a, true, 0, 'B'));
+
+    // Another source decoding with its own state does not change the codes this one releases with
+    keymap_state_t other;
+    keymap_init(&other);
+    tanmatsu_coprocessor_keys_t a = {.key_a = 1};
+    event_count = 0;
+    keymap_decode(&other, &none, &a, record);
+    keymap_decode(&other, &a, &none, record);
+    CHECK(event_count == 2 && events[0].key == 'a' && events[1].key == 'a');
+    CHECK(decode_one(&shift_l_a, &none, true, 0, 'A'));
+
+    return host_test_result("keymap");
+}
@@ -0,0 +1,91 @@
+#include <stdbool.h>
+#include <stdint.h>
+#include "host_test.h"
+#include "latency.h"
+
+// Upper bound of the bucket us falls into. A second, larger sample keeps the percentile from being clamped to max_us.
+static uint32_t bucket_bound(uint32_t us) {
+    static latency_histogram_t histogram;
+    latency_histogram_reset(&histogram);
+    latency_histogram_add(&histogram, us);
+    latency_histogram_add(&histogram, UINT32_MAX);
+    return latency_histogram_percentile(&histogram, 500);
+}
+
+// Every value up to 2^LATENCY_MAX_EXPONENT us lands in a bucket at most 1/8 wider than the value, and only larger
+// values land in the last bucket
+static void check_buckets() {
+    uint32_t limit = 1u << LATENCY_MAX_EXPONENT;
+    bool exact = true;
+    bool bounded = true;
+    for (uint32_t us = 0; us < limit; us += us < 4096 ? 1 : 37) {
+        uint32_t bound = bucket_bound(us);
+        exact &= us >= 16 || bound == us;
+        bounded &= bound >= us && bound - us <= us / 8;
+    }
+    CHECK(exact);
+    CHECK(bounded);
+    CHECK(bucket_bound(limit - 1) == limit - 1);
+    CHECK(bucket_bound(limit) == UINT32_MAX);
+
+    static latency_histogram_t histogram;
+    latency_histogram_reset(&histogram);
+    latency_histogram_add(&histogram, limit - 1);
+    CHECK(histogram.counts[LATENCY_BUCKETS - 1] == 0);
+    latency_histogram_add(&histogram, limit);
+    latency_histogram_add(&histogram, UINT32_MAX);
+    CHECK(histogram.counts[LATENCY_BUCKETS - 1] == 2);
+}
+
+static void check_percentiles() {
+    static latency_histogram_t histogram;
+    latency_histogram_reset(&histogram);
+    CHECK(latency_histogram_percentile(&histogram, 500) == 0);
+    for (uint32_t us = 1; us <= 1000; us++) {
+        latency_histogram_add(&histogram, us);
+    }
+    CHECK(histogram.total == 1000);
+    CHECK(histogram.min_us == 1 && histogram.max_us == 1000);
+    uint32_t p50 = latency_histogram_percentile(&histogram, 500);
+    uint32_t p99 = latency_histogram_percentile(&histogram, 990);
+    CHECK(p50 >= 500 && p50 <= 500 + 500 / 8);
+    CHECK(p99 >= 990 && p99 <= 1000);
+    CHECK(latency_histogram_percentile(&histogram, 1000) == 1000);
+}
+
+// Events read before a flush are completed by it, a flush after LATENCY_FLUSH_TIMEOUT_US only counts them. The clock
+// wraps in the middle.
+static void check_tracker() {
+    static latency_tracker_t tracker;
+    latency_tracker_reset(&tracker);
+    uint32_t base = UINT32_MAX - 1000;
+    latency_stamp_t stamp = {.irq_us = base, .callback_us = base + 100};
+    latency_tracker_read(&tracker, &stamp, base + 300);
+    latency_tracker_read(&tracker, &stamp, base + 400);
+    CHECK(latency_tracker_pending(&tracker));
+    latency_tracker_flush(&tracker, base + 5000);
+    CHECK(!latency_tracker_pending(&tracker));
+
+    const latency_histogram_t* irq_to_flush = &tracker.spans[LATENCY_IRQ_TO_FLUSH];
+    CHECK(tracker.spans[LATENCY_IRQ_TO_CALLBACK].max_us == 100);
+    CHECK(tracker.spans[LATENCY_CALLBACK_TO_READ].min_us == 200);
+    CHECK(tracker.spans[LATENCY_READ_TO_FLUSH].max_us == 4700);
+    CHECK(irq_to_flush->total == 2 && irq_to_flush->min_us == 5000);
+
+    latency_tracker_read(&tracker, &stamp, base + 6000);
+    latency_tracker_flush(&tracker, base + 6000 + LATENCY_FLUSH_TIMEOUT_US + 1);
+    CHECK(tracker.without_flush == 1);
+    CHECK(irq_to_flush->total == 2);
+
+    for (int i = 0; i < LATENCY_MAX_PENDING + 3; i++) {
+        latency_tracker_read(&tracker, &stamp, base + 7000);
+    }
+    CHECK(tracker.untracked == 3);
+}
+
+int main(void) {
+    check_buckets();
+    check_percentiles();
+    check_tracker();
+    return host_test_result("latency");
+}
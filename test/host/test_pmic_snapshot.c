@@ -0,0 +1,105 @@
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <string.h>
+#include "fake_coprocessor.h"
+#include "host_test.h"
+#include "pmic_snapshot.h"
+
+// Bus speed and per-transaction overhead the check models, the overhead is in the range the ESP-IDF I2C master
+// driver shows for short transactions
+#define BUS_HZ      400000
+#define OVERHEAD_US 60
+#define ITERATIONS  1000
+
+static uint32_t next_random(uint32_t* seed) {
+    *seed = *seed * 1664525u + 1013904223u;
+    return *seed;
+}
+
+static pmic_snapshot_t random_snapshot(uint32_t* seed) {
+    pmic_snapshot_t snapshot = {
+        .rtc = next_random(seed),
+        .comm_fault_last = next_random(seed) & 1,
+        .comm_fault_latch = next_random(seed) & 1,
+        .faults = next_random(seed) & 0x1FF,
+        .vbat_mv = next_random(seed) >> 16,
+        .vsys_mv = next_random(seed) >> 16,
+        .ts = next_random(seed) >> 16,
+        .vbus_mv = next_random(seed) >> 16,
+        .ichgr_ma = next_random(seed) >> 16,
+        .charging_disable_setting = next_random(seed) & 1,
+        .charging_speed = next_random(seed) & 3,
+        .battery_attached = next_random(seed) & 1,
+        .usb_attached = next_random(seed) & 1,
+        .charging_disabled = next_random(seed) & 1,
+        .charging_status = next_random(seed) & 3,
+    };
+    return snapshot;
+}
+
+// A record written by hand from the layout in pmic_snapshot.h, which tools/telemetry_log_to_csv.py and
+// tools/coproc_trace.py read as well
+static void check_record_layout() {
+    const uint8_t block[PMIC_SNAPSHOT_BLOCK_SIZE] = {
+        0x78, 0x56, 0x34, 0x12,  // RTC
+        0x02,                    // Latched communication fault
+        0x41, 0x01,              // Faults: watchdog, NTC cold, NTC boost
+        0x68, 0x10,              // VBAT 4200 mV
+        0xD2, 0x0F,              // VSYS 4050 mV
+        0x88, 0x13,              // TS 50.00 %
+        0x8C, 0x13,              // VBUS 5004 mV
+        0xF4, 0x01,              // ICHGR 500 mA
+        0x05,                    // Charging disabled, speed 2
+        0x1B,                    // Battery, USB, status 3
+    };
+
+    pmic_snapshot_t snapshot;
+    pmic_snapshot_decode(block, &snapshot);
+    CHECK(snapshot.rtc == 0x12345678);
+    CHECK(!snapshot.comm_fault_last && snapshot.comm_fault_latch);
+    CHECK(snapshot.faults == (PMIC_FAULT_WATCHDOG | PMIC_FAULT_NTC_COLD | PMIC_FAULT_NTC_BOOST));
+    CHECK(snapshot.vbat_mv == 4200 && snapshot.vsys_mv == 4050 && snapshot.ts == 5000);
+    CHECK(snapshot.vbus_mv == 5004 && snapshot.ichgr_ma == 500);
+    CHECK(snapshot.charging_disable_setting && snapshot.charging_speed == 2);
+    CHECK(snapshot.battery_attached && snapshot.usb_attached && !snapshot.charging_disabled);
+    CHECK(snapshot.charging_status == 3);
+
+    uint8_t encoded[PMIC_SNAPSHOT_BLOCK_SIZE];
+    pmic_snapshot_encode(&snapshot, encoded);
+    CHECK(memcmp(encoded, block, sizeof(block)) == 0);
+}
+
+// Random snapshots survive encoding and decoding
+static void check_round_trip() {
+    uint32_t seed = 0x9E3779B9;
+    bool same = true;
+    for (int i = 0; i < ITERATIONS; i++) {
+        pmic_snapshot_t expected = random_snapshot(&seed);
+        uint8_t block[PMIC_SNAPSHOT_BLOCK_SIZE];
+        pmic_snapshot_encode(&expected, block);
+        pmic_snapshot_t decoded;
+        pmic_snapshot_decode(block, &decoded);
+        same &= pmic_snapshot_equal(&expected, &decoded);
+        same &= expected.vbat_mv == decoded.vbat_mv && expected.rtc == decoded.rtc &&
+                expected.charging_status == decoded.charging_status;
+    }
+    CHECK(same);
+}
+
+// A read past the register file fails instead of returning stale data
+static void check_out_of_range() {
+    static fake_coprocessor_t fake;
+    fake_coprocessor_init(&fake, BUS_HZ, OVERHEAD_US);
+    uint8_t data[8];
+    CHECK(fake_coprocessor_read(&fake, 0xFC, data, 4));
+    CHECK(!fake_coprocessor_read(&fake, 0xFD, data, 4));
+    CHECK(fake.transactions == 1);
+}
+
+int main(void) {
+    check_record_layout();
+    check_round_trip();
+    check_out_of_range();
+    return host_test_result("pmic_snapshot");
+}
@@ -0,0 +1,133 @@
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+#include "host_test.h"
+#include "rotate_rgb565.h"
+
+#define GUARD 0xDEAD  // Fill of the destination, pixels the rotation must not touch keep it
+
+// The RGB565 loops of lv_draw_sw_rotate() from LVGL 9.2 (src/draw/sw/lv_draw_sw.c, MIT licensed), copied without
+// the LV_DRAW_SW_ROTATE*_RGB565 hooks, which LVGL's software renderer leaves unset. LVGL names its loops by the
+// direction they turn the buffer, so LV_DISPLAY_ROTATION_90 runs rotate270_rgb565() and the other way around. The
+// 180 degree loop writes with the source stride, which is also the destination stride there.
+static void rotate90_rgb565(const uint16_t* src, uint16_t* dst, int32_t srcWidth, int32_t srcHeight, int32_t srcStride,
+                            int32_t dstStride) {
+    srcStride /= sizeof(uint16_t);
+    dstStride /= sizeof(uint16_t);
+
+    for (int32_t x = 0; x < srcWidth; ++x) {
+        int32_t dstIndex = x * dstStride;
+        int32_t srcIndex = x;
+        for (int32_t y = 0; y < srcHeight; ++y) {
+            dst[dstIndex + (srcHeight - y - 1)] = src[srcIndex];
+            srcIndex += srcStride;
+        }
+    }
+}
+
+static void rotate180_rgb565(const uint16_t* src, uint16_t* dst, int32_t width, int32_t height, int32_t src_stride,
+                             int32_t dest_stride) {
+    (void)dest_stride;
+    src_stride /= sizeof(uint16_t);
+
+    for (int y = 0; y < height; ++y) {
+        int dstIndex = (height - y - 1) * src_stride;
+        int srcIndex = y * src_stride;
+        for (int x = 0; x < width; ++x) {
+            dst[dstIndex + width - x - 1] = src[srcIndex + x];
+        }
+    }
+}
+
+static void rotate270_rgb565(const uint16_t* src, uint16_t* dst, int32_t srcWidth, int32_t srcHeight,
+                             int32_t srcStride, int32_t dstStride) {
+    srcStride /= sizeof(uint16_t);
+    dstStride /= sizeof(uint16_t);
+
+    for (int32_t x = 0; x < srcWidth; ++x) {
+        int32_t dstIndex = (srcWidth - x - 1);
+        int32_t srcIndex = x;
+        for (int32_t y = 0; y < srcHeight; ++y) {
+            dst[dstIndex * dstStride + y] = src[srcIndex];
+            srcIndex += srcStride;
+        }
+    }
+}
+
+// lv_draw_sw_rotate() for RGB565. It leaves the buffer alone at LV_DISPLAY_ROTATION_0, where lvgl_flush_prepare()
+// copies the rows instead.
+static void lv_draw_sw_rotate_rgb565(const void* src, void* dest, int32_t src_width, int32_t src_height,
+                                     int32_t src_stride, int32_t dest_stride, lv_display_rotation_t rotation) {
+    switch (rotation) {
+        case LV_DISPLAY_ROTATION_90:
+            rotate270_rgb565(src, dest, src_width, src_height, src_stride, dest_stride);
+            break;
+        case LV_DISPLAY_ROTATION_180:
+            rotate180_rgb565(src, dest, src_width, src_height, src_stride, dest_stride);
+            break;
+        case LV_DISPLAY_ROTATION_270:
+            rotate90_rgb565(src, dest, src_width, src_height, src_stride, dest_stride);
+            break;
+        default:
+            for (int32_t y = 0; y < src_height; y++) {
+                memcpy((uint8_t*)dest + y * dest_stride, (const uint8_t*)src + y * src_stride,
+                       src_width * sizeof(uint16_t));
+            }
+            break;
+    }
+}
+
+// Rotates with the given padding after each row and offset of the buffers in pixels. Odd values keep the rows off
+// word boundaries and so test the scalar loops, even values the paired ones.
+static void check_rotation(int32_t width, int32_t height, int32_t padding, int32_t offset,
+                           lv_display_rotation_t rotation) {
+    bool transposed = rotation == LV_DISPLAY_ROTATION_90 || rotation == LV_DISPLAY_ROTATION_270;
+    int32_t ss = width + padding;
+    int32_t ds = (transposed ? height : width) + padding;
+    int32_t dst_rows = transposed ? width : height;
+    size_t src_count = offset + height * ss;
+    size_t dst_count = offset + dst_rows * ds;
+
+    uint16_t* src = malloc(src_count * sizeof(uint16_t));
+    uint16_t* out = malloc(dst_count * sizeof(uint16_t));
+    uint16_t* ref = malloc(dst_count * sizeof(uint16_t));
+    for (size_t i = 0; i < src_count; i++) {
+        src[i] = (uint16_t)(i * 2654435761u >> 16);
+    }
+    for (size_t i = 0; i < dst_count; i++) {
+        out[i] = GUARD;
+        ref[i] = GUARD;
+    }
+
+    lv_draw_sw_rotate_rgb565(src + offset, ref + offset, width, height, ss * (int32_t)sizeof(uint16_t),
+                             ds * (int32_t)sizeof(uint16_t), rotation);
+    rotate_rgb565(src + offset, out + offset, width, height, ss * (int32_t)sizeof(uint16_t),
+                  ds * (int32_t)sizeof(uint16_t), rotation);
+
+    bool same = memcmp(out, ref, dst_count * sizeof(uint16_t)) == 0;
+    if (!same) {
+        fprintf(stderr, "%dx%d, padding %d, offset %d, rotation %d:\n", (int)width, (int)height, (int)padding,
+                (int)offset, rotation * 90);
+    }
+    CHECK(same);
+    free(src);
+    free(out);
+    free(ref);
+}
+
+int main(void) {
+    static const int32_t sizes[][2] = {
+        {1, 1}, {2, 2}, {3, 7}, {31, 17}, {32, 32}, {33, 65}, {64, 10}, {100, 34}, {480, 48}, {480, 81},
+    };
+    for (size_t i = 0; i < sizeof(sizes) / sizeof(sizes[0]); i++) {
+        for (int32_t padding = 0; padding <= 3; padding++) {
+            for (int32_t offset = 0; offset <= 1; offset++) {
+                for (int rotation = LV_DISPLAY_ROTATION_0; rotation <= LV_DISPLAY_ROTATION_270; rotation++) {
+                    check_rotation(sizes[i][0], sizes[i][1], padding, offset, (lv_display_rotation_t)rotation);
+                }
+            }
+        }
+    }
+    return host_test_result("rotate_rgb565");
+}
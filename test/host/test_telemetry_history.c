@@ -0,0 +1,154 @@
+#include <inttypes.h>
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "host_test.h"
+#include "telemetry_history.h"
+
+// The size and period main.c uses
+#define HISTORY_SIZE     8192
+#define HISTORY_PERIOD_S 30
+
+typedef struct {
+    const telemetry_history_sample_t* expected;
+    size_t next;
+    bool same;
+} history_check_t;
+
+static void check_sample(void* ctx, const telemetry_history_sample_t* sample) {
+    history_check_t* check = ctx;
+    check->same &= memcmp(sample, &check->expected[check->next], sizeof(*sample)) == 0;
+    check->next++;
+}
+
+// Whether the history holds exactly the newest history->samples of the count samples
+static bool holds_newest(const telemetry_history_t* history, const telemetry_history_sample_t* samples, size_t count) {
+    if (history->samples > count) {
+        return false;
+    }
+    history_check_t check = {.expected = &samples[count - history->samples], .same = true};
+    telemetry_history_for_each(history, check_sample, &check);
+    return check.same && check.next == history->samples;
+}
+
+static uint32_t next_random(uint32_t* seed) {
+    *seed = *seed * 1664525u + 1013904223u;
+    return *seed;
+}
+
+// A day of battery telemetry: discharge from 4.2 V to 3.5 V with a few mV of noise, with USB and charging current for
+// two hours in between
+static void check_synthetic_day() {
+    size_t total = 24 * 3600 / HISTORY_PERIOD_S;
+    telemetry_history_sample_t* samples = malloc(total * sizeof(*samples));
+    static uint8_t storage[HISTORY_SIZE];
+    uint32_t seed = 0x9E3779B9;
+    for (size_t i = 0; i < total; i++) {
+        bool usb = i * HISTORY_PERIOD_S >= 10 * 3600 && i * HISTORY_PERIOD_S < 12 * 3600;
+        uint16_t vbat = 4200 - (uint32_t)(700 * i / total) + next_random(&seed) % 7 - 3;
+        samples[i] = (telemetry_history_sample_t){
+            .time_s = 1700000000 + i * HISTORY_PERIOD_S,
+            .values = {
+                [TELEMETRY_HISTORY_VBAT] = vbat,
+                [TELEMETRY_HISTORY_VSYS] = usb ? 4400 + next_random(&seed) % 5 : (uint16_t)(vbat - 40),
+                [TELEMETRY_HISTORY_VBUS] = usb ? 5000 + next_random(&seed) % 21 - 10 : 0,
+                [TELEMETRY_HISTORY_ICHGR] = usb ? 1000 + next_random(&seed) % 41 - 20 : 0,
+            },
+        };
+    }
+
+    telemetry_history_t history;
+    telemetry_history_init(&history, storage, sizeof(storage));
+    for (size_t i = 0; i < total; i++) {
+        telemetry_history_append(&history, &samples[i]);
+    }
+    CHECK(holds_newest(&history, samples, total));
+    CHECK(history.used == history.block_count);
+
+    // The header promises more than 11 hours in 8 KiB
+    double hours = (double)history.samples * HISTORY_PERIOD_S / 3600;
+    double bytes_per_hour = telemetry_history_bytes_used(&history) / hours;
+    printf("Telemetry history of %u bytes at %u s per sample: %" PRIu32 " samples, %.1f hours, %.0f bytes per hour\n",
+           (unsigned)sizeof(storage), HISTORY_PERIOD_S, history.samples, hours, bytes_per_hour);
+    CHECK(hours > 11);
+    CHECK(bytes_per_hour < 750);
+    free(samples);
+}
+
+// A time that goes backwards or jumps by more than the largest time step starts a new block with the full sample
+static void check_time_discontinuities() {
+    static uint8_t storage[4 * TELEMETRY_HISTORY_BLOCK_SIZE];
+    telemetry_history_t history;
+    telemetry_history_init(&history, storage, sizeof(storage));
+    const telemetry_history_sample_t samples[] = {
+        {.time_s = 1000, .values = {4000, 3960, 0, 0}},
+        {.time_s = 1030, .values = {4001, 3961, 0, 0}},
+        {.time_s = 500, .values = {3999, 3959, 0, 0}},
+        {.time_s = 500 + 0x10000, .values = {3998, 3958, 5000, 900}},
+        {.time_s = 530 + 0x10000, .values = {3998, 3958, 5001, 901}},
+    };
+    size_t count = sizeof(samples) / sizeof(samples[0]);
+    for (size_t i = 0; i < count; i++) {
+        telemetry_history_append(&history, &samples[i]);
+    }
+    CHECK(history.used == 3);
+    CHECK(history.samples == count);
+    CHECK(holds_newest(&history, samples, count));
+}
+
+// Once every block is in use the oldest one is dropped with its samples
+static void check_wraparound() {
+    static uint8_t storage[3 * TELEMETRY_HISTORY_BLOCK_SIZE + 10];
+    static telemetry_history_sample_t samples[1000];
+    telemetry_history_t history;
+    telemetry_history_init(&history, storage, sizeof(storage));
+    CHECK(history.block_count == 3);
+
+    uint32_t seed = 1;
+    size_t first_drop = 0;
+    for (size_t i = 0; i < sizeof(samples) / sizeof(samples[0]); i++) {
+        samples[i] = (telemetry_history_sample_t){
+            .time_s = 100 + i * 10,
+            .values = {3700 + next_random(&seed) % 200, 3650, 0, next_random(&seed) % 3},
+        };
+        uint32_t before = history.samples;
+        telemetry_history_append(&history, &samples[i]);
+        if (first_drop == 0 && history.samples <= before) {
+            first_drop = i;
+        }
+        CHECK(history.used <= history.block_count);
+    }
+    CHECK(first_drop > 0);
+    CHECK(history.used == 3);
+    CHECK(history.samples < first_drop);
+    CHECK(holds_newest(&history, samples, sizeof(samples) / sizeof(samples[0])));
+}
+
+static void count_sample(void* ctx, const telemetry_history_sample_t* sample) {
+    (void)sample;
+    (*(size_t*)ctx)++;
+}
+
+// Without storage appends do nothing
+static void check_no_storage() {
+    telemetry_history_t history;
+    telemetry_history_init(&history, NULL, 0);
+    telemetry_history_sample_t sample = {.time_s = 1, .values = {4000, 3960, 0, 0}};
+    telemetry_history_append(&history, &sample);
+    size_t visited = 0;
+    telemetry_history_for_each(&history, count_sample, &visited);
+    CHECK(history.samples == 0);
+    CHECK(visited == 0);
+    CHECK(telemetry_history_bytes_used(&history) == 0);
+}
+
+int main(void) {
+    check_synthetic_day();
+    check_time_discontinuities();
+    check_wraparound();
+    check_no_storage();
+    return host_test_result("telemetry_history");
+}
@@ -0,0 +1,150 @@
+#!/usr/bin/env python3
+"""Collects the results of the benchmark suite and compares them against the stored baseline.
+
+The firmware prints every measurement of main/bench.c as a line "BENCH {json}". Run the suite in the simulator with
+make bench, or on a device over the console UART, which sends the 'b' serial command and waits for the run to end:
+
+    tools/bench_compare.py --port /dev/ttyACM0
+    tools/bench_compare.py console.log
+
+The results are written to bench/results-<target>.json and compared with bench/baseline-<target>.json. A benchmark
+whose median time per operation exceeds its baseline by more than the threshold, a benchmark missing from the run
+or from the baseline and a run that did not finish fail with exit status 1. --update stores the results as the new baseline instead.
+The threshold is --threshold percent, a baseline entry can override it with its own "threshold_percent".
+"""
+
+import argparse
+import json
+import os
+import sys
+import time
+
+PREFIX = "BENCH "
+BENCH_DIR = os.path.join(os.path.dirname(os.path.abspath(__file__)), "..", "bench")
+PORT_TIMEOUT_S = 300
+
+
+def parse_lines(lines):
+    """Returns the suite's begin and end records and the results by name, from the lines of a console capture"""
+    begin = end = None
+    results = {}
+    for line in lines:
+        index = line.find(PREFIX)
+        if index < 0:
+            continue
+        try:
+            record = json.loads(line[index + len(PREFIX) :])
+        except json.JSONDecodeError:
+            print(f"Unreadable benchmark line: {line.strip()}", file=sys.stderr)
+            continue
+        if record.get("event") == "begin":
+            begin, end, results = record, None, {}
+        elif record.get("event") == "end":
+            end = record
+        elif "name" in record:
+            name = record.pop("name")
+            results[name] = record
+    return begin, end, results
+
+
+def read_port(port):
+    import serial  # pyserial, part of the ESP-IDF Python environment
+
+    lines = []
+    with serial.Serial(port, 115200, timeout=1) as connection:
+        connection.reset_input_buffer()
+        connection.write(b"b")
+        deadline = time.monotonic() + PORT_TIMEOUT_S
+        while time.monotonic() < deadline:
+            line = connection.readline().decode("utf-8", "replace")
+            if not line:
+                continue
+            lines.append(line)
+            if PREFIX in line and '"event":"end"' in line:
+                break
+    return lines
+
+
+def compare(results, baseline, threshold):
+    """Prints one row per benchmark and returns the names of the failed ones"""
+    failed = []
+    print(f"{'benchmark':28} {'baseline':>12} {'result':>12} {'change':>8}")
+    for name, base in sorted(baseline.items()):
+        limit = base.get("threshold_percent", threshold)
+        if name not in results:
+            print(f"{name:28} {base['ns_per_op']:>10} ns {'missing':>12}")
+            failed.append(name)
+            continue
+        value = results[name]["ns_per_op"]
+        change = (value - base["ns_per_op"]) * 100 / max(base["ns_per_op"], 1)
+        verdict = ""
+        if change > limit:
+            verdict = f"  REGRESSION, limit +{limit}%"
+            failed.append(name)
+        print(f"{name:28} {base['ns_per_op']:>10} ns {value:>9} ns {change:>+7.1f}%{verdict}")
+    # A benchmark without a baseline is not gated, so the baseline has to be recorded again before it counts as passed
+    for name in sorted(set(results) - set(baseline)):
+        print(f"{name:28} {'no baseline':>12} {results[name]['ns_per_op']:>9} ns")
+        failed.append(name)
+    return failed
+
+
+def main():
+    parser = argparse.ArgumentParser(description=__doc__.splitlines()[0])
+    source = parser.add_mutually_exclusive_group(required=True)
+    source.add_argument("log", nargs="?", help="console output with the BENCH lines, - for stdin")
+    source.add_argument("--port", help="serial port of a device to run the suite on")
+    parser.add_argument("--threshold", type=float, default=10, help="allowed slowdown in percent (default 10)")
+    parser.add_argument("--bench-dir", default=BENCH_DIR, help="directory of the results and baselines")
+    parser.add_argument("--update", action="store_true", help="store the results as the baseline")
+    args = parser.parse_args()
+
+    if args.port:
+        lines = read_port(args.port)
+    elif args.log == "-":
+        lines = sys.stdin.readlines()
+    else:
+        with open(args.log, errors="replace") as file:
+            lines = file.readlines()
+
+    begin, end, results = parse_lines(lines)
+    if begin is None or end is None or end.get("results") != len(results):
+        print("The benchmark run did not complete", file=sys.stderr)
+        sys.exit(1)
+
+    target = begin["target"]
+    os.makedirs(args.bench_dir, exist_ok=True)
+    results_path = os.path.join(args.bench_dir, f"results-{target}.json")
+    baseline_path = os.path.join(args.bench_dir, f"baseline-{target}.json")
+    with open(results_path, "w") as file:
+        json.dump({"target": target, "idf": begin.get("idf"), "results": results}, file, indent=2, sort_keys=True)
+        file.write("\n")
+    print(f"Results of {len(results)} benchmarks written to {results_path}")
+
+    baseline = {}
+    if os.path.exists(baseline_path):
+        with open(baseline_path) as file:
+            baseline = json.load(file)["results"]
+
+    if args.update:
+        # Keep the thresholds set by hand
+        for name, result in results.items():
+            if "threshold_percent" in baseline.get(name, {}):
+                result["threshold_percent"] = baseline[name]["threshold_percent"]
+        with open(baseline_path, "w") as file:
+            json.dump({"target": target, "idf": begin.get("idf"), "results": results}, file, indent=2, sort_keys=True)
+            file.write("\n")
+        print(f"Baseline {baseline_path} updated")
+        return
+
+    if not baseline:
+        print(f"No baseline in {baseline_path}, record one with --update", file=sys.stderr)
+        sys.exit(1)
+    failed = compare(results, baseline, args.threshold)
+    if failed:
+        print(f"{len(failed)} benchmark(s) regressed or missing: {', '.join(failed)}", file=sys.stderr)
+        sys.exit(1)
+
+
+if __name__ == "__main__":
+    main()
@@ -0,0 +1,210 @@
+#!/usr/bin/env python3
+"""Dumps and compares coprocessor traces written by main/coproc_trace.c.
+
+A device saves its trace to /fat/TRACE.BIN with the serial command 'C', get it off the device like the telemetry log
+(see tools/telemetry_log_to_csv.py). The simulator saves one to the path in SIM_TRACE.
+
+    tools/coproc_trace.py dump TRACE.BIN          every record, one per line
+    tools/coproc_trace.py stats TRACE.BIN         call durations per operation and event counts
+    tools/coproc_trace.py compare A.BIN B.BIN     B against A: exits with 1 when the key and input events differ or
+                                                  the p99 duration of an operation grew by more than --threshold
+
+To compare two firmware versions, replay the same trace on both (make sim-replay, or 'y' on a device with 'c' and
+'C' around it) and compare the two recordings. The layout has to follow coproc_trace.h.
+"""
+
+import argparse
+import struct
+import sys
+
+MAGIC = 0x43525443
+VERSION = 1
+HEADER = struct.Struct("<IB3x")
+
+KEYS, INPUTS, CALL, PMIC = 1, 2, 3, 4
+KEYS_SIZE = 9
+INPUTS_SIZE = 1
+PMIC_BLOCK = struct.Struct("<IBHHHHHHBB")  # As pmic_snapshot_encode() packs it, see tools/telemetry_log_to_csv.py
+
+# coproc_op_t order
+OPS = [
+    "get_faults",
+    "get_vbat",
+    "get_vsys",
+    "get_ts",
+    "get_vbus",
+    "get_ichgr",
+    "get_comm_fault",
+    "get_charging_control",
+    "get_charging_status",
+    "get_real_time",
+    "set_adc_control",
+    "set_charging_control",
+    "set_otg_control",
+    "set_backlight",
+    "radio",
+    "read_registers",
+]
+
+
+def op_name(op):
+    return OPS[op - 1] if 1 <= op <= len(OPS) else f"op{op}"
+
+
+def get_varint(data, offset):
+    value = 0
+    shift = 0
+    while True:
+        byte = data[offset]
+        offset += 1
+        value |= (byte & 0x7F) << shift
+        shift += 7
+        if not byte & 0x80:
+            return value, offset
+
+
+def read_trace(path):
+    """Yields (time_us, type, fields) for each record, time counted from the start of the recording"""
+    with open(path, "rb") as file:
+        data = file.read()
+    if len(data) < HEADER.size:
+        sys.exit(f"{path}: too short for a trace")
+    magic, version = HEADER.unpack_from(data)
+    if magic != MAGIC or version != VERSION:
+        sys.exit(f"{path}: not a coprocessor trace of version {VERSION}")
+
+    offset = HEADER.size
+    time_us = 0
+    try:
+        while offset < len(data):
+            kind = data[offset]
+            delta, offset = get_varint(data, offset + 1)
+            time_us += delta
+            if kind == KEYS:
+                fields = {"keys": data[offset : offset + KEYS_SIZE].hex()}
+                offset += KEYS_SIZE
+            elif kind == INPUTS:
+                fields = {"inputs": f"0x{data[offset]:02x}"}
+                offset += INPUTS_SIZE
+            elif kind == CALL:
+                op, arg0, arg1 = data[offset : offset + 3]
+                duration, offset = get_varint(data, offset + 3)
+                result, offset = get_varint(data, offset)
+                fields = {"op": op_name(op), "args": (arg0, arg1), "duration_us": duration, "result": result}
+            elif kind == PMIC:
+                metrics, offset = get_varint(data, offset)
+                ok = data[offset]
+                values = PMIC_BLOCK.unpack_from(data, offset + 1)
+                fields = {"metrics": metrics, "ok": ok, "vbat_mv": values[3], "ichgr_ma": values[7], "rtc": values[0]}
+                offset += 1 + PMIC_BLOCK.size
+            else:
+                print(f"{path}: unknown record type {kind} at offset {offset}, stopping", file=sys.stderr)
+                return
+            if offset > len(data):
+                raise IndexError
+            yield time_us, kind, fields
+    except (IndexError, struct.error):
+        print(f"{path}: record cut off at the end, stopping", file=sys.stderr)
+
+
+def percentile(values, fraction):
+    values = sorted(values)
+    return values[min(len(values) - 1, int(fraction * len(values)))]
+
+
+def op_stats(path):
+    durations = {}
+    failures = {}
+    for _, kind, fields in read_trace(path):
+        if kind == CALL:
+            durations.setdefault(fields["op"], []).append(fields["duration_us"])
+            failures[fields["op"]] = failures.get(fields["op"], 0) + (fields["result"] != 0)
+    return {
+        op: {
+            "count": len(values),
+            "failed": failures[op],
+            "p50": percentile(values, 0.5),
+            "p99": percentile(values, 0.99),
+            "max": max(values),
+        }
+        for op, values in durations.items()
+    }
+
+
+def events(path):
+    return [(kind, fields) for _, kind, fields in read_trace(path) if kind in (KEYS, INPUTS)]
+
+
+def dump(args):
+    for time_us, kind, fields in read_trace(args.trace):
+        name = {KEYS: "keys", INPUTS: "inputs", CALL: "call", PMIC: "pmic"}[kind]
+        print(f"{time_us / 1e6:12.6f} {name:6} " + " ".join(f"{key}={value}" for key, value in fields.items()))
+    return 0
+
+
+def print_stats(stats):
+    print(f"{'operation':24} {'count':>7} {'failed':>7} {'p50 us':>8} {'p99 us':>8} {'max us':>8}")
+    for op in sorted(stats):
+        s = stats[op]
+        print(f"{op:24} {s['count']:7} {s['failed']:7} {s['p50']:8} {s['p99']:8} {s['max']:8}")
+
+
+def stats(args):
+    print_stats(op_stats(args.trace))
+    counts = {}
+    duration_us = 0
+    for duration_us, kind, _ in read_trace(args.trace):
+        counts[kind] = counts.get(kind, 0) + 1
+    print(
+        f"{counts.get(KEYS, 0)} key events, {counts.get(INPUTS, 0)} input events, {counts.get(PMIC, 0)} telemetry "
+        f"rounds in {duration_us / 1e6:.1f} s"
+    )
+    return 0
+
+
+def compare(args):
+    failed = False
+    base_events = events(args.base)
+    new_events = events(args.new)
+    if base_events != new_events:
+        mismatch = next((i for i, pair in enumerate(zip(base_events, new_events)) if pair[0] != pair[1]), None)
+        where = f"first difference at event {mismatch}" if mismatch is not None else "one is a prefix of the other"
+        print(f"Events differ: {len(base_events)} against {len(new_events)}, {where}")
+        failed = True
+    else:
+        print(f"Events match: {len(base_events)}")
+
+    base = op_stats(args.base)
+    new = op_stats(args.new)
+    print(f"{'operation':24} {'p99 us':>8} {'new p99':>8} {'change':>8}")
+    for op in sorted(set(base) | set(new)):
+        if op not in base or op not in new:
+            print(f"{op:24} only in {'the new trace' if op in new else 'the base trace'}")
+            continue
+        change = (new[op]["p99"] - base[op]["p99"]) * 100 / max(base[op]["p99"], 1)
+        regressed = change > args.threshold
+        failed |= regressed
+        print(f"{op:24} {base[op]['p99']:8} {new[op]['p99']:8} {change:+7.1f}%{'  REGRESSION' if regressed else ''}")
+    return 1 if failed else 0
+
+
+def main():
+    parser = argparse.ArgumentParser(description=__doc__.splitlines()[0])
+    commands = parser.add_subparsers(dest="command", required=True)
+    parser_dump = commands.add_parser("dump", help="print every record")
+    parser_dump.add_argument("trace")
+    parser_dump.set_defaults(run=dump)
+    parser_stats = commands.add_parser("stats", help="print call durations per operation")
+    parser_stats.add_argument("trace")
+    parser_stats.set_defaults(run=stats)
+    parser_compare = commands.add_parser("compare", help="compare the events and call durations of two traces")
+    parser_compare.add_argument("base")
+    parser_compare.add_argument("new")
+    parser_compare.add_argument("--threshold", type=float, default=10, help="allowed p99 growth in percent")
+    parser_compare.set_defaults(run=compare)
+    args = parser.parse_args()
+    sys.exit(args.run(args))
+
+
+if __name__ == "__main__":
+    main()
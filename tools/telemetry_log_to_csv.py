@@ -0,0 +1,117 @@
+#!/usr/bin/env python3
+"""Converts telemetry logs written by main/telemetry_log.c to CSV.
+
+The log lives in /fat/TELEM.BIN on the fat partition, the previous one in TELEM.OLD. To get them off a device, read
+the partition with esptool.py read_flash 0x220000 0x200000 fat.bin and unpack the image with ESP-IDF's
+components/fatfs/fatfsparse.py --wl-layer enabled fat.bin. Pass TELEM.OLD before TELEM.BIN to get one trace:
+
+    tools/telemetry_log_to_csv.py TELEM.OLD TELEM.BIN > trace.csv
+
+Blocks with a bad CRC are skipped with a warning on stderr. The layout has to follow telemetry_log.h and
+pmic_snapshot.h.
+"""
+
+import argparse
+import csv
+import struct
+import sys
+import zlib
+
+BLOCK_SIZE = 4096
+HEADER = struct.Struct("<IIHHI")  # magic, sequence, count, record size, CRC-32 of the records
+MAGIC = 0x474F4C54
+RECORD_SIZE = 24
+# PMIC snapshot: RTC, communication faults, faults, vbat, vsys, ts, vbus, ichgr, charging control and status,
+# followed by the valid mask and the flags of the log record
+RECORD = struct.Struct("<IBHHHHHHBBHB2x")
+
+# telemetry_metric_t order, for the valid mask
+METRICS = ["vbat", "ichgr", "vsys", "vbus", "ts", "faults", "comm_fault", "charging_status", "charging_control", "rtc"]
+FLAG_ERROR = 1 << 0
+FLAG_BOOT = 1 << 1
+
+COLUMNS = [
+    "block",
+    "rtc",
+    "vbat_mv",
+    "vsys_mv",
+    "vbus_mv",
+    "ichgr_ma",
+    "ts_percent",
+    "faults",
+    "comm_fault_last",
+    "comm_fault_latch",
+    "charging_disable_setting",
+    "charging_speed",
+    "battery_attached",
+    "usb_attached",
+    "charging_disabled",
+    "charging_status",
+    "valid",
+    "error",
+    "boot",
+]
+
+
+def read_blocks(path):
+    with open(path, "rb") as file:
+        data = file.read()
+    for offset in range(0, len(data) - BLOCK_SIZE + 1, BLOCK_SIZE):
+        block = data[offset : offset + BLOCK_SIZE]
+        magic, sequence, count, record_size, crc = HEADER.unpack_from(block)
+        records = block[HEADER.size : HEADER.size + count * RECORD_SIZE]
+        if magic != MAGIC or record_size != RECORD_SIZE or len(records) != count * RECORD_SIZE:
+            print(f"{path}: no log block at offset {offset}, skipped", file=sys.stderr)
+            continue
+        if zlib.crc32(records) != crc:
+            print(f"{path}: block {sequence} at offset {offset} fails its CRC, skipped", file=sys.stderr)
+            continue
+        yield sequence, records
+    if len(data) % BLOCK_SIZE:
+        print(f"{path}: {len(data) % BLOCK_SIZE} bytes of a partial block at the end, skipped", file=sys.stderr)
+
+
+def decode_record(sequence, record):
+    (rtc, comm, faults, vbat, vsys, ts, vbus, ichgr, control, status, valid, flags) = RECORD.unpack(record)
+    return [
+        sequence,
+        rtc,
+        vbat,
+        vsys,
+        vbus,
+        ichgr,
+        f"{ts // 100}.{ts % 100:02d}",
+        f"0x{faults:04x}",
+        comm & 1,
+        (comm >> 1) & 1,
+        control & 1,
+        (control >> 1) & 3,
+        status & 1,
+        (status >> 1) & 1,
+        (status >> 2) & 1,
+        (status >> 3) & 3,
+        "|".join(name for bit, name in enumerate(METRICS) if valid & (1 << bit)),
+        int(bool(flags & FLAG_ERROR)),
+        int(bool(flags & FLAG_BOOT)),
+    ]
+
+
+def main():
+    parser = argparse.ArgumentParser(description=__doc__.splitlines()[0])
+    parser.add_argument("logs", nargs="+", help="log files, oldest first")
+    parser.add_argument("-o", "--output", help="CSV file to write instead of stdout")
+    args = parser.parse_args()
+
+    output = open(args.output, "w", newline="") if args.output else sys.stdout
+    writer = csv.writer(output)
+    writer.writerow(COLUMNS)
+    for path in args.logs:
+        for sequence, records in read_blocks(path):
+            for offset in range(0, len(records), RECORD_SIZE):
+                writer.writerow(decode_record(sequence, records[offset : offset + RECORD_SIZE]))
+    if output is not sys.stdout:
+        output.close()
+
+
+if __name__ == "__main__":
+    main()